@@ -69,8 +69,18 @@ extern "C" {
 #endif
 
 
+// async contexts of hiredis 1.2 or upper know SSUBSCRIBE and smessage, shard channels can not be subscribed with older ones
+#if !defined(HIREDIS_HAPP_PUBSUB_SHARD) && defined(HIREDIS_MAJOR) && defined(HIREDIS_MINOR)
+#if HIREDIS_MAJOR > 1 || (HIREDIS_MAJOR == 1 && HIREDIS_MINOR >= 2)
+#define HIREDIS_HAPP_PUBSUB_SHARD 1
+#endif
+#endif
+
 #define HIREDIS_HAPP_SLOT_NUMBER 16384
 
+// slot is not served by any node
+#define HIREDIS_HAPP_SLOT_NODE_NONE 0xFFFF
+
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1600)
 #include <unordered_map>
 #define HIREDIS_HAPP_MAP(...) std::unordered_map<__VA_ARGS__>
@@ -100,6 +110,94 @@ extern "C" {
 #define HIREDIS_HAPP_TIMER_TIMEOUT_SEC 30
 #endif
 
+#ifndef HIREDIS_HAPP_CONNECTION_POOL_BUSY_PENDING
+// a new connection is made only when every connection in the pool has so many pending cmds
+#define HIREDIS_HAPP_CONNECTION_POOL_BUSY_PENDING 16
+#endif
+
+#ifndef HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_SEC
+// 1 s
+#define HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_SEC 1
+#endif
+
+#ifndef HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_USEC
+// 0 ms
+#define HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_USEC 0
+#endif
+
+#ifndef HIREDIS_HAPP_SLOT_RELOAD_FANOUT
+// CLUSTER SLOTS is sent to 2 nodes at the same time, and the first valid reply wins
+#define HIREDIS_HAPP_SLOT_RELOAD_FANOUT 2
+#endif
+
+#ifndef HIREDIS_HAPP_SENTINEL_RETRY_INTERVAL_SEC
+// connect to the next sentinel 1 s later when the current one is lost
+#define HIREDIS_HAPP_SENTINEL_RETRY_INTERVAL_SEC 1
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_POOL_LOW_WATERMARK
+// cached cmds kept when idle
+#define HIREDIS_HAPP_CMD_POOL_LOW_WATERMARK 64
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_POOL_HIGH_WATERMARK
+// max cached cmds
+#define HIREDIS_HAPP_CMD_POOL_HIGH_WATERMARK 4096
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_TIMEOUT_SEC
+// deadline of every cmd, 0 means no deadline
+#define HIREDIS_HAPP_CMD_TIMEOUT_SEC 0
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_TIMEOUT_USEC
+#define HIREDIS_HAPP_CMD_TIMEOUT_USEC 0
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_TIMER_TICK_MS
+// precision of cmd deadline, 10 ms
+#define HIREDIS_HAPP_CMD_TIMER_TICK_MS 10
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_TIMER_SLOT_NUMBER
+// slots in cmd timing wheel, 512 * 10ms = 5.12s in a round
+#define HIREDIS_HAPP_CMD_TIMER_SLOT_NUMBER 512
+#endif
+
+#ifndef HIREDIS_HAPP_RETRY_IMMEDIATE_TIMES
+// retry at once after the first failure, and then backoff
+#define HIREDIS_HAPP_RETRY_IMMEDIATE_TIMES 1
+#endif
+
+#ifndef HIREDIS_HAPP_RETRY_BACKOFF_BASE_USEC
+// 50 ms
+#define HIREDIS_HAPP_RETRY_BACKOFF_BASE_USEC 50000
+#endif
+
+#ifndef HIREDIS_HAPP_RETRY_BACKOFF_MAX_USEC
+// 5 s
+#define HIREDIS_HAPP_RETRY_BACKOFF_MAX_USEC 5000000
+#endif
+
+#ifndef HIREDIS_HAPP_RETRY_BUDGET_PERCENT
+// retries allowed for every 100 requests
+#define HIREDIS_HAPP_RETRY_BUDGET_PERCENT 20
+#endif
+
+#ifndef HIREDIS_HAPP_RETRY_BUDGET_MIN_PER_SEC
+#define HIREDIS_HAPP_RETRY_BUDGET_MIN_PER_SEC 10
+#endif
+
+#ifndef HIREDIS_HAPP_RESUBSCRIBE_TIMES
+// rounds of resubscribing without any reply, lost subscriptions wait for the next subscribe after that
+#define HIREDIS_HAPP_RESUBSCRIBE_TIMES 32
+#endif
+
+#ifndef HIREDIS_HAPP_CMD_WIRE_BUFFER_MAX_SIZE
+// formatting buffer larger than this will not be kept in cached cmds, 16 KB
+#define HIREDIS_HAPP_CMD_WIRE_BUFFER_MAX_SIZE 16384
+#endif
+
 #ifdef _MSC_VER
 #define HIREDIS_HAPP_STRCASE_CMP(l, r) _stricmp(l, r)
 #define HIREDIS_HAPP_STRNCASE_CMP(l, r, s) _strnicmp(l, r, s)
@@ -182,6 +280,8 @@ namespace hiredis {
                 REDIS_HAPP_PARAM = -1007,            // param error
                 REDIS_HAPP_TIMEOUT = -1008,          // timeout
                 REDIS_HAPP_NOT_FOUND = -1009,        // not found
+                REDIS_HAPP_RETRY_BUDGET = -1010,     // retry budget exhausted
+                REDIS_HAPP_ABORT = -1011,            // aborted before sent
             } type;
         };
     }
@@ -9,11 +9,17 @@
 
 #include <vector>
 #include <list>
+#include <set>
 #include <ostream>
 
 #include "config.h"
 
 #include "happ_connection.h"
+#include "happ_near_cache.h"
+#include "happ_pubsub.h"
+#include "happ_retry_policy.h"
+#include "happ_script.h"
+#include "happ_timer_heap.h"
 
 namespace hiredis {
     namespace happ {
@@ -21,19 +27,59 @@ namespace hiredis {
         public:
             typedef cmd_exec cmd_t;
 
+            // all slots served by the same master share one slot_t
             struct slot_t {
-                int index;
-                std::vector<connection::key_t> hosts;
+                int index;                              // index in the node table
+                std::vector<connection::key_t> hosts;   // master first, and then the replicas
             };
             typedef connection connection_t;
-            typedef HIREDIS_HAPP_MAP(std::string, ::hiredis::happ::unique_ptr<connection_t>::type) connection_map_t;
+            typedef ::hiredis::happ::unique_ptr<connection_t>::type connection_ptr_t;
+
+            // all connections to the same node
+            struct connection_pool_t {
+                std::vector<connection_ptr_t> conns;
+                size_t round_robin;
+
+                connection_pool_t() : round_robin(0) {}
+            };
+            typedef HIREDIS_HAPP_MAP(std::string, connection_pool_t) connection_map_t;
 
             typedef std::function<void(cluster *, connection_t *)> onconnect_fn_t;
             typedef std::function<void(cluster *, connection_t *, const struct redisAsyncContext *, int status)> onconnected_fn_t;
             typedef std::function<void(cluster *, connection_t *, const struct redisAsyncContext *, int)> ondisconnected_fn_t;
+            typedef std::function<void(cluster *, int status)> onready_fn_t;
+            typedef std::function<void(cluster *)> onslotupdate_fn_t;
             typedef std::function<void(const char *)> log_fn_t;
 
+            // where to send read-only commands
+            struct read_policy {
+                enum type {
+                    MASTER_ONLY = 0, // always read from master
+                    PREFER_REPLICA,  // random replica, master if there is no replica
+                    ROUND_ROBIN,     // master and replicas in turn
+                    LEAST_PENDING    // the one with the least cmds waiting for reply
+                };
+            };
+
+            // which connection in the pool of a node to use
+            struct pool_policy {
+                enum type {
+                    LEAST_PENDING = 0, // the one with the least cmds waiting for reply
+                    ROUND_ROBIN        // all connections in turn
+                };
+            };
+
+            // which nodes to connect after slots loaded
+            struct warm_up_policy {
+                enum type {
+                    NONE = 0, // connect when a cmd is sent to the node
+                    MASTERS,  // connect all masters
+                    ALL       // connect all masters and replicas
+                };
+            };
+
         private:
+            friend class cluster_group;
             cluster(const cluster &);
             cluster &operator=(const cluster &);
 
@@ -43,6 +89,16 @@ namespace hiredis {
 
             int init(const std::string &ip, uint16_t port);
 
+            /**
+             * @breif add another seed node, seeds are used to load slots when no cluster node is known or all of them failed
+             * @param ip ip
+             * @param port port
+             * @return REDIS_HAPP_OK
+             */
+            int add_seed(const std::string &ip, uint16_t port);
+
+            inline const std::vector<connection::key_t> &get_seeds() const { return conf.seeds; }
+
             const std::string& get_auth_password();
             void set_auth_password(const std::string& passwd);
 
@@ -153,47 +209,471 @@ namespace hiredis {
              *
              * @see connection::redis_raw_cmd
              * @see connection::redis_cmd
-             * @return command wrapper of this message, NULL if failed
+             * @see retry_policy
+             * @return command wrapper of this message, NULL if failed or retry budget is exhausted(REDIS_HAPP_RETRY_BUDGET)
              */
             cmd_t *retry(cmd_t *cmd, connection_t *conn = NULL);
 
+            /**
+             * @breif get values of keys in different slots, just like MGET
+             * @param count key count
+             * @param keys keys
+             * @param keys_len size of every key
+             * @param cbk callback, reply is an array with values in the order of keys
+             * @param priv_data private data passed to callback
+             *
+             * @note keys are grouped by slot and one MGET is sent for each slot,
+             *       those in the same node are pipelined into the same connection.
+             *       cbk will be called only once after all sub commands finished
+             * @param out command wrapper passed to cbk if it's still running, or NULL if cbk has already been called
+             * @return error code, cbk will not be called if it's not REDIS_HAPP_OK
+             */
+            int mget(size_t count, const char **keys, const size_t *keys_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out = NULL);
+
+            /**
+             * @breif set values of keys in different slots, just like MSET
+             * @param count key count
+             * @param keys keys
+             * @param keys_len size of every key
+             * @param values values
+             * @param values_len size of every value
+             * @param cbk callback, reply is status OK or the first error
+             * @param priv_data private data passed to callback
+             *
+             * @note it's not atomic across slots
+             * @see mget
+             * @param out command wrapper passed to cbk if it's still running, or NULL if cbk has already been called
+             * @return error code, cbk will not be called if it's not REDIS_HAPP_OK
+             */
+            int mset(size_t count, const char **keys, const size_t *keys_len, const char **values, const size_t *values_len, cmd_t::callback_fn_t cbk,
+                     void *priv_data, cmd_t **out = NULL);
+
+            /**
+             * @breif delete keys in different slots, just like DEL
+             * @param count key count
+             * @param keys keys
+             * @param keys_len size of every key
+             * @param cbk callback, reply is the total number of keys removed or the first error
+             * @param priv_data private data passed to callback
+             *
+             * @see mget
+             * @param out command wrapper passed to cbk if it's still running, or NULL if cbk has already been called
+             * @return error code, cbk will not be called if it's not REDIS_HAPP_OK
+             */
+            int del(size_t count, const char **keys, const size_t *keys_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out = NULL);
+
+            struct batch_t;
+
+            /**
+             * @breif create a batch, cmds added into it will not be sent until flush_batch is called
+             * @param cbk callback when all cmds in this batch finished, reply is always NULL and the first error code of cmds is passed to it
+             * @param priv_data private data passed to cbk
+             * @note a batch must be flushed or aborted, and it will be destroyed after all cmds in it finished
+             * @return batch object, NULL if failed
+             */
+            batch_t *create_batch(cmd_t::callback_fn_t cbk, void *priv_data);
+
+            /**
+             * @breif add a request into batch
+             * @param b batch object
+             * @param key the key used to calculate slot id
+             * @param ks  key size
+             * @param cbk callback of this cmd
+             * @param priv_data private data passed to callback
+             * @param argc argument count
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @see exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *batch_exec(batch_t *b, const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv,
+                              const size_t *argvlen);
+
+            /**
+             * @breif add a request into batch
+             * @param b batch object
+             * @param key the key used to calculate slot id
+             * @param ks  key size
+             * @param cbk callback of this cmd
+             * @param priv_data private data passed to callback
+             * @param fmt format string
+             * @param ... format data
+             * @see exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *batch_exec(batch_t *b, const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...);
+
+            /**
+             * @breif send all cmds in batch
+             * @param b batch object
+             * @note cmds are grouped by connection, cmds to the same connection are appended into the output buffer of hiredis one after another,
+             *       so they are written together when the connection is writable
+             * @return count of cmds sent
+             */
+            size_t flush_batch(batch_t *b);
+
+            /**
+             * @breif destroy a batch without sending any cmd in it
+             * @param b batch object, it can not be used after aborted
+             * @note callbacks of all cmds and then the batch are called with REDIS_HAPP_ABORT
+             * @return error code, REDIS_HAPP_PARAM if it's already flushed
+             */
+            int abort_batch(batch_t *b);
+
+            struct transaction_t;
+
+            /**
+             * @breif create a transaction, cmds added into it are sent in MULTI/EXEC to the same connection
+             * @param cbk callback with reply of EXEC, which is an array of replies of all cmds in this transaction
+             * @param priv_data private data passed to cbk
+             * @note a transaction must be flushed, and it will be destroyed after cbk is called
+             * @return transaction object, NULL if failed
+             */
+            transaction_t *create_transaction(cmd_t::callback_fn_t cbk, void *priv_data);
+
+            /**
+             * @breif add a request into transaction
+             * @param t transaction object
+             * @param key the key used to calculate slot id, NULL if this cmd has no key
+             * @param ks  key size
+             * @param argc argument count
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @note keys of all cmds must be in the same slot, use hash tags({...}) to put them together
+             * @return error code, REDIS_HAPP_SLOT_UNAVAILABLE if key is not in the same slot as others, and the transaction will fail when flushed
+             */
+            int transaction_exec(transaction_t *t, const char *key, size_t ks, int argc, const char **argv, const size_t *argvlen);
+
+            /**
+             * @breif add a request into transaction
+             * @param t transaction object
+             * @param key the key used to calculate slot id, NULL if this cmd has no key
+             * @param ks  key size
+             * @param fmt format string
+             * @param ... format data
+             * @see transaction_exec
+             * @return error code
+             */
+            int transaction_exec(transaction_t *t, const char *key, size_t ks, const char *fmt, ...);
+
+            /**
+             * @breif send MULTI, all cmds in transaction and EXEC to the node of their slot
+             * @param t transaction object
+             * @note they are written into the same connection in one system call.
+             *       If any cmd is redirected by MOVED or ASK, EXEC is aborted by server and the whole transaction is sent again,
+             *       to the new master after MOVED, or to the importing node with ASKING before MULTI after ASK.
+             * @return command wrapper of EXEC which is passed to cbk, NULL if failed or already finished
+             */
+            cmd_t *flush_transaction(transaction_t *t);
+
+            /**
+             * @breif register a lua script, it's loaded by SCRIPT LOAD into every new connection
+             * @param body script
+             * @return SHA1 of script, used by eval_script
+             */
+            const std::string &register_script(const std::string &body);
+
+            inline const script_registry &get_scripts() const { return scripts; }
+
+            /**
+             * @breif run a registered script by EVALSHA
+             * @param key the key used to calculate slot id, NULL if this script has no key
+             * @param ks  key size
+             * @param sha1 SHA1 returned by register_script
+             * @param cbk callback
+             * @param priv_data private data passed to callback
+             * @param argc argument count after SHA1, including numkeys, keys and args
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @note if the node replies NOSCRIPT, the script is loaded again and EVALSHA is sent just after it in the same connection
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *eval_script(const char *key, size_t ks, const std::string &sha1, cmd_t::callback_fn_t cbk, void *priv_data, int argc,
+                               const char **argv, const size_t *argvlen);
+
+            /**
+             * @breif reload all slots right now
+             * @note only one reload can be running, cmds waiting for slots will be sent after it finished.
+             *       the node is picked randomly from all known nodes and the init node, except the one failed last time.
+             *       if it failed, another reload will be sent in proc after a backoff delay of retry policy.
+             * @return true if a reload is sent
+             */
             bool reload_slots();
 
+            /**
+             * @breif reload all slots, but no more than once in slot reload interval
+             * @note slots changed by MOVED are already patched, so a full reload can wait for a while.
+             *       If the interval is not reached, it will be delayed and run in proc.
+             *       And all requests during this time will be merged into one reload.
+             * @return true if a full reload is sent right now
+             */
+            bool reload_slots_later();
+
+            /**
+             * @breif set the min interval of full slot reload, except the first one and those called by reload_slots directly
+             * @param sec seconds
+             * @param usec microseconds
+             */
+            void set_slot_reload_interval(time_t sec, time_t usec);
+
+            /**
+             * @breif set how many nodes CLUSTER SLOTS is sent to at the same time
+             * @param n node number, the first valid reply wins and the reload fails only when all of them failed
+             */
+            void set_slot_reload_fanout(size_t n);
+
+            inline size_t get_slot_reload_fanout() const { return conf.slot_reload_fanout; }
+
+            // how many full slot reloads are sent
+            inline size_t get_slot_reload_count() const { return slot_reload.reload_count; }
+
+            // how many full slot reloads are avoided(merged or patched incrementally)
+            inline size_t get_slot_reload_avoided_count() const { return slot_reload.avoided_count; }
+
             const connection::key_t *get_slot_master(int index);
 
+            /**
+             * @breif get the host to send read-only command of a slot, using read policy
+             * @param index slot index
+             * @return master or one of the replicas of this slot
+             */
+            const connection::key_t *get_slot_reader(int index);
+
+            /**
+             * @breif set where read-only commands(GET, HGET, ZRANGE and etc.) are sent to
+             * @param p read policy
+             * @note READONLY will be sent to all connections if it's not read_policy::MASTER_ONLY
+             */
+            void set_read_policy(read_policy::type p);
+
+            inline read_policy::type get_read_policy() const { return conf.read_policy_type; }
+
+            /**
+             * @breif send read-only commands again to another node of the same slot if they are not replied for a while
+             * @param percentile latency percentile(0-100) of finished commands used as the delay, 0 means disable hedging
+             * @param min_sec min delay, in seconds
+             * @param min_usec min delay, microseconds part
+             * @note the first successful reply wins and it's always passed by the cmd returned by exec.
+             *       It needs timer, and the read policy must not be read_policy::MASTER_ONLY, or replicas will not serve the hedged copy.
+             */
+            void set_hedge_policy(double percentile, time_t min_sec, time_t min_usec);
+
+            /**
+             * @breif cache replies of read-only single key commands(GET, HGET, ZRANGE and etc.) in client
+             * @param max_memory max memory of cached replies, 0 means disable the cache
+             * @note one more connection to every node subscribes __redis__:invalidate, and other connections to the node
+             *       send CLIENT TRACKING on REDIRECT to it, so redis 6.0 or upper is required.
+             *       exec returns NULL if the reply is cached, and the callback is called with a NULL context before exec returns.
+             */
+            void set_near_cache(size_t max_memory);
+
+            inline const near_cache &get_near_cache() const { return reply_cache; }
+
+            /**
+             * @breif subscribe a channel or pattern, messages are passed to fn
+             * @param t pubsub::channel_type::CHANNEL(SUBSCRIBE), pubsub::channel_type::PATTERN(PSUBSCRIBE) or pubsub::channel_type::SHARD(SSUBSCRIBE, hiredis 1.2 or upper)
+             * @param name channel or pattern
+             * @param fn message callback, the old one is replaced if it's already subscribed
+             * @note subscriptions use dedicated connections. Channels and patterns share one node because messages are broadcast to all nodes,
+             *       and a shard channel is subscribed on the master of its slot.
+             *       They are subscribed again when the connection is lost or slots are changed, with backoff of get_retry_policy(),
+             *       and lost ones wait for the next subscribe after HIREDIS_HAPP_RESUBSCRIBE_TIMES rounds without any reply
+             * @return error code, REDIS_HAPP_PARAM if t is not supported by this hiredis, @see pubsub::is_supported
+             */
+            int subscribe(pubsub::channel_type::type t, const std::string &name, pubsub::message_fn_t fn);
+
+            /**
+             * @breif unsubscribe a channel or pattern
+             * @return error code, REDIS_HAPP_NOT_FOUND if not subscribed
+             */
+            int unsubscribe(pubsub::channel_type::type t, const std::string &name);
+
+            inline const pubsub &get_pubsub() const { return subscriptions; }
+
             /**
              * @breif get slot info of a key
              * @param key the key used to calculate slot id
              * @param ks  key size
-             * @return slot info of this key
+             * @return slot info of this key, NULL if key is empty or the slot is not available now
              */
             const slot_t *get_slot_by_key(const char *key, size_t ks) const;
 
+            /**
+             * @breif calculate slot id of a key, hash tags({...}) are supported just like redis cluster
+             * @param key the key used to calculate slot id
+             * @param ks  key size
+             * @note keys with the same hash tag will always be in the same slot, e.g. {user1000}.following and {user1000}.followers
+             * @see http://redis.io/topics/cluster-spec
+             * @return slot id of this key, -1 if key is empty
+             */
+            static int get_slot_index(const char *key, size_t ks);
+
+            // node table of slots, master first and then the replicas
+            inline const std::vector<slot_t> &get_slot_nodes() const { return slot_nodes; }
+
+            // index in node table of every slot, HIREDIS_HAPP_SLOT_NODE_NONE if unavailable
+            inline const uint16_t *get_slot_table() const { return slots; }
+
+            /**
+             * @breif replace all slots without CLUSTER SLOTS, used to share slots loaded by another cluster of the same nodes
+             * @param nodes node table
+             * @param table index in node table of every slot, HIREDIS_HAPP_SLOT_NUMBER elements
+             * @note running reload is ignored, and cmds waiting for slots are sent at once
+             * @return error code, REDIS_HAPP_PARAM if any index is out of node table
+             */
+            int load_slots(const std::vector<slot_t> &nodes, const uint16_t *table);
+
+            /**
+             * @breif get a connection of a node
+             * @param key name of the node
+             * @note if there are more than one connection to this node, one of them will be selected by pool policy
+             * @return connection or NULL if not found
+             */
             const connection_t *get_connection(const std::string &key) const;
             connection_t *get_connection(const std::string &key);
 
             const connection_t *get_connection(const std::string &ip, uint16_t port) const;
             connection_t *get_connection(const std::string &ip, uint16_t port);
 
+            /**
+             * @breif make a new connection to a node
+             * @param key address of the node
+             * @return new connection or NULL if failed or the pool of this node is full
+             */
             connection_t *make_connection(const connection::key_t &key);
+
+            /**
+             * @breif get a connection of a node, a new one will be made if all connections are busy and the pool is not full
+             * @param key address of the node
+             * @return connection or NULL if failed
+             */
+            connection_t *get_or_make_connection(const connection::key_t &key);
+
+            /**
+             * @breif release all connections of a node
+             */
             bool release_connection(const connection::key_t &key, bool close_fd, int status);
 
+            /**
+             * @breif release one connection
+             */
+            bool release_connection(connection_t *conn, bool close_fd, int status);
+
+            /**
+             * @breif set max connection count to every node
+             * @param s pool size, 1 by default
+             */
+            void set_connection_pool_size(size_t s);
+
+            inline size_t get_connection_pool_size() const { return conf.connection_pool_size; }
+
+            /**
+             * @breif set when a connection is busy, the pool only grows when every connection in it is busy
+             * @param n pending cmds of a busy connection, HIREDIS_HAPP_CONNECTION_POOL_BUSY_PENDING by default
+             */
+            void set_connection_pool_busy_pending(size_t n);
+
+            inline size_t get_connection_pool_busy_pending() const { return conf.connection_pool_busy_pending; }
+
+            /**
+             * @breif set how to select connection when there are more than one connection to the same node
+             * @param p pool policy
+             */
+            void set_connection_pool_policy(pool_policy::type p);
+
+            /**
+             * @breif connect nodes in parallel every time slots are loaded, instead of connecting when the first cmd is sent
+             * @param p warm up policy, all connections in the pool of a node are made
+             * @note a PING is sent by every connection after AUTH and READONLY, and on_ready is called when all of them are replied
+             */
+            void set_warm_up_policy(warm_up_policy::type p);
+
+            inline warm_up_policy::type get_warm_up_policy() const { return conf.warm_up_policy_type; }
+
             onconnect_fn_t set_on_connect(onconnect_fn_t cbk);
             onconnected_fn_t set_on_connected(onconnected_fn_t cbk);
             ondisconnected_fn_t set_on_disconnected(ondisconnected_fn_t cbk);
 
+            /**
+             * @breif set callback when warm up finished
+             * @param cbk callback, status is REDIS_HAPP_OK if all connections are ready, or REDIS_HAPP_CONNECTION if any of them failed
+             * @return old callback
+             */
+            onready_fn_t set_on_ready(onready_fn_t cbk);
+
+            /**
+             * @breif set callback when all slots are reloaded by CLUSTER SLOTS
+             * @param cbk callback, slots can be got by get_slot_nodes and get_slot_table
+             * @note it's not called when slots are patched by MOVED or loaded by load_slots
+             * @return old callback
+             */
+            onslotupdate_fn_t set_on_slot_update(onslotupdate_fn_t cbk);
+
             void set_cmd_buffer_size(size_t s);
 
             size_t get_cmd_buffer_size() const;
 
+            /**
+             * @breif set watermarks of cached cmd objects
+             * @param low cached cmds kept when idle
+             * @param high max cached cmds, 0 to disable the cache
+             */
+            void set_cmd_pool_watermark(size_t low, size_t high);
+
+            // cached cmd objects and stats
+            inline const cmd_pool &get_cmd_pool() const { return cmd_cache; }
+
             bool is_timer_active() const;
 
             void set_timer_interval(time_t sec, time_t usec);
 
             void set_timeout(time_t sec);
 
+            /**
+             * @breif set default deadline of every cmd, counted from the first time it's sent
+             * @param sec seconds, 0 with usec=0 means no deadline
+             * @param usec microseconds
+             * @note cmds reach the deadline will be finished with REDIS_HAPP_TIMEOUT in proc, even if it's still waiting for reply
+             */
+            void set_cmd_timeout(time_t sec, time_t usec);
+
+            /**
+             * @breif set deadline of a cmd
+             * @param cmd the cmd returned by exec
+             * @param sec seconds from now
+             * @param usec microseconds from now
+             * @return false if timer is not active or cmd is already finished
+             */
+            bool set_cmd_deadline(cmd_t *cmd, time_t sec, time_t usec);
+
             void add_timer_cmd(cmd_t *cmd);
 
+            /**
+             * @breif send a cmd after a while
+             * @param cmd cmd wrapper
+             * @param sec delay in seconds
+             * @param usec delay in microseconds
+             * @note cmd is sent at once if timer is not active
+             */
+            void add_timer_cmd(cmd_t *cmd, time_t sec, time_t usec);
+
+            // backoff and budget of retries
+            inline retry_policy &get_retry_policy() { return retry_backoff; }
+            inline const retry_policy &get_retry_policy() const { return retry_backoff; }
+
+            // counters and latency of all cmds, copy it to take a snapshot
+            inline const cmd_stats &get_stats() const { return stats; }
+
+            void reset_stats();
+
+            /**
+             * @breif get stats of all connections to a node
+             * @param name node name, ip:port
+             * @param out stats of connections are merged into it
+             * @return false if there is no connection to this node
+             */
+            bool get_node_stats(const std::string &name, cmd_stats &out) const;
+
             int proc(time_t sec, time_t usec);
 
             void set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size = 65536);
@@ -210,8 +690,102 @@ namespace hiredis {
 
             static void on_reply_auth(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
 
+            void add_cmd_deadline(cmd_t *cmd);
+            static void on_reply_readonly(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_scatter(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+            // how to merge replies of scatter-gather commands
+            struct scatter_type {
+                enum type {
+                    ARRAY = 0, // elements in the order of keys, MGET
+                    SUM,       // sum of integers, DEL
+                    STATUS     // OK or the first error, MSET
+                };
+            };
+            struct scatter_t;
+            struct scatter_group_t;
+
+            int scatter(const char *cmd_name, scatter_type::type t, size_t count, const char **keys, const size_t *keys_len, const char **values,
+                        const size_t *values_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out);
+            void finish_scatter(scatter_t *s);
+
+            struct batch_cmd_t;
+            static void on_reply_batch(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            void finish_batch(batch_t *b);
+
+            // all keys of a transaction must be in the same slot
+            int check_transaction_slot(transaction_t *t, const char *key, size_t ks);
+
+            // MULTI and queued cmds are sent just before EXEC every time, and ASKING before them after ASK
+            int send_transaction(connection_t *conn, cmd_t *cmd);
+            static void on_reply_transaction(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_transaction_part(redisAsyncContext *c, void *r, void *privdata);
+
+            // point a slot to the node of its new master after MOVED
+            void move_slot(int slot_index, const std::string &ip, uint16_t port);
+
+            struct hedge_t;
+            bool is_hedge_cmd(cmd_t *cmd);
+            void start_hedge(cmd_t *cmd, const std::string &node);
+            void send_hedge(hedge_t *h);
+            void release_hedge(hedge_t *h);
+            static void on_reply_hedge(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+            const connection::key_t *get_cmd_host(cmd_t *cmd);
+
+            void send_readonly(connection_t *conn);
+
+            // SCRIPT LOAD of registered scripts
+            void send_script_load(connection_t *conn, const std::string &body);
+            static void on_reply_script_load(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+            bool send_auth(connection_t *conn);
+
+            // invalidation of near cache
+            connection_t *make_tracking_connection(const connection::key_t &key);
+            void start_tracking(connection_t *conn);
+            void send_tracking(connection_t *conn, long long client_id);
+            void release_tracking_connection(const std::string &name, connection_t *conn);
+            static void on_reply_tracking_id(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_tracking(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_invalidate(redisAsyncContext *c, void *r, void *privdata);
+
+            // connect without joining the pool, for tracking and subscriber connections
+            connection_t *make_dedicated_connection(connection_ptr_t &holder, const connection::key_t &key);
+
+            // pub/sub
+            bool get_subscribe_node(const pubsub::subscription_t &sub, connection::key_t &key);
+            bool send_subscribe(pubsub::subscription_t &sub);
+            void send_unsubscribe(const std::string &node, pubsub::channel_type::type t, const std::string &name);
+            void resubscribe();
+            connection_t *get_or_make_subscriber_connection(const connection::key_t &key);
+            void release_subscriber_connection(const std::string &name, connection_t *conn);
+            static void on_reply_subscribe(redisAsyncContext *c, void *r, void *privdata);
+
+            void warm_up();
+            void finish_warm_up();
+            static void on_reply_warm_up(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
             void remove_connection_key(const std::string &name);
 
+            connection_t *find_connection(const std::string &key, uint64_t sequence);
+
+            bool is_slot_reload_interval_passed() const;
+
+            void get_slot_reload_nodes(std::vector<const connection::key_t *> &out, size_t count);
+
+            bool send_slot_reload(const connection::key_t &key);
+
+            void on_slot_reload_query_failed();
+
+            void on_slot_reload_failed();
+
+            const slot_t *get_slot_node(int index) const;
+            void clear_slots();
+
+            // connect nodes and send cmds waiting for slots after slots are loaded
+            void on_slots_updated();
+
         private:
             void log_debug(const char *fmt, ...);
 
@@ -219,6 +793,7 @@ namespace hiredis {
 
             HIREDIS_HAPP_PRIVATE : struct config_t {
                 connection::key_t init_connection;
+                std::vector<connection::key_t> seeds;
                 log_fn_t log_fn_info;
                 log_fn_t log_fn_debug;
                 char *log_buffer;
@@ -228,25 +803,114 @@ namespace hiredis {
                 time_t timer_interval_usec;
                 time_t timer_timeout_sec;
 
+                time_t slot_reload_interval_sec;
+                time_t slot_reload_interval_usec;
+                size_t slot_reload_fanout;
+
                 size_t cmd_buffer_size;
+
+                time_t cmd_timeout_sec;
+                time_t cmd_timeout_usec;
+
+                read_policy::type read_policy_type;
+
+                size_t connection_pool_size;
+                size_t connection_pool_busy_pending;
+                pool_policy::type connection_pool_policy;
+
+                warm_up_policy::type warm_up_policy_type;
+
+                double hedge_percentile;
+                uint64_t hedge_min_delay_usec;
             };
             config_t conf;
 
             // authorization information
             connection::auth_info_t auth;
 
+            // cached cmd objects, must be destroyed after all connections
+            cmd_pool cmd_cache;
+
+            // deadlines of cmds
+            cmd_timer_wheel cmd_deadlines;
+
+            retry_policy retry_backoff;
+
+            cmd_stats stats;
+
+            near_cache reply_cache;
+
+            script_registry scripts;
+
             // slot information
             struct slot_status {
                 enum type { INVALID = 0, UPDATING, OK };
             };
-            slot_t slots[HIREDIS_HAPP_SLOT_NUMBER];
+            // node table and the index of node of every slot(HIREDIS_HAPP_SLOT_NODE_NONE if unavailable)
+            std::vector<slot_t> slot_nodes;
+            uint16_t slots[HIREDIS_HAPP_SLOT_NUMBER];
             slot_status::type slot_flag;
             // retry cmd queue after slots reloaded
             std::list<cmd_t *> slot_pending;
 
+            // full slot reload throttle
+            struct slot_reload_t {
+                time_t last_sec;     // when the last full reload is sent
+                time_t last_usec;
+                bool delayed;        // a full reload should be sent after the interval
+                size_t reload_count;
+                size_t avoided_count;
+
+                size_t failed_count;    // continuous failed reloads
+                uint64_t retry_delay;   // backoff delay after last failure, in microseconds
+                time_t retry_sec;       // no reload before this after failure
+                time_t retry_usec;
+                std::vector<std::string> nodes;     // nodes which queries of this round are sent to
+                std::set<std::string> failed_nodes; // nodes failed since the last successful reload
+
+                uintptr_t sequence;     // replies of other rounds are ignored
+                size_t pending;         // queries of this round not replied yet
+            };
+            slot_reload_t slot_reload;
+
+            // round robin index of read_policy::ROUND_ROBIN
+            size_t read_round_robin;
+
+            // connecting all nodes after slots loaded
+            struct warm_up_t {
+                uintptr_t sequence; // replies of old warm up are ignored
+                size_t pending;     // connections not replied yet
+                size_t failed;
+            };
+            warm_up_t warm_up_status;
+
             // connection pool
             connection_map_t connections;
 
+            // connections subscribing invalidation messages of near cache, one for each node
+            struct tracking_t {
+                connection_ptr_t conn;
+                long long client_id; // 0 before CLIENT ID replied
+            };
+            typedef HIREDIS_HAPP_MAP(std::string, tracking_t) tracking_map_t;
+            tracking_map_t tracking_conns;
+
+            // subscriber connections, one for each node
+            typedef HIREDIS_HAPP_MAP(std::string, connection_ptr_t) subscriber_map_t;
+            subscriber_map_t subscriber_conns;
+            pubsub subscriptions;
+            std::string subscribe_node; // node of channels and patterns
+
+            // subscriptions lost are subscribed again in proc, with backoff of retry_backoff
+            struct resubscribe_t {
+                bool pending;           // some subscriptions are not subscribed on any node
+                size_t times;           // rounds sent since the last reply of subscriber connections
+                uint64_t retry_delay;   // backoff delay of the last round, in microseconds
+                time_t retry_sec;       // no round before this
+                time_t retry_usec;
+            };
+            resubscribe_t resubscribe_status;
+
 
             // timer
             struct timer_t {
@@ -257,15 +921,32 @@ namespace hiredis {
                     time_t sec;
                     time_t usec;
                     cmd_t *cmd;
+
+                    inline bool operator<(const delay_t& r) const {
+                        return sec < r.sec || (sec == r.sec && usec < r.usec);
+                    }
                 };
-                std::list<delay_t> timer_pending;
+                timer_heap<delay_t> timer_pending;
 
                 struct conn_timetout_t {
                     std::string name;
                     uint64_t sequence;
                     time_t timeout;
+
+                    inline bool operator<(const conn_timetout_t& r) const { return timeout < r.timeout; }
+                };
+                timer_heap<conn_timetout_t> timer_conns;
+
+                struct hedge_delay_t {
+                    time_t sec;
+                    time_t usec;
+                    hedge_t *hedge;
+
+                    inline bool operator<(const hedge_delay_t& r) const {
+                        return sec < r.sec || (sec == r.sec && usec < r.usec);
+                    }
                 };
-                std::list<conn_timetout_t> timer_conns;
+                timer_heap<hedge_delay_t> timer_hedges;
             };
             timer_t timer_actions;
 
@@ -274,6 +955,8 @@ namespace hiredis {
                 onconnect_fn_t on_connect;
                 onconnected_fn_t on_connected;
                 ondisconnected_fn_t on_disconnected;
+                onready_fn_t on_ready;
+                onslotupdate_fn_t on_slot_update;
             };
             callback_set_t callbacks;
         };
@@ -0,0 +1,177 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_CLUSTER_GROUP_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_CLUSTER_GROUP_H
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#include "happ_cluster.h"
+
+#if defined(HIREDIS_HAPP_ATOMIC_STD)
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @breif clusters of the same nodes driven by several threads, each worker cluster is owned by one event loop
+         * @note cmds can be submitted from any thread, they are passed to the worker by a lock-free MPSC queue,
+         *       and the worker sends them in dispatch or proc on its own thread, so callbacks are called there.
+         *       Slots loaded by any worker are published as an immutable snapshot, which is swapped under a small mutex,
+         *       the other workers load it instead of sending CLUSTER SLOTS again.
+         *       Node of every slot is also published into a table of atomic integers, so submit picks the worker without any lock.
+         *       Cmds of one node are submitted to the same worker if there are enough nodes, so its connections are only in one loop.
+         *       Cmds of a key are only kept in order while it's submitted to the same worker, @see pick_worker
+         */
+        class cluster_group {
+        public:
+            typedef cluster::cmd_t cmd_t;
+
+            // slots of all workers, it's never changed after published
+            struct slot_snapshot_t {
+                uint64_t version;
+                std::vector<cluster::slot_t> nodes;
+                uint16_t slots[HIREDIS_HAPP_SLOT_NUMBER];
+            };
+            typedef std::shared_ptr<const slot_snapshot_t> slot_snapshot_ptr_t;
+
+            // called in the thread submitting cmds when the queue of a worker is not empty, dispatch should be called in its loop
+            typedef std::function<void(cluster_group *, size_t index)> onsubmit_fn_t;
+
+        private:
+            cluster_group(const cluster_group &);
+            cluster_group &operator=(const cluster_group &);
+
+        public:
+            cluster_group();
+            ~cluster_group();
+
+            /**
+             * @breif create workers
+             * @param worker_count count of workers, usually one for each event loop thread
+             * @param ip ip of any node
+             * @param port port of any node
+             * @note it must be called before any thread is started, and options of workers can be set by get_worker
+             */
+            int init(size_t worker_count, const std::string &ip, uint16_t port);
+
+            inline size_t size() const { return workers.size(); }
+
+            cluster *get_worker(size_t index);
+            const cluster *get_worker(size_t index) const;
+
+            /**
+             * @breif start a worker in its own thread
+             * @param index index of worker
+             * @note slots are loaded from the snapshot if any worker has loaded them, or CLUSTER SLOTS is sent
+             */
+            int start(size_t index);
+
+            /**
+             * @breif reset all workers and finish all cmds in queue with REDIS_HAPP_CONNECTION
+             * @note all threads of workers and submitters must be stopped
+             */
+            int reset();
+
+            /**
+             * @breif send a request to redis server from any thread
+             * @param key the key used to calculate slot id
+             * @param ks  key size
+             * @param cbk callback, called in the thread of worker
+             * @param priv_data private data passed to callback
+             * @param argc argument count
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @note cmd is formatted in the calling thread and sent by the worker in dispatch
+             * @return error code
+             */
+            int submit(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen);
+
+            /**
+             * @breif send a request to redis server from any thread
+             * @param key the key used to calculate slot id
+             * @param ks  key size
+             * @param cbk callback, called in the thread of worker
+             * @param priv_data private data passed to callback
+             * @param fmt format string
+             * @param ... format data
+             * @see submit
+             * @return error code
+             */
+            int submit(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...);
+
+            /**
+             * @breif get which worker the cmd of a key is submitted to
+             * @note it's picked by the node of the slot in the latest snapshot, or by the slot before any snapshot is published.
+             *       So a key may be moved to another worker when the first snapshot is published or nodes are renumbered by a reload,
+             *       and cmds of the key submitted before and after that may be sent in a different order
+             * @return index of worker
+             */
+            size_t pick_worker(const char *key, size_t ks) const;
+
+            /**
+             * @breif send cmds in queue of a worker, it must be called in the thread of the worker
+             * @param index index of worker
+             * @note the new slot snapshot is loaded first if there is one
+             * @return count of cmds sent
+             */
+            size_t dispatch(size_t index);
+
+            /**
+             * @breif dispatch and proc of a worker, it must be called in the thread of the worker
+             * @see cluster::proc
+             */
+            int proc(size_t index, time_t sec, time_t usec);
+
+            // the latest slots, NULL before any worker loaded them
+            slot_snapshot_ptr_t get_slot_snapshot() const;
+
+            /**
+             * @breif set callback when a cmd is submitted into an empty queue
+             * @param cbk callback, usually wakes up the loop of worker(event_active, uv_async_send and etc.)
+             * @note it's called in the thread submitting cmds, and it may be called in the worker by dispatch if cmds are still queued
+             * @return old callback
+             */
+            onsubmit_fn_t set_on_submit(onsubmit_fn_t cbk);
+
+            // cmds submitted but not dispatched
+            size_t get_queued_count(size_t index) const;
+
+            HIREDIS_HAPP_PRIVATE : struct request_t;
+            struct worker_t;
+
+            void push(worker_t *w, request_t *req);
+            request_t *pop(worker_t *w);
+            int enqueue(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, sds content);
+
+            // set as on_slot_update of every worker
+            struct slot_update_handler_t;
+            void publish_slots(cluster *clu);
+            void load_slots(worker_t *w);
+
+            HIREDIS_HAPP_PRIVATE : std::vector<worker_t *> workers;
+
+            // readers get a reference and the writer swaps a new one, both under slot_snapshot_lock
+            // shared_ptr atomic functions are not available in libstdc++ before GCC 5
+            slot_snapshot_ptr_t slot_snapshot;
+            mutable std::mutex slot_snapshot_lock;
+            std::atomic<uint64_t> slot_version;
+
+            // node of every slot in the latest snapshot, read by pick_worker without lock and written under slot_snapshot_lock
+            // slot_node_count is 0 before any snapshot is published
+            std::atomic<uint16_t> slot_nodes[HIREDIS_HAPP_SLOT_NUMBER];
+            std::atomic<size_t> slot_node_count;
+
+            onsubmit_fn_t on_submit;
+        };
+    }
+}
+
+#endif
+
+#endif // HIREDIS_HAPP_HIREDIS_HAPP_CLUSTER_GROUP_H
@@ -7,18 +7,36 @@
 
 #pragma once
 
+#include <ctime>
 #include <ostream>
+#include <vector>
 #include "config.h"
 
 namespace hiredis {
     namespace happ {
         class cluster;
         class raw;
+        class sentinel;
         class connection;
+        class cmd_pool;
+        class cmd_timer_wheel;
+        class near_cache;
+        class cmd_exec;
+        struct cmd_stats;
+
+        // node in a slot of cmd_timer_wheel
+        struct cmd_timer_node {
+            cmd_timer_node* prev;
+            cmd_timer_node* next;
+            cmd_exec* owner;
+            cmd_timer_wheel* wheel;     // NULL if not in any wheel
+            uint64_t expire_tick;
+        };
 
         union holder_t {
             cluster* clu;
             raw* r;
+            sentinel* s;
         };
 
         struct cmd_content {
@@ -56,6 +74,45 @@ namespace hiredis {
             const char* pick_argument(const char* start, const char** str, size_t* len);
             
             const char* pick_cmd(const char** str, size_t* len);
+
+            /**
+             * @brief check if this is a read-only command, which can also be sent to replicas
+             * @return true if it's a read-only command
+             */
+            bool is_readonly();
+
+            /**
+             * @brief check if cmd is a read-only command
+             * @param cmd command name, case insensitive
+             * @param len length of command name
+             * @return true if it's a read-only command
+             */
+            static bool is_readonly_cmd(const char* cmd, size_t len);
+
+            /**
+             * @brief check if reply of cmd can be kept in near cache, it must be a read-only command which reads only one key
+             *        and the reply does not change with time
+             * @param cmd command name, case insensitive
+             * @param len length of command name
+             * @return true if it can be cached
+             */
+            static bool is_cacheable_cmd(const char* cmd, size_t len);
+
+            /**
+             * @brief get formatted content of this cmd
+             * @param len length of content
+             * @return formatted content, NULL if not formatted
+             */
+            const char* get_content(size_t* len) const;
+
+            /**
+             * @brief deep copy of a reply
+             * @param src reply to copy, a nil reply is returned if it's NULL
+             * @return reply which should be released by free_reply, NULL if malloc failed
+             */
+            static redisReply* clone_reply(const redisReply* src);
+
+            static void free_reply(redisReply* r);
             
             static void dump(std::ostream& out, redisReply* reply, int ident = 0);
         HIREDIS_HAPP_PRIVATE:
@@ -67,12 +124,29 @@ namespace hiredis {
              * @param buff_len alloacte some memory inner cmd(this can be used to store some more data for later usage)
              * @return address of cmd object if success
              */
-            static cmd_exec* create(holder_t holder, callback_fn_t cbk, void* pridata, size_t buffer_len);
+            static cmd_exec* create(holder_t holder, callback_fn_t cbk, void* pridata, size_t buffer_len, cmd_pool* pool = NULL);
             static void destroy(cmd_exec* c);
 
+            /**
+             * @brief make sure wire buffer can hold s bytes
+             * @return wire buffer or NULL if failed
+             */
+            char* reserve_wire_buffer(size_t s);
+
+            /**
+             * @brief copy formatted content of another cmd
+             * @param src the cmd to copy from
+             * @return length of content, 0 if failed
+             */
+            int copy_from(const cmd_exec* src);
+
             friend class cluster;
             friend class raw;
+            friend class sentinel;
             friend class connection;
+            friend class cmd_pool;
+            friend class cmd_timer_wheel;
+            friend class near_cache;
         HIREDIS_HAPP_PRIVATE:
             holder_t holder;            // holder
             cmd_content cmd;
@@ -86,6 +160,181 @@ namespace hiredis {
             } engine;
 
             void* pri_data;             // user pri data
+            uint64_t retry_delay;       // delay of last retry in microseconds, used by backoff
+
+            // ========= memory =========
+            cmd_pool* pool;             // where to put back when destroyed, NULL means free it
+            size_t buffer_len;          // size of buffer after this object
+
+            // cmds from pool are formatted into this buffer, which is kept with the cmd object when cached
+            char* wire_buffer;
+            size_t wire_buffer_size;
+
+            // ========= waiting for reply =========
+            cmd_exec* reply_next;       // next cmd in reply queue of the same connection
+            connection* reply_owner;    // connection which this cmd is waiting for reply in, NULL if not in any reply queue
+
+            // ========= deadline =========
+            cmd_timer_node timer;
+            // callback is already called with REDIS_HAPP_TIMEOUT, the cmd will not be sent again
+            // and it will be destroyed when hiredis return it back
+            bool deadline_expired;
+
+            // ========= stats =========
+            cmd_stats* stats;           // stats of holder, NULL if not recorded
+            uint64_t start_usec;        // steady clock when it's sent the first time, 0 if not sent
+            uint64_t sent_usec;         // steady clock when it's sent the last time
+        };
+
+        /**
+         * @brief hashed timing wheel of cmd deadlines, owned by cluster or raw
+         * @note cmds are linked into the slot of their deadline, so adding and removing are O(1).
+         *       deadlines longer than a round are kept in the slot and checked again in the next round
+         */
+        class cmd_timer_wheel {
+        public:
+            cmd_timer_wheel();
+            ~cmd_timer_wheel();
+
+            /**
+             * @brief add a cmd, it will be removed first if it's already in a wheel
+             * @param c cmd
+             * @param sec deadline, in seconds
+             * @param usec deadline, microseconds part
+             */
+            void add(cmd_exec* c, time_t sec, time_t usec);
+
+            /**
+             * @brief remove a cmd from the wheel it's in
+             * @param c cmd
+             * @return true if it's in a wheel
+             */
+            static bool remove(cmd_exec* c);
+
+            /**
+             * @brief set deadline of a cmd to a timeout from now, the old one is replaced
+             * @param c cmd
+             * @param now_sec current time, in seconds
+             * @param now_usec current time, microseconds part
+             * @param sec timeout, in seconds
+             * @param usec timeout, microseconds part
+             * @return false if c has no callback or its deadline has already expired
+             */
+            bool set_timeout(cmd_exec* c, time_t now_sec, time_t now_usec, time_t sec, time_t usec);
+
+            /**
+             * @brief set deadline of a cmd to a timeout from now, only if it has no deadline
+             * @note deadline is counted from the first time a cmd is sent, so retries will not change it
+             * @return false if c already has a deadline or timeout is 0
+             * @see set_timeout
+             */
+            bool add_timeout(cmd_exec* c, time_t now_sec, time_t now_usec, time_t sec, time_t usec);
+
+            /**
+             * @brief remove all cmds whose deadline is not later than current time
+             * @param sec current time, in seconds
+             * @param usec current time, microseconds part
+             * @param out expired cmds
+             * @return count of expired cmds
+             */
+            size_t expire(time_t sec, time_t usec, std::vector<cmd_exec*>& out);
+
+            inline size_t size() const { return count; }
+
+        private:
+            cmd_timer_wheel(const cmd_timer_wheel&);
+            cmd_timer_wheel& operator=(const cmd_timer_wheel&);
+
+            static uint64_t to_ms(time_t sec, time_t usec);
+
+        HIREDIS_HAPP_PRIVATE:
+            std::vector<cmd_timer_node> slots;  // list heads
+            uint64_t current_tick;
+            bool started;
+            size_t count;
+        };
+
+        /**
+         * @brief free list of cmd_exec objects with the same buffer size, owned by cluster or raw
+         * @note cached objects are limited by high watermark, and those not used in the last second are released down to low watermark
+         */
+        class cmd_pool {
+        public:
+            cmd_pool();
+            ~cmd_pool();
+
+            /**
+             * @brief set size of buffer in every cmd, cached cmds will be released if changed
+             * @param s buffer size
+             */
+            void set_buffer_size(size_t s);
+
+            inline size_t get_buffer_size() const { return buffer_size; }
+
+            /**
+             * @brief set watermarks
+             * @param low cached cmds kept when idle
+             * @param high max cached cmds, 0 to disable the pool
+             */
+            void set_watermark(size_t low, size_t high);
+
+            inline size_t get_low_watermark() const { return low_watermark; }
+            inline size_t get_high_watermark() const { return high_watermark; }
+
+            /**
+             * @brief release cached cmds which are not used since last trim, but keep at least low watermark
+             * @param sec current time, trim no more than once in a second
+             * @return count of cmds released
+             */
+            size_t trim(time_t sec);
+
+            /**
+             * @brief release all cached cmds
+             */
+            void clear();
+
+            // cmds got from free list
+            inline size_t get_hit_count() const { return hit_count; }
+
+            // cmds allocated from system
+            inline size_t get_miss_count() const { return miss_count; }
+
+            inline size_t get_cached_count() const { return free_list.size(); }
+
+            // memory of cached cmds, including their formatting buffers
+            inline size_t get_retained_bytes() const { return free_list.size() * block_size + wire_bytes; }
+
+            /**
+             * @brief memory size of a cmd with buffer
+             * @param buffer_len buffer size
+             * @return memory size, padding to sizeof(void*)
+             */
+            static size_t get_block_size(size_t buffer_len);
+
+        HIREDIS_HAPP_PRIVATE:
+            cmd_exec* pop(size_t buffer_len);
+            bool push(cmd_exec* c);
+            static void free_block(cmd_exec* c);
+
+            friend class cmd_exec;
+
+        private:
+            cmd_pool(const cmd_pool&);
+            cmd_pool& operator=(const cmd_pool&);
+
+        HIREDIS_HAPP_PRIVATE:
+            std::vector<cmd_exec*> free_list;
+            size_t buffer_size;
+            size_t block_size;
+            size_t low_watermark;
+            size_t high_watermark;
+            size_t wire_bytes;          // formatting buffers of cached cmds
+
+            size_t min_cached;          // min count of cached cmds since last trim
+            time_t last_trim_sec;
+
+            size_t hit_count;
+            size_t miss_count;
         };
     }
 }
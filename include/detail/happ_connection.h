@@ -7,11 +7,10 @@
 
 #pragma once
 
-#include <list>
-
 #include "config.h"
 
 #include "happ_cmd.h"
+#include "happ_stats.h"
 
 namespace hiredis {
     namespace happ {
@@ -121,6 +120,13 @@ namespace hiredis {
 
             inline status::type get_status() const { return conn_status; }
 
+            // count of cmds waiting for reply
+            inline size_t get_pending_count() const { return reply_count; }
+
+            // stats of cmds sent by this connection
+            inline const cmd_stats &get_stats() const { return stats; }
+            inline cmd_stats &get_stats() { return stats; }
+
         private:
             connection(const connection &);
             connection &operator=(const connection &);
@@ -132,15 +138,22 @@ namespace hiredis {
             static void set_key(connection::key_t &k, const std::string &ip, uint16_t port);
             static bool pick_name(const std::string &name, std::string &ip, uint16_t &port);
 
+            HIREDIS_HAPP_PRIVATE : void push_reply(cmd_exec *c);
+            cmd_exec *pop_front_reply();
+
             HIREDIS_HAPP_PRIVATE : key_t key;
             uint64_t sequence;
 
             holder_t holder;
             redisAsyncContext *context;
 
-            // cmds inner this connection
-            std::list<cmd_exec *> reply_list;
+            // cmds inner this connection, an intrusive FIFO linked by cmd_exec::reply_next
+            cmd_exec *reply_head;
+            cmd_exec *reply_tail;
+            size_t reply_count;
             status::type conn_status;
+
+            cmd_stats stats;
         };
     }
 }
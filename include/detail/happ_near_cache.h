@@ -0,0 +1,143 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_NEAR_CACHE_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_NEAR_CACHE_H
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include "config.h"
+
+#include "happ_cmd.h"
+
+namespace hiredis {
+    namespace happ {
+        class connection;
+
+        /**
+         * @brief replies of read-only cmds kept in client, owned by cluster or raw
+         * @note keys are invalidated by messages of __redis__:invalidate, which are sent by CLIENT TRACKING with REDIRECT.
+         *       only replies from tracked connections are cached, and a reply is dropped if any key is invalidated while it's in flight.
+         *       least recently used replies are evicted when memory exceeds the limit
+         */
+        class near_cache {
+        public:
+            struct entry_t;
+
+            near_cache();
+            ~near_cache();
+
+            /**
+             * @brief set the max memory of cached replies
+             * @param bytes max memory, 0 means disable the cache
+             */
+            void set_max_memory(size_t bytes);
+
+            inline size_t get_max_memory() const { return max_memory; }
+
+            inline bool is_enabled() const { return max_memory > 0; }
+
+            inline size_t get_memory() const { return memory; }
+
+            inline size_t size() const { return entries.size(); }
+
+            /**
+             * @brief find cached reply of a cmd and pin it
+             * @param cmd formatted cmd
+             * @return entry which must be unpinned by release, NULL if not cached
+             * @note only cacheable reads are looked up and counted as misses
+             */
+            entry_t *acquire(cmd_exec *cmd);
+
+            void release(entry_t *e);
+
+            static redisReply *get_reply(entry_t *e);
+
+            /**
+             * @brief replace callback of cmd, and cache its reply when it's finished
+             * @param cmd cmd to be sent, it's not wrapped if it can not be cached
+             * @return true if wrapped
+             */
+            bool wrap(cmd_exec *cmd);
+
+            /**
+             * @brief cache reply of a cmd
+             * @param cmd finished cmd
+             * @param reply reply of cmd
+             * @param generation generation when cmd is sent
+             * @return true if cached
+             */
+            bool put(cmd_exec *cmd, const redisReply *reply, uint64_t generation);
+
+            // changed every time any key is invalidated
+            inline uint64_t get_generation() const { return generation; }
+
+            /**
+             * @brief remove replies of a key
+             * @return count of removed replies
+             */
+            size_t invalidate(const char *key, size_t len);
+
+            void clear();
+
+            /**
+             * @brief handle a message of __redis__:invalidate channel
+             * @param msg message reply, subscribe replies and messages of other channels are ignored
+             * @return true if it's an invalidation
+             */
+            bool on_invalidate(const redisReply *msg);
+
+            /**
+             * @brief mark a connection as tracked, only replies from tracked connections are cached
+             * @note a connection must be untracked before it's destroyed
+             */
+            void set_tracked(const connection *conn, bool tracked);
+
+            inline bool is_tracked(const connection *conn) const { return tracked_conns.find(conn) != tracked_conns.end(); }
+
+            inline size_t get_tracked_count() const { return tracked_conns.size(); }
+
+            inline uint64_t get_hit_count() const { return hits; }
+            inline uint64_t get_miss_count() const { return misses; }
+            inline uint64_t get_eviction_count() const { return evictions; }
+            inline uint64_t get_invalidation_count() const { return invalidations; }
+
+            static void on_reply(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+        private:
+            near_cache(const near_cache &);
+            near_cache &operator=(const near_cache &);
+
+            // key of cache, the cmd name and the first argument
+            static bool pick_key(cmd_exec *cmd, const char **key, size_t *len);
+
+            static size_t get_reply_memory(const redisReply *r);
+
+            void remove(entry_t *e);
+
+            void evict();
+
+        HIREDIS_HAPP_PRIVATE:
+            struct request_t;
+
+            size_t max_memory;
+            size_t memory;
+            uint64_t generation;
+
+            // the most recently used one is in the head
+            entry_t *lru_head;
+            entry_t *lru_tail;
+
+            HIREDIS_HAPP_MAP(std::string, entry_t *) entries; // formatted cmd => entry
+            HIREDIS_HAPP_MAP(std::string, std::vector<entry_t *>) keys; // key => entries of the key
+            std::set<const connection *> tracked_conns;
+
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            uint64_t invalidations;
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_NEAR_CACHE_H
@@ -0,0 +1,100 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_PUBSUB_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_PUBSUB_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "config.h"
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @brief channels and patterns subscribed, and their callbacks, owned by cluster or raw
+         * @note every subscription remembers the node it's subscribed on, and it's subscribed again by its owner when the node is lost.
+         *       messages are dispatched by the channel(or pattern) in the message, so messages after unsubscribed are dropped
+         */
+        class pubsub {
+        public:
+            struct channel_type {
+                enum type {
+                    CHANNEL = 0, // SUBSCRIBE, any node in cluster
+                    PATTERN,     // PSUBSCRIBE, any node in cluster
+                    SHARD,       // SSUBSCRIBE, the master of slot of channel in cluster, redis 7.0 and hiredis 1.2 or upper
+                    MAX
+                };
+            };
+
+            /**
+             * @brief message callback
+             * @param channel channel of the message, it's the real channel even if subscribed by a pattern
+             * @param message payload
+             */
+            typedef std::function<void(const redisReply *channel, const redisReply *message)> message_fn_t;
+
+            struct subscription_t {
+                std::string name;
+                channel_type::type t;
+                message_fn_t fn;
+                std::string node; // node subscribed on, empty if not subscribed yet
+            };
+            typedef HIREDIS_HAPP_MAP(std::string, subscription_t) subscription_map_t;
+
+            pubsub();
+
+            /**
+             * @brief add or replace a subscription
+             * @return the subscription, its node is empty if it's not subscribed on any node yet
+             */
+            subscription_t *add(channel_type::type t, const std::string &name, message_fn_t fn);
+
+            subscription_t *find(channel_type::type t, const std::string &name);
+
+            /**
+             * @brief remove a subscription
+             * @param node where to send the unsubscribe cmd, empty if not subscribed on any node
+             * @return false if not found
+             */
+            bool remove(channel_type::type t, const std::string &name, std::string &node);
+
+            inline subscription_map_t &get_subscriptions(channel_type::type t) { return subscriptions[t]; }
+
+            inline size_t size() const { return subscriptions[channel_type::CHANNEL].size() + subscriptions[channel_type::PATTERN].size() + subscriptions[channel_type::SHARD].size(); }
+
+            void clear();
+
+            /**
+             * @brief mark all subscriptions on a node unsubscribed
+             * @return count of subscriptions should be subscribed again
+             */
+            size_t reset_node(const std::string &node);
+
+            /**
+             * @brief call the callback of a message
+             * @param r reply from a subscriber connection
+             * @return false if it's not a message(subscribe replies, errors and etc.)
+             */
+            bool dispatch(const redisReply *r);
+
+            inline uint64_t get_message_count() const { return messages; }
+            inline uint64_t get_dropped_count() const { return dropped; }
+
+            /**
+             * @brief if a channel type can be subscribed
+             * @note shard channels are only available when HIREDIS_HAPP_PUBSUB_SHARD is defined, @see config.h
+             */
+            static bool is_supported(channel_type::type t);
+
+            static const char *get_subscribe_cmd(channel_type::type t);
+            static const char *get_unsubscribe_cmd(channel_type::type t);
+
+        HIREDIS_HAPP_PRIVATE:
+            subscription_map_t subscriptions[channel_type::MAX];
+
+            uint64_t messages; // dispatched messages
+            uint64_t dropped;  // messages without callback
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_PUBSUB_H
@@ -8,11 +8,15 @@
 #pragma once
 
 #include <vector>
-#include <list>
 
 #include "config.h"
 
 #include "happ_connection.h"
+#include "happ_near_cache.h"
+#include "happ_pubsub.h"
+#include "happ_retry_policy.h"
+#include "happ_script.h"
+#include "happ_timer_heap.h"
 
 namespace hiredis {
     namespace happ {
@@ -32,6 +36,9 @@ namespace hiredis {
             raw(const raw &);
             raw &operator=(const raw &);
 
+            // sentinel holds a raw connected to master
+            friend class sentinel;
+
         public:
             raw();
             ~raw();
@@ -129,6 +136,58 @@ namespace hiredis {
              */
             cmd_t *exec(connection_t *conn, cmd_t *cmd);
 
+            struct batch_t;
+
+            /**
+             * @breif create a batch, cmds added into it will not be sent until flush_batch is called
+             * @param cbk callback when all cmds in this batch finished, reply is always NULL and the first error code of cmds is passed to it
+             * @param priv_data private data passed to cbk
+             * @note a batch must be flushed or aborted, and it will be destroyed after all cmds in it finished
+             * @return batch object, NULL if failed
+             */
+            batch_t *create_batch(cmd_t::callback_fn_t cbk, void *priv_data);
+
+            /**
+             * @breif add a request into batch
+             * @param b batch object
+             * @param cbk callback of this cmd
+             * @param priv_data private data passed to callback
+             * @param argc argument count
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @see exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *batch_exec(batch_t *b, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen);
+
+            /**
+             * @breif add a request into batch
+             * @param b batch object
+             * @param cbk callback of this cmd
+             * @param priv_data private data passed to callback
+             * @param fmt format string
+             * @param ... format data
+             * @see exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *batch_exec(batch_t *b, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...);
+
+            /**
+             * @breif send all cmds in batch
+             * @param b batch object
+             * @note cmds are appended into the output buffer of hiredis one after another, so they are written together when the connection is writable
+             * @return count of cmds sent
+             */
+            size_t flush_batch(batch_t *b);
+
+            /**
+             * @breif destroy a batch without sending any cmd in it
+             * @param b batch object, it can not be used after aborted
+             * @note callbacks of all cmds and then the batch are called with REDIS_HAPP_ABORT
+             * @return error code, REDIS_HAPP_PARAM if it's already flushed
+             */
+            int abort_batch(batch_t *b);
+
             /**
              * @breif retry to send a request to redis server
              * @param cmd cmd wrapper
@@ -140,7 +199,8 @@ namespace hiredis {
              *
              * @see connection::redis_raw_cmd
              * @see connection::redis_cmd
-             * @return command wrapper of this message, NULL if failed
+             * @see retry_policy
+             * @return command wrapper of this message, NULL if failed or retry budget is exhausted(REDIS_HAPP_RETRY_BUDGET)
              */
             cmd_t *retry(cmd_t *cmd, connection_t *conn = NULL);
 
@@ -150,6 +210,68 @@ namespace hiredis {
             connection_t *make_connection();
             bool release_connection(bool close_fd, int status);
 
+            /**
+             * @breif change address of redis server, used when master is switched
+             * @param ip new ip
+             * @param port new port
+             * @note cmds waiting for reply of the old server are sent to the new one at once, without waiting for timeout or retry.
+             *       near cache tracking and subscriber connections are made again to the new server.
+             * @return error code
+             */
+            int redirect(const std::string &ip, uint16_t port);
+
+            /**
+             * @breif cache replies of read-only single key commands(GET, HGET, ZRANGE and etc.) in client
+             * @param max_memory max memory of cached replies, 0 means disable the cache
+             * @note one more connection subscribes __redis__:invalidate, and the other one sends CLIENT TRACKING on REDIRECT to it,
+             *       so redis 6.0 or upper is required.
+             *       exec returns NULL if the reply is cached, and the callback is called with a NULL context before exec returns.
+             */
+            void set_near_cache(size_t max_memory);
+
+            inline const near_cache &get_near_cache() const { return reply_cache; }
+
+            /**
+             * @breif subscribe a channel or pattern, messages are passed to fn
+             * @param t pubsub::channel_type::CHANNEL(SUBSCRIBE), pubsub::channel_type::PATTERN(PSUBSCRIBE) or pubsub::channel_type::SHARD(SSUBSCRIBE, hiredis 1.2 or upper)
+             * @param name channel or pattern
+             * @param fn message callback, the old one is replaced if it's already subscribed
+             * @note subscriptions use a dedicated connection, and they are subscribed again when the connection is lost, with backoff of get_retry_policy(),
+             *       and lost ones wait for the next subscribe after HIREDIS_HAPP_RESUBSCRIBE_TIMES rounds without any reply
+             * @return error code, REDIS_HAPP_PARAM if t is not supported by this hiredis, @see pubsub::is_supported
+             */
+            int subscribe(pubsub::channel_type::type t, const std::string &name, pubsub::message_fn_t fn);
+
+            /**
+             * @breif unsubscribe a channel or pattern
+             * @return error code, REDIS_HAPP_NOT_FOUND if not subscribed
+             */
+            int unsubscribe(pubsub::channel_type::type t, const std::string &name);
+
+            inline const pubsub &get_pubsub() const { return subscriptions; }
+
+            /**
+             * @breif register a lua script, it's loaded by SCRIPT LOAD into every new connection
+             * @param body script
+             * @return SHA1 of script, used by eval_script
+             */
+            const std::string &register_script(const std::string &body);
+
+            inline const script_registry &get_scripts() const { return scripts; }
+
+            /**
+             * @breif run a registered script by EVALSHA
+             * @param sha1 SHA1 returned by register_script
+             * @param cbk callback
+             * @param priv_data private data passed to callback
+             * @param argc argument count after SHA1, including numkeys, keys and args
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @note if the server replies NOSCRIPT, the script is loaded again and EVALSHA is sent just after it
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *eval_script(const std::string &sha1, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen);
+
             onconnect_fn_t set_on_connect(onconnect_fn_t cbk);
             onconnected_fn_t set_on_connected(onconnected_fn_t cbk);
             ondisconnected_fn_t set_on_disconnected(ondisconnected_fn_t cbk);
@@ -158,14 +280,59 @@ namespace hiredis {
 
             size_t get_cmd_buffer_size() const;
 
+            /**
+             * @breif set watermarks of cached cmd objects
+             * @param low cached cmds kept when idle
+             * @param high max cached cmds, 0 to disable the cache
+             */
+            void set_cmd_pool_watermark(size_t low, size_t high);
+
+            // cached cmd objects and stats
+            inline const cmd_pool &get_cmd_pool() const { return cmd_cache; }
+
             bool is_timer_active() const;
 
             void set_timer_interval(time_t sec, time_t usec);
 
             void set_timeout(time_t sec);
 
+            /**
+             * @breif set default deadline of every cmd, counted from the first time it's sent
+             * @param sec seconds, 0 with usec=0 means no deadline
+             * @param usec microseconds
+             * @note cmds reach the deadline will be finished with REDIS_HAPP_TIMEOUT in proc, even if it's still waiting for reply
+             */
+            void set_cmd_timeout(time_t sec, time_t usec);
+
+            /**
+             * @breif set deadline of a cmd
+             * @param cmd the cmd returned by exec
+             * @param sec seconds from now
+             * @param usec microseconds from now
+             * @return false if timer is not active or cmd is already finished
+             */
+            bool set_cmd_deadline(cmd_t *cmd, time_t sec, time_t usec);
+
             void add_timer_cmd(cmd_t *cmd);
 
+            /**
+             * @breif send a cmd after a while
+             * @param cmd cmd wrapper
+             * @param sec delay in seconds
+             * @param usec delay in microseconds
+             * @note cmd is sent at once if timer is not active
+             */
+            void add_timer_cmd(cmd_t *cmd, time_t sec, time_t usec);
+
+            // backoff and budget of retries
+            inline retry_policy &get_retry_policy() { return retry_backoff; }
+            inline const retry_policy &get_retry_policy() const { return retry_backoff; }
+
+            // counters and latency of all cmds, copy it to take a snapshot
+            inline const cmd_stats &get_stats() const { return stats; }
+
+            void reset_stats();
+
             int proc(time_t sec, time_t usec);
 
             void set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size = 65536);
@@ -179,6 +346,38 @@ namespace hiredis {
             static void on_disconnected_wrapper(const struct redisAsyncContext *, int status);
 
             static void on_reply_auth(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+            struct batch_cmd_t;
+            static void on_reply_batch(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            void finish_batch(batch_t *b);
+
+            void add_cmd_deadline(cmd_t *cmd);
+
+            bool send_auth(connection_t *conn);
+
+            // SCRIPT LOAD of registered scripts
+            void send_script_load(connection_t *conn, const std::string &body);
+            static void on_reply_script_load(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+
+            // connect without replacing the current connection, for tracking and subscriber connections
+            // connection of the old server after redirect is also released by release_dedicated_connection
+            connection_t *make_dedicated_connection(connection_ptr_t &holder);
+            bool release_dedicated_connection(connection_t *conn, bool close_fd, int status);
+            static void on_dedicated_connected_wrapper(const struct redisAsyncContext *, int status);
+            static void on_dedicated_disconnected_wrapper(const struct redisAsyncContext *, int status);
+
+            // invalidation of near cache
+            connection_t *make_tracking_connection();
+            void start_tracking();
+            void send_tracking(connection_t *conn);
+            static void on_reply_tracking_id(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_tracking(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_invalidate(redisAsyncContext *c, void *r, void *privdata);
+
+            // pub/sub
+            bool send_subscribe(pubsub::subscription_t &sub);
+            void resubscribe();
+            static void on_reply_subscribe(redisAsyncContext *c, void *r, void *privdata);
             
         private:
             void log_debug(const char *fmt, ...);
@@ -197,15 +396,53 @@ namespace hiredis {
                 time_t timer_timeout_sec;
 
                 size_t cmd_buffer_size;
+
+                time_t cmd_timeout_sec;
+                time_t cmd_timeout_usec;
             };
             config_t conf;
 
             // authorization information
             connection::auth_info_t auth;
 
+            // cached cmd objects, must be destroyed after all connections
+            cmd_pool cmd_cache;
+
+            // deadlines of cmds
+            cmd_timer_wheel cmd_deadlines;
+
+            retry_policy retry_backoff;
+
+            cmd_stats stats;
+
+            near_cache reply_cache;
+
+            script_registry scripts;
+
             // current connection
             connection_ptr_t conn_;
 
+            // connection of the old server after redirect, cmds in it are moved to conn_
+            connection_ptr_t redirected_conn_;
+
+            // connection subscribing invalidation messages of near cache
+            connection_ptr_t tracking_conn_;
+            long long tracking_client_id; // 0 before CLIENT ID replied
+
+            // subscriber connection
+            connection_ptr_t subscriber_conn_;
+            pubsub subscriptions;
+
+            // subscriptions lost are subscribed again in proc, with backoff of retry_backoff
+            struct resubscribe_t {
+                bool pending;           // some subscriptions are not subscribed
+                size_t times;           // rounds sent since the last reply of the subscriber connection
+                uint64_t retry_delay;   // backoff delay of the last round, in microseconds
+                time_t retry_sec;       // no round before this
+                time_t retry_usec;
+            };
+            resubscribe_t resubscribe_status;
+
 
             // timers
             struct timer_t {
@@ -216,8 +453,12 @@ namespace hiredis {
                     time_t sec;
                     time_t usec;
                     cmd_t *cmd;
+
+                    inline bool operator<(const delay_t& r) const {
+                        return sec < r.sec || (sec == r.sec && usec < r.usec);
+                    }
                 };
-                std::list<delay_t> timer_pending;
+                timer_heap<delay_t> timer_pending;
 
                 struct conn_timetout_t {
                     uint64_t sequence;
@@ -0,0 +1,113 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_RETRY_POLICY_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_RETRY_POLICY_H
+
+#pragma once
+
+#include <ctime>
+#include "config.h"
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @brief when and whether to retry a failed cmd, owned by cluster or raw
+         * @note delay grows with decorrelated jitter: min(max, random(base, max(base, last delay) * 3)),
+         *       so clients failed at the same time will not retry in lockstep.
+         *       retries are limited by a budget of min_per_sec + percent of requests in the current and last second
+         */
+        class retry_policy {
+        public:
+            retry_policy();
+
+            /**
+             * @brief set how many retries are sent at once before backoff
+             * @param times retries sent at once, 1 means only the first retry is not delayed
+             */
+            void set_immediate_times(size_t times);
+
+            inline size_t get_immediate_times() const { return immediate_times; }
+
+            /**
+             * @brief set delay range of backoff
+             * @param base_sec min delay, seconds
+             * @param base_usec min delay, microseconds
+             * @param max_sec max delay, seconds
+             * @param max_usec max delay, microseconds
+             * @note retries are never delayed if max delay is 0
+             */
+            void set_backoff(time_t base_sec, time_t base_usec, time_t max_sec, time_t max_usec);
+
+            inline uint64_t get_backoff_base() const { return base_delay; }
+            inline uint64_t get_backoff_max() const { return max_delay; }
+
+            /**
+             * @brief set retry budget
+             * @param percent retries allowed for every 100 requests, 0 to disable the budget
+             * @param min_per_sec retries always allowed in a second
+             */
+            void set_budget(uint32_t percent, uint32_t min_per_sec);
+
+            inline uint32_t get_budget_percent() const { return budget_percent; }
+            inline uint32_t get_budget_min_per_sec() const { return budget_min_per_sec; }
+
+            /**
+             * @brief count a request sent the first time, which adds to the retry budget
+             * @param sec current time, in seconds
+             */
+            void add_request(time_t sec);
+
+            /**
+             * @brief take a retry from the budget
+             * @param sec current time, in seconds
+             * @return false if the budget is exhausted
+             */
+            bool acquire(time_t sec);
+
+            /**
+             * @brief delay before next retry
+             * @param sent_times how many times the cmd has been sent, it's 1 before the first retry
+             * @param last_delay delay of last retry, in microseconds
+             * @return delay in microseconds, 0 means retry immediately
+             */
+            uint64_t next_delay(size_t sent_times, uint64_t last_delay);
+
+            /**
+             * @brief take a retry from the budget and get its delay
+             * @param sec current time, in seconds
+             * @param sent_times how many times the cmd has been sent
+             * @param delay delay of last retry, and it's set to the delay of this retry in microseconds
+             * @return false if the budget is exhausted, and delay is not changed
+             * @see acquire
+             * @see next_delay
+             */
+            bool retry(time_t sec, size_t sent_times, uint64_t *delay);
+
+            inline size_t get_retry_count() const { return retry_count; }
+            inline size_t get_rejected_count() const { return rejected_count; }
+
+        private:
+            uint64_t random();
+            void roll(time_t sec);
+
+        HIREDIS_HAPP_PRIVATE:
+            size_t immediate_times;
+            uint64_t base_delay;            // microseconds
+            uint64_t max_delay;             // microseconds
+
+            uint32_t budget_percent;
+            uint32_t budget_min_per_sec;
+
+            // budget window of one second
+            time_t window_sec;
+            size_t window_requests;
+            size_t window_retries;
+            size_t last_window_requests;
+
+            uint64_t random_seed;
+
+            size_t retry_count;
+            size_t rejected_count;
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_RETRY_POLICY_H
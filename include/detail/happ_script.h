@@ -0,0 +1,97 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_SCRIPT_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_SCRIPT_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "config.h"
+
+namespace hiredis {
+    namespace happ {
+        class cmd_exec;
+
+        /**
+         * @brief Lua scripts registered by their SHA1, owned by cluster or raw
+         * @note scripts are run by EVALSHA, and the body is only sent by SCRIPT LOAD when a connection is made or NOSCRIPT is replied
+         */
+        class script_registry {
+        public:
+            typedef HIREDIS_HAPP_MAP(std::string, std::string) script_map_t; // sha1 => body
+
+            script_registry();
+
+            /**
+             * @brief add a script
+             * @param body script
+             * @return SHA1 of script in lower case hex, the same as SCRIPT LOAD
+             */
+            const std::string &add(const std::string &body);
+
+            /**
+             * @brief find a script
+             * @param sha1 SHA1 in hex, case insensitive
+             * @return body of script, NULL if not found
+             */
+            const std::string *find(const char *sha1, size_t len) const;
+
+            inline const std::string *find(const std::string &sha1) const { return find(sha1.c_str(), sha1.size()); }
+
+            /**
+             * @brief find the script run by a EVALSHA cmd
+             * @return body of script, NULL if it's not EVALSHA(or EVALSHA_RO) or the script is not found
+             */
+            const std::string *find(cmd_exec *cmd) const;
+
+            bool remove(const std::string &sha1);
+
+            void clear();
+
+            inline size_t size() const { return scripts.size(); }
+
+            inline bool empty() const { return scripts.empty(); }
+
+            inline const script_map_t &get_scripts() const { return scripts; }
+
+            /**
+             * @brief find the script to load again when a cmd is replied NOSCRIPT, and count it
+             * @param cmd the cmd replied
+             * @param reply error reply
+             * @return body of script, NULL if it's not NOSCRIPT or the script is not registered
+             */
+            const std::string *reload(cmd_exec *cmd, const redisReply *reply);
+
+            // scripts loaded again after NOSCRIPT
+            inline uint64_t get_reload_count() const { return reloads; }
+
+            /**
+             * @brief format EVALSHA of a script
+             * @param cmd cmd to be sent
+             * @param sha1 SHA1 returned by add
+             * @param argc count of arguments after SHA1, numkeys, keys and args
+             * @param argv pointer of every argument
+             * @param argvlen size of every argument
+             * @return size of formatted cmd, <= 0 if failed
+             */
+            static int format_eval(cmd_exec *cmd, const std::string &sha1, int argc, const char **argv, const size_t *argvlen);
+
+            /**
+             * @brief format SCRIPT LOAD of a script
+             * @return size of formatted cmd, <= 0 if failed
+             */
+            static int format_load(cmd_exec *cmd, const std::string &body);
+
+            /**
+             * @brief calculate SHA1
+             * @return SHA1 in lower case hex
+             */
+            static std::string sha1_hex(const char *data, size_t len);
+
+        HIREDIS_HAPP_PRIVATE:
+            script_map_t scripts;
+            uint64_t reloads;
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_SCRIPT_H
@@ -0,0 +1,148 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_SENTINEL_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_SENTINEL_H
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#include "happ_raw.h"
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @breif redis master managed by sentinels
+         * @note address of master is got by SENTINEL get-master-addr-by-name, and +switch-master is subscribed on the same connection.
+         *       when master is switched, cmds waiting for reply are sent to the new master at once.
+         *       cmds sent before master is known are kept and sent when it's known.
+         */
+        class sentinel {
+        public:
+            typedef raw::cmd_t cmd_t;
+
+            typedef raw::connection_t connection_t;
+            typedef raw::connection_ptr_t connection_ptr_t;
+
+            typedef std::function<void(sentinel *, const connection::key_t &)> onswitch_fn_t;
+            typedef raw::log_fn_t log_fn_t;
+
+        private:
+            sentinel(const sentinel &);
+            sentinel &operator=(const sentinel &);
+
+        public:
+            sentinel();
+            ~sentinel();
+
+            /**
+             * @breif set name of master
+             * @param master_name name in sentinel's configure
+             */
+            int init(const std::string &master_name);
+
+            /**
+             * @breif add a sentinel, they are used one by one when the current one is lost
+             */
+            int add_sentinel(const std::string &ip, uint16_t port);
+
+            inline const std::string &get_master_name() const { return master_name; }
+
+            // address of master, name is empty before it's known
+            inline const connection::key_t &get_master() const { return master; }
+
+            int start();
+
+            int reset();
+
+            /**
+             * @breif send a request to master
+             * @see raw::exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *exec(cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen);
+
+            /**
+             * @breif send a request to master
+             * @see raw::exec
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *exec(cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...);
+
+            /**
+             * @breif send a request to master
+             * @param cmd cmd wrapper
+             * @note cmd is kept until master is known
+             * @return command wrapper of this message, NULL if failed
+             */
+            cmd_t *exec(cmd_t *cmd);
+
+            // master connection, auth, timeout, near cache and subscriptions are all set here
+            inline raw &get_raw() { return master_raw; }
+            inline const raw &get_raw() const { return master_raw; }
+
+            const connection_t *get_sentinel_connection() const;
+
+            /**
+             * @breif set callback when master is known or switched
+             * @return the old callback
+             */
+            onswitch_fn_t set_on_switch_master(onswitch_fn_t cbk);
+
+            // times of master switched
+            inline uint64_t get_switch_count() const { return switch_count; }
+
+            // cmds waiting for master
+            inline size_t get_pending_count() const { return pending_cmds.size(); }
+
+            void set_retry_interval(time_t sec);
+
+            int proc(time_t sec, time_t usec);
+
+            void set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size = 65536);
+
+            HIREDIS_HAPP_PRIVATE : connection_t *make_sentinel_connection();
+            bool release_sentinel_connection(bool close_fd, int status);
+
+            void switch_master(const std::string &ip, uint16_t port);
+            void send_pending();
+
+            static void on_connected_wrapper(const struct redisAsyncContext *, int status);
+            static void on_disconnected_wrapper(const struct redisAsyncContext *, int status);
+
+            static void on_reply_master_addr(redisAsyncContext *c, void *r, void *privdata);
+            static void on_reply_switch_master(redisAsyncContext *c, void *r, void *privdata);
+
+            HIREDIS_HAPP_PRIVATE : std::string master_name;
+            connection::key_t master;
+
+            std::vector<connection::key_t> sentinels;
+            size_t sentinel_index; // the next one to connect
+
+            // connection to sentinel, SUBSCRIBE +switch-master
+            connection_ptr_t sentinel_conn;
+
+            // connection to master
+            raw master_raw;
+
+            std::list<cmd_t *> pending_cmds;
+
+            struct timer_t {
+                time_t last_update_sec;
+                time_t retry_interval_sec;
+                time_t next_connect_sec; // 0 means at once
+                time_t connect_timeout; // 0 means no timeout
+            };
+            timer_t timer_actions;
+
+            bool started;
+            bool reconnect_pending; // current sentinel can not be used, connect to the next one in proc
+            uint64_t switch_count;
+            onswitch_fn_t on_switch;
+        };
+    }
+}
+
+#endif // HIREDIS_HAPP_HIREDIS_HAPP_SENTINEL_H
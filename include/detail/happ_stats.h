@@ -0,0 +1,116 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_STATS_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_STATS_H
+
+#pragma once
+
+#include "config.h"
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @brief log-linear histogram of latency in microseconds, just like HdrHistogram
+         * @note every power of 2 is split into 16 linear sub buckets, so the relative error is no more than 1/16.
+         *       values larger than 2^32 us are recorded as 2^32 us
+         */
+        class latency_histogram {
+        public:
+            enum {
+                SUB_BUCKET_BITS = 4,
+                SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+                MAX_VALUE_BITS = 32,
+                BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+            };
+
+            latency_histogram();
+
+            inline void record(uint64_t usec) {
+                ++buckets[get_bucket_index(usec)];
+                ++count;
+                sum += usec;
+                if (usec < min_value) {
+                    min_value = usec;
+                }
+                if (usec > max_value) {
+                    max_value = usec;
+                }
+            }
+
+            void merge(const latency_histogram &other);
+
+            void reset();
+
+            inline uint64_t get_count() const { return count; }
+            inline uint64_t get_sum() const { return sum; }
+            inline uint64_t get_min() const { return 0 == count ? 0 : min_value; }
+            inline uint64_t get_max() const { return max_value; }
+            inline uint64_t get_mean() const { return 0 == count ? 0 : sum / count; }
+
+            /**
+             * @brief get value at percentile
+             * @param percentile 0-100
+             * @return the highest value in the bucket which the percentile is in, 0 if empty
+             */
+            uint64_t get_percentile(double percentile) const;
+
+            inline uint64_t get_bucket_count(size_t index) const { return index < BUCKET_COUNT ? buckets[index] : 0; }
+
+            static size_t get_bucket_index(uint64_t usec);
+
+            // the highest value which is recorded into this bucket
+            static uint64_t get_bucket_upper_bound(size_t index);
+
+        HIREDIS_HAPP_PRIVATE:
+            uint64_t buckets[BUCKET_COUNT];
+            uint64_t count;
+            uint64_t sum;
+            uint64_t min_value;
+            uint64_t max_value;
+        };
+
+        /**
+         * @brief counters and latency of cmds, kept by cluster, raw and every connection
+         * @note counters are plain integers updated in the event loop thread, copy it to take a snapshot
+         */
+        struct cmd_stats {
+            enum {
+                // error_code from REDIS_HAPP_UNKNOWD(-1001) to REDIS_HAPP_ABORT(-1011), and all the other errors in 0
+                ERROR_TYPE_COUNT = 12
+            };
+
+            uint64_t sent;       // sent to server, including retries
+            uint64_t replied;    // replies received from server, only in connection
+            uint64_t finished;   // callbacks called, only in cluster and raw
+            uint64_t moved;      // MOVED replies
+            uint64_t ask;        // ASK replies
+            uint64_t retries;    // retries
+            uint64_t reloads;    // slot reloads
+            uint64_t timeouts;   // cmds or connections timeout
+            uint64_t hedges;     // read-only cmds sent again to another node, only in cluster
+            uint64_t hedge_wins; // hedged copies replied first, only in cluster
+            uint64_t errors[ERROR_TYPE_COUNT];
+
+            // in cluster and raw, from first sent to callback. in connection, from sent to reply
+            latency_histogram latency;
+
+            cmd_stats();
+
+            void reset();
+
+            void merge(const cmd_stats &other);
+
+            inline void add_error(int err) { ++errors[get_error_index(err)]; }
+
+            inline uint64_t get_error_count(int err) const { return errors[get_error_index(err)]; }
+
+            static size_t get_error_index(int err);
+
+            /**
+             * @brief get time of a steady clock, it's not affected by system time changing
+             * @return microseconds from an unspecified point
+             */
+            static uint64_t now_usec();
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_STATS_H
@@ -0,0 +1,56 @@
+#ifndef HIREDIS_HAPP_HIREDIS_HAPP_TIMER_HEAP_H
+#define HIREDIS_HAPP_HIREDIS_HAPP_TIMER_HEAP_H
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "config.h"
+
+namespace hiredis {
+    namespace happ {
+        /**
+         * @brief min-heap of timers, the earliest one is at front
+         * @note T must provide operator< which means the timer expires earlier.
+         *       elements are stored in a vector whose capacity is kept after pop and clear,
+         *       so it does not allocate memory for each timer once it's warmed up
+         */
+        template<typename T>
+        class timer_heap {
+        public:
+            typedef T value_type;
+            typedef typename std::vector<T>::size_type size_type;
+
+            inline bool empty() const { return heap.empty(); }
+            inline size_type size() const { return heap.size(); }
+            inline size_type capacity() const { return heap.capacity(); }
+
+            inline const T& front() const { return heap.front(); }
+
+            void push(const T& t) {
+                heap.push_back(t);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+
+            void pop_front() {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                heap.pop_back();
+            }
+
+            inline void clear() { heap.clear(); }
+
+            inline void reserve(size_type s) { heap.reserve(s); }
+
+            // iterate in heap order, not in time order
+            inline const T& operator[](size_type i) const { return heap[i]; }
+
+        private:
+            static bool later(const T& l, const T& r) { return r < l; }
+
+        HIREDIS_HAPP_PRIVATE:
+            std::vector<T> heap;
+        };
+    }
+}
+
+#endif //HIREDIS_HAPP_HIREDIS_HAPP_TIMER_HEAP_H
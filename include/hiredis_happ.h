@@ -8,6 +8,8 @@
 #pragma once
 
 #include "detail/happ_cluster.h"
+#include "detail/happ_cluster_group.h"
 #include "detail/happ_raw.h"
+#include "detail/happ_sentinel.h"
 
 #endif //HIREDIS_HAPP_HIREDIS_HAPP_H
@@ -2,5 +2,6 @@
 #####################################################################
 option(BUILD_SHARED_LIBS "Build shared libraries (DLLs)." OFF)
 option(ENABLE_BOOST_UNIT_TEST "Enable boost unit test." OFF)
+option(ENABLE_BENCHMARK_TEST "Run benchmarks in unit test." OFF)
 
 set(HIREDIS_VERSION "0.13.3" CACHE STRING "hiredis version")
@@ -258,13 +258,12 @@ static void on_timer_proc(
 
         if (is_raw) { // run special command
 
-            const hiredis::happ::cluster::slot_t *slot_info = NULL;
+            int slot_index = -1;
             if (cmds.size() > 1) {
-                slot_info = g_clu.get_slot_by_key(cmds[1].c_str(), cmds[1].size());
-                assert(slot_info);
+                slot_index = hiredis::happ::cluster::get_slot_index(cmds[1].c_str(), cmds[1].size());
             }
 
-            const hiredis::happ::connection::key_t *conn_key = g_clu.get_slot_master(NULL == slot_info ? -1 : slot_info->index);
+            const hiredis::happ::connection::key_t *conn_key = g_clu.get_slot_master(slot_index);
             if (NULL == conn_key) {
                 printf("connection not found.\n");
                 continue;
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <assert.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <detail/happ_cmd.h>
 #include <random>
@@ -34,20 +36,118 @@ namespace hiredis {
             }
 
             static char NONE_MSG[] = "none";
+
+            // find the node whose master is master_name, return nodes.size() if not found
+            static size_t find_slot_node(const std::vector<cluster::slot_t> &nodes, const std::string &master_name) {
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    if (!nodes[i].hosts.empty() && nodes[i].hosts.front().name == master_name) {
+                        return i;
+                    }
+                }
+
+                return nodes.size();
+            }
         } // namespace detail
 
-        cluster::cluster() : slot_flag(slot_status::INVALID) {
+        // all sub commands of a scatter-gather command
+        struct cluster::scatter_t {
+            scatter_type::type type;
+            cmd_t *cmd;      // the one passed to user callback
+            size_t pending;  // running sub commands, and one more before all sub commands are sent
+            int err;         // the first error code of sub commands
+            long long sum;
+            redisReply *error_reply;
+            std::vector<redisReply *> results; // reply of every key
+            std::vector<scatter_group_t> groups;
+        };
+
+        // keys in the same slot, sent in one sub command
+        struct cluster::scatter_group_t {
+            scatter_t *owner;
+            std::vector<size_t> indexes;
+        };
+
+        // cmds added by batch_exec and not finished yet
+        struct cluster::batch_t {
+            cmd_t *cmd;     // the one passed to batch callback
+            size_t pending; // running cmds, and one more before all cmds are sent
+            int err;        // the first error code of cmds
+            bool flushed;
+            std::vector<batch_cmd_t> cmds;
+        };
+
+        // user callback of a cmd in batch
+        struct cluster::batch_cmd_t {
+            batch_t *owner;
+            cmd_t *cmd;
+            cmd_t::callback_fn_t callback;
+            void *pri_data;
+        };
+
+        // cmds sent between MULTI and EXEC
+        struct cluster::transaction_t {
+            cmd_t *cmd; // EXEC, the one passed to user callback
+            cmd_t::callback_fn_t callback;
+            void *pri_data;
+            int slot;   // slot of all keys, -1 if no key
+            int err;    // the first error when cmds are added
+            std::vector<std::string> cmds; // formatted cmds
+            bool asking; // slot is migrating, send it to ask_node with ASKING
+            connection::key_t ask_node;
+        };
+
+        // a read-only cmd which may be sent again to another node of the same slot
+        struct cluster::hedge_t {
+            cmd_t *cmd;     // the one passed to user callback, NULL if finished
+            cmd_t::callback_fn_t callback;
+            void *pri_data;
+            std::string node; // where cmd is sent to
+            size_t refs;      // cmd, and the timer or the hedged copy
+        };
+
+        cluster::cluster() : slot_flag(slot_status::INVALID), read_round_robin(0) {
             conf.log_fn_debug = conf.log_fn_info = NULL;
             conf.log_buffer = NULL;
             conf.log_max_size = 0;
             conf.timer_interval_sec = HIREDIS_HAPP_TIMER_INTERVAL_SEC;
             conf.timer_interval_usec = HIREDIS_HAPP_TIMER_INTERVAL_USEC;
             conf.timer_timeout_sec = HIREDIS_HAPP_TIMER_TIMEOUT_SEC;
+            conf.slot_reload_interval_sec = HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_SEC;
+            conf.slot_reload_interval_usec = HIREDIS_HAPP_SLOT_RELOAD_INTERVAL_USEC;
+            conf.slot_reload_fanout = HIREDIS_HAPP_SLOT_RELOAD_FANOUT;
             conf.cmd_buffer_size = 0;
-
-            for (int i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
-                slots[i].index = i;
-            }
+            conf.cmd_timeout_sec = HIREDIS_HAPP_CMD_TIMEOUT_SEC;
+            conf.cmd_timeout_usec = HIREDIS_HAPP_CMD_TIMEOUT_USEC;
+            conf.read_policy_type = read_policy::MASTER_ONLY;
+            conf.connection_pool_size = 1;
+            conf.connection_pool_busy_pending = HIREDIS_HAPP_CONNECTION_POOL_BUSY_PENDING;
+            conf.connection_pool_policy = pool_policy::LEAST_PENDING;
+            conf.warm_up_policy_type = warm_up_policy::NONE;
+            conf.hedge_percentile = 0;
+            conf.hedge_min_delay_usec = 0;
+
+            warm_up_status.sequence = 0;
+            warm_up_status.pending = 0;
+            warm_up_status.failed = 0;
+
+            resubscribe_status.pending = false;
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+            resubscribe_status.retry_sec = 0;
+            resubscribe_status.retry_usec = 0;
+
+            clear_slots();
+            slot_reload.last_sec = 0;
+            slot_reload.last_usec = 0;
+            slot_reload.delayed = false;
+            slot_reload.reload_count = 0;
+            slot_reload.avoided_count = 0;
+            slot_reload.failed_count = 0;
+            slot_reload.retry_delay = 0;
+            slot_reload.retry_sec = 0;
+            slot_reload.retry_usec = 0;
+            slot_reload.sequence = 0;
+            slot_reload.pending = 0;
 
             memset(&callbacks, 0, sizeof(callbacks));
 
@@ -67,7 +167,25 @@ namespace hiredis {
 
         int cluster::init(const std::string &ip, uint16_t port) {
             connection::set_key(conf.init_connection, ip, port);
+            conf.seeds.clear();
+            conf.seeds.push_back(conf.init_connection);
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int cluster::add_seed(const std::string &ip, uint16_t port) {
+            connection::key_t key;
+            connection::set_key(key, ip, port);
+            for (size_t i = 0; i < conf.seeds.size(); ++i) {
+                if (conf.seeds[i].name == key.name) {
+                    return error_code::REDIS_HAPP_OK;
+                }
+            }
 
+            if (conf.seeds.empty()) {
+                conf.init_connection = key;
+            }
+            conf.seeds.push_back(key);
             return error_code::REDIS_HAPP_OK;
         }
 
@@ -93,8 +211,26 @@ namespace hiredis {
                 connection_map_t::const_iterator it_b = connections.begin();
                 connection_map_t::const_iterator it_e = connections.end();
                 for (; it_b != it_e; ++it_b) {
-                    if (NULL != it_b->second->get_context()) {
-                        all_contexts.push_back(it_b->second->get_context());
+                    for (size_t i = 0; i < it_b->second.conns.size(); ++i) {
+                        if (NULL != it_b->second.conns[i]->get_context()) {
+                            all_contexts.push_back(it_b->second.conns[i]->get_context());
+                        }
+                    }
+                }
+
+                tracking_map_t::const_iterator tracking_b = tracking_conns.begin();
+                tracking_map_t::const_iterator tracking_e = tracking_conns.end();
+                for (; tracking_b != tracking_e; ++tracking_b) {
+                    if (NULL != tracking_b->second.conn->get_context()) {
+                        all_contexts.push_back(tracking_b->second.conn->get_context());
+                    }
+                }
+
+                subscriber_map_t::const_iterator subscriber_b = subscriber_conns.begin();
+                subscriber_map_t::const_iterator subscriber_e = subscriber_conns.end();
+                for (; subscriber_b != subscriber_e; ++subscriber_b) {
+                    if (NULL != subscriber_b->second->get_context()) {
+                        all_contexts.push_back(subscriber_b->second->get_context());
                     }
                 }
             }
@@ -117,10 +253,7 @@ namespace hiredis {
                 destroy_cmd(cmd);
             }
 
-            for (int i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
-                slots[i].hosts.clear();
-            }
-
+            clear_slots();
 
             // release timer pending list
             while (!timer_actions.timer_pending.empty()) {
@@ -131,6 +264,13 @@ namespace hiredis {
                 destroy_cmd(cmd);
             }
 
+            // hedged copies not sent, the original cmds will be finished by their connections
+            while (!timer_actions.timer_hedges.empty()) {
+                hedge_t *h = timer_actions.timer_hedges.front().hedge;
+                timer_actions.timer_hedges.pop_front();
+                release_hedge(h);
+            }
+
             // connection timeout
             // while(!timer_actions.timer_conns.empty()) {
             //    timer_t::conn_timetout_t& conn_expire = timer_actions.timer_conns.front();
@@ -153,6 +293,34 @@ namespace hiredis {
             timer_actions.last_update_sec = 0;
             timer_actions.last_update_usec = 0;
 
+            slot_reload.last_sec = 0;
+            slot_reload.last_usec = 0;
+            slot_reload.delayed = false;
+            slot_reload.failed_count = 0;
+            slot_reload.retry_delay = 0;
+            slot_reload.retry_sec = 0;
+            slot_reload.retry_usec = 0;
+            slot_reload.nodes.clear();
+            slot_reload.failed_nodes.clear();
+            ++slot_reload.sequence;
+            slot_reload.pending = 0;
+
+            // replies of running warm up will be ignored
+            ++warm_up_status.sequence;
+            warm_up_status.pending = 0;
+
+            // no invalidation messages any more
+            reply_cache.clear();
+
+            // all subscriptions are removed
+            subscriptions.clear();
+            subscribe_node.clear();
+            resubscribe_status.pending = false;
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+            resubscribe_status.retry_sec = 0;
+            resubscribe_status.retry_usec = 0;
+
             // If in a callback, cmds in this connection will not finished, so it can not be freed.
             // In this case, it will call disconnect callback after callback is finished and then release the connection.
             // If not in a callback, this connection is already freed at the begining "redisAsyncDisconnect(all_contexts[i]);"
@@ -221,9 +389,16 @@ namespace hiredis {
                 return NULL;
             }
 
+            // already finished by deadline
+            if (cmd->deadline_expired) {
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            add_cmd_deadline(cmd);
+
             // calculate the slot index
             if (NULL != key && 0 != ks) {
-                cmd->engine.slot = static_cast<int>(crc16(key, ks) % HIREDIS_HAPP_SLOT_NUMBER);
+                cmd->engine.slot = get_slot_index(key, ks);
             }
 
             // ttl pre-judge
@@ -234,18 +409,31 @@ namespace hiredis {
                 return NULL;
             }
 
+            // near cache, only the first sending
+            if (HIREDIS_HAPP_TTL == cmd->ttl && reply_cache.is_enabled()) {
+                near_cache::entry_t *cached = reply_cache.acquire(cmd);
+                if (NULL != cached) {
+                    log_debug("cmd %p at slot %d hit near cache", cmd, cmd->engine.slot);
+                    call_cmd(cmd, error_code::REDIS_HAPP_OK, NULL, near_cache::get_reply(cached));
+                    reply_cache.release(cached);
+                    destroy_cmd(cmd);
+                    return NULL;
+                }
+
+                reply_cache.wrap(cmd);
+            }
+
             // update slot
             if (slot_status::INVALID == slot_flag || slot_status::UPDATING == slot_flag) {
                 log_debug("transfer cmd at slot %d to slot update pending list", cmd->engine.slot);
                 slot_pending.push_back(cmd);
 
-                reload_slots();
+                reload_slots_later();
                 return cmd;
             }
 
             // get a connection in the specified slot
-            const connection::key_t *conn_key = get_slot_master(cmd->engine.slot);
-
+            const connection::key_t *conn_key = get_cmd_host(cmd);
             if (NULL == conn_key) {
                 log_info("get connect of slot %d failed", cmd->engine.slot);
                 call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, NULL, NULL);
@@ -254,11 +442,7 @@ namespace hiredis {
             }
 
             // move cmd into connection
-            connection_t *conn_inst = get_connection(conn_key->name);
-            if (NULL == conn_inst) {
-                conn_inst = make_connection(*conn_key);
-            }
-
+            connection_t *conn_inst = get_or_make_connection(*conn_key);
             if (NULL == conn_inst) {
                 log_info("connect to %s failed", conn_key->name.c_str());
 
@@ -268,7 +452,22 @@ namespace hiredis {
                 return NULL;
             }
 
-            return exec(conn_inst, cmd);
+            // tracking connection is lost, make a new one
+            if (reply_cache.is_enabled() && !reply_cache.is_tracked(conn_inst) && tracking_conns.end() == tracking_conns.find(conn_inst->get_key().name)) {
+                make_tracking_connection(conn_inst->get_key());
+            }
+
+            // only the first sending can be hedged
+            if (HIREDIS_HAPP_TTL != cmd->ttl || !is_hedge_cmd(cmd)) {
+                return exec(conn_inst, cmd);
+            }
+
+            std::string node = conn_inst->get_key().name;
+            cmd_t *ret = exec(conn_inst, cmd);
+            if (NULL != ret) {
+                start_hedge(ret, node);
+            }
+            return ret;
         }
 
         cluster::cmd_t *cluster::exec(connection_t *conn, cmd_t *cmd) {
@@ -276,6 +475,13 @@ namespace hiredis {
                 return NULL;
             }
 
+            // already finished by deadline
+            if (cmd->deadline_expired) {
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            add_cmd_deadline(cmd);
+
             // ttl
             if (0 == cmd->ttl) {
                 log_debug("cmd %p at slot %d ttl expired", cmd, cmd->engine.slot);
@@ -284,6 +490,11 @@ namespace hiredis {
                 return NULL;
             }
 
+            // only the first sending adds to retry budget
+            if (HIREDIS_HAPP_TTL == cmd->ttl) {
+                retry_backoff.add_request(timer_actions.last_update_sec);
+            }
+
             // ttl
             --cmd->ttl;
 
@@ -294,7 +505,12 @@ namespace hiredis {
             }
 
             // main loop
-            int res = conn->redis_cmd(cmd, on_reply_wrapper);
+            int res;
+            if (on_reply_transaction == cmd->callback) {
+                res = send_transaction(conn, cmd);
+            } else {
+                res = conn->redis_cmd(cmd, on_reply_wrapper);
+            }
 
             if (REDIS_OK != res) {
                 // some version of hiredis will miss onDisconnect, patch it
@@ -307,7 +523,7 @@ namespace hiredis {
                     // If not in hiredis's callback, REDIS_DISCONNECTING or REDIS_FREEING means resource is freed
                     // If in hiredis's callback, disconnect will be called after callback finished, so do nothing here
                     if (!(conn->get_context()->c.flags & REDIS_IN_CALLBACK)) {
-                        release_connection(conn->get_key(), false, error_code::REDIS_HAPP_CONNECTION);
+                        release_connection(conn, false, error_code::REDIS_HAPP_CONNECTION);
                     }
 
                     // conn = NULL;
@@ -321,6 +537,7 @@ namespace hiredis {
                 return NULL;
             }
 
+            ++stats.sent;
             log_debug("exec cmd %p at slot %d, connection %s", cmd, cmd->engine.slot, conn->get_key().name.c_str());
             return cmd;
         }
@@ -331,7 +548,23 @@ namespace hiredis {
             }
 
             // First, retry immediately for several times.
-            if (false == is_timer_active() || cmd->ttl > HIREDIS_HAPP_TTL / 2) {
+            // If it's still failed, maybe it will take some more time to recover the connection,
+            // so wait for a while and retry again.
+            // And too many retries will make the recovering server even worse.
+            if (false == retry_backoff.retry(timer_actions.last_update_sec, HIREDIS_HAPP_TTL - cmd->ttl, &cmd->retry_delay)) {
+                log_info("cmd %p retry budget exhausted", cmd);
+                call_cmd(cmd, error_code::REDIS_HAPP_RETRY_BUDGET, NULL, NULL);
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            ++stats.retries;
+
+            // retry can not be delayed without timer
+            if (!is_timer_active()) {
+                cmd->retry_delay = 0;
+            }
+
+            if (0 == cmd->retry_delay) {
                 if (NULL == conn) {
                     return exec(NULL, 0, cmd);
                 } else {
@@ -339,649 +572,2722 @@ namespace hiredis {
                 }
             }
 
-            // If it's still failed, maybe it will take some more time to recover the connection,
-            // so wait for a while and retry again.
-            add_timer_cmd(cmd);
+            log_debug("cmd %p will retry after %llu us", cmd, static_cast<unsigned long long>(cmd->retry_delay));
+            add_timer_cmd(cmd, static_cast<time_t>(cmd->retry_delay / 1000000), static_cast<time_t>(cmd->retry_delay % 1000000));
             return cmd;
         }
 
-        bool cluster::reload_slots() {
-            if (slot_status::UPDATING == slot_flag) {
-                return false;
-            }
+        int cluster::mget(size_t count, const char **keys, const size_t *keys_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out) {
+            return scatter("MGET", scatter_type::ARRAY, count, keys, keys_len, NULL, NULL, cbk, priv_data, out);
+        }
 
-            const connection::key_t *conn_key = get_slot_master(-1);
-            if (NULL == conn_key) {
-                return false;
+        int cluster::mset(size_t count, const char **keys, const size_t *keys_len, const char **values, const size_t *values_len,
+                          cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out) {
+            if (NULL == values || NULL == values_len) {
+                if (NULL != out) {
+                    *out = NULL;
+                }
+                return error_code::REDIS_HAPP_PARAM;
             }
 
-            connection_t *conn = get_connection(conn_key->name);
-            if (NULL == conn) {
-                conn = make_connection(*conn_key);
-            }
+            return scatter("MSET", scatter_type::STATUS, count, keys, keys_len, values, values_len, cbk, priv_data, out);
+        }
 
-            if (NULL == conn) {
-                return false;
-            }
+        int cluster::del(size_t count, const char **keys, const size_t *keys_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out) {
+            return scatter("DEL", scatter_type::SUM, count, keys, keys_len, NULL, NULL, cbk, priv_data, out);
+        }
 
-            // CLUSTER SLOTS cmd
-            cmd_t *cmd = create_cmd(on_reply_update_slot, NULL);
-            if (NULL == cmd) {
-                log_info("create cmd CLUSTER SLOTS failed");
-                return false;
+        int cluster::scatter(const char *cmd_name, scatter_type::type t, size_t count, const char **keys, const size_t *keys_len, const char **values,
+                             const size_t *values_len, cmd_t::callback_fn_t cbk, void *priv_data, cmd_t **out) {
+            if (NULL != out) {
+                *out = NULL;
             }
 
-            int len = cmd->format("CLUSTER SLOTS");
-            if (len <= 0) {
-                log_info("format cmd CLUSTER SLOTS failed");
-                destroy_cmd(cmd);
-                return false;
+            if (0 == count || NULL == keys || NULL == keys_len) {
+                return error_code::REDIS_HAPP_PARAM;
             }
 
-            if (NULL != exec(conn, cmd)) {
-                slot_flag = slot_status::UPDATING;
+            cmd_t *cmd = create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return error_code::REDIS_HAPP_CREATE;
             }
+            // only sub cmds are recorded in stats
+            cmd->stats = NULL;
 
-            return true;
-        }
-
-        const connection::key_t *cluster::get_slot_master(int index) {
-            if (index >= 0 && index < HIREDIS_HAPP_SLOT_NUMBER && !slots[index].hosts.empty()) {
-                return &slots[index].hosts.front();
+            // group keys by slot, redis refuses multi-key commands across slots even if they are in the same node
+            std::vector<std::pair<int, size_t> > key_slots;
+            key_slots.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                key_slots.push_back(std::make_pair(get_slot_index(keys[i], keys_len[i]), i));
             }
+            std::sort(key_slots.begin(), key_slots.end());
 
-            // random a address
-            index = (detail::random() & 0xFFFF) % HIREDIS_HAPP_SLOT_NUMBER;
-            if (slots[index].hosts.empty()) {
-                return &conf.init_connection;
+            scatter_t *s = new scatter_t();
+            s->type = t;
+            s->cmd = cmd;
+            s->err = error_code::REDIS_HAPP_OK;
+            s->sum = 0;
+            s->error_reply = NULL;
+            if (scatter_type::ARRAY == t) {
+                s->results.resize(count, NULL);
             }
 
-            return &slots[index].hosts.front();
-        }
-
-        const cluster::slot_t *cluster::get_slot_by_key(const char *key, size_t ks) const {
-            int index = static_cast<int>(crc16(key, ks) % HIREDIS_HAPP_SLOT_NUMBER);
-            return &slots[index];
-        }
+            for (size_t i = 0; i < key_slots.size(); ++i) {
+                if (0 == i || key_slots[i].first != key_slots[i - 1].first) {
+                    s->groups.push_back(scatter_group_t());
+                    s->groups.back().owner = s;
+                }
+                s->groups.back().indexes.push_back(key_slots[i].second);
+            }
+
+            // sub commands may finish in exec, so keep one more pending until all of them are sent
+            s->pending = s->groups.size() + 1;
+            size_t cmd_name_len = strlen(cmd_name);
+            std::vector<const char *> argv;
+            std::vector<size_t> argvlen;
+            for (size_t i = 0; i < s->groups.size(); ++i) {
+                scatter_group_t &group = s->groups[i];
+                argv.clear();
+                argvlen.clear();
+                argv.push_back(cmd_name);
+                argvlen.push_back(cmd_name_len);
+                for (size_t j = 0; j < group.indexes.size(); ++j) {
+                    argv.push_back(keys[group.indexes[j]]);
+                    argvlen.push_back(keys_len[group.indexes[j]]);
+                    if (NULL != values) {
+                        argv.push_back(values[group.indexes[j]]);
+                        argvlen.push_back(values_len[group.indexes[j]]);
+                    }
+                }
 
-        const cluster::connection_t *cluster::get_connection(const std::string &key) const {
-            connection_map_t::const_iterator it = connections.find(key);
-            if (it == connections.end()) {
-                return NULL;
-            }
+                cmd_t *sub_cmd = create_cmd(on_reply_scatter, &group);
+                if (NULL == sub_cmd || sub_cmd->vformat(static_cast<int>(argv.size()), &argv[0], &argvlen[0]) <= 0) {
+                    log_info("format cmd %s with argc=%d failed", cmd_name, static_cast<int>(argv.size()));
+                    if (NULL != sub_cmd) {
+                        sub_cmd->callback = NULL;
+                        destroy_cmd(sub_cmd);
+                    }
 
-            return it->second.get();
-        }
+                    s->err = error_code::REDIS_HAPP_CREATE;
+                    finish_scatter(s);
+                    continue;
+                }
 
-        cluster::connection_t *cluster::get_connection(const std::string &key) {
-            connection_map_t::iterator it = connections.find(key);
-            if (it == connections.end()) {
-                return NULL;
+                // exec will call on_reply_scatter if failed
+                size_t first = group.indexes.front();
+                exec(keys[first], keys_len[first], sub_cmd);
             }
 
-            return it->second.get();
-        }
-
-        const cluster::connection_t *cluster::get_connection(const std::string &ip, uint16_t port) const {
-            return get_connection(connection::make_name(ip, port));
-        }
-
-        cluster::connection_t *cluster::get_connection(const std::string &ip, uint16_t port) { return get_connection(connection::make_name(ip, port)); }
-
-        cluster::connection_t *cluster::make_connection(const connection::key_t &key) {
-            holder_t h;
-            connection_map_t::iterator check_it = connections.find(key.name);
-            if (check_it != connections.end()) {
-                log_debug("connection %s already exists", key.name.c_str());
-                return NULL;
+            // all sub commands finished in exec, cbk is called here
+            if (1 == s->pending) {
+                finish_scatter(s);
+                return error_code::REDIS_HAPP_OK;
             }
 
-            redisAsyncContext *c = redisAsyncConnect(key.ip.c_str(), static_cast<int>(key.port));
-            if (NULL == c || c->err) {
-                log_info("redis connect to %s failed, msg: %s", key.name.c_str(), NULL == c ? detail::NONE_MSG : c->errstr);
-                return NULL;
+            --s->pending;
+            if (NULL != out) {
+                *out = cmd;
             }
+            return error_code::REDIS_HAPP_OK;
+        }
 
-            h.clu = this;
-            redisAsyncSetConnectCallback(c, on_connected_wrapper);
-            redisAsyncSetDisconnectCallback(c, on_disconnected_wrapper);
-            redisEnableKeepAlive(&c->c);
-            if (conf.timer_timeout_sec > 0) {
-                struct timeval tv;
-                tv.tv_sec = conf.timer_timeout_sec;
-                tv.tv_usec = 0;
-                redisSetTimeout(&c->c, tv);
+        void cluster::finish_scatter(scatter_t *s) {
+            if (NULL == s || 0 == s->pending) {
+                return;
             }
 
-            ::hiredis::happ::unique_ptr<connection_t>::type ret_ptr(new connection_t());
-            connection_t &ret = *ret_ptr;
-            ::hiredis::happ::unique_ptr<connection_t>::swap(connections[key.name], ret_ptr);
-            ret.init(h, key);
-            ret.set_connecting(c);
-
-            c->data = &ret;
-
-            // timeout timer
-            if (conf.timer_timeout_sec > 0 && is_timer_active()) {
-                timer_actions.timer_conns.push_back(timer_t::conn_timetout_t());
-                timer_t::conn_timetout_t &conn_expire = timer_actions.timer_conns.back();
-                conn_expire.name = key.name;
-                conn_expire.sequence = ret.get_sequence();
-                conn_expire.timeout = timer_actions.last_update_sec + conf.timer_timeout_sec;
+            if (--s->pending > 0) {
+                return;
             }
 
-            // auth command
-            if (auth.auth_fn || !auth.password.empty()) {
-                // AUTH cmd
-                cmd_t *cmd = create_cmd(on_reply_auth, NULL);
-                if (NULL != cmd) {
-                    int len = 0;
-                    if (auth.auth_fn) {
-                        const std::string &passwd = auth.auth_fn(&ret, auth.password);
-                        len = cmd->format("AUTH %b", passwd.c_str(), passwd.size());
-                    } else if (!auth.password.empty()) {
-                        len = cmd->format("AUTH %b", auth.password.c_str(), auth.password.size());
+            redisReply *reply = NULL;
+            switch (s->type) {
+            case scatter_type::ARRAY: {
+                reply = cmd_t::clone_reply(NULL);
+                if (NULL != reply) {
+                    reply->type = REDIS_REPLY_ARRAY;
+                    reply->element = reinterpret_cast<redisReply **>(calloc(s->results.size(), sizeof(redisReply *)));
+                    if (NULL != reply->element) {
+                        reply->elements = s->results.size();
+                        for (size_t i = 0; i < s->results.size(); ++i) {
+                            // keys whose sub command failed are nil
+                            reply->element[i] = NULL == s->results[i] ? cmd_t::clone_reply(NULL) : s->results[i];
+                            s->results[i] = NULL;
+                        }
                     }
+                }
+                break;
+            }
 
-                    if (len <= 0) {
-                        log_info("format cmd AUTH failed");
-                        destroy_cmd(cmd);
-                        return NULL;
+            case scatter_type::SUM: {
+                if (NULL != s->error_reply) {
+                    reply = s->error_reply;
+                    s->error_reply = NULL;
+                } else {
+                    reply = cmd_t::clone_reply(NULL);
+                    if (NULL != reply) {
+                        reply->type = REDIS_REPLY_INTEGER;
+                        reply->integer = s->sum;
                     }
-
-                    exec(&ret, cmd);
                 }
+                break;
             }
 
-            // event callback must be call at the last
-            if (callbacks.on_connect) {
-                callbacks.on_connect(this, &ret);
+            default: {
+                if (NULL != s->error_reply) {
+                    reply = s->error_reply;
+                    s->error_reply = NULL;
+                } else {
+                    redisReply ok;
+                    memset(&ok, 0, sizeof(ok));
+                    ok.type = REDIS_REPLY_STATUS;
+                    ok.str = const_cast<char *>("OK");
+                    ok.len = 2;
+                    reply = cmd_t::clone_reply(&ok);
+                }
+                break;
+            }
             }
 
-            log_debug("redis make connection to %s ", key.name.c_str());
-            return &ret;
+            call_cmd(s->cmd, s->err, NULL, reply);
+            destroy_cmd(s->cmd);
+
+            cmd_t::free_reply(reply);
+            cmd_t::free_reply(s->error_reply);
+            for (size_t i = 0; i < s->results.size(); ++i) {
+                cmd_t::free_reply(s->results[i]);
+            }
+            delete s;
         }
 
-        bool cluster::release_connection(const connection::key_t &key, bool close_fd, int status) {
-            connection_map_t::iterator it = connections.find(key.name);
-            if (connections.end() == it) {
-                log_debug("connection %s not found", key.name.c_str());
-                return false;
+        void cluster::on_reply_scatter(cmd_exec *cmd, redisAsyncContext *, void *r, void *privdata) {
+            scatter_group_t *group = reinterpret_cast<scatter_group_t *>(privdata);
+            scatter_t *s = group->owner;
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+
+            if (error_code::REDIS_HAPP_OK != cmd->result() && error_code::REDIS_HAPP_OK == s->err) {
+                s->err = cmd->result();
             }
 
-            connection_t::status::type from_status = it->second->set_disconnected(close_fd);
-            switch (from_status) {
-            // recursion, exit
-            case connection_t::status::DISCONNECTED:
-                return true;
+            if (NULL != reply && REDIS_REPLY_ERROR == reply->type && NULL == s->error_reply) {
+                s->error_reply = cmd_t::clone_reply(reply);
+            }
 
-            // connecting, call on_connected event
-            case connection_t::status::CONNECTING:
-                if (callbacks.on_connected) {
-                    callbacks.on_connected(this, it->second.get(), it->second->get_context(),
-                                           error_code::REDIS_HAPP_OK == status ? error_code::REDIS_HAPP_CONNECTION : status);
+            if (NULL != reply) {
+                switch (s->type) {
+                case scatter_type::ARRAY: {
+                    for (size_t i = 0; i < group->indexes.size(); ++i) {
+                        if (REDIS_REPLY_ARRAY == reply->type && i < reply->elements) {
+                            s->results[group->indexes[i]] = cmd_t::clone_reply(reply->element[i]);
+                        } else if (REDIS_REPLY_ERROR == reply->type) {
+                            s->results[group->indexes[i]] = cmd_t::clone_reply(reply);
+                        }
+                    }
+                    break;
                 }
-                break;
 
-            // connecting, call on_disconnected event
-            case connection_t::status::CONNECTED:
-                if (callbacks.on_disconnected) {
-                    callbacks.on_disconnected(this, it->second.get(), it->second->get_context(), status);
+                case scatter_type::SUM: {
+                    if (REDIS_REPLY_INTEGER == reply->type) {
+                        s->sum += reply->integer;
+                    }
+                    break;
                 }
-                break;
 
-            default:
-                log_info("unknown connection status %d", static_cast<int>(from_status));
-                break;
+                default:
+                    break;
+                }
             }
 
-            log_debug("release connection %s", key.name.c_str());
-
-            // can not use key any more
-            connections.erase(it);
-
-            return true;
+            cmd->holder.clu->finish_scatter(s);
         }
 
-        cluster::onconnect_fn_t cluster::set_on_connect(onconnect_fn_t cbk) {
-            using std::swap;
-            swap(cbk, callbacks.on_connect);
-            return cbk;
-        }
+        cluster::batch_t *cluster::create_batch(cmd_t::callback_fn_t cbk, void *priv_data) {
+            cmd_t *cmd = create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
+            // only sub cmds are recorded in stats
+            cmd->stats = NULL;
 
-        cluster::onconnected_fn_t cluster::set_on_connected(onconnected_fn_t cbk) {
-            using std::swap;
-            swap(cbk, callbacks.on_connected);
-            return cbk;
+            batch_t *ret = new batch_t();
+            ret->cmd = cmd;
+            ret->pending = 0;
+            ret->err = error_code::REDIS_HAPP_OK;
+            ret->flushed = false;
+            return ret;
         }
 
-        cluster::ondisconnected_fn_t cluster::set_on_disconnected(ondisconnected_fn_t cbk) {
-            using std::swap;
-            swap(cbk, callbacks.on_disconnected);
-            return cbk;
-        }
+        cluster::cmd_t *cluster::batch_exec(batch_t *b, const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, int argc,
+                                            const char **argv, const size_t *argvlen) {
+            if (NULL == b || b->flushed) {
+                log_info("can not add cmd into a flushed batch");
+                return NULL;
+            }
 
-        void cluster::set_cmd_buffer_size(size_t s) { conf.cmd_buffer_size = s; }
+            cmd_t *cmd = create_cmd(on_reply_batch, NULL);
+            if (NULL == cmd) {
+                return NULL;
+            }
 
-        size_t cluster::get_cmd_buffer_size() const { return conf.cmd_buffer_size; }
+            int len = cmd->vformat(argc, argv, argvlen);
+            if (len <= 0) {
+                log_info("format cmd with argc=%d failed", argc);
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                return NULL;
+            }
 
-        bool cluster::is_timer_active() const {
-            return (timer_actions.last_update_sec != 0 || timer_actions.last_update_usec != 0) && (conf.timer_interval_sec > 0 || conf.timer_interval_usec > 0);
-        }
+            if (NULL != key && 0 != ks) {
+                cmd->engine.slot = get_slot_index(key, ks);
+            }
 
-        void cluster::set_timer_interval(time_t sec, time_t usec) {
-            conf.timer_interval_sec = sec;
-            conf.timer_interval_usec = usec;
+            b->cmds.push_back(batch_cmd_t());
+            batch_cmd_t &bc = b->cmds.back();
+            bc.owner = b;
+            bc.cmd = cmd;
+            bc.callback = cbk;
+            bc.pri_data = priv_data;
+            return cmd;
         }
 
-        void cluster::set_timeout(time_t sec) { conf.timer_timeout_sec = sec; }
+        cluster::cmd_t *cluster::batch_exec(batch_t *b, const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...) {
+            if (NULL == b || b->flushed) {
+                log_info("can not add cmd into a flushed batch");
+                return NULL;
+            }
 
-        void cluster::add_timer_cmd(cmd_t *cmd) {
+            cmd_t *cmd = create_cmd(on_reply_batch, NULL);
             if (NULL == cmd) {
-                return;
+                return NULL;
             }
 
-            if (is_timer_active()) {
-                timer_actions.timer_pending.push_back(timer_t::delay_t());
-                timer_t::delay_t &d = timer_actions.timer_pending.back();
-                d.sec = timer_actions.last_update_sec + conf.timer_interval_sec;
-                d.usec = timer_actions.last_update_usec + conf.timer_interval_usec;
-                d.cmd = cmd;
-            } else {
-                exec(NULL, 0, cmd);
+            va_list ap;
+            va_start(ap, fmt);
+            int len = cmd->vformat(fmt, ap);
+            va_end(ap);
+            if (len <= 0) {
+                log_info("format cmd with format=%s failed", fmt);
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                return NULL;
+            }
+
+            if (NULL != key && 0 != ks) {
+                cmd->engine.slot = get_slot_index(key, ks);
             }
+
+            b->cmds.push_back(batch_cmd_t());
+            batch_cmd_t &bc = b->cmds.back();
+            bc.owner = b;
+            bc.cmd = cmd;
+            bc.callback = cbk;
+            bc.pri_data = priv_data;
+            return cmd;
         }
 
-        int cluster::proc(time_t sec, time_t usec) {
-            int ret = 0;
+        size_t cluster::flush_batch(batch_t *b) {
+            if (NULL == b || b->flushed) {
+                return 0;
+            }
 
-            timer_actions.last_update_sec = sec;
-            timer_actions.last_update_usec = usec;
+            // cmds can not be added any more, so the address of batch_cmd_t will not change
+            b->flushed = true;
+            b->pending = b->cmds.size() + 1;
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                b->cmds[i].cmd->pri_data = &b->cmds[i];
+            }
+            size_t ret = b->cmds.size();
 
-            while (!timer_actions.timer_pending.empty()) {
-                timer_t::delay_t &rd = timer_actions.timer_pending.front();
-                if (rd.sec > sec || (rd.sec == sec && rd.usec > usec)) {
-                    break;
+            if (slot_status::OK != slot_flag) {
+                // all cmds will be sent after slots reloaded
+                for (size_t i = 0; i < b->cmds.size(); ++i) {
+                    exec(NULL, 0, b->cmds[i].cmd);
                 }
 
+                finish_batch(b);
+                return ret;
+            }
 
-                timer_t::delay_t d = rd;
-                timer_actions.timer_pending.pop_front();
+            // group cmds by host, and keep the order of cmds to the same host
+            typedef std::pair<const connection::key_t *, std::vector<cmd_t *> > host_cmds_t;
+            std::vector<host_cmds_t> groups;
+            HIREDIS_HAPP_MAP(std::string, size_t) group_index;
+            std::vector<cmd_t *> all_cmds;
+            all_cmds.reserve(b->cmds.size());
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                all_cmds.push_back(b->cmds[i].cmd);
+            }
 
-                exec(NULL, 0, d.cmd);
+            for (size_t i = 0; i < all_cmds.size(); ++i) {
+                const connection::key_t *host = get_cmd_host(all_cmds[i]);
+                if (NULL == host) {
+                    // exec will find no host and call the callback
+                    exec(NULL, 0, all_cmds[i]);
+                    continue;
+                }
 
-                ++ret;
+                HIREDIS_HAPP_MAP(std::string, size_t)::iterator iter = group_index.find(host->name);
+                if (group_index.end() == iter) {
+                    group_index[host->name] = groups.size();
+                    groups.push_back(host_cmds_t(host, std::vector<cmd_t *>()));
+                    groups.back().second.push_back(all_cmds[i]);
+                } else {
+                    groups[iter->second].second.push_back(all_cmds[i]);
+                }
             }
 
-            // connection timeout
-            // this can not be call in callback
-            while (!timer_actions.timer_conns.empty() && sec >= timer_actions.timer_conns.front().timeout) {
-                timer_t::conn_timetout_t &conn_expire = timer_actions.timer_conns.front();
-
-                connection_t *conn = get_connection(conn_expire.name);
-                if (NULL != conn && conn->get_sequence() == conn_expire.sequence) {
-                    assert(!(conn->get_context()->c.flags & REDIS_IN_CALLBACK));
-                    release_connection(conn->get_key(), true, error_code::REDIS_HAPP_TIMEOUT);
+            for (size_t i = 0; i < groups.size(); ++i) {
+                std::vector<cmd_t *> &cmds = groups[i].second;
+                connection_t *conn = get_or_make_connection(*groups[i].first);
+                if (NULL == conn) {
+                    for (size_t j = 0; j < cmds.size(); ++j) {
+                        exec(NULL, 0, cmds[j]);
+                    }
+                    continue;
                 }
 
-                timer_actions.timer_conns.pop_front();
+                // connection may be released when sending cmd, check it by name and sequence
+                std::string name = conn->get_key().name;
+                uint64_t sequence = conn->get_sequence();
+                for (size_t j = 0; j < cmds.size(); ++j) {
+                    if (NULL != conn && conn != find_connection(name, sequence)) {
+                        conn = NULL;
+                    }
+
+                    if (NULL == conn) {
+                        exec(NULL, 0, cmds[j]);
+                    } else {
+                        exec(conn, cmds[j]);
+                    }
+                }
             }
 
+            finish_batch(b);
             return ret;
         }
 
-        cluster::cmd_t *cluster::create_cmd(cmd_t::callback_fn_t cbk, void *pridata) {
-            holder_t h;
-            h.clu = this;
-            cmd_t *ret = cmd_t::create(h, cbk, pridata, conf.cmd_buffer_size);
-            return ret;
+        int cluster::abort_batch(batch_t *b) {
+            if (NULL == b || b->flushed) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            b->flushed = true;
+            b->pending = b->cmds.size() + 1;
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                b->cmds[i].cmd->pri_data = &b->cmds[i];
+            }
+
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                call_cmd(b->cmds[i].cmd, error_code::REDIS_HAPP_ABORT, NULL, NULL);
+                destroy_cmd(b->cmds[i].cmd);
+            }
+
+            b->err = error_code::REDIS_HAPP_ABORT;
+            finish_batch(b);
+            return error_code::REDIS_HAPP_OK;
         }
 
-        void cluster::destroy_cmd(cmd_t *c) {
-            if (NULL == c) {
-                log_debug("can not destroy null cmd");
+        void cluster::finish_batch(batch_t *b) {
+            if (NULL == b || 0 == b->pending) {
                 return;
             }
 
-            // lost connection
-            if (NULL != c->callback) {
-                call_cmd(c, error_code::REDIS_HAPP_UNKNOWD, NULL, NULL);
+            if (--b->pending > 0) {
+                return;
             }
 
-            cmd_t::destroy(c);
+            call_cmd(b->cmd, b->err, NULL, NULL);
+            destroy_cmd(b->cmd);
+            delete b;
         }
 
-        int cluster::call_cmd(cmd_t *c, int err, redisAsyncContext *context, void *reply) {
-            if (NULL == c) {
-                log_debug("can not call cmd without cmd object");
-                return error_code::REDIS_HAPP_UNKNOWD;
+        void cluster::on_reply_batch(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            batch_cmd_t *bc = reinterpret_cast<batch_cmd_t *>(privdata);
+            batch_t *b = bc->owner;
+
+            if (error_code::REDIS_HAPP_OK != cmd->result() && error_code::REDIS_HAPP_OK == b->err) {
+                b->err = cmd->result();
             }
 
-            return c->call_reply(err, context, reply);
+            // user callback and private data of this cmd
+            cmd->pri_data = bc->pri_data;
+            if (NULL != bc->callback) {
+                bc->callback(cmd, c, r, bc->pri_data);
+            }
+
+            cmd->holder.clu->finish_batch(b);
         }
 
-        void cluster::set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size) {
-            using std::swap;
-            conf.log_fn_info = info_fn;
-            conf.log_fn_debug = debug_fn;
-            conf.log_max_size = max_size;
+        cluster::transaction_t *cluster::create_transaction(cmd_t::callback_fn_t cbk, void *priv_data) {
+            transaction_t *ret = new transaction_t();
+            cmd_t *cmd = create_cmd(on_reply_transaction, ret);
+            if (NULL == cmd) {
+                delete ret;
+                return NULL;
+            }
 
-            if (NULL != conf.log_buffer) {
-                free(conf.log_buffer);
-                conf.log_buffer = NULL;
+            if (cmd->format("EXEC") <= 0) {
+                log_info("format cmd EXEC failed");
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                delete ret;
+                return NULL;
             }
+
+            ret->cmd = cmd;
+            ret->callback = cbk;
+            ret->pri_data = priv_data;
+            ret->slot = -1;
+            ret->err = error_code::REDIS_HAPP_OK;
+            ret->asking = false;
+            return ret;
         }
 
-        void cluster::on_reply_wrapper(redisAsyncContext *c, void *r, void *privdata) {
-            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
-            cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
-            cluster *self = cmd->holder.clu;
+        int cluster::check_transaction_slot(transaction_t *t, const char *key, size_t ks) {
+            if (NULL == key || 0 == ks) {
+                return error_code::REDIS_HAPP_OK;
+            }
 
-            // retry if disconnecting will lead to a infinite loop
-            if (c->c.flags & REDIS_DISCONNECTING) {
-                self->log_debug("redis cmd %p reply when disconnecting context err %d,msg %s", cmd, c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
-                cmd->err = error_code::REDIS_HAPP_CONNECTION;
-                conn->call_reply(cmd, r);
-                return;
+            int slot = get_slot_index(key, ks);
+            if (t->slot >= 0 && t->slot != slot) {
+                log_info("transaction cmd at slot %d, expect slot: %d", slot, t->slot);
+                t->err = error_code::REDIS_HAPP_SLOT_UNAVAILABLE;
+                return t->err;
             }
 
-            if (REDIS_ERR_IO == c->err && REDIS_ERR_EOF == c->err) {
-                self->log_debug("redis cmd %p reply context err %d and will retry, %s", cmd, c->err, c->errstr);
-                // retry if it's a network error
-                conn->pop_reply(cmd);
-                self->retry(cmd);
-                return;
+            t->slot = slot;
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int cluster::transaction_exec(transaction_t *t, const char *key, size_t ks, int argc, const char **argv, const size_t *argvlen) {
+            if (NULL == t) {
+                return error_code::REDIS_HAPP_PARAM;
             }
 
-            if (REDIS_OK != c->err || NULL == r) {
-                self->log_debug("redis cmd %p reply context err %d and abort, %s", cmd, c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
-                // other errors will be passed to caller
-                conn->call_reply(cmd, r);
-                return;
+            if (error_code::REDIS_HAPP_OK != check_transaction_slot(t, key, ks)) {
+                return t->err;
+            }
+
+            char *content = NULL;
+            int len = redisFormatCommandArgv(&content, argc, argv, argvlen);
+            if (len <= 0 || NULL == content) {
+                log_info("format cmd with argc=%d failed", argc);
+                t->err = error_code::REDIS_HAPP_PARAM;
+                return t->err;
+            }
+
+            t->cmds.push_back(std::string(content, static_cast<size_t>(len)));
+            redisFreeCommand(content);
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int cluster::transaction_exec(transaction_t *t, const char *key, size_t ks, const char *fmt, ...) {
+            if (NULL == t) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            if (error_code::REDIS_HAPP_OK != check_transaction_slot(t, key, ks)) {
+                return t->err;
+            }
+
+            char *content = NULL;
+            va_list ap;
+            va_start(ap, fmt);
+            int len = redisvFormatCommand(&content, fmt, ap);
+            va_end(ap);
+            if (len <= 0 || NULL == content) {
+                log_info("format cmd with format=%s failed", fmt);
+                t->err = error_code::REDIS_HAPP_PARAM;
+                return t->err;
+            }
+
+            t->cmds.push_back(std::string(content, static_cast<size_t>(len)));
+            redisFreeCommand(content);
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        cluster::cmd_t *cluster::flush_transaction(transaction_t *t) {
+            if (NULL == t) {
+                return NULL;
+            }
+
+            // t is destroyed in callback
+            cmd_t *cmd = t->cmd;
+            if (error_code::REDIS_HAPP_OK != t->err || t->cmds.empty()) {
+                log_info("transaction with %d cmds can not be sent, err: %d", static_cast<int>(t->cmds.size()), t->err);
+                call_cmd(cmd, error_code::REDIS_HAPP_OK == t->err ? error_code::REDIS_HAPP_PARAM : t->err, NULL, NULL);
+                destroy_cmd(cmd);
+                return NULL;
+            }
+
+            // EXEC is routed by slot, and MULTI and queued cmds are always sent with it
+            cmd->engine.slot = t->slot;
+            return exec(NULL, 0, cmd);
+        }
+
+        int cluster::send_transaction(connection_t *conn, cmd_t *cmd) {
+            transaction_t *t = reinterpret_cast<transaction_t *>(cmd->pri_data);
+            redisAsyncContext *c = conn->get_context();
+            if (NULL == c) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
+
+            // MULTI, queued cmds and EXEC are appended into the output buffer one after another, and written together
+            // MOVED or ASK of queued cmds is marked in cmd->err, and EXEC will be aborted by server
+            cmd->err = error_code::REDIS_HAPP_OK;
+            int res = REDIS_OK;
+
+            // ASKING is kept by server until EXEC if it's sent before MULTI, so all queued cmds can be run on the importing node
+            if (t->asking) {
+                t->asking = false;
+                res = redisAsyncCommand(c, on_reply_transaction_part, cmd, "ASKING");
+            }
+
+            if (REDIS_OK == res) {
+                res = redisAsyncCommand(c, on_reply_transaction_part, cmd, "MULTI");
+            }
+            if (REDIS_OK != res) {
+                return res;
+            }
+
+            for (size_t i = 0; REDIS_OK == res && i < t->cmds.size(); ++i) {
+                res = redisAsyncFormattedCommand(c, on_reply_transaction_part, cmd, t->cmds[i].c_str(), t->cmds[i].size());
+            }
+
+            if (REDIS_OK == res) {
+                res = conn->redis_cmd(cmd, on_reply_wrapper);
+            }
+
+            // MULTI is already in the output buffer, do not leave the connection in a transaction
+            if (REDIS_OK != res) {
+                redisAsyncCommand(c, NULL, NULL, "DISCARD");
+            }
+
+            return res;
+        }
+
+        void cluster::on_reply_transaction(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            transaction_t *t = reinterpret_cast<transaction_t *>(privdata);
+
+            // user callback and private data
+            cmd->pri_data = t->pri_data;
+            if (NULL != t->callback) {
+                t->callback(cmd, c, r, t->pri_data);
             }
 
+            delete t;
+        }
+
+        void cluster::on_reply_transaction_part(redisAsyncContext *c, void *r, void *privdata) {
             redisReply *reply = reinterpret_cast<redisReply *>(r);
 
-            // error handler
-            if (REDIS_REPLY_ERROR == reply->type) {
+            // EXEC will be finished with the same error if the connection is lost.
+            // If disconnecting, EXEC will not be sent again and may be already finished, so cmd can not be used
+            if (NULL == reply || REDIS_REPLY_ERROR != reply->type || NULL == reply->str || (c->c.flags & REDIS_DISCONNECTING)) {
+                return;
+            }
+
+            cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
+            cluster *self = cmd->holder.clu;
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+
+            // EXEC finished by deadline is released when its reply comes back, but transaction_t is already deleted
+            // and pri_data is the user's one, so only slots are updated
+            bool finished = cmd->deadline_expired || on_reply_transaction != cmd->callback;
+
+            if (0 == HIREDIS_HAPP_STRNCASE_CMP("MOVED", reply->str, 5)) {
+                self->log_debug("redis transaction %p %s", cmd, reply->str);
+                ++self->stats.moved;
+                ++conn->get_stats().moved;
+
                 int slot_index = 0;
                 char addr[260] = {0};
+                HIREDIS_HAPP_SSCANF(reply->str + 6, " %d %s", &slot_index, addr);
 
-                // detect MOVED,ASK and CLUSTERDOWN
-                if (0 == HIREDIS_HAPP_STRNCASE_CMP("ASK", reply->str, 3)) {
-                    self->log_debug("redis cmd %p %s", cmd, reply->str);
-                    // send ASK to another connection
-                    HIREDIS_HAPP_SSCANF(reply->str + 4, " %d %s", &slot_index, addr);
-                    std::string ip;
-                    uint16_t port;
+                std::string ip;
+                uint16_t port;
+                if (slot_index >= 0 && slot_index < HIREDIS_HAPP_SLOT_NUMBER && connection::pick_name(addr, ip, port)) {
+                    self->move_slot(slot_index, ip, port);
+                } else {
+                    self->slot_flag = slot_status::INVALID;
+                }
+
+                // migration is finished, it's sent to the new master by slots
+                if (!finished) {
+                    reinterpret_cast<transaction_t *>(cmd->pri_data)->asking = false;
+                    cmd->err = error_code::REDIS_HAPP_SLOT_UNAVAILABLE;
+                }
+            } else if (0 == HIREDIS_HAPP_STRNCASE_CMP("ASK", reply->str, 3)) {
+                // slot is migrating, the whole transaction is sent to the importing node with ASKING after EXECABORT
+                self->log_debug("redis transaction %p %s", cmd, reply->str);
+                ++self->stats.ask;
+                ++conn->get_stats().ask;
+
+                int slot_index = 0;
+                char addr[260] = {0};
+                HIREDIS_HAPP_SSCANF(reply->str + 4, " %d %s", &slot_index, addr);
+
+                std::string ip;
+                uint16_t port;
+                if (!finished) {
+                    transaction_t *t = reinterpret_cast<transaction_t *>(cmd->pri_data);
                     if (connection::pick_name(addr, ip, port)) {
-                        connection::key_t conn_key;
-                        connection::set_key(conn_key, ip, port);
+                        connection::set_key(t->ask_node, ip, port);
+                        t->asking = true;
+                    }
+                    cmd->err = error_code::REDIS_HAPP_SLOT_UNAVAILABLE;
+                }
+            } else {
+                self->log_debug("redis transaction %p queue cmd failed, msg: %s", cmd, reply->str);
+            }
+        }
 
-                        // ASKING request
-                        connection_t *ask_conn = self->get_connection(conn_key.name);
-                        if (NULL == ask_conn) {
-                            ask_conn = self->make_connection(conn_key);
-                        }
+        const std::string &cluster::register_script(const std::string &body) {
+            // connections made later load it in make_connection, and the existing ones load it when NOSCRIPT is replied
+            return scripts.add(body);
+        }
 
-                        // pop from old connection, and run it
-                        conn->pop_reply(cmd);
+        cluster::cmd_t *cluster::eval_script(const char *key, size_t ks, const std::string &sha1, cmd_t::callback_fn_t cbk, void *priv_data, int argc,
+                                             const char **argv, const size_t *argvlen) {
+            cmd_t *cmd = create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
 
-                        if (NULL != ask_conn) {
-                            if (REDIS_OK == redisAsyncCommand(ask_conn->get_context(), on_reply_asking, cmd, "ASKING")) {
-                                return;
-                            }
-                        }
+            if (script_registry::format_eval(cmd, sha1, argc, argv, argvlen) <= 0) {
+                log_info("format cmd EVALSHA with argc=%d failed", argc);
+                destroy_cmd(cmd);
+                return NULL;
+            }
 
-                        // retry if ASK failed
-                        self->retry(cmd);
-                        return;
-                    }
-                } else if (0 == HIREDIS_HAPP_STRNCASE_CMP("MOVED", reply->str, 5)) {
-                    self->log_debug("redis cmd %p %s", cmd, reply->str);
+            return exec(key, ks, cmd);
+        }
 
-                    HIREDIS_HAPP_SSCANF(reply->str + 6, " %d %s", &slot_index, addr);
+        bool cluster::is_hedge_cmd(cmd_t *cmd) {
+            if (conf.hedge_percentile <= 0 || read_policy::MASTER_ONLY == conf.read_policy_type || !is_timer_active()) {
+                return false;
+            }
 
-                    if (cmd->engine.slot >= 0 && cmd->engine.slot != slot_index) {
-                        self->log_info("cluster cmd key error, expect slot: %d, real slot: %d", cmd->engine.slot, slot_index);
-                        cmd->engine.slot = slot_index;
+            if (NULL == cmd->callback || on_reply_hedge == cmd->callback || !cmd->is_readonly()) {
+                return false;
+            }
+
+            const slot_t *node = get_slot_node(cmd->engine.slot);
+            return NULL != node && node->hosts.size() > 1;
+        }
+
+        void cluster::start_hedge(cmd_t *cmd, const std::string &node) {
+            hedge_t *h = new hedge_t();
+            h->cmd = cmd;
+            h->callback = cmd->callback;
+            h->pri_data = cmd->pri_data;
+            h->node = node;
+            h->refs = 2;
+
+            cmd->callback = on_reply_hedge;
+            cmd->pri_data = h;
+
+            // slow cmds in the tail of latency, but not less than the min delay
+            uint64_t delay = stats.latency.get_percentile(conf.hedge_percentile);
+            if (delay < conf.hedge_min_delay_usec) {
+                delay = conf.hedge_min_delay_usec;
+            }
+
+            timer_t::hedge_delay_t d;
+            d.sec = timer_actions.last_update_sec + static_cast<time_t>(delay / 1000000);
+            d.usec = timer_actions.last_update_usec + static_cast<time_t>(delay % 1000000);
+            if (d.usec >= 1000000) {
+                d.sec += d.usec / 1000000;
+                d.usec %= 1000000;
+            }
+            d.hedge = h;
+            timer_actions.timer_hedges.push(d);
+        }
+
+        void cluster::send_hedge(hedge_t *h) {
+            // already finished, just release the reference of timer
+            if (NULL == h->cmd) {
+                release_hedge(h);
+                return;
+            }
+
+            const slot_t *node = get_slot_node(h->cmd->engine.slot);
+            std::vector<const connection::key_t *> candidates;
+            if (NULL != node) {
+                for (size_t i = 0; i < node->hosts.size(); ++i) {
+                    if (node->hosts[i].name != h->node) {
+                        candidates.push_back(&node->hosts[i]);
                     }
+                }
+            }
+
+            if (candidates.empty()) {
+                release_hedge(h);
+                return;
+            }
+
+            connection::key_t key = *candidates[static_cast<size_t>(detail::random() & 0xFFFF) % candidates.size()];
+            connection_t *conn = get_or_make_connection(key);
+            if (NULL == conn) {
+                release_hedge(h);
+                return;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_hedge, h);
+            if (NULL == cmd) {
+                release_hedge(h);
+                return;
+            }
+
+            if (cmd->copy_from(h->cmd) <= 0) {
+                log_info("copy cmd %p for hedging failed", h->cmd);
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                release_hedge(h);
+                return;
+            }
+
+            // the hedged copy is sent only once and not recorded, the original one is still running
+            cmd->stats = NULL;
+            cmd->ttl = 1;
+            cmd->engine.slot = h->cmd->engine.slot;
+            ++stats.hedges;
+
+            log_debug("hedge cmd %p by %p at connection %s", h->cmd, cmd, key.name.c_str());
+
+            // the reference of timer is passed to the hedged copy, on_reply_hedge is already called if failed
+            exec(conn, cmd);
+        }
+
+        void cluster::release_hedge(hedge_t *h) {
+            if (NULL != h && 0 == --h->refs) {
+                delete h;
+            }
+        }
+
+        void cluster::on_reply_hedge(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            hedge_t *h = reinterpret_cast<hedge_t *>(privdata);
+            cluster *self = cmd->holder.clu;
+            cmd_t::callback_fn_t callback = h->callback;
+            void *pri_data = h->pri_data;
+
+            // the original one finished first, successful or not
+            if (cmd == h->cmd) {
+                h->cmd = NULL;
+                self->release_hedge(h);
+
+                cmd->pri_data = pri_data;
+                if (NULL != callback) {
+                    callback(cmd, c, r, pri_data);
+                }
+                return;
+            }
+
+            // the hedged copy failed, or the original one already finished
+            cmd_t *origin = h->cmd;
+            if (NULL == origin || error_code::REDIS_HAPP_OK != cmd->result() || NULL == r) {
+                self->release_hedge(h);
+                return;
+            }
+
+            // the hedged copy wins, pass its reply by the original one.
+            // the original one will not be sent again, and its reply will be dropped by call_reply because callback is already cleared
+            ++self->stats.hedge_wins;
+            h->cmd = NULL;
+            self->release_hedge(h);
+            self->release_hedge(h);
+
+            cmd_timer_wheel::remove(origin);
+            origin->deadline_expired = true;
+            origin->callback = callback;
+            origin->pri_data = pri_data;
+            self->call_cmd(origin, cmd->result(), c, r);
+        }
+
+        bool cluster::reload_slots() {
+            // single flight, cmds waiting for slots will be sent after the running one finished
+            if (slot_status::UPDATING == slot_flag) {
+                ++slot_reload.avoided_count;
+                return false;
+            }
+
+            slot_reload.delayed = false;
+            slot_reload.last_sec = timer_actions.last_update_sec;
+            slot_reload.last_usec = timer_actions.last_update_usec;
+
+            std::vector<const connection::key_t *> nodes;
+            get_slot_reload_nodes(nodes, conf.slot_reload_fanout);
+
+            // all queries of one round share a sequence, the first valid reply wins and the others are ignored
+            ++slot_reload.sequence;
+            // guard, the reload will not fail until all queries are sent
+            slot_reload.pending = nodes.size() + 1;
+            slot_flag = slot_status::UPDATING;
+
+            ++slot_reload.reload_count;
+            ++stats.reloads;
+
+            // the keys may be removed from slot nodes when making connection failed, so copy them first
+            std::vector<connection::key_t> keys;
+            keys.reserve(nodes.size());
+            slot_reload.nodes.clear();
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                keys.push_back(*nodes[i]);
+                slot_reload.nodes.push_back(nodes[i]->name);
+            }
+
+            for (size_t i = 0; i < keys.size(); ++i) {
+                send_slot_reload(keys[i]);
+            }
+
+            on_slot_reload_query_failed();
+            return slot_status::UPDATING == slot_flag;
+        }
+
+        void cluster::get_slot_reload_nodes(std::vector<const connection::key_t *> &out, size_t count) {
+            // spread reloads into all nodes, replicas can also reply CLUSTER SLOTS.
+            // nodes failed since the last successful reload are skipped, unless all of them failed
+            std::vector<const connection::key_t *> candidates;
+            for (int pass = 0; pass < 2 && candidates.empty(); ++pass) {
+                bool skip_failed = 0 == pass;
+                for (size_t i = 0; i < slot_nodes.size(); ++i) {
+                    for (size_t j = 0; j < slot_nodes[i].hosts.size(); ++j) {
+                        if (!skip_failed || 0 == slot_reload.failed_nodes.count(slot_nodes[i].hosts[j].name)) {
+                            candidates.push_back(&slot_nodes[i].hosts[j]);
+                        }
+                    }
+                }
+
+                // seeds, used when cluster nodes are not loaded or all changed
+                size_t known_count = candidates.size();
+                for (size_t i = 0; i < conf.seeds.size(); ++i) {
+                    if (skip_failed && 0 != slot_reload.failed_nodes.count(conf.seeds[i].name)) {
+                        continue;
+                    }
+
+                    bool found = false;
+                    for (size_t j = 0; false == found && j < known_count; ++j) {
+                        found = candidates[j]->name == conf.seeds[i].name;
+                    }
+
+                    if (false == found) {
+                        candidates.push_back(&conf.seeds[i]);
+                    }
+                }
+            }
+
+            if (candidates.empty()) {
+                candidates.push_back(&conf.init_connection);
+            }
+
+            // partial shuffle, so the nodes are different from each other
+            if (count <= 0) {
+                count = 1;
+            }
+            for (size_t i = 0; i < count && i < candidates.size(); ++i) {
+                size_t j = i + static_cast<size_t>(detail::random() & 0xFFFF) % (candidates.size() - i);
+                std::swap(candidates[i], candidates[j]);
+                out.push_back(candidates[i]);
+            }
+        }
+
+        bool cluster::send_slot_reload(const connection::key_t &key) {
+            connection_t *conn = get_connection(key.name);
+            if (NULL == conn) {
+                conn = make_connection(key);
+            }
+
+            if (NULL == conn) {
+                on_slot_reload_query_failed();
+                return false;
+            }
+
+            // CLUSTER SLOTS cmd
+            cmd_t *cmd = create_cmd(on_reply_update_slot, reinterpret_cast<void *>(slot_reload.sequence));
+            if (NULL == cmd) {
+                log_info("create cmd CLUSTER SLOTS failed");
+                on_slot_reload_query_failed();
+                return false;
+            }
+
+            int len = cmd->format("CLUSTER SLOTS");
+            if (len <= 0) {
+                log_info("format cmd CLUSTER SLOTS failed");
+                destroy_cmd(cmd);
+                on_slot_reload_query_failed();
+                return false;
+            }
+
+            // send only once, the failed one will be sent again to another node after backoff
+            cmd->ttl = 1;
+
+            // on_reply_update_slot is already called if failed
+            return NULL != exec(conn, cmd);
+        }
+
+        void cluster::on_slot_reload_query_failed() {
+            // wait for other queries of this round
+            if (slot_reload.pending > 1) {
+                --slot_reload.pending;
+                return;
+            }
+
+            // this round is over
+            ++slot_reload.sequence;
+            slot_reload.pending = 0;
+            on_slot_reload_failed();
+        }
+
+        void cluster::on_slot_reload_failed() {
+            slot_flag = slot_status::INVALID;
+            // a round fails only if all queries of it failed
+            slot_reload.failed_nodes.insert(slot_reload.nodes.begin(), slot_reload.nodes.end());
+            ++slot_reload.failed_count;
+
+            // backoff, it's also limited by slot reload interval
+            slot_reload.retry_delay = retry_backoff.next_delay(slot_reload.failed_count, slot_reload.retry_delay);
+            slot_reload.retry_sec = timer_actions.last_update_sec + static_cast<time_t>(slot_reload.retry_delay / 1000000);
+            slot_reload.retry_usec = timer_actions.last_update_usec + static_cast<time_t>(slot_reload.retry_delay % 1000000);
+            if (slot_reload.retry_usec >= 1000000) {
+                slot_reload.retry_sec += slot_reload.retry_usec / 1000000;
+                slot_reload.retry_usec %= 1000000;
+            }
+
+            // too many failures, cmds waiting for slots can not wait any more
+            if (slot_reload.failed_count >= HIREDIS_HAPP_TTL) {
+                log_info("update slots failed for %d times", static_cast<int>(slot_reload.failed_count));
+                slot_reload.failed_count = 0;
+
+                std::list<cmd_t *> pending_cmds;
+                pending_cmds.swap(slot_pending);
+                while (!pending_cmds.empty()) {
+                    cmd_t *cmd = pending_cmds.front();
+                    pending_cmds.pop_front();
+
+                    call_cmd(cmd, error_code::REDIS_HAPP_SLOT_UNAVAILABLE, NULL, NULL);
+                    destroy_cmd(cmd);
+                }
+            }
+
+            // cmds are waiting, so reload again in proc. or it will be reloaded by the next cmd
+            if (!slot_pending.empty()) {
+                log_info("update slots failed and will retry after %llu us.", static_cast<unsigned long long>(slot_reload.retry_delay));
+                slot_reload.delayed = true;
+            } else {
+                log_info("update slots failed and will retry later.");
+            }
+        }
+
+        bool cluster::reload_slots_later() {
+            // a reloading is running, the slots will be refreshed after it finished
+            if (slot_status::UPDATING == slot_flag) {
+                ++slot_reload.avoided_count;
+                return false;
+            }
+
+            if (false == is_slot_reload_interval_passed()) {
+                ++slot_reload.avoided_count;
+                slot_reload.delayed = true;
+                return false;
+            }
+
+            return reload_slots();
+        }
+
+        bool cluster::is_slot_reload_interval_passed() const {
+            // can not delay without timer
+            if (false == is_timer_active()) {
+                return true;
+            }
+
+            // backoff after failure
+            if (timer_actions.last_update_sec < slot_reload.retry_sec ||
+                (timer_actions.last_update_sec == slot_reload.retry_sec && timer_actions.last_update_usec < slot_reload.retry_usec)) {
+                return false;
+            }
+
+            if (0 == slot_reload.last_sec && 0 == slot_reload.last_usec) {
+                return true;
+            }
+
+            time_t passed_sec = timer_actions.last_update_sec - slot_reload.last_sec;
+            time_t passed_usec = timer_actions.last_update_usec - slot_reload.last_usec;
+            if (passed_usec < 0) {
+                passed_usec += 1000000;
+                --passed_sec;
+            }
+
+            if (passed_sec != conf.slot_reload_interval_sec) {
+                return passed_sec > conf.slot_reload_interval_sec;
+            }
+
+            return passed_usec >= conf.slot_reload_interval_usec;
+        }
+
+        void cluster::set_slot_reload_interval(time_t sec, time_t usec) {
+            conf.slot_reload_interval_sec = sec;
+            conf.slot_reload_interval_usec = usec;
+        }
+
+        void cluster::set_slot_reload_fanout(size_t n) { conf.slot_reload_fanout = n > 0 ? n : 1; }
+
+        void cluster::set_hedge_policy(double percentile, time_t min_sec, time_t min_usec) {
+            conf.hedge_percentile = percentile > 100 ? 100 : percentile;
+            conf.hedge_min_delay_usec = static_cast<uint64_t>(min_sec) * 1000000 + static_cast<uint64_t>(min_usec);
+        }
+
+        void cluster::set_near_cache(size_t max_memory) {
+            reply_cache.set_max_memory(max_memory);
+            if (!reply_cache.is_enabled()) {
+                return;
+            }
+
+            // connections already created
+            std::vector<connection_t *> all_conns;
+            for (connection_map_t::iterator it = connections.begin(); it != connections.end(); ++it) {
+                for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                    all_conns.push_back(it->second.conns[i].get());
+                }
+            }
+
+            for (size_t i = 0; i < all_conns.size(); ++i) {
+                if (!reply_cache.is_tracked(all_conns[i])) {
+                    start_tracking(all_conns[i]);
+                }
+            }
+        }
+
+        const connection::key_t *cluster::get_slot_master(int index) {
+            const slot_t *node = get_slot_node(index);
+            if (NULL != node && !node->hosts.empty()) {
+                return &node->hosts.front();
+            }
+
+            // random a address
+            index = (detail::random() & 0xFFFF) % HIREDIS_HAPP_SLOT_NUMBER;
+            node = get_slot_node(index);
+            if (NULL == node || node->hosts.empty()) {
+                if (conf.seeds.empty()) {
+                    return &conf.init_connection;
+                }
+
+                return &conf.seeds[static_cast<size_t>(detail::random() & 0xFFFF) % conf.seeds.size()];
+            }
+
+            return &node->hosts.front();
+        }
+
+        const connection::key_t *cluster::get_cmd_host(cmd_t *cmd) {
+            // read-only cmds may be sent to replicas
+            if (read_policy::MASTER_ONLY != conf.read_policy_type && cmd->is_readonly()) {
+                return get_slot_reader(cmd->engine.slot);
+            }
+
+            return get_slot_master(cmd->engine.slot);
+        }
+
+        const connection::key_t *cluster::get_slot_reader(int index) {
+            const slot_t *node = get_slot_node(index);
+            if (read_policy::MASTER_ONLY == conf.read_policy_type || NULL == node || node->hosts.size() <= 1) {
+                return get_slot_master(index);
+            }
+
+            switch (conf.read_policy_type) {
+            case read_policy::PREFER_REPLICA: {
+                size_t replica_count = node->hosts.size() - 1;
+                return &node->hosts[1 + static_cast<size_t>(detail::random() & 0xFFFF) % replica_count];
+            }
+
+            case read_policy::ROUND_ROBIN: {
+                return &node->hosts[(read_round_robin++) % node->hosts.size()];
+            }
+
+            case read_policy::LEAST_PENDING: {
+                // replicas first, then master
+                const connection::key_t *ret = NULL;
+                size_t min_pending = 0;
+                for (size_t i = 1; i <= node->hosts.size(); ++i) {
+                    const connection::key_t &host = node->hosts[i % node->hosts.size()];
+                    const connection_t *conn = static_cast<const cluster *>(this)->get_connection(host.name);
+                    size_t pending = NULL == conn ? 0 : conn->get_pending_count();
+                    if (NULL == ret || pending < min_pending) {
+                        ret = &host;
+                        min_pending = pending;
+                    }
+                }
+
+                return ret;
+            }
+
+            default:
+                return &node->hosts.front();
+            }
+        }
+
+        void cluster::set_read_policy(read_policy::type p) {
+            read_policy::type old_policy = conf.read_policy_type;
+            conf.read_policy_type = p;
+
+            // connections made before should also be able to serve read-only commands
+            if (read_policy::MASTER_ONLY == old_policy && read_policy::MASTER_ONLY != p) {
+                std::vector<connection_t *> all_conns;
+                for (connection_map_t::iterator it = connections.begin(); it != connections.end(); ++it) {
+                    for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                        all_conns.push_back(it->second.conns[i].get());
+                    }
+                }
+
+                for (size_t i = 0; i < all_conns.size(); ++i) {
+                    send_readonly(all_conns[i]);
+                }
+            }
+        }
+
+        const cluster::slot_t *cluster::get_slot_by_key(const char *key, size_t ks) const {
+            return get_slot_node(get_slot_index(key, ks));
+        }
+
+        int cluster::get_slot_index(const char *key, size_t ks) {
+            if (NULL == key || 0 == ks) {
+                return -1;
+            }
+
+            // only the part between the first { and the first } after it will be hashed if it's not empty
+            // @see http://redis.io/topics/cluster-spec
+            const char *tag_begin = reinterpret_cast<const char *>(memchr(key, '{', ks));
+            if (NULL != tag_begin) {
+                ++tag_begin;
+                size_t left = ks - static_cast<size_t>(tag_begin - key);
+                const char *tag_end = reinterpret_cast<const char *>(memchr(tag_begin, '}', left));
+                if (NULL != tag_end && tag_end != tag_begin) {
+                    key = tag_begin;
+                    ks = static_cast<size_t>(tag_end - tag_begin);
+                }
+            }
+
+            return static_cast<int>(crc16(key, ks) & (HIREDIS_HAPP_SLOT_NUMBER - 1));
+        }
+
+        const cluster::connection_t *cluster::get_connection(const std::string &key) const {
+            connection_map_t::const_iterator it = connections.find(key);
+            if (it == connections.end() || it->second.conns.empty()) {
+                return NULL;
+            }
+
+            // round robin index can not be changed here, so always use the one with the least pending cmds
+            const std::vector<connection_ptr_t> &conns = it->second.conns;
+            const connection_t *ret = conns[0].get();
+            for (size_t i = 1; i < conns.size(); ++i) {
+                if (conns[i]->get_pending_count() < ret->get_pending_count()) {
+                    ret = conns[i].get();
+                }
+            }
+
+            return ret;
+        }
+
+        cluster::connection_t *cluster::get_connection(const std::string &key) {
+            connection_map_t::iterator it = connections.find(key);
+            if (it == connections.end() || it->second.conns.empty()) {
+                return NULL;
+            }
+
+            std::vector<connection_ptr_t> &conns = it->second.conns;
+            if (pool_policy::ROUND_ROBIN == conf.connection_pool_policy) {
+                return conns[(it->second.round_robin++) % conns.size()].get();
+            }
+
+            connection_t *ret = conns[0].get();
+            for (size_t i = 1; i < conns.size() && ret->get_pending_count() > 0; ++i) {
+                if (conns[i]->get_pending_count() < ret->get_pending_count()) {
+                    ret = conns[i].get();
+                }
+            }
+
+            return ret;
+        }
+
+        cluster::connection_t *cluster::find_connection(const std::string &key, uint64_t sequence) {
+            connection_map_t::iterator it = connections.find(key);
+            if (it == connections.end()) {
+                return NULL;
+            }
+
+            for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                if (it->second.conns[i]->get_sequence() == sequence) {
+                    return it->second.conns[i].get();
+                }
+            }
+
+            return NULL;
+        }
+
+        const cluster::connection_t *cluster::get_connection(const std::string &ip, uint16_t port) const {
+            return get_connection(connection::make_name(ip, port));
+        }
+
+        cluster::connection_t *cluster::get_connection(const std::string &ip, uint16_t port) { return get_connection(connection::make_name(ip, port)); }
+
+        cluster::connection_t *cluster::make_connection(const connection::key_t &key) {
+            holder_t h;
+            connection_map_t::iterator check_it = connections.find(key.name);
+            if (check_it != connections.end() && check_it->second.conns.size() >= conf.connection_pool_size) {
+                log_debug("connection %s already exists", key.name.c_str());
+                return NULL;
+            }
+
+            redisAsyncContext *c = redisAsyncConnect(key.ip.c_str(), static_cast<int>(key.port));
+            if (NULL == c || c->err) {
+                log_info("redis connect to %s failed, msg: %s", key.name.c_str(), NULL == c ? detail::NONE_MSG : c->errstr);
+                return NULL;
+            }
+
+            h.clu = this;
+            redisAsyncSetConnectCallback(c, on_connected_wrapper);
+            redisAsyncSetDisconnectCallback(c, on_disconnected_wrapper);
+            redisEnableKeepAlive(&c->c);
+            if (conf.timer_timeout_sec > 0) {
+                struct timeval tv;
+                tv.tv_sec = conf.timer_timeout_sec;
+                tv.tv_usec = 0;
+                redisSetTimeout(&c->c, tv);
+            }
+
+            connection_ptr_t ret_ptr(new connection_t());
+            connection_t &ret = *ret_ptr;
+            std::vector<connection_ptr_t> &pool_conns = connections[key.name].conns;
+            pool_conns.push_back(connection_ptr_t());
+            ::hiredis::happ::unique_ptr<connection_t>::swap(pool_conns.back(), ret_ptr);
+            ret.init(h, key);
+            ret.set_connecting(c);
+
+            c->data = &ret;
+
+            // timeout timer
+            if (conf.timer_timeout_sec > 0 && is_timer_active()) {
+                timer_t::conn_timetout_t conn_expire;
+                conn_expire.name = key.name;
+                conn_expire.sequence = ret.get_sequence();
+                conn_expire.timeout = timer_actions.last_update_sec + conf.timer_timeout_sec;
+                timer_actions.timer_conns.push(conn_expire);
+            }
+
+            // auth command
+            if (!send_auth(&ret)) {
+                return NULL;
+            }
+
+            // replicas only serve read-only commands after READONLY
+            if (read_policy::MASTER_ONLY != conf.read_policy_type) {
+                send_readonly(&ret);
+            }
+
+            if (reply_cache.is_enabled()) {
+                start_tracking(&ret);
+            }
+
+            // EVALSHA will not get NOSCRIPT in this connection unless the script cache is flushed
+            for (script_registry::script_map_t::const_iterator iter = scripts.get_scripts().begin(); iter != scripts.get_scripts().end(); ++iter) {
+                send_script_load(&ret, iter->second);
+            }
+
+            // event callback must be call at the last
+            if (callbacks.on_connect) {
+                callbacks.on_connect(this, &ret);
+            }
+
+            log_debug("redis make connection to %s ", key.name.c_str());
+            return &ret;
+        }
+
+        cluster::connection_t *cluster::get_or_make_connection(const connection::key_t &key) {
+            connection_t *ret = get_connection(key.name);
+            if (NULL == ret) {
+                return make_connection(key);
+            }
+
+            connection_map_t::iterator it = connections.find(key.name);
+            if (it->second.conns.size() >= conf.connection_pool_size) {
+                return ret;
+            }
+
+            // make a new one only if all connections are busy
+            for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                if (it->second.conns[i]->get_pending_count() < conf.connection_pool_busy_pending) {
+                    return ret;
+                }
+            }
+
+            connection_t *new_conn = make_connection(key);
+            return NULL == new_conn ? ret : new_conn;
+        }
+
+        bool cluster::release_connection(const connection::key_t &key, bool close_fd, int status) {
+            connection_map_t::iterator it = connections.find(key.name);
+            if (connections.end() == it) {
+                log_debug("connection %s not found", key.name.c_str());
+                return false;
+            }
+
+            // the pool may be changed in callbacks, so copy all connections first
+            std::vector<connection_t *> pool_conns;
+            pool_conns.reserve(it->second.conns.size());
+            for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                pool_conns.push_back(it->second.conns[i].get());
+            }
+
+            for (size_t i = 0; i < pool_conns.size(); ++i) {
+                release_connection(pool_conns[i], close_fd, status);
+            }
+
+            return true;
+        }
+
+        bool cluster::release_connection(connection_t *conn, bool close_fd, int status) {
+            if (NULL == conn) {
+                return false;
+            }
+
+            // copy the name, conn will be destroyed later
+            std::string name = conn->get_key().name;
+            tracking_map_t::iterator tracking_it = tracking_conns.find(name);
+            bool is_tracking = tracking_conns.end() != tracking_it && tracking_it->second.conn.get() == conn;
+            subscriber_map_t::iterator subscriber_it = subscriber_conns.find(name);
+            bool is_subscriber = subscriber_conns.end() != subscriber_it && subscriber_it->second.get() == conn;
+            connection_map_t::iterator it = connections.find(name);
+            if (!is_tracking && !is_subscriber && connections.end() == it) {
+                log_debug("connection %s not found", name.c_str());
+                return false;
+            }
+
+            reply_cache.set_tracked(conn, false);
+
+            connection_t::status::type from_status = conn->set_disconnected(close_fd);
+            switch (from_status) {
+            // recursion, exit
+            case connection_t::status::DISCONNECTED:
+                return true;
+
+            // connecting, call on_connected event
+            case connection_t::status::CONNECTING:
+                if (callbacks.on_connected) {
+                    callbacks.on_connected(this, conn, conn->get_context(), error_code::REDIS_HAPP_OK == status ? error_code::REDIS_HAPP_CONNECTION : status);
+                }
+                break;
+
+            // connecting, call on_disconnected event
+            case connection_t::status::CONNECTED:
+                if (callbacks.on_disconnected) {
+                    callbacks.on_disconnected(this, conn, conn->get_context(), status);
+                }
+                break;
+
+            default:
+                log_info("unknown connection status %d", static_cast<int>(from_status));
+                break;
+            }
+
+            log_debug("release connection %s", name.c_str());
+
+            if (is_tracking) {
+                release_tracking_connection(name, conn);
+                return true;
+            }
+
+            if (is_subscriber) {
+                release_subscriber_connection(name, conn);
+                return true;
+            }
+
+            // connections may be changed in callbacks, find it again
+            it = connections.find(name);
+            if (connections.end() == it) {
+                return true;
+            }
+
+            std::vector<connection_ptr_t> &pool_conns = it->second.conns;
+            for (size_t i = 0; i < pool_conns.size(); ++i) {
+                if (pool_conns[i].get() == conn) {
+                    // can not use conn any more
+                    if (i + 1 != pool_conns.size()) {
+                        ::hiredis::happ::unique_ptr<connection_t>::swap(pool_conns[i], pool_conns.back());
+                    }
+                    pool_conns.pop_back();
+                    break;
+                }
+            }
+
+            if (pool_conns.empty()) {
+                connections.erase(it);
+            }
+
+            return true;
+        }
+
+        void cluster::set_connection_pool_size(size_t s) { conf.connection_pool_size = s > 0 ? s : 1; }
+
+        void cluster::set_connection_pool_busy_pending(size_t n) { conf.connection_pool_busy_pending = n; }
+
+        void cluster::set_connection_pool_policy(pool_policy::type p) { conf.connection_pool_policy = p; }
+
+        cluster::onconnect_fn_t cluster::set_on_connect(onconnect_fn_t cbk) {
+            using std::swap;
+            swap(cbk, callbacks.on_connect);
+            return cbk;
+        }
+
+        cluster::onconnected_fn_t cluster::set_on_connected(onconnected_fn_t cbk) {
+            using std::swap;
+            swap(cbk, callbacks.on_connected);
+            return cbk;
+        }
+
+        cluster::ondisconnected_fn_t cluster::set_on_disconnected(ondisconnected_fn_t cbk) {
+            using std::swap;
+            swap(cbk, callbacks.on_disconnected);
+            return cbk;
+        }
+
+        cluster::onready_fn_t cluster::set_on_ready(onready_fn_t cbk) {
+            using std::swap;
+            swap(cbk, callbacks.on_ready);
+            return cbk;
+        }
+
+        cluster::onslotupdate_fn_t cluster::set_on_slot_update(onslotupdate_fn_t cbk) {
+            using std::swap;
+            swap(cbk, callbacks.on_slot_update);
+            return cbk;
+        }
+
+        void cluster::set_warm_up_policy(warm_up_policy::type p) { conf.warm_up_policy_type = p; }
+
+        void cluster::set_cmd_buffer_size(size_t s) {
+            conf.cmd_buffer_size = s;
+            cmd_cache.set_buffer_size(s);
+        }
+
+        size_t cluster::get_cmd_buffer_size() const { return conf.cmd_buffer_size; }
+
+        void cluster::set_cmd_pool_watermark(size_t low, size_t high) { cmd_cache.set_watermark(low, high); }
+
+        void cluster::reset_stats() {
+            stats.reset();
+            for (connection_map_t::iterator it = connections.begin(); it != connections.end(); ++it) {
+                for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                    it->second.conns[i]->get_stats().reset();
+                }
+            }
+        }
+
+        bool cluster::get_node_stats(const std::string &name, cmd_stats &out) const {
+            connection_map_t::const_iterator it = connections.find(name);
+            if (it == connections.end() || it->second.conns.empty()) {
+                return false;
+            }
+
+            for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                out.merge(it->second.conns[i]->get_stats());
+            }
+            return true;
+        }
+
+        bool cluster::is_timer_active() const {
+            return (timer_actions.last_update_sec != 0 || timer_actions.last_update_usec != 0) && (conf.timer_interval_sec > 0 || conf.timer_interval_usec > 0);
+        }
+
+        void cluster::set_timer_interval(time_t sec, time_t usec) {
+            conf.timer_interval_sec = sec;
+            conf.timer_interval_usec = usec;
+        }
+
+        void cluster::set_timeout(time_t sec) { conf.timer_timeout_sec = sec; }
+
+        void cluster::set_cmd_timeout(time_t sec, time_t usec) {
+            conf.cmd_timeout_sec = sec;
+            conf.cmd_timeout_usec = usec;
+        }
+
+        bool cluster::set_cmd_deadline(cmd_t *cmd, time_t sec, time_t usec) {
+            return is_timer_active() && cmd_deadlines.set_timeout(cmd, timer_actions.last_update_sec, timer_actions.last_update_usec, sec, usec);
+        }
+
+        void cluster::add_cmd_deadline(cmd_t *cmd) {
+            if (is_timer_active()) {
+                cmd_deadlines.add_timeout(cmd, timer_actions.last_update_sec, timer_actions.last_update_usec, conf.cmd_timeout_sec, conf.cmd_timeout_usec);
+            }
+        }
+
+        void cluster::add_timer_cmd(cmd_t *cmd) { add_timer_cmd(cmd, conf.timer_interval_sec, conf.timer_interval_usec); }
+
+        void cluster::add_timer_cmd(cmd_t *cmd, time_t sec, time_t usec) {
+            if (NULL == cmd) {
+                return;
+            }
+
+            if (is_timer_active()) {
+                timer_t::delay_t d;
+                d.sec = timer_actions.last_update_sec + sec;
+                d.usec = timer_actions.last_update_usec + usec;
+                if (d.usec >= 1000000) {
+                    d.sec += d.usec / 1000000;
+                    d.usec %= 1000000;
+                }
+                d.cmd = cmd;
+                timer_actions.timer_pending.push(d);
+            } else {
+                exec(NULL, 0, cmd);
+            }
+        }
+
+        int cluster::proc(time_t sec, time_t usec) {
+            int ret = 0;
+
+            timer_actions.last_update_sec = sec;
+            timer_actions.last_update_usec = usec;
+
+            // release cached cmds not used recently
+            cmd_cache.trim(sec);
+
+            // cmds reach deadline, they will be destroyed when hiredis give them back
+            if (cmd_deadlines.size() > 0) {
+                std::vector<cmd_t *> expired_cmds;
+                cmd_deadlines.expire(sec, usec, expired_cmds);
+                for (size_t i = 0; i < expired_cmds.size(); ++i) {
+                    log_debug("cmd %p reach deadline", expired_cmds[i]);
+                    ++stats.timeouts;
+                    expired_cmds[i]->deadline_expired = true;
+                    call_cmd(expired_cmds[i], error_code::REDIS_HAPP_TIMEOUT, NULL, NULL);
+                    ++ret;
+                }
+            }
+
+            while (!timer_actions.timer_pending.empty()) {
+                const timer_t::delay_t &rd = timer_actions.timer_pending.front();
+                if (rd.sec > sec || (rd.sec == sec && rd.usec > usec)) {
+                    break;
+                }
+
+
+                timer_t::delay_t d = rd;
+                timer_actions.timer_pending.pop_front();
+
+                exec(NULL, 0, d.cmd);
+
+                ++ret;
+            }
+
+            // read-only cmds not replied for a while
+            while (!timer_actions.timer_hedges.empty()) {
+                const timer_t::hedge_delay_t &hd = timer_actions.timer_hedges.front();
+                if (hd.sec > sec || (hd.sec == sec && hd.usec > usec)) {
+                    break;
+                }
+
+                hedge_t *h = hd.hedge;
+                timer_actions.timer_hedges.pop_front();
+
+                send_hedge(h);
+                ++ret;
+            }
+
+            // subscriptions lost with their connections, stop after too many rounds without any reply
+            if (resubscribe_status.pending && resubscribe_status.times < HIREDIS_HAPP_RESUBSCRIBE_TIMES &&
+                (sec > resubscribe_status.retry_sec || (sec == resubscribe_status.retry_sec && usec >= resubscribe_status.retry_usec))) {
+                resubscribe();
+            }
+
+            // connection timeout
+            // this can not be call in callback
+            while (!timer_actions.timer_conns.empty() && sec >= timer_actions.timer_conns.front().timeout) {
+                // callbacks may add new connections into the heap, so pop it first
+                timer_t::conn_timetout_t conn_expire = timer_actions.timer_conns.front();
+                timer_actions.timer_conns.pop_front();
+
+                connection_t *conn = find_connection(conn_expire.name, conn_expire.sequence);
+                if (NULL != conn) {
+                    assert(!(conn->get_context()->c.flags & REDIS_IN_CALLBACK));
+                    ++stats.timeouts;
+                    release_connection(conn, true, error_code::REDIS_HAPP_TIMEOUT);
+                }
+            }
+
+            // delayed slot reload
+            if (slot_reload.delayed && slot_status::UPDATING != slot_flag && is_slot_reload_interval_passed()) {
+                slot_reload.delayed = false;
+                reload_slots();
+            }
+
+            return ret;
+        }
+
+        cluster::cmd_t *cluster::create_cmd(cmd_t::callback_fn_t cbk, void *pridata) {
+            holder_t h;
+            h.clu = this;
+            cmd_t *ret = cmd_t::create(h, cbk, pridata, conf.cmd_buffer_size, &cmd_cache);
+            if (NULL != ret) {
+                ret->stats = &stats;
+            }
+            return ret;
+        }
+
+        void cluster::destroy_cmd(cmd_t *c) {
+            if (NULL == c) {
+                log_debug("can not destroy null cmd");
+                return;
+            }
+
+            // lost connection
+            if (NULL != c->callback) {
+                call_cmd(c, error_code::REDIS_HAPP_UNKNOWD, NULL, NULL);
+            }
+
+            cmd_t::destroy(c);
+        }
+
+        int cluster::call_cmd(cmd_t *c, int err, redisAsyncContext *context, void *reply) {
+            if (NULL == c) {
+                log_debug("can not call cmd without cmd object");
+                return error_code::REDIS_HAPP_UNKNOWD;
+            }
+
+            return c->call_reply(err, context, reply);
+        }
+
+        void cluster::set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size) {
+            using std::swap;
+            conf.log_fn_info = info_fn;
+            conf.log_fn_debug = debug_fn;
+            conf.log_max_size = max_size;
+
+            if (NULL != conf.log_buffer) {
+                free(conf.log_buffer);
+                conf.log_buffer = NULL;
+            }
+        }
+
+        void cluster::on_reply_wrapper(redisAsyncContext *c, void *r, void *privdata) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
+            cluster *self = cmd->holder.clu;
+
+            // callback is already called when reach deadline, just release it
+            if (cmd->deadline_expired) {
+                conn->call_reply(cmd, r);
+                return;
+            }
+
+            // retry if disconnecting will lead to a infinite loop
+            if (c->c.flags & REDIS_DISCONNECTING) {
+                self->log_debug("redis cmd %p reply when disconnecting context err %d,msg %s", cmd, c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
+                cmd->err = error_code::REDIS_HAPP_CONNECTION;
+                conn->call_reply(cmd, r);
+                return;
+            }
+
+            if (REDIS_ERR_IO == c->err && REDIS_ERR_EOF == c->err) {
+                self->log_debug("redis cmd %p reply context err %d and will retry, %s", cmd, c->err, c->errstr);
+                // retry if it's a network error
+                conn->pop_reply(cmd);
+                self->retry(cmd);
+                return;
+            }
+
+            if (REDIS_OK != c->err || NULL == r) {
+                self->log_debug("redis cmd %p reply context err %d and abort, %s", cmd, c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
+                // other errors will be passed to caller
+                conn->call_reply(cmd, r);
+                return;
+            }
+
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+
+            // error handler
+            if (REDIS_REPLY_ERROR == reply->type) {
+                int slot_index = 0;
+                char addr[260] = {0};
+
+                // queued cmds of transaction are redirected, send the whole transaction again
+                if (on_reply_transaction == cmd->callback && error_code::REDIS_HAPP_SLOT_UNAVAILABLE == cmd->err &&
+                    0 == HIREDIS_HAPP_STRNCASE_CMP("EXECABORT", reply->str, 9)) {
+                    self->log_debug("redis transaction %p aborted by redirection and will retry", cmd);
+                    conn->pop_reply(cmd);
+                    cmd->err = error_code::REDIS_HAPP_OK;
+
+                    // ASK, slots are not changed until the migration is finished, so it's sent to the importing node at once
+                    transaction_t *t = reinterpret_cast<transaction_t *>(cmd->pri_data);
+                    if (t->asking) {
+                        connection_t *ask_conn = self->get_connection(t->ask_node.name);
+                        if (NULL == ask_conn) {
+                            ask_conn = self->make_connection(t->ask_node);
+                        }
+
+                        if (NULL != ask_conn) {
+                            self->exec(ask_conn, cmd);
+                            return;
+                        }
+                        t->asking = false;
+                    }
+
+                    self->retry(cmd);
+                    self->reload_slots_later();
+                    return;
+                }
+
+                // detect MOVED,ASK and CLUSTERDOWN
+                if (0 == HIREDIS_HAPP_STRNCASE_CMP("ASK", reply->str, 3)) {
+                    self->log_debug("redis cmd %p %s", cmd, reply->str);
+                    ++self->stats.ask;
+                    ++conn->get_stats().ask;
+                    // send ASK to another connection
+                    HIREDIS_HAPP_SSCANF(reply->str + 4, " %d %s", &slot_index, addr);
+                    std::string ip;
+                    uint16_t port;
+                    if (connection::pick_name(addr, ip, port)) {
+                        connection::key_t conn_key;
+                        connection::set_key(conn_key, ip, port);
+
+                        // ASKING request
+                        connection_t *ask_conn = self->get_connection(conn_key.name);
+                        if (NULL == ask_conn) {
+                            ask_conn = self->make_connection(conn_key);
+                        }
+
+                        // pop from old connection, and run it
+                        conn->pop_reply(cmd);
+
+                        if (NULL != ask_conn) {
+                            if (REDIS_OK == redisAsyncCommand(ask_conn->get_context(), on_reply_asking, cmd, "ASKING")) {
+                                return;
+                            }
+                        }
+
+                        // retry if ASK failed
+                        self->retry(cmd);
+                        return;
+                    }
+                } else if (0 == HIREDIS_HAPP_STRNCASE_CMP("MOVED", reply->str, 5)) {
+                    self->log_debug("redis cmd %p %s", cmd, reply->str);
+                    ++self->stats.moved;
+                    ++conn->get_stats().moved;
+
+                    HIREDIS_HAPP_SSCANF(reply->str + 6, " %d %s", &slot_index, addr);
+
+                    if (cmd->engine.slot >= 0 && cmd->engine.slot != slot_index) {
+                        self->log_info("cluster cmd key error, expect slot: %d, real slot: %d", cmd->engine.slot, slot_index);
+                        cmd->engine.slot = slot_index;
+                    }
+
+                    std::string ip;
+                    uint16_t port;
+                    if (slot_index >= 0 && slot_index < HIREDIS_HAPP_SLOT_NUMBER && connection::pick_name(addr, ip, port)) {
+                        // update slot, point it to the node of the new master
+                        self->move_slot(slot_index, ip, port);
+
+                        // redirection is not a failure, send it to the new master at once
+                        conn->pop_reply(cmd);
+                        self->exec(NULL, 0, cmd);
+
+                        // reload all slots
+                        // If we don't reload all slots, many slot may be expired and will make many cmd has a long delay later.
+                        // But if we reload all slots every time, there may be a reload storm when resharding.
+                        // So this slot is patched above and all slots will be reloaded no more than once in slot reload interval
+                        self->reload_slots_later();
+                        return;
+                    } else {
+                        self->slot_flag = slot_status::INVALID;
+                    }
+                } else if (0 == HIREDIS_HAPP_STRNCASE_CMP("CLUSTERDOWN", reply->str, 11)) {
+                    self->log_info("cluster down reset all connection, cmd and replys");
+                    conn->call_reply(cmd, r);
+                    self->reset();
+                    return;
+                }
+
+                // script cache of this node is flushed or it's a new replica, load it and run again in the same connection
+                const std::string *body = self->scripts.reload(cmd, reply);
+                if (NULL != body) {
+                    self->log_debug("redis cmd %p %s, load script and retry", cmd, reply->str);
+                    conn->pop_reply(cmd);
+                    self->send_script_load(conn, *body);
+                    self->exec(conn, cmd);
+                    return;
+                }
+
+                self->log_debug("redis cmd %p reply error and abort, msg: %s", cmd, NULL == reply->str ? detail::NONE_MSG : reply->str);
+                // other errors will be passed to caller
+                conn->call_reply(cmd, r);
+                return;
+            }
+
+            // success and call callback
+            self->log_debug("redis cmd %p got reply success.(ttl=%3d)", cmd, NULL == cmd ? -1 : static_cast<int>(cmd->ttl));
+            conn->call_reply(cmd, r);
+        }
+
+        void cluster::move_slot(int slot_index, const std::string &ip, uint16_t port) {
+            std::string master_name = connection::make_name(ip, port);
+            size_t node_index = detail::find_slot_node(slot_nodes, master_name);
+            if (node_index >= slot_nodes.size() && node_index < HIREDIS_HAPP_SLOT_NODE_NONE) {
+                slot_nodes.push_back(slot_t());
+                slot_nodes.back().index = static_cast<int>(node_index);
+                slot_nodes.back().hosts.push_back(connection::key_t());
+                connection::set_key(slot_nodes.back().hosts.back(), ip, port);
+            }
+
+            if (node_index < slot_nodes.size()) {
+                slots[slot_index] = static_cast<uint16_t>(node_index);
+            }
+        }
+
+        void cluster::on_reply_update_slot(cmd_exec *cmd, redisAsyncContext *, void *r, void *privdata) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            cluster *self = cmd->holder.clu;
+
+            // another query of the same round already won, or the cluster is reset
+            if (reinterpret_cast<uintptr_t>(privdata) != self->slot_reload.sequence) {
+                return;
+            }
+
+            // failed and retry
+            // cmd will be destroyed after callback, so a new reload will be sent later
+            if (NULL == reply || reply->elements <= 0 || REDIS_REPLY_ARRAY != reply->element[0]->type) {
+                self->on_slot_reload_query_failed();
+                return;
+            }
+
+            ++self->slot_reload.sequence;
+            self->slot_reload.pending = 0;
+
+            self->slot_reload.failed_count = 0;
+            self->slot_reload.retry_delay = 0;
+            self->slot_reload.failed_nodes.clear();
+
+            // clear and reset slots ...
+            self->clear_slots();
+
+            for (size_t i = 0; i < reply->elements; ++i) {
+                redisReply *slot_node = reply->element[i];
+                if (slot_node->elements >= 3) {
+                    long long si = slot_node->element[0]->integer;
+                    long long ei = slot_node->element[1]->integer;
+                    if (si < 0 || ei >= HIREDIS_HAPP_SLOT_NUMBER || si > ei) {
+                        self->log_info("slot update: invalid range [%lld-%lld]", si, ei);
+                        continue;
+                    }
+
+                    std::vector<connection::key_t> hosts;
+                    for (size_t j = 2; j < slot_node->elements; ++j) {
+                        redisReply *addr = slot_node->element[j];
+                        // redis cluster may response a empty list when some error happened
+                        if (addr->elements >= 2 && REDIS_REPLY_STRING == addr->element[0]->type && addr->element[0]->str[0] &&
+                            REDIS_REPLY_INTEGER == addr->element[1]->type) {
+                            hosts.push_back(connection::key_t());
+                            connection::set_key(hosts.back(), addr->element[0]->str, static_cast<uint16_t>(addr->element[1]->integer));
+                        }
+                    }
+
+                    // log
+                    if (NULL != self->conf.log_fn_debug && self->conf.log_max_size > 0) {
+                        self->log_debug("slot update: [%lld-%lld]", si, ei);
+                        for (size_t j = 0; j < hosts.size(); ++j) {
+                            self->log_debug(" -- %s", hosts[j].name.c_str());
+                        }
+                    }
+
+                    if (hosts.empty()) {
+                        continue;
+                    }
+
+                    // all ranges of the same master share one node
+                    size_t node_index = detail::find_slot_node(self->slot_nodes, hosts.front().name);
+                    if (node_index >= self->slot_nodes.size()) {
+                        if (node_index >= HIREDIS_HAPP_SLOT_NODE_NONE) {
+                            self->log_info("slot update: too many nodes, skip [%lld-%lld]", si, ei);
+                            continue;
+                        }
+
+                        self->slot_nodes.push_back(slot_t());
+                        self->slot_nodes.back().index = static_cast<int>(node_index);
+                        self->slot_nodes.back().hosts.swap(hosts);
+                    }
+
+                    std::fill(self->slots + si, self->slots + ei + 1, static_cast<uint16_t>(node_index));
+                }
+            }
+
+            // set status first and then retry, or there will be a infinite loop
+            self->slot_flag = slot_status::OK;
+
+            self->log_info("update %d slots done", static_cast<int>(reply->elements));
+
+            if (self->callbacks.on_slot_update) {
+                self->callbacks.on_slot_update(self);
+            }
+
+            self->on_slots_updated();
+        }
+
+        int cluster::load_slots(const std::vector<slot_t> &nodes, const uint16_t *table) {
+            if (NULL == table || nodes.size() >= HIREDIS_HAPP_SLOT_NODE_NONE) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            for (size_t i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
+                if (HIREDIS_HAPP_SLOT_NODE_NONE != table[i] && table[i] >= nodes.size()) {
+                    return error_code::REDIS_HAPP_PARAM;
+                }
+            }
+
+            // replies of running reload will be ignored
+            ++slot_reload.sequence;
+            slot_reload.pending = 0;
+
+            slot_reload.failed_count = 0;
+            slot_reload.retry_delay = 0;
+            slot_reload.failed_nodes.clear();
+
+            slot_nodes = nodes;
+            std::copy(table, table + HIREDIS_HAPP_SLOT_NUMBER, slots);
+
+            slot_flag = slot_status::OK;
+            log_info("load %d slot nodes done", static_cast<int>(nodes.size()));
+
+            on_slots_updated();
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        void cluster::on_slots_updated() {
+            // connect before pending cmds are sent, so they can use all connections in the pool
+            if (warm_up_policy::NONE != conf.warm_up_policy_type) {
+                warm_up();
+            }
+
+            // shard channels may be moved
+            if (!subscriptions.get_subscriptions(pubsub::channel_type::SHARD).empty()) {
+                resubscribe();
+            }
+
+            // run pending list
+            while (!slot_pending.empty()) {
+                cmd_t *cmd = slot_pending.front();
+                slot_pending.pop_front();
+                // they have waited for slots, so there is no need to backoff again
+                exec(NULL, 0, cmd);
+            }
+        }
+
+        void cluster::on_reply_asking(redisAsyncContext *c, void *r, void *privdata) {
+            cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            cluster *self = conn->get_holder().clu;
+
+            // cmd in ask command is not in any connection
+            // so there is no need to pop it, directly retry will be OK
+
+            // callback is already called when reach deadline, just release it
+            if (cmd->deadline_expired) {
+                self->destroy_cmd(cmd);
+                return;
+            }
+
+            if (REDIS_ERR_IO == c->err && REDIS_ERR_EOF == c->err) {
+                self->log_debug("redis asking err %d and will retry, %s", c->err, c->errstr);
+                // retry if network error
+                self->retry(cmd);
+                return;
+            }
+
+            if (REDIS_OK != c->err || NULL == r) {
+                self->log_debug("redis asking err %d and abort, %s", c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
+
+                if (c->c.flags & REDIS_DISCONNECTING) {
+                    cmd->err = error_code::REDIS_HAPP_CONNECTION;
+                }
+
+                // other errors should be passed to callback
+                self->call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, conn->get_context(), r);
+                self->destroy_cmd(cmd);
+                return;
+            }
+
+            // ASKING only affects the next cmd, so it must be sent at once
+            if (NULL != reply->str && 0 == HIREDIS_HAPP_STRNCASE_CMP("OK", reply->str, 2)) {
+                self->exec(conn, cmd);
+                return;
+            }
+
+            self->log_debug("redis reply asking err %d and abort, %s", reply->type, NULL == reply->str ? detail::NONE_MSG : reply->str);
+            // other errors should be passed to callback
+            self->call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, conn->get_context(), r);
+            self->destroy_cmd(cmd);
+        }
+
+        void cluster::on_connected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            cluster *self = conn->get_holder().clu;
+
+            // hiredis bug, sometimes 0 == status but c is already closed
+            if (REDIS_OK == status && hiredis::happ::connection::status::DISCONNECTED == conn->get_status()) {
+                status = REDIS_ERR_OTHER;
+            }
+
+            // event callback
+            if (self->callbacks.on_connected) {
+                self->callbacks.on_connected(self, conn, c, status);
+            }
+
+            // failed, release resource
+            if (REDIS_OK != status) {
+                self->log_debug("connect to %s failed, status: %d, msg: %s", conn->get_key().name.c_str(), status, c->errstr);
+                self->release_connection(conn, false, status);
+
+                // update slots if connect failed
+                self->reload_slots_later();
+            } else {
+                conn->set_connected();
+
+                self->log_debug("connect to %s success", conn->get_key().name.c_str());
+
+                // reload slots
+                if (slot_status::INVALID == self->slot_flag) {
+                    self->reload_slots_later();
+                }
+            }
+        }
+
+        void cluster::on_disconnected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            cluster *self = conn->get_holder().clu;
+
+            // We should update slots on next cmd if there is any connection disconnected
+            if (REDIS_OK != status) {
+                self->remove_connection_key(conn->get_key().name);
+            }
+
+            // release resource
+            self->release_connection(conn, false, status);
+        }
+
+        void cluster::on_reply_auth(cmd_exec *cmd, redisAsyncContext *rctx, void *r, void *privdata) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            cluster *self = cmd->holder.clu;
+            assert(rctx);
+
+            // error and log
+            if (NULL == reply || 0 != HIREDIS_HAPP_STRNCASE_CMP("OK", reply->str, 2)) {
+                const char *error_text = "";
+                if (NULL != reply && NULL != reply->str) {
+                    error_text = reply->str;
+                }
+                if (REDIS_CONN_TCP == rctx->c.connection_type) {
+                    self->log_info("tcp:%s:%d AUTH failed. %s",
+                                   rctx->c.tcp.host ? rctx->c.tcp.host : (rctx->c.tcp.source_addr ? rctx->c.tcp.source_addr : "UNKNOWN"), rctx->c.tcp.port,
+                                   error_text);
+                } else if (REDIS_CONN_UNIX == rctx->c.connection_type) {
+                    self->log_info("unix:%s AUTH failed. %s", rctx->c.unix_sock.path ? rctx->c.unix_sock.path : "NULL", error_text);
+                } else {
+                    self->log_info("AUTH failed. %s", error_text);
+                }
+            } else {
+                if (REDIS_CONN_TCP == rctx->c.connection_type) {
+                    self->log_info("tcp:%s:%d AUTH success.",
+                                   rctx->c.tcp.host ? rctx->c.tcp.host : (rctx->c.tcp.source_addr ? rctx->c.tcp.source_addr : "UNKNOWN"), rctx->c.tcp.port);
+                } else if (REDIS_CONN_UNIX == rctx->c.connection_type) {
+                    self->log_info("unix:%s AUTH success.", rctx->c.unix_sock.path ? rctx->c.unix_sock.path : "NULL");
+                } else {
+                    self->log_info("AUTH success.");
+                }
+            }
+        }
+
+        void cluster::on_reply_readonly(cmd_exec *cmd, redisAsyncContext *, void *r, void *) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            cluster *self = cmd->holder.clu;
+
+            if (NULL == reply || REDIS_REPLY_ERROR == reply->type) {
+                self->log_info("READONLY failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+            }
+        }
+
+        void cluster::warm_up() {
+            // connections may be removed from slot nodes when making connection failed, so copy them first
+            std::vector<connection::key_t> hosts;
+            for (size_t i = 0; i < slot_nodes.size(); ++i) {
+                for (size_t j = 0; j < slot_nodes[i].hosts.size(); ++j) {
+                    if (0 == j || warm_up_policy::ALL == conf.warm_up_policy_type) {
+                        hosts.push_back(slot_nodes[i].hosts[j]);
+                    }
+                }
+            }
+
+            ++warm_up_status.sequence;
+            warm_up_status.failed = 0;
+            // guard, on_ready will not be called until all PING are sent
+            warm_up_status.pending = 1;
+
+            std::vector<connection_t *> all_conns;
+            for (size_t i = 0; i < hosts.size(); ++i) {
+                connection_map_t::iterator it = connections.find(hosts[i].name);
+                size_t conn_count = it == connections.end() ? 0 : it->second.conns.size();
+                for (; conn_count < conf.connection_pool_size; ++conn_count) {
+                    if (NULL == make_connection(hosts[i])) {
+                        ++warm_up_status.failed;
+                        break;
+                    }
+                }
+
+                // connected ones are already warmed up, only new ones and those still connecting are waited
+                it = connections.find(hosts[i].name);
+                if (it != connections.end()) {
+                    for (size_t j = 0; j < it->second.conns.size(); ++j) {
+                        if (connection::status::CONNECTED != it->second.conns[j]->get_status()) {
+                            all_conns.push_back(it->second.conns[j].get());
+                        }
+                    }
+                }
+            }
+
+            log_debug("warm up %d nodes with %d connections", static_cast<int>(hosts.size()), static_cast<int>(all_conns.size()));
+
+            // PING is replied after AUTH and READONLY, so the connection is ready to serve any cmd then
+            for (size_t i = 0; i < all_conns.size(); ++i) {
+                cmd_t *cmd = create_cmd(on_reply_warm_up, reinterpret_cast<void *>(warm_up_status.sequence));
+                if (NULL == cmd) {
+                    ++warm_up_status.failed;
+                    continue;
+                }
+
+                if (cmd->format("PING") <= 0) {
+                    log_info("format cmd PING failed");
+                    cmd->callback = NULL;
+                    destroy_cmd(cmd);
+                    ++warm_up_status.failed;
+                    continue;
+                }
+
+                // do not send to other nodes if failed
+                cmd->ttl = 1;
+                ++warm_up_status.pending;
+                exec(all_conns[i], cmd);
+            }
+
+            finish_warm_up();
+        }
+
+        void cluster::finish_warm_up() {
+            if (0 == warm_up_status.pending || 0 != --warm_up_status.pending) {
+                return;
+            }
+
+            int status = 0 == warm_up_status.failed ? error_code::REDIS_HAPP_OK : error_code::REDIS_HAPP_CONNECTION;
+            log_info("warm up finished, %d connections failed", static_cast<int>(warm_up_status.failed));
+
+            if (callbacks.on_ready) {
+                callbacks.on_ready(this, status);
+            }
+        }
+
+        void cluster::on_reply_warm_up(cmd_exec *cmd, redisAsyncContext *, void *r, void *privdata) {
+            cluster *self = cmd->holder.clu;
+
+            // slots are reloaded or cluster is reset
+            if (reinterpret_cast<uintptr_t>(privdata) != self->warm_up_status.sequence) {
+                return;
+            }
+
+            if (error_code::REDIS_HAPP_OK != cmd->result() || NULL == r) {
+                ++self->warm_up_status.failed;
+            }
+
+            self->finish_warm_up();
+        }
+
+        void cluster::send_readonly(connection_t *conn) {
+            if (NULL == conn) {
+                return;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_readonly, NULL);
+            if (NULL == cmd) {
+                log_info("create cmd READONLY failed");
+                return;
+            }
+
+            if (cmd->format("READONLY") <= 0) {
+                log_info("format cmd READONLY failed");
+                destroy_cmd(cmd);
+                return;
+            }
+
+            exec(conn, cmd);
+        }
+
+        void cluster::send_script_load(connection_t *conn, const std::string &body) {
+            if (NULL == conn) {
+                return;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_script_load, NULL);
+            if (NULL == cmd) {
+                log_info("create cmd SCRIPT LOAD failed");
+                return;
+            }
+
+            if (script_registry::format_load(cmd, body) <= 0) {
+                log_info("format cmd SCRIPT LOAD failed");
+                destroy_cmd(cmd);
+                return;
+            }
+
+            exec(conn, cmd);
+        }
+
+        void cluster::on_reply_script_load(cmd_exec *cmd, redisAsyncContext *, void *r, void *) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            cluster *self = cmd->holder.clu;
+
+            if (NULL == reply || REDIS_REPLY_ERROR == reply->type) {
+                self->log_info("SCRIPT LOAD failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+            }
+        }
+
+        bool cluster::send_auth(connection_t *conn) {
+            if (!auth.auth_fn && auth.password.empty()) {
+                return true;
+            }
+
+            // AUTH cmd
+            cmd_t *cmd = create_cmd(on_reply_auth, NULL);
+            if (NULL != cmd) {
+                int len = 0;
+                if (auth.auth_fn) {
+                    const std::string &passwd = auth.auth_fn(conn, auth.password);
+                    len = cmd->format("AUTH %b", passwd.c_str(), passwd.size());
+                } else if (!auth.password.empty()) {
+                    len = cmd->format("AUTH %b", auth.password.c_str(), auth.password.size());
+                }
+
+                if (len <= 0) {
+                    log_info("format cmd AUTH failed");
+                    destroy_cmd(cmd);
+                    return false;
+                }
+
+                exec(conn, cmd);
+            }
+
+            return true;
+        }
+
+        cluster::connection_t *cluster::make_tracking_connection(const connection::key_t &key) {
+            if (tracking_conns.end() != tracking_conns.find(key.name)) {
+                return NULL;
+            }
+
+            connection_ptr_t ret_ptr;
+            if (NULL == make_dedicated_connection(ret_ptr, key)) {
+                return NULL;
+            }
+
+            tracking_t &tracking = tracking_conns[key.name];
+            ::hiredis::happ::unique_ptr<connection_t>::swap(tracking.conn, ret_ptr);
+            tracking.client_id = 0;
+
+            connection_t &ret = *tracking.conn;
+            if (!send_auth(&ret)) {
+                return NULL;
+            }
+
+            // other connections redirect invalidation messages to this one by its id
+            cmd_t *cmd = create_cmd(on_reply_tracking_id, NULL);
+            if (NULL != cmd) {
+                if (cmd->format("CLIENT ID") <= 0) {
+                    log_info("format cmd CLIENT ID failed");
+                    destroy_cmd(cmd);
+                } else {
+                    exec(&ret, cmd);
+                }
+            }
+
+            // subscribe message must use raw cmd, @see raw.h
+            if (REDIS_OK != ret.redis_raw_cmd(on_reply_invalidate, NULL, "SUBSCRIBE __redis__:invalidate")) {
+                log_info("subscribe invalidation messages from %s failed", key.name.c_str());
+            }
+
+            // event callback must be call at the last
+            if (callbacks.on_connect) {
+                callbacks.on_connect(this, &ret);
+            }
+
+            log_debug("redis make tracking connection to %s ", key.name.c_str());
+            return &ret;
+        }
+
+        void cluster::start_tracking(connection_t *conn) {
+            tracking_map_t::iterator it = tracking_conns.find(conn->get_key().name);
+            if (tracking_conns.end() == it) {
+                // all connections of this node will be tracked after CLIENT ID replied
+                make_tracking_connection(conn->get_key());
+                return;
+            }
+
+            if (it->second.client_id > 0) {
+                send_tracking(conn, it->second.client_id);
+            }
+        }
+
+        void cluster::send_tracking(connection_t *conn, long long client_id) {
+            cmd_t *cmd = create_cmd(on_reply_tracking, reinterpret_cast<void *>(static_cast<intptr_t>(client_id)));
+            if (NULL == cmd) {
+                log_info("create cmd CLIENT TRACKING failed");
+                return;
+            }
+
+            if (cmd->format("CLIENT TRACKING on REDIRECT %lld", client_id) <= 0) {
+                log_info("format cmd CLIENT TRACKING failed");
+                destroy_cmd(cmd);
+                return;
+            }
 
-                    std::string ip;
-                    uint16_t port;
-                    if (connection::pick_name(addr, ip, port)) {
-                        // update slot
-                        self->slots[slot_index].hosts.clear();
-                        self->slots[slot_index].hosts.push_back(connection::key_t());
-                        connection::set_key(self->slots[slot_index].hosts.back(), ip, port);
+            exec(conn, cmd);
+        }
 
-                        // retry
-                        conn->pop_reply(cmd);
-                        self->retry(cmd);
+        void cluster::release_tracking_connection(const std::string &name, connection_t *conn) {
+            // no invalidation messages of this node any more
+            reply_cache.clear();
 
-                        // reload all slots
-                        // FIXME: Is it necessary to reload all slots here?
-                        //        If we don't reload all slots, many slot may be expired and will make many cmd has a long delay later.
-                        //        But if we reload all slots, there may be too often to do this if network is not stable for a short time
-                        //        Reload slots will use much more CPU resource than a cmd (clear and copy 16384 lists)
-                        self->reload_slots();
-                        return;
-                    } else {
-                        self->slot_flag = slot_status::INVALID;
-                    }
-                } else if (0 == HIREDIS_HAPP_STRNCASE_CMP("CLUSTERDOWN", reply->str, 11)) {
-                    self->log_info("cluster down reset all connection, cmd and replys");
-                    conn->call_reply(cmd, r);
-                    self->reset();
-                    return;
+            connection_map_t::iterator it = connections.find(name);
+            if (connections.end() != it) {
+                for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                    reply_cache.set_tracked(it->second.conns[i].get(), false);
                 }
+            }
 
-                self->log_debug("redis cmd %p reply error and abort, msg: %s", cmd, NULL == reply->str ? detail::NONE_MSG : reply->str);
-                // other errors will be passed to caller
-                conn->call_reply(cmd, r);
+            // connections may be changed in callbacks, find it again
+            tracking_map_t::iterator tracking_it = tracking_conns.find(name);
+            if (tracking_conns.end() != tracking_it && tracking_it->second.conn.get() == conn) {
+                tracking_conns.erase(tracking_it);
+            }
+        }
+
+        void cluster::on_reply_tracking_id(cmd_exec *cmd, redisAsyncContext *c, void *r, void *) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            cluster *self = cmd->holder.clu;
+
+            if (NULL == reply || REDIS_REPLY_INTEGER != reply->type || NULL == c || NULL == c->data) {
+                self->log_info("CLIENT ID failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
                 return;
             }
 
-            // success and call callback
-            self->log_debug("redis cmd %p got reply success.(ttl=%3d)", cmd, NULL == cmd ? -1 : static_cast<int>(cmd->ttl));
-            conn->call_reply(cmd, r);
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            std::string name = conn->get_key().name;
+            tracking_map_t::iterator tracking_it = self->tracking_conns.find(name);
+            if (self->tracking_conns.end() == tracking_it || tracking_it->second.conn.get() != conn) {
+                return;
+            }
+            tracking_it->second.client_id = reply->integer;
+
+            // connections may be changed when sending, so copy them first
+            std::vector<connection_t *> pool_conns;
+            connection_map_t::iterator it = self->connections.find(name);
+            if (self->connections.end() != it) {
+                for (size_t i = 0; i < it->second.conns.size(); ++i) {
+                    pool_conns.push_back(it->second.conns[i].get());
+                }
+            }
+
+            for (size_t i = 0; i < pool_conns.size(); ++i) {
+                self->send_tracking(pool_conns[i], reply->integer);
+            }
         }
 
-        void cluster::on_reply_update_slot(cmd_exec *cmd, redisAsyncContext *, void *r, void *privdata) {
+        void cluster::on_reply_tracking(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
             redisReply *reply = reinterpret_cast<redisReply *>(r);
             cluster *self = cmd->holder.clu;
 
-            // failed and retry
-            if (NULL == reply || reply->elements <= 0 || REDIS_REPLY_ARRAY != reply->element[0]->type) {
-                self->slot_flag = slot_status::INVALID;
+            if (NULL == reply || REDIS_REPLY_ERROR == reply->type || NULL == c || NULL == c->data) {
+                self->log_info("CLIENT TRACKING failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+                return;
+            }
 
-                if (!self->slot_pending.empty()) {
-                    self->log_info("update slots failed and try to retry again.");
+            // the tracking connection may be lost and replaced
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            tracking_map_t::iterator tracking_it = self->tracking_conns.find(conn->get_key().name);
+            if (self->tracking_conns.end() == tracking_it ||
+                tracking_it->second.client_id != static_cast<long long>(reinterpret_cast<intptr_t>(privdata))) {
+                return;
+            }
 
-                    // Wait for a while if it's network problem
-                    // this message will also retry for TTL times
-                    // update slots always random a connection
-                    cmd->engine.slot = -1;
-                    self->add_timer_cmd(cmd);
-                } else {
-                    self->log_info("update slots failed and will retry later.");
-                }
+            self->reply_cache.set_tracked(conn, true);
+        }
 
+        void cluster::on_reply_invalidate(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
                 return;
             }
 
-            // clear and reset slots ...
-            for (size_t i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
-                self->slots[i].hosts.clear();
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            conn->get_holder().clu->reply_cache.on_invalidate(reinterpret_cast<const redisReply *>(r));
+        }
+
+        cluster::connection_t *cluster::make_dedicated_connection(connection_ptr_t &holder, const connection::key_t &key) {
+            redisAsyncContext *c = redisAsyncConnect(key.ip.c_str(), static_cast<int>(key.port));
+            if (NULL == c || c->err) {
+                log_info("redis connect to %s failed, msg: %s", key.name.c_str(), NULL == c ? detail::NONE_MSG : c->errstr);
+                return NULL;
             }
 
-            for (size_t i = 0; i < reply->elements; ++i) {
-                redisReply *slot_node = reply->element[i];
-                if (slot_node->elements >= 3) {
-                    long long si = slot_node->element[0]->integer;
-                    long long ei = slot_node->element[1]->integer;
+            holder_t h;
+            h.clu = this;
+            redisAsyncSetConnectCallback(c, on_connected_wrapper);
+            redisAsyncSetDisconnectCallback(c, on_disconnected_wrapper);
+            redisEnableKeepAlive(&c->c);
 
-                    std::vector<connection::key_t> hosts;
-                    for (size_t j = 2; j < slot_node->elements; ++j) {
-                        redisReply *addr = slot_node->element[j];
-                        // redis cluster may response a empty list when some error happened
-                        if (addr->elements >= 2 && REDIS_REPLY_STRING == addr->element[0]->type && addr->element[0]->str[0] &&
-                            REDIS_REPLY_INTEGER == addr->element[1]->type) {
-                            hosts.push_back(connection::key_t());
-                            connection::set_key(hosts.back(), addr->element[0]->str, static_cast<uint16_t>(addr->element[1]->integer));
-                        }
-                    }
+            connection_ptr_t ret_ptr(new connection_t());
+            ::hiredis::happ::unique_ptr<connection_t>::swap(holder, ret_ptr);
 
-                    // log
-                    if (NULL != self->conf.log_fn_debug && self->conf.log_max_size > 0) {
-                        self->log_debug("slot update: [%lld-%lld]", si, ei);
-                        for (size_t j = 0; j < hosts.size(); ++j) {
-                            self->log_debug(" -- %s", hosts[j].name.c_str());
-                        }
-                    }
-                    // copy for 16384 times
-                    for (; si <= ei; ++si) {
-                        self->slots[si].hosts = hosts;
-                    }
-                }
+            connection_t &ret = *holder;
+            ret.init(h, key);
+            ret.set_connecting(c);
+
+            c->data = &ret;
+            return &ret;
+        }
+
+        int cluster::subscribe(pubsub::channel_type::type t, const std::string &name, pubsub::message_fn_t fn) {
+            if (name.empty() || !fn || !pubsub::is_supported(t)) {
+                return error_code::REDIS_HAPP_PARAM;
             }
 
-            // set status first and then retry, or there will be a infinite loop
-            self->slot_flag = slot_status::OK;
+            pubsub::subscription_t *sub = subscriptions.add(t, name, fn);
+            if (NULL == sub) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
 
-            self->log_info("update %d slots done", static_cast<int>(reply->elements));
+            // already subscribed, only the callback is changed
+            if (!sub->node.empty()) {
+                return error_code::REDIS_HAPP_OK;
+            }
 
-            // run pending list
-            while (!self->slot_pending.empty()) {
-                cmd_t *cmd = self->slot_pending.front();
-                self->slot_pending.pop_front();
-                self->retry(cmd);
+            // subscriptions given up are sent again with this one
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+
+            // node not available now, try again in proc
+            if (!send_subscribe(*sub)) {
+                log_debug("subscribe %s later", name.c_str());
+                resubscribe_status.pending = true;
+                if (pubsub::channel_type::SHARD == t) {
+                    reload_slots_later();
+                }
             }
+
+            return error_code::REDIS_HAPP_OK;
         }
 
-        void cluster::on_reply_asking(redisAsyncContext *c, void *r, void *privdata) {
-            cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
-            redisReply *reply = reinterpret_cast<redisReply *>(r);
-            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
-            cluster *self = conn->get_holder().clu;
+        int cluster::unsubscribe(pubsub::channel_type::type t, const std::string &name) {
+            if (t < pubsub::channel_type::CHANNEL || t >= pubsub::channel_type::MAX) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
 
-            // cmd in ask command is not in any connection
-            // so there is no need to pop it, directly retry will be OK
+            std::string node;
+            if (!subscriptions.remove(t, name, node)) {
+                return error_code::REDIS_HAPP_NOT_FOUND;
+            }
 
-            if (REDIS_ERR_IO == c->err && REDIS_ERR_EOF == c->err) {
-                self->log_debug("redis asking err %d and will retry, %s", c->err, c->errstr);
-                // retry if network error
-                self->retry(cmd);
-                return;
+            if (!node.empty()) {
+                send_unsubscribe(node, t, name);
             }
 
-            if (REDIS_OK != c->err || NULL == r) {
-                self->log_debug("redis asking err %d and abort, %s", c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
+            return error_code::REDIS_HAPP_OK;
+        }
 
-                if (c->c.flags & REDIS_DISCONNECTING) {
-                    cmd->err = error_code::REDIS_HAPP_CONNECTION;
+        bool cluster::get_subscribe_node(const pubsub::subscription_t &sub, connection::key_t &key) {
+            if (pubsub::channel_type::SHARD == sub.t) {
+                if (slot_status::OK != slot_flag) {
+                    return false;
                 }
 
-                // other errors should be passed to callback
-                self->call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, conn->get_context(), r);
-                self->destroy_cmd(cmd);
-                return;
+                const slot_t *node = get_slot_node(get_slot_index(sub.name.c_str(), sub.name.size()));
+                if (NULL == node || node->hosts.empty()) {
+                    return false;
+                }
+
+                key = node->hosts.front();
+                return true;
             }
 
-            if (NULL != reply->str && 0 == HIREDIS_HAPP_STRNCASE_CMP("OK", reply->str, 2)) {
-                self->retry(cmd, conn);
-                return;
+            // channels and patterns share one node
+            subscriber_map_t::iterator it = subscriber_conns.find(subscribe_node);
+            if (!subscribe_node.empty() && subscriber_conns.end() != it) {
+                key = it->second->get_key();
+                return true;
             }
 
-            self->log_debug("redis reply asking err %d and abort, %s", reply->type, NULL == reply->str ? detail::NONE_MSG : reply->str);
-            // other errors should be passed to callback
-            self->call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, conn->get_context(), r);
-            self->destroy_cmd(cmd);
+            const connection::key_t *master = get_slot_master(-1);
+            if (NULL == master) {
+                return false;
+            }
+
+            key = *master;
+            return true;
         }
 
-        void cluster::on_connected_wrapper(const struct redisAsyncContext *c, int status) {
-            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
-            cluster *self = conn->get_holder().clu;
+        bool cluster::send_subscribe(pubsub::subscription_t &sub) {
+            connection::key_t key;
+            if (!get_subscribe_node(sub, key)) {
+                return false;
+            }
 
-            // hiredis bug, sometimes 0 == status but c is already closed
-            if (REDIS_OK == status && hiredis::happ::connection::status::DISCONNECTED == conn->get_status()) {
-                status = REDIS_ERR_OTHER;
+            if (sub.node == key.name) {
+                return true;
             }
 
-            // event callback
-            if (self->callbacks.on_connected) {
-                self->callbacks.on_connected(self, conn, c, status);
+            // moved to another node
+            if (!sub.node.empty()) {
+                send_unsubscribe(sub.node, sub.t, sub.name);
+                sub.node.clear();
             }
 
-            // failed, release resource
-            if (REDIS_OK != status) {
-                self->log_debug("connect to %s failed, status: %d, msg: %s", conn->get_key().name.c_str(), status, c->errstr);
-                self->release_connection(conn->get_key(), false, status);
+            connection_t *conn = get_or_make_subscriber_connection(key);
+            if (NULL == conn) {
+                return false;
+            }
 
-                // update slots if connect failed
-                self->reload_slots();
-            } else {
-                conn->set_connected();
+            // subscribe message must use raw cmd, @see raw.h
+            if (REDIS_OK != conn->redis_raw_cmd(on_reply_subscribe, NULL, "%s %b", pubsub::get_subscribe_cmd(sub.t), sub.name.c_str(), sub.name.size())) {
+                log_info("%s %s to %s failed", pubsub::get_subscribe_cmd(sub.t), sub.name.c_str(), key.name.c_str());
+                return false;
+            }
 
-                self->log_debug("connect to %s success", conn->get_key().name.c_str());
+            sub.node = key.name;
+            if (pubsub::channel_type::SHARD != sub.t) {
+                subscribe_node = key.name;
+            }
+            return true;
+        }
 
-                // reload slots
-                if (slot_status::INVALID == self->slot_flag) {
-                    self->reload_slots();
+        void cluster::send_unsubscribe(const std::string &node, pubsub::channel_type::type t, const std::string &name) {
+            subscriber_map_t::iterator it = subscriber_conns.find(node);
+            if (subscriber_conns.end() == it) {
+                return;
+            }
+
+            if (REDIS_OK != it->second->redis_raw_cmd(on_reply_subscribe, NULL, "%s %b", pubsub::get_unsubscribe_cmd(t), name.c_str(), name.size())) {
+                log_info("%s %s to %s failed", pubsub::get_unsubscribe_cmd(t), name.c_str(), node.c_str());
+            }
+        }
+
+        void cluster::resubscribe() {
+            resubscribe_status.pending = false;
+
+            for (int t = pubsub::channel_type::CHANNEL; t < pubsub::channel_type::MAX; ++t) {
+                // subscription map is not changed when sending
+                pubsub::subscription_map_t &subs = subscriptions.get_subscriptions(static_cast<pubsub::channel_type::type>(t));
+                for (pubsub::subscription_map_t::iterator it = subs.begin(); it != subs.end(); ++it) {
+                    if (!send_subscribe(it->second)) {
+                        resubscribe_status.pending = true;
+                    }
                 }
             }
+
+            // connections made in this round may be lost later, the next round waits for backoff
+            ++resubscribe_status.times;
+            resubscribe_status.retry_delay = retry_backoff.next_delay(resubscribe_status.times, resubscribe_status.retry_delay);
+            resubscribe_status.retry_sec = timer_actions.last_update_sec + static_cast<time_t>(resubscribe_status.retry_delay / 1000000);
+            resubscribe_status.retry_usec = timer_actions.last_update_usec + static_cast<time_t>(resubscribe_status.retry_delay % 1000000);
+            if (resubscribe_status.retry_usec >= 1000000) {
+                resubscribe_status.retry_sec += resubscribe_status.retry_usec / 1000000;
+                resubscribe_status.retry_usec %= 1000000;
+            }
+
+            if (resubscribe_status.times >= HIREDIS_HAPP_RESUBSCRIBE_TIMES) {
+                log_info("resubscribe for %d times without any reply, wait for the next subscribe", static_cast<int>(resubscribe_status.times));
+            }
         }
 
-        void cluster::on_disconnected_wrapper(const struct redisAsyncContext *c, int status) {
-            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
-            cluster *self = conn->get_holder().clu;
+        cluster::connection_t *cluster::get_or_make_subscriber_connection(const connection::key_t &key) {
+            subscriber_map_t::iterator it = subscriber_conns.find(key.name);
+            if (subscriber_conns.end() != it) {
+                return it->second.get();
+            }
 
-            // We should update slots on next cmd if there is any connection disconnected
-            if (REDIS_OK != status) {
-                self->remove_connection_key(conn->get_key().name);
+            connection_ptr_t ret_ptr;
+            if (NULL == make_dedicated_connection(ret_ptr, key)) {
+                return NULL;
             }
 
-            // release resource
-            self->release_connection(conn->get_key(), false, status);
+            connection_ptr_t &conn_ptr = subscriber_conns[key.name];
+            ::hiredis::happ::unique_ptr<connection_t>::swap(conn_ptr, ret_ptr);
+
+            connection_t &ret = *conn_ptr;
+            if (!send_auth(&ret)) {
+                return NULL;
+            }
+
+            // event callback must be call at the last
+            if (callbacks.on_connect) {
+                callbacks.on_connect(this, &ret);
+            }
+
+            log_debug("redis make subscriber connection to %s ", key.name.c_str());
+            return &ret;
         }
 
-        void cluster::on_reply_auth(cmd_exec *cmd, redisAsyncContext *rctx, void *r, void *privdata) {
+        void cluster::release_subscriber_connection(const std::string &name, connection_t *conn) {
+            // connections may be changed in callbacks, find it again
+            subscriber_map_t::iterator it = subscriber_conns.find(name);
+            if (subscriber_conns.end() != it && it->second.get() == conn) {
+                subscriber_conns.erase(it);
+            }
+
+            if (subscribe_node == name) {
+                subscribe_node.clear();
+            }
+
+            // subscribe again in proc
+            if (subscriptions.reset_node(name) > 0) {
+                resubscribe_status.pending = true;
+            }
+        }
+
+        void cluster::on_reply_subscribe(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
+                return;
+            }
+
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            cluster *self = conn->get_holder().clu;
             redisReply *reply = reinterpret_cast<redisReply *>(r);
-            cluster *self = cmd->holder.clu;
-            assert(rctx);
 
-            // error and log
-            if (NULL == reply || 0 != HIREDIS_HAPP_STRNCASE_CMP("OK", reply->str, 2)) {
-                const char *error_text = "";
-                if (NULL != reply && NULL != reply->str) {
-                    error_text = reply->str;
-                }
-                if (REDIS_CONN_TCP == rctx->c.connection_type) {
-                    self->log_info("tcp:%s:%d AUTH failed. %s",
-                                   rctx->c.tcp.host ? rctx->c.tcp.host : (rctx->c.tcp.source_addr ? rctx->c.tcp.source_addr : "UNKNOWN"), rctx->c.tcp.port,
-                                   error_text);
-                } else if (REDIS_CONN_UNIX == rctx->c.connection_type) {
-                    self->log_info("unix:%s AUTH failed. %s", rctx->c.unix_sock.path ? rctx->c.unix_sock.path : "NULL", error_text);
-                } else {
-                    self->log_info("AUTH failed. %s", error_text);
-                }
-            } else {
-                if (REDIS_CONN_TCP == rctx->c.connection_type) {
-                    self->log_info("tcp:%s:%d AUTH success.",
-                                   rctx->c.tcp.host ? rctx->c.tcp.host : (rctx->c.tcp.source_addr ? rctx->c.tcp.source_addr : "UNKNOWN"), rctx->c.tcp.port);
-                } else if (REDIS_CONN_UNIX == rctx->c.connection_type) {
-                    self->log_info("unix:%s AUTH success.", rctx->c.unix_sock.path ? rctx->c.unix_sock.path : "NULL");
-                } else {
-                    self->log_info("AUTH success.");
+            // MOVED of shard channels, subscribe all of this node again after slots reloaded
+            if (REDIS_REPLY_ERROR == reply->type) {
+                self->log_info("subscribe on %s failed. %s", conn->get_key().name.c_str(), NULL == reply->str ? detail::NONE_MSG : reply->str);
+                if (self->subscriptions.reset_node(conn->get_key().name) > 0) {
+                    self->resubscribe_status.pending = true;
                 }
+                self->reload_slots_later();
+                return;
+            }
+
+            // subscriber connections work again
+            if (!self->resubscribe_status.pending) {
+                self->resubscribe_status.times = 0;
+                self->resubscribe_status.retry_delay = 0;
             }
+
+            self->subscriptions.dispatch(reply);
         }
 
         void cluster::remove_connection_key(const std::string &name) {
             slot_flag = slot_status::INVALID;
 
-            for (int i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
-                std::vector<connection::key_t> &hosts = slots[i].hosts;
+            for (size_t i = 0; i < slot_nodes.size(); ++i) {
+                std::vector<connection::key_t> &hosts = slot_nodes[i].hosts;
                 if (!hosts.empty() && hosts[0].name == name) {
                     if (hosts.size() > 1) {
                         using std::swap;
@@ -993,6 +3299,24 @@ namespace hiredis {
             }
         }
 
+        const cluster::slot_t *cluster::get_slot_node(int index) const {
+            if (index < 0 || index >= HIREDIS_HAPP_SLOT_NUMBER) {
+                return NULL;
+            }
+
+            uint16_t node_index = slots[index];
+            if (HIREDIS_HAPP_SLOT_NODE_NONE == node_index || node_index >= slot_nodes.size()) {
+                return NULL;
+            }
+
+            return &slot_nodes[node_index];
+        }
+
+        void cluster::clear_slots() {
+            slot_nodes.clear();
+            std::fill(slots, slots + HIREDIS_HAPP_SLOT_NUMBER, static_cast<uint16_t>(HIREDIS_HAPP_SLOT_NODE_NONE));
+        }
+
         void cluster::log_debug(const char *fmt, ...) {
             if (NULL == conf.log_fn_debug || 0 == conf.log_max_size) {
                 return;
@@ -0,0 +1,367 @@
+#include <cstdarg>
+
+#include "detail/happ_cluster_group.h"
+
+#if defined(HIREDIS_HAPP_ATOMIC_STD)
+
+namespace hiredis {
+    namespace happ {
+        struct cluster_group::request_t {
+            std::atomic<request_t *> next;
+            std::string key;
+            cmd_t::callback_fn_t callback;
+            void *pri_data;
+            sds content; // formatted in the submitting thread
+
+            request_t() : next(NULL), callback(NULL), pri_data(NULL), content(NULL) {}
+            ~request_t() {
+                if (NULL != content) {
+                    sdsfree(content);
+                }
+            }
+        };
+
+        struct cluster_group::worker_t {
+            cluster clu;
+
+            // intrusive MPSC queue, producers exchange head and the owner thread pops from tail
+            std::atomic<request_t *> head;
+            request_t *tail;
+            request_t stub;
+            // may be negative for a while when a request is popped before its producer counts it
+            std::atomic<long> queued;
+
+            uint64_t slot_version; // version of slots loaded or published by this worker
+
+            worker_t() : head(&stub), tail(&stub), queued(0), slot_version(0) {}
+        };
+
+        struct cluster_group::slot_update_handler_t {
+            cluster_group *owner;
+
+            explicit slot_update_handler_t(cluster_group *o) : owner(o) {}
+            void operator()(cluster *clu) const { owner->publish_slots(clu); }
+        };
+
+        cluster_group::cluster_group() : slot_version(0), slot_node_count(0) {
+            for (size_t i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
+                slot_nodes[i].store(HIREDIS_HAPP_SLOT_NODE_NONE, std::memory_order_relaxed);
+            }
+        }
+
+        cluster_group::~cluster_group() {
+            reset();
+
+            for (size_t i = 0; i < workers.size(); ++i) {
+                delete workers[i];
+            }
+            workers.clear();
+        }
+
+        int cluster_group::init(size_t worker_count, const std::string &ip, uint16_t port) {
+            if (0 == worker_count || !workers.empty()) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            workers.reserve(worker_count);
+            for (size_t i = 0; i < worker_count; ++i) {
+                worker_t *w = new worker_t();
+                w->clu.init(ip, port);
+                w->clu.set_on_slot_update(slot_update_handler_t(this));
+                workers.push_back(w);
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        cluster *cluster_group::get_worker(size_t index) {
+            if (index >= workers.size()) {
+                return NULL;
+            }
+
+            return &workers[index]->clu;
+        }
+
+        const cluster *cluster_group::get_worker(size_t index) const {
+            if (index >= workers.size()) {
+                return NULL;
+            }
+
+            return &workers[index]->clu;
+        }
+
+        int cluster_group::start(size_t index) {
+            if (index >= workers.size()) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            worker_t *w = workers[index];
+            load_slots(w);
+            if (0 != w->slot_version) {
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            return w->clu.start();
+        }
+
+        int cluster_group::reset() {
+            for (size_t i = 0; i < workers.size(); ++i) {
+                worker_t *w = workers[i];
+
+                request_t *req;
+                while (NULL != (req = pop(w))) {
+                    cmd_t *cmd = w->clu.create_cmd(req->callback, req->pri_data);
+                    if (NULL != cmd) {
+                        w->clu.call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, NULL, NULL);
+                        w->clu.destroy_cmd(cmd);
+                    }
+                    delete req;
+                }
+                w->queued.store(0);
+
+                w->clu.reset();
+                w->slot_version = 0;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(slot_snapshot_lock);
+                slot_snapshot.reset();
+                slot_node_count.store(0, std::memory_order_release);
+            }
+            slot_version.store(0);
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int cluster_group::submit(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv,
+                                  const size_t *argvlen) {
+            sds content = NULL;
+            if (redisFormatSdsCommandArgv(&content, argc, argv, argvlen) <= 0) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
+
+            return enqueue(key, ks, cbk, priv_data, content);
+        }
+
+        int cluster_group::submit(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...) {
+            char *buf = NULL;
+            va_list ap;
+            va_start(ap, fmt);
+            int len = redisvFormatCommand(&buf, fmt, ap);
+            va_end(ap);
+            if (len <= 0 || NULL == buf) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
+
+            sds content = sdsnewlen(buf, static_cast<size_t>(len));
+            redisFreeCommand(buf);
+            if (NULL == content) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
+
+            return enqueue(key, ks, cbk, priv_data, content);
+        }
+
+        int cluster_group::enqueue(const char *key, size_t ks, cmd_t::callback_fn_t cbk, void *priv_data, sds content) {
+            if (workers.empty()) {
+                sdsfree(content);
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            request_t *req = new request_t();
+            if (NULL != key && 0 != ks) {
+                req->key.assign(key, ks);
+            }
+            req->callback = cbk;
+            req->pri_data = priv_data;
+            req->content = content;
+
+            size_t index = pick_worker(key, ks);
+            worker_t *w = workers[index];
+            push(w, req);
+
+            // only the first one wakes up the worker, the others are dispatched together
+            if (0 == w->queued.fetch_add(1) && on_submit) {
+                on_submit(this, index);
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        size_t cluster_group::pick_worker(const char *key, size_t ks) const {
+            size_t n = workers.size();
+            int slot = cluster::get_slot_index(key, ks);
+            if (n <= 1 || slot < 0) {
+                return 0;
+            }
+
+            // connections to a node are only in one worker if there are enough nodes, or slots are spread to all workers
+            // it's called by every submit, so only atomic loads here. A slot may be picked by the old node while a snapshot is being published
+            if (slot_node_count.load(std::memory_order_acquire) >= n) {
+                uint16_t node = slot_nodes[slot].load(std::memory_order_relaxed);
+                if (HIREDIS_HAPP_SLOT_NODE_NONE != node) {
+                    return node % n;
+                }
+            }
+
+            return static_cast<size_t>(slot) % n;
+        }
+
+        size_t cluster_group::dispatch(size_t index) {
+            if (index >= workers.size()) {
+                return 0;
+            }
+
+            worker_t *w = workers[index];
+
+            // cmds are sent by the latest slots
+            load_slots(w);
+
+            long count = 0;
+            request_t *req;
+            while (NULL != (req = pop(w))) {
+                ++count;
+
+                cmd_t *cmd = w->clu.create_cmd(req->callback, req->pri_data);
+                if (NULL == cmd) {
+                    delete req;
+                    continue;
+                }
+
+                if (cmd->vformat(&req->content) <= 0) {
+                    w->clu.call_cmd(cmd, error_code::REDIS_HAPP_CREATE, NULL, NULL);
+                    w->clu.destroy_cmd(cmd);
+                } else if (req->key.empty()) {
+                    w->clu.exec(NULL, 0, cmd);
+                } else {
+                    w->clu.exec(req->key.c_str(), req->key.size(), cmd);
+                }
+                delete req;
+            }
+
+            // a producer is linking its request, wake up again so it will not wait for the next submit
+            if (w->queued.fetch_sub(count) - count > 0 && on_submit) {
+                on_submit(this, index);
+            }
+
+            return static_cast<size_t>(count);
+        }
+
+        int cluster_group::proc(size_t index, time_t sec, time_t usec) {
+            if (index >= workers.size()) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            dispatch(index);
+            return workers[index]->clu.proc(sec, usec);
+        }
+
+        cluster_group::slot_snapshot_ptr_t cluster_group::get_slot_snapshot() const {
+            std::lock_guard<std::mutex> lock(slot_snapshot_lock);
+            return slot_snapshot;
+        }
+
+        cluster_group::onsubmit_fn_t cluster_group::set_on_submit(onsubmit_fn_t cbk) {
+            using std::swap;
+            swap(cbk, on_submit);
+            return cbk;
+        }
+
+        size_t cluster_group::get_queued_count(size_t index) const {
+            if (index >= workers.size()) {
+                return 0;
+            }
+
+            long ret = workers[index]->queued.load();
+            return ret > 0 ? static_cast<size_t>(ret) : 0;
+        }
+
+        void cluster_group::push(worker_t *w, request_t *req) {
+            req->next.store(NULL, std::memory_order_relaxed);
+            request_t *prev = w->head.exchange(req, std::memory_order_acq_rel);
+            prev->next.store(req, std::memory_order_release);
+        }
+
+        cluster_group::request_t *cluster_group::pop(worker_t *w) {
+            request_t *tail = w->tail;
+            request_t *next = tail->next.load(std::memory_order_acquire);
+            if (&w->stub == tail) {
+                if (NULL == next) {
+                    return NULL;
+                }
+
+                w->tail = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+
+            if (NULL != next) {
+                w->tail = next;
+                return tail;
+            }
+
+            // a producer has exchanged head but not linked it yet
+            if (tail != w->head.load(std::memory_order_acquire)) {
+                return NULL;
+            }
+
+            // tail is the last one, push stub behind it so it can be popped
+            push(w, &w->stub);
+            next = tail->next.load(std::memory_order_acquire);
+            if (NULL != next) {
+                w->tail = next;
+                return tail;
+            }
+
+            return NULL;
+        }
+
+        void cluster_group::publish_slots(cluster *clu) {
+            worker_t *w = NULL;
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (&workers[i]->clu == clu) {
+                    w = workers[i];
+                    break;
+                }
+            }
+
+            if (NULL == w) {
+                return;
+            }
+
+            slot_snapshot_t *snapshot = new slot_snapshot_t();
+            snapshot->version = slot_version.fetch_add(1) + 1;
+            snapshot->nodes = clu->get_slot_nodes();
+            std::copy(clu->get_slot_table(), clu->get_slot_table() + HIREDIS_HAPP_SLOT_NUMBER, snapshot->slots);
+            w->slot_version = snapshot->version;
+
+            // readers keep the old one until they release it, and a newer one published by another worker is never replaced
+            slot_snapshot_ptr_t desired(snapshot);
+            std::lock_guard<std::mutex> lock(slot_snapshot_lock);
+            if (!slot_snapshot || slot_snapshot->version < desired->version) {
+                slot_snapshot = desired;
+
+                for (size_t i = 0; i < HIREDIS_HAPP_SLOT_NUMBER; ++i) {
+                    slot_nodes[i].store(desired->slots[i], std::memory_order_relaxed);
+                }
+                slot_node_count.store(desired->nodes.size(), std::memory_order_release);
+            }
+        }
+
+        void cluster_group::load_slots(worker_t *w) {
+            // nothing new, only an atomic load in the fast path
+            if (slot_version.load() <= w->slot_version) {
+                return;
+            }
+
+            slot_snapshot_ptr_t snapshot = get_slot_snapshot();
+            if (!snapshot || snapshot->version <= w->slot_version) {
+                return;
+            }
+
+            w->slot_version = snapshot->version;
+            w->clu.load_slots(snapshot->nodes, snapshot->slots);
+        }
+    }
+}
+
+#endif
@@ -1,4 +1,5 @@
 
+#include <cctype>
 #include <cstring>
 #include <cstdlib>
 #include <algorithm>
@@ -6,6 +7,7 @@
 #include <assert.h>
 
 #include "detail/happ_cmd.h"
+#include "detail/happ_stats.h"
 
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1600)
 #include <type_traits>
@@ -17,12 +19,103 @@
 
 namespace hiredis {
     namespace happ {
-        cmd_exec* cmd_exec::create(holder_t holder, callback_fn_t cbk, void* pridata, size_t buffer_len) {
-            size_t sum_len = sizeof(cmd_exec) + buffer_len;
-            // padding to sizeof(void*)
-            sum_len = (sum_len + sizeof(void*) - 1) & (~(sizeof(void*) - 1));
+        namespace detail {
+            // sorted read-only commands which can be sent to replicas
+            static const char* readonly_cmds[] = {
+                "BITCOUNT", "BITFIELD_RO", "BITPOS", "DUMP", "EXISTS", "GEODIST", "GEOHASH", "GEOPOS", "GEORADIUSBYMEMBER_RO", "GEORADIUS_RO",
+                "GEOSEARCH", "GET", "GETBIT", "GETRANGE", "HEXISTS", "HGET", "HGETALL", "HKEYS", "HLEN", "HMGET", "HRANDFIELD", "HSCAN", "HSTRLEN",
+                "HVALS", "LINDEX", "LLEN", "LPOS", "LRANGE", "MGET", "PFCOUNT", "PTTL", "SCARD", "SDIFF", "SINTER", "SISMEMBER", "SMEMBERS",
+                "SMISMEMBER", "SRANDMEMBER", "SSCAN", "STRLEN", "SUBSTR", "SUNION", "TTL", "TYPE", "XLEN", "XRANGE", "XREVRANGE", "ZCARD",
+                "ZCOUNT", "ZLEXCOUNT", "ZMSCORE", "ZRANGE", "ZRANGEBYLEX", "ZRANGEBYSCORE", "ZRANK", "ZREVRANGE", "ZREVRANGEBYLEX",
+                "ZREVRANGEBYSCORE", "ZREVRANK", "ZSCAN", "ZSCORE"
+            };
+
+            // sorted read-only commands which read only one key, and whose reply does not change until the key is modified
+            static const char* cacheable_cmds[] = {
+                "BITCOUNT", "BITFIELD_RO", "BITPOS", "GEODIST", "GEOHASH", "GEOPOS", "GET", "GETBIT", "GETRANGE", "HEXISTS", "HGET",
+                "HGETALL", "HKEYS", "HLEN", "HMGET", "HSTRLEN", "HVALS", "LINDEX", "LLEN", "LPOS", "LRANGE", "SCARD", "SISMEMBER",
+                "SMEMBERS", "SMISMEMBER", "STRLEN", "SUBSTR", "TYPE", "XLEN", "XRANGE", "XREVRANGE", "ZCARD", "ZCOUNT", "ZLEXCOUNT",
+                "ZMSCORE", "ZRANGE", "ZRANGEBYLEX", "ZRANGEBYSCORE", "ZRANK", "ZREVRANGE", "ZREVRANGEBYLEX", "ZREVRANGEBYSCORE",
+                "ZREVRANK", "ZSCORE"
+            };
+
+            // compare a command name which may not end with \0 and a upper case string
+            static int compare_cmd_name(const char* cmd, size_t len, const char* upper_name) {
+                for (size_t i = 0; i < len; ++i) {
+                    int l = toupper(static_cast<unsigned char>(cmd[i]));
+                    int r = static_cast<unsigned char>(upper_name[i]);
+                    if (l != r) {
+                        return l - r;
+                    }
+                }
+
+                return 0 == upper_name[len] ? 0 : -1;
+            }
+
+            // binary search in a sorted list of upper case command names
+            static bool find_cmd_name(const char** names, size_t count, const char* cmd, size_t len) {
+                if (NULL == cmd || 0 == len) {
+                    return false;
+                }
+
+                size_t l = 0;
+                size_t r = count;
+                while (l < r) {
+                    size_t m = l + (r - l) / 2;
+                    int res = compare_cmd_name(cmd, len, names[m]);
+                    if (0 == res) {
+                        return true;
+                    } else if (res < 0) {
+                        r = m;
+                    } else {
+                        l = m + 1;
+                    }
+                }
+
+                return false;
+            }
+
+            static size_t count_digits(size_t v) {
+                size_t ret = 1;
+                while (v >= 10) {
+                    v /= 10;
+                    ++ret;
+                }
+
+                return ret;
+            }
+
+            // write [prefix][v]\r\n, digits is count_digits(v)
+            static char* write_length(char* out, char prefix, size_t v, size_t digits) {
+                *out++ = prefix;
+                for (size_t i = digits; i > 0; --i) {
+                    out[i - 1] = static_cast<char>('0' + v % 10);
+                    v /= 10;
+                }
+                out += digits;
+                *out++ = '\r';
+                *out++ = '\n';
+                return out;
+            }
+        }
+
+        cmd_exec* cmd_exec::create(holder_t holder, callback_fn_t cbk, void* pridata, size_t buffer_len, cmd_pool* pool) {
+            cmd_exec* ret = NULL;
+            char* wire_buffer = NULL;
+            size_t wire_buffer_size = 0;
+            if (NULL != pool) {
+                ret = pool->pop(buffer_len);
+            }
 
-            cmd_exec* ret = reinterpret_cast<cmd_exec*>(malloc(sum_len));
+            // reuse wire buffer of cached cmd
+            if (NULL != ret) {
+                wire_buffer = ret->wire_buffer;
+                wire_buffer_size = ret->wire_buffer_size;
+            }
+
+            if (NULL == ret) {
+                ret = reinterpret_cast<cmd_exec*>(malloc(cmd_pool::get_block_size(buffer_len)));
+            }
 
             if (NULL == ret) {
                 return NULL;
@@ -36,10 +129,16 @@ namespace hiredis {
             ret->ttl = HIREDIS_HAPP_TTL;
 
             ret->engine.slot = -1;
+
+            ret->pool = pool;
+            ret->buffer_len = buffer_len;
+            ret->wire_buffer = wire_buffer;
+            ret->wire_buffer_size = wire_buffer_size;
+            ret->timer.owner = ret;
             return ret;
         }
 
-        static void free_cmd_content(cmd_content* c) {
+        static void free_cmd_content(cmd_content* c, const char* wire_buffer) {
             if (NULL == c) {
                 return;
             }
@@ -50,10 +149,11 @@ namespace hiredis {
                     c->content.redis_sds = NULL;
                 }
             } else {
-                if (NULL != c->content.raw) {
+                // wire buffer is owned by cmd
+                if (NULL != c->content.raw && wire_buffer != c->content.raw) {
                     redisFreeCommand(c->content.raw);
-                    c->content.raw = NULL;
                 }
+                c->content.raw = NULL;
                 c->raw_len = 0;
             }
         }
@@ -63,23 +163,79 @@ namespace hiredis {
                 return;
             }
 
-            free_cmd_content(&c->cmd);
+            free_cmd_content(&c->cmd, c->wire_buffer);
+            cmd_timer_wheel::remove(c);
 
-            free(c);
+            if (NULL == c->pool || !c->pool->push(c)) {
+                cmd_pool::free_block(c);
+            }
         }
 
+        char* cmd_exec::reserve_wire_buffer(size_t s) {
+            if (s <= wire_buffer_size && NULL != wire_buffer) {
+                return wire_buffer;
+            }
+
+            size_t new_size = wire_buffer_size > 0 ? wire_buffer_size : 128;
+            while (new_size < s) {
+                new_size <<= 1;
+            }
+
+            char* new_buffer = reinterpret_cast<char*>(realloc(wire_buffer, new_size));
+            if (NULL == new_buffer) {
+                return NULL;
+            }
+
+            wire_buffer = new_buffer;
+            wire_buffer_size = new_size;
+            return wire_buffer;
+        }
 
         int cmd_exec::vformat(int argc, const char** argv, const size_t* argvlen) {
-            free_cmd_content(&cmd);
+            free_cmd_content(&cmd, wire_buffer);
 
-            cmd.raw_len = 0;
-            return redisFormatSdsCommandArgv(&cmd.content.redis_sds, argc, argv, argvlen);
+            // cmds not from pool are short-lived, just use hiredis's sds
+            if (NULL == pool || argc < 0) {
+                cmd.raw_len = 0;
+                return redisFormatSdsCommandArgv(&cmd.content.redis_sds, argc, argv, argvlen);
+            }
+
+            // @see http://redis.io/topics/protocol
+            // *[argc]\r\n and then $[LENGTH]\r\n[CONTENT]\r\n for every argument
+            size_t argc_digits = detail::count_digits(static_cast<size_t>(argc));
+            size_t total_len = 1 + argc_digits + 2;
+            for (int i = 0; i < argc; ++i) {
+                size_t len = NULL == argvlen ? strlen(argv[i]) : argvlen[i];
+                total_len += 1 + detail::count_digits(len) + 2 + len + 2;
+            }
+
+            // keep \0 at the end, so pick_argument can use strchr
+            char* out = reserve_wire_buffer(total_len + 1);
+            if (NULL == out) {
+                cmd.raw_len = 0;
+                return redisFormatSdsCommandArgv(&cmd.content.redis_sds, argc, argv, argvlen);
+            }
+
+            out = detail::write_length(out, '*', static_cast<size_t>(argc), argc_digits);
+            for (int i = 0; i < argc; ++i) {
+                size_t len = NULL == argvlen ? strlen(argv[i]) : argvlen[i];
+                out = detail::write_length(out, '$', len, detail::count_digits(len));
+                memcpy(out, argv[i], len);
+                out += len;
+                *out++ = '\r';
+                *out++ = '\n';
+            }
+            *out = 0;
+
+            cmd.content.raw = wire_buffer;
+            cmd.raw_len = total_len;
+            return static_cast<int>(total_len);
         }
 
         int cmd_exec::format(const char* fmt, ...) {
             va_list ap;
 
-            free_cmd_content(&cmd);
+            free_cmd_content(&cmd, wire_buffer);
             va_start(ap, fmt);
             cmd.raw_len = redisvFormatCommand(&cmd.content.raw, fmt, ap);
             va_end(ap);
@@ -88,7 +244,7 @@ namespace hiredis {
         }
 
         int cmd_exec::vformat(const char* fmt, va_list ap) {
-            free_cmd_content(&cmd);
+            free_cmd_content(&cmd, wire_buffer);
 
             va_list ap_c;
             va_copy(ap_c, ap);
@@ -97,23 +253,72 @@ namespace hiredis {
         }
 
         int cmd_exec::vformat(const sds* src) {
-            free_cmd_content(&cmd);
+            free_cmd_content(&cmd, wire_buffer);
 
             if (NULL == src) {
                 return 0;
             }
 
+            // copy into wire buffer if from pool
+            size_t src_len = sdslen(*src);
+            if (NULL != pool && src_len > 0 && NULL != reserve_wire_buffer(src_len + 1)) {
+                memcpy(wire_buffer, *src, src_len);
+                wire_buffer[src_len] = 0;
+                cmd.content.raw = wire_buffer;
+                cmd.raw_len = src_len;
+                return static_cast<int>(src_len);
+            }
+
             cmd.content.redis_sds = sdsdup(*src);
             cmd.raw_len = 0;
 
             return static_cast<int>(sdslen(cmd.content.redis_sds));
         }
 
+        int cmd_exec::copy_from(const cmd_exec* src) {
+            if (NULL == src) {
+                return 0;
+            }
+
+            if (0 == src->cmd.raw_len) {
+                if (NULL == src->cmd.content.redis_sds) {
+                    free_cmd_content(&cmd, wire_buffer);
+                    return 0;
+                }
+
+                return vformat(&src->cmd.content.redis_sds);
+            }
+
+            free_cmd_content(&cmd, wire_buffer);
+            if (NULL != pool && NULL != reserve_wire_buffer(src->cmd.raw_len + 1)) {
+                memcpy(wire_buffer, src->cmd.content.raw, src->cmd.raw_len);
+                wire_buffer[src->cmd.raw_len] = 0;
+                cmd.content.raw = wire_buffer;
+                cmd.raw_len = src->cmd.raw_len;
+                return static_cast<int>(cmd.raw_len);
+            }
+
+            cmd.content.redis_sds = sdsnewlen(src->cmd.content.raw, src->cmd.raw_len);
+            cmd.raw_len = 0;
+            return NULL == cmd.content.redis_sds ? 0 : static_cast<int>(sdslen(cmd.content.redis_sds));
+        }
+
         int cmd_exec::call_reply(int rcode, redisAsyncContext* context, void* reply) {
             if (NULL == callback) {
                 return error_code::REDIS_HAPP_OK;
             }
 
+            if (NULL != stats) {
+                ++stats->finished;
+                if (error_code::REDIS_HAPP_OK != rcode) {
+                    stats->add_error(rcode);
+                }
+
+                if (0 != start_usec) {
+                    stats->latency.record(cmd_stats::now_usec() - start_usec);
+                }
+            }
+
             err = rcode;
             callback_fn_t tc = callback;
             callback = NULL;
@@ -176,6 +381,92 @@ namespace hiredis {
         const char* cmd_exec::pick_cmd(const char** str, size_t* len) {
             return pick_argument(NULL, str, len);
         }
+
+        bool cmd_exec::is_readonly() {
+            const char* cstr = NULL;
+            size_t clen = 0;
+            pick_cmd(&cstr, &clen);
+            if (NULL == cstr) {
+                return false;
+            }
+
+            return is_readonly_cmd(cstr, clen);
+        }
+
+        bool cmd_exec::is_readonly_cmd(const char* cmd, size_t len) {
+            return detail::find_cmd_name(detail::readonly_cmds, sizeof(detail::readonly_cmds) / sizeof(detail::readonly_cmds[0]), cmd, len);
+        }
+
+        bool cmd_exec::is_cacheable_cmd(const char* cmd, size_t len) {
+            return detail::find_cmd_name(detail::cacheable_cmds, sizeof(detail::cacheable_cmds) / sizeof(detail::cacheable_cmds[0]), cmd, len);
+        }
+
+        const char* cmd_exec::get_content(size_t* len) const {
+            if (0 == cmd.raw_len) {
+                if (NULL == cmd.content.redis_sds) {
+                    *len = 0;
+                    return NULL;
+                }
+
+                *len = sdslen(cmd.content.redis_sds);
+                return cmd.content.redis_sds;
+            }
+
+            *len = cmd.raw_len;
+            return cmd.content.raw;
+        }
+
+        redisReply* cmd_exec::clone_reply(const redisReply* src) {
+            redisReply* ret = reinterpret_cast<redisReply*>(calloc(1, sizeof(redisReply)));
+            if (NULL == ret || NULL == src) {
+                if (NULL != ret) {
+                    ret->type = REDIS_REPLY_NIL;
+                }
+                return ret;
+            }
+
+            ret->type = src->type;
+            ret->integer = src->integer;
+            if (NULL != src->str) {
+                ret->str = reinterpret_cast<char*>(malloc(static_cast<size_t>(src->len) + 1));
+                if (NULL != ret->str) {
+                    memcpy(ret->str, src->str, static_cast<size_t>(src->len));
+                    ret->str[src->len] = 0;
+                    ret->len = src->len;
+                }
+            }
+
+            if (src->elements > 0 && NULL != src->element) {
+                ret->element = reinterpret_cast<redisReply**>(calloc(src->elements, sizeof(redisReply*)));
+                if (NULL != ret->element) {
+                    ret->elements = src->elements;
+                    for (size_t i = 0; i < src->elements; ++i) {
+                        ret->element[i] = clone_reply(src->element[i]);
+                    }
+                }
+            }
+
+            return ret;
+        }
+
+        void cmd_exec::free_reply(redisReply* r) {
+            if (NULL == r) {
+                return;
+            }
+
+            if (NULL != r->element) {
+                for (size_t i = 0; i < r->elements; ++i) {
+                    free_reply(r->element[i]);
+                }
+                free(r->element);
+            }
+
+            if (NULL != r->str) {
+                free(r->str);
+            }
+
+            free(r);
+        }
         
         void cmd_exec::dump(std::ostream& out, redisReply* reply, int ident) {
             if (NULL == reply) {
@@ -222,5 +513,229 @@ namespace hiredis {
             }
             }
         }
+
+        cmd_pool::cmd_pool()
+            : buffer_size(0), block_size(get_block_size(0)), low_watermark(HIREDIS_HAPP_CMD_POOL_LOW_WATERMARK),
+              high_watermark(HIREDIS_HAPP_CMD_POOL_HIGH_WATERMARK), wire_bytes(0), min_cached(0), last_trim_sec(0), hit_count(0), miss_count(0) {}
+
+        cmd_pool::~cmd_pool() { clear(); }
+
+        void cmd_pool::set_buffer_size(size_t s) {
+            if (s == buffer_size) {
+                return;
+            }
+
+            // cmds with old size will be freed when destroyed
+            clear();
+            buffer_size = s;
+            block_size = get_block_size(s);
+        }
+
+        void cmd_pool::set_watermark(size_t low, size_t high) {
+            high_watermark = high;
+            low_watermark = low > high ? high : low;
+
+            while (free_list.size() > high_watermark) {
+                wire_bytes -= free_list.back()->wire_buffer_size;
+                free_block(free_list.back());
+                free_list.pop_back();
+            }
+
+            if (min_cached > free_list.size()) {
+                min_cached = free_list.size();
+            }
+        }
+
+        size_t cmd_pool::trim(time_t sec) {
+            if (sec == last_trim_sec) {
+                return 0;
+            }
+            last_trim_sec = sec;
+
+            // cmds never used since last trim are not required
+            size_t ret = 0;
+            while (min_cached > 0 && free_list.size() > low_watermark) {
+                wire_bytes -= free_list.back()->wire_buffer_size;
+                free_block(free_list.back());
+                free_list.pop_back();
+                --min_cached;
+                ++ret;
+            }
+
+            min_cached = free_list.size();
+            return ret;
+        }
+
+        void cmd_pool::clear() {
+            for (size_t i = 0; i < free_list.size(); ++i) {
+                free_block(free_list[i]);
+            }
+            free_list.clear();
+            wire_bytes = 0;
+            min_cached = 0;
+        }
+
+        size_t cmd_pool::get_block_size(size_t buffer_len) {
+            size_t sum_len = sizeof(cmd_exec) + buffer_len;
+            // padding to sizeof(void*)
+            return (sum_len + sizeof(void*) - 1) & (~(sizeof(void*) - 1));
+        }
+
+        cmd_exec* cmd_pool::pop(size_t buffer_len) {
+            if (buffer_len != buffer_size || free_list.empty()) {
+                ++miss_count;
+                return NULL;
+            }
+
+            ++hit_count;
+            cmd_exec* ret = free_list.back();
+            free_list.pop_back();
+            wire_bytes -= ret->wire_buffer_size;
+
+            if (min_cached > free_list.size()) {
+                min_cached = free_list.size();
+            }
+            return ret;
+        }
+
+        bool cmd_pool::push(cmd_exec* c) {
+            if (NULL == c || c->buffer_len != buffer_size || free_list.size() >= high_watermark) {
+                return false;
+            }
+
+            // do not keep too large formatting buffer
+            if (c->wire_buffer_size > HIREDIS_HAPP_CMD_WIRE_BUFFER_MAX_SIZE) {
+                free(c->wire_buffer);
+                c->wire_buffer = NULL;
+                c->wire_buffer_size = 0;
+            }
+
+            free_list.push_back(c);
+            wire_bytes += c->wire_buffer_size;
+            return true;
+        }
+
+        void cmd_pool::free_block(cmd_exec* c) {
+            if (NULL == c) {
+                return;
+            }
+
+            if (NULL != c->wire_buffer) {
+                free(c->wire_buffer);
+            }
+            free(c);
+        }
+
+        cmd_timer_wheel::cmd_timer_wheel() : current_tick(0), started(false), count(0) {
+            slots.resize(HIREDIS_HAPP_CMD_TIMER_SLOT_NUMBER);
+            for (size_t i = 0; i < slots.size(); ++i) {
+                slots[i].prev = slots[i].next = &slots[i];
+                slots[i].owner = NULL;
+                slots[i].wheel = this;
+                slots[i].expire_tick = 0;
+            }
+        }
+
+        cmd_timer_wheel::~cmd_timer_wheel() {
+            // cmds are owned by others, just unlink them
+            for (size_t i = 0; i < slots.size(); ++i) {
+                while (slots[i].next != &slots[i]) {
+                    remove(slots[i].next->owner);
+                }
+            }
+        }
+
+        void cmd_timer_wheel::add(cmd_exec* c, time_t sec, time_t usec) {
+            if (NULL == c) {
+                return;
+            }
+
+            remove(c);
+
+            // round up, never expire earlier than deadline
+            uint64_t tick = (to_ms(sec, usec) + HIREDIS_HAPP_CMD_TIMER_TICK_MS - 1) / HIREDIS_HAPP_CMD_TIMER_TICK_MS;
+            if (started && tick < current_tick) {
+                tick = current_tick;
+            }
+
+            cmd_timer_node& head = slots[tick % slots.size()];
+            c->timer.expire_tick = tick;
+            c->timer.wheel = this;
+            c->timer.prev = head.prev;
+            c->timer.next = &head;
+            head.prev->next = &c->timer;
+            head.prev = &c->timer;
+            ++count;
+        }
+
+        bool cmd_timer_wheel::remove(cmd_exec* c) {
+            if (NULL == c || NULL == c->timer.wheel) {
+                return false;
+            }
+
+            c->timer.prev->next = c->timer.next;
+            c->timer.next->prev = c->timer.prev;
+            --c->timer.wheel->count;
+
+            c->timer.prev = c->timer.next = NULL;
+            c->timer.wheel = NULL;
+            return true;
+        }
+
+        bool cmd_timer_wheel::set_timeout(cmd_exec* c, time_t now_sec, time_t now_usec, time_t sec, time_t usec) {
+            if (NULL == c || c->deadline_expired || NULL == c->callback) {
+                return false;
+            }
+
+            add(c, now_sec + sec, now_usec + usec);
+            return true;
+        }
+
+        bool cmd_timer_wheel::add_timeout(cmd_exec* c, time_t now_sec, time_t now_usec, time_t sec, time_t usec) {
+            if (NULL == c || NULL != c->timer.wheel || (sec <= 0 && usec <= 0)) {
+                return false;
+            }
+
+            add(c, now_sec + sec, now_usec + usec);
+            return true;
+        }
+
+        size_t cmd_timer_wheel::expire(time_t sec, time_t usec, std::vector<cmd_exec*>& out) {
+            uint64_t now_tick = to_ms(sec, usec) / HIREDIS_HAPP_CMD_TIMER_TICK_MS;
+            if (!started || now_tick < current_tick) {
+                // deadlines added before the first check or a clock going back can be in any slot, so check all slots once
+                started = true;
+                current_tick = now_tick >= slots.size() ? now_tick - slots.size() + 1 : 0;
+            }
+
+            // every slot need to be checked only once
+            uint64_t end_tick = now_tick;
+            if (end_tick - current_tick >= slots.size()) {
+                end_tick = current_tick + slots.size() - 1;
+            }
+
+            size_t ret = 0;
+            for (uint64_t tick = current_tick; tick <= end_tick; ++tick) {
+                cmd_timer_node& head = slots[tick % slots.size()];
+                cmd_timer_node* node = head.next;
+                while (node != &head) {
+                    cmd_timer_node* next = node->next;
+                    if (node->expire_tick <= now_tick) {
+                        cmd_exec* c = node->owner;
+                        remove(c);
+                        out.push_back(c);
+                        ++ret;
+                    }
+                    node = next;
+                }
+            }
+
+            current_tick = now_tick;
+            return ret;
+        }
+
+        uint64_t cmd_timer_wheel::to_ms(time_t sec, time_t usec) {
+            return static_cast<uint64_t>(sec) * 1000 + static_cast<uint64_t>(usec) / 1000;
+        }
     }
 }
@@ -9,7 +9,8 @@
 
 namespace hiredis {
     namespace happ {
-        connection::connection() : sequence(0), context(NULL), conn_status(status::DISCONNECTED) {
+        connection::connection()
+            : sequence(0), context(NULL), reply_head(NULL), reply_tail(NULL), reply_count(0), conn_status(status::DISCONNECTED) {
             make_sequence();
             holder.clu = NULL;
         }
@@ -107,9 +108,15 @@ namespace hiredis {
                 }
 
                 if (REDIS_OK == res) {
+                    ++stats.sent;
+                    c->sent_usec = cmd_stats::now_usec();
+                    if (0 == c->start_usec) {
+                        c->start_usec = c->sent_usec;
+                    }
+
                     c->pick_cmd(&cstr, &clen);
                     if (NULL == cstr) {
-                        reply_list.push_back(c);
+                        push_reply(c);
                     } else {
                         bool is_pattern = tolower(cstr[0]) == 'p';
                         if (is_pattern) {
@@ -130,7 +137,7 @@ namespace hiredis {
                             cmd_exec::destroy(c);
                         } else {
                             // request-response message
-                            reply_list.push_back(c);
+                            push_reply(c);
                         }
                     }
                 }
@@ -221,6 +228,14 @@ namespace hiredis {
                 }
             }
 
+            ++stats.replied;
+            if (error_code::REDIS_HAPP_OK != sc->err) {
+                stats.add_error(sc->err);
+            }
+            if (0 != sc->sent_usec) {
+                stats.latency.record(cmd_stats::now_usec() - sc->sent_usec);
+            }
+
             int res = sc->call_reply(sc->err, context, r);
 
             cmd_exec::destroy(sc);
@@ -229,33 +244,55 @@ namespace hiredis {
 
         cmd_exec *connection::pop_reply(cmd_exec *c) {
             if (NULL == c) {
-                if (reply_list.empty()) {
-                    return NULL;
-                }
-
-                c = reply_list.front();
-                reply_list.pop_front();
-                return c;
+                return pop_front_reply();
             }
 
-            std::list<cmd_exec *>::iterator it = std::find(reply_list.begin(), reply_list.end(), c);
-            if (it == reply_list.end()) {
+            // every cmd knows which reply queue it's in
+            if (this != c->reply_owner) {
                 return NULL;
             }
 
             // first, deal with all expired cmd
-            while (!reply_list.empty() && reply_list.front() != c) {
-                cmd_exec *expired_c = reply_list.front();
-                reply_list.pop_front();
+            while (NULL != reply_head && reply_head != c) {
+                cmd_exec *expired_c = pop_front_reply();
 
+                ++stats.timeouts;
                 expired_c->call_reply(error_code::REDIS_HAPP_TIMEOUT, context, NULL);
                 cmd_exec::destroy(expired_c);
             }
 
-            // now, c == reply_list.front()
-            c = reply_list.front();
-            reply_list.pop_front();
-            return c;
+            // now, c == reply_head
+            return pop_front_reply();
+        }
+
+        void connection::push_reply(cmd_exec *c) {
+            c->reply_next = NULL;
+            c->reply_owner = this;
+            if (NULL == reply_tail) {
+                reply_head = reply_tail = c;
+            } else {
+                reply_tail->reply_next = c;
+                reply_tail = c;
+            }
+
+            ++reply_count;
+        }
+
+        cmd_exec *connection::pop_front_reply() {
+            cmd_exec *ret = reply_head;
+            if (NULL == ret) {
+                return NULL;
+            }
+
+            reply_head = ret->reply_next;
+            if (NULL == reply_head) {
+                reply_tail = NULL;
+            }
+            --reply_count;
+
+            ret->reply_next = NULL;
+            ret->reply_owner = NULL;
+            return ret;
         }
 
         redisAsyncContext *connection::get_context() const { return context; }
@@ -266,9 +303,8 @@ namespace hiredis {
             }
 
             // reply list
-            while (!reply_list.empty()) {
-                cmd_exec *expired_c = reply_list.front();
-                reply_list.pop_front();
+            while (NULL != reply_head) {
+                cmd_exec *expired_c = pop_front_reply();
 
                 // context may already be closed here
                 expired_c->call_reply(error_code::REDIS_HAPP_CONNECTION, NULL, NULL);
@@ -0,0 +1,337 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "detail/happ_connection.h"
+#include "detail/happ_near_cache.h"
+
+namespace hiredis {
+    namespace happ {
+        struct near_cache::entry_t {
+            std::string cmd;
+            std::string key;
+            redisReply *reply;
+            size_t memory;
+            size_t refs;   // pinned by callbacks
+            bool removed;  // removed from cache, and will be freed when unpinned
+            entry_t *prev;
+            entry_t *next;
+        };
+
+        // user callback of a cmd whose reply will be cached
+        struct near_cache::request_t {
+            near_cache *owner;
+            cmd_exec::callback_fn_t callback;
+            void *pri_data;
+            uint64_t generation;
+        };
+
+        near_cache::near_cache() : max_memory(0), memory(0), generation(0), lru_head(NULL), lru_tail(NULL), hits(0), misses(0), evictions(0), invalidations(0) {}
+
+        near_cache::~near_cache() { clear(); }
+
+        void near_cache::set_max_memory(size_t bytes) {
+            max_memory = bytes;
+            evict();
+        }
+
+        near_cache::entry_t *near_cache::acquire(cmd_exec *cmd) {
+            if (0 == max_memory || NULL == cmd) {
+                return NULL;
+            }
+
+            // writes are the most of cmds in many cases, skip them before copying the whole cmd
+            const char *key = NULL;
+            size_t key_len = 0;
+            if (false == pick_key(cmd, &key, &key_len)) {
+                return NULL;
+            }
+
+            size_t len = 0;
+            const char *content = cmd->get_content(&len);
+            if (NULL == content || 0 == len) {
+                return NULL;
+            }
+
+            HIREDIS_HAPP_MAP(std::string, entry_t *)::iterator it = entries.find(std::string(content, len));
+            if (entries.end() == it) {
+                ++misses;
+                return NULL;
+            }
+
+            // move to head
+            entry_t *e = it->second;
+            if (lru_head != e) {
+                e->prev->next = e->next;
+                if (NULL != e->next) {
+                    e->next->prev = e->prev;
+                } else {
+                    lru_tail = e->prev;
+                }
+
+                e->prev = NULL;
+                e->next = lru_head;
+                lru_head->prev = e;
+                lru_head = e;
+            }
+
+            ++hits;
+            ++e->refs;
+            return e;
+        }
+
+        void near_cache::release(entry_t *e) {
+            if (NULL == e || 0 == e->refs) {
+                return;
+            }
+
+            if (0 == --e->refs && e->removed) {
+                cmd_exec::free_reply(e->reply);
+                delete e;
+            }
+        }
+
+        redisReply *near_cache::get_reply(entry_t *e) { return NULL == e ? NULL : e->reply; }
+
+        bool near_cache::wrap(cmd_exec *cmd) {
+            if (0 == max_memory || NULL == cmd || NULL == cmd->callback || on_reply == cmd->callback) {
+                return false;
+            }
+
+            const char *key = NULL;
+            size_t key_len = 0;
+            if (false == pick_key(cmd, &key, &key_len)) {
+                return false;
+            }
+
+            request_t *req = new request_t();
+            req->owner = this;
+            req->callback = cmd->callback;
+            req->pri_data = cmd->pri_data;
+            req->generation = generation;
+
+            cmd->callback = on_reply;
+            cmd->pri_data = req;
+            return true;
+        }
+
+        bool near_cache::put(cmd_exec *cmd, const redisReply *reply, uint64_t gen) {
+            // keys may be changed after cmd is sent
+            if (0 == max_memory || NULL == cmd || NULL == reply || REDIS_REPLY_ERROR == reply->type || gen != generation) {
+                return false;
+            }
+
+            const char *key = NULL;
+            size_t key_len = 0;
+            if (false == pick_key(cmd, &key, &key_len)) {
+                return false;
+            }
+
+            size_t len = 0;
+            const char *content = cmd->get_content(&len);
+            std::string cmd_content(content, len);
+            size_t entry_memory = sizeof(entry_t) + len + key_len + get_reply_memory(reply);
+            if (entry_memory > max_memory) {
+                return false;
+            }
+
+            // replace the old one
+            HIREDIS_HAPP_MAP(std::string, entry_t *)::iterator it = entries.find(cmd_content);
+            if (entries.end() != it) {
+                remove(it->second);
+            }
+
+            entry_t *e = new entry_t();
+            e->reply = cmd_exec::clone_reply(reply);
+            if (NULL == e->reply) {
+                delete e;
+                return false;
+            }
+            e->cmd.swap(cmd_content);
+            e->key.assign(key, key_len);
+            e->memory = entry_memory;
+            e->refs = 0;
+            e->removed = false;
+            e->prev = NULL;
+            e->next = lru_head;
+            if (NULL != lru_head) {
+                lru_head->prev = e;
+            } else {
+                lru_tail = e;
+            }
+            lru_head = e;
+
+            entries[e->cmd] = e;
+            keys[e->key].push_back(e);
+            memory += entry_memory;
+
+            evict();
+            return true;
+        }
+
+        size_t near_cache::invalidate(const char *key, size_t len) {
+            ++generation;
+
+            HIREDIS_HAPP_MAP(std::string, std::vector<entry_t *>)::iterator it = keys.find(std::string(key, len));
+            if (keys.end() == it) {
+                return 0;
+            }
+
+            // remove will change the list, so copy it first
+            std::vector<entry_t *> key_entries;
+            key_entries.swap(it->second);
+            keys.erase(it);
+            for (size_t i = 0; i < key_entries.size(); ++i) {
+                remove(key_entries[i]);
+            }
+
+            invalidations += key_entries.size();
+            return key_entries.size();
+        }
+
+        void near_cache::clear() {
+            ++generation;
+
+            while (NULL != lru_head) {
+                remove(lru_head);
+            }
+        }
+
+        bool near_cache::on_invalidate(const redisReply *msg) {
+            // message, __redis__:invalidate, [keys...] or nil if all keys are flushed
+            if (NULL == msg || REDIS_REPLY_ARRAY != msg->type || msg->elements < 3) {
+                return false;
+            }
+
+            const redisReply *type = msg->element[0];
+            const redisReply *channel = msg->element[1];
+            if (NULL == type || REDIS_REPLY_STRING != type->type || 0 != HIREDIS_HAPP_STRCASE_CMP("message", type->str)) {
+                return false;
+            }
+
+            if (NULL == channel || REDIS_REPLY_STRING != channel->type || 0 != strcmp("__redis__:invalidate", channel->str)) {
+                return false;
+            }
+
+            const redisReply *invalidated = msg->element[2];
+            if (NULL != invalidated && REDIS_REPLY_ARRAY == invalidated->type) {
+                for (size_t i = 0; i < invalidated->elements; ++i) {
+                    const redisReply *key = invalidated->element[i];
+                    if (NULL != key && NULL != key->str) {
+                        invalidate(key->str, static_cast<size_t>(key->len));
+                    }
+                }
+            } else {
+                clear();
+            }
+
+            return true;
+        }
+
+        void near_cache::set_tracked(const connection *conn, bool tracked) {
+            if (tracked) {
+                tracked_conns.insert(conn);
+            } else {
+                tracked_conns.erase(conn);
+            }
+        }
+
+        void near_cache::on_reply(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            request_t *req = reinterpret_cast<request_t *>(privdata);
+            near_cache *self = req->owner;
+            cmd_exec::callback_fn_t callback = req->callback;
+            void *pri_data = req->pri_data;
+
+            if (error_code::REDIS_HAPP_OK == cmd->result() && NULL != c && self->is_tracked(reinterpret_cast<const connection *>(c->data))) {
+                self->put(cmd, reinterpret_cast<const redisReply *>(r), req->generation);
+            }
+            delete req;
+
+            cmd->pri_data = pri_data;
+            if (NULL != callback) {
+                callback(cmd, c, r, pri_data);
+            }
+        }
+
+        bool near_cache::pick_key(cmd_exec *cmd, const char **key, size_t *len) {
+            const char *name = NULL;
+            size_t name_len = 0;
+            const char *next = cmd->pick_cmd(&name, &name_len);
+            if (NULL == name || false == cmd_exec::is_cacheable_cmd(name, name_len)) {
+                return false;
+            }
+
+            *key = NULL;
+            cmd->pick_argument(next, key, len);
+            return NULL != *key;
+        }
+
+        size_t near_cache::get_reply_memory(const redisReply *r) {
+            if (NULL == r) {
+                return 0;
+            }
+
+            size_t ret = sizeof(redisReply);
+            if (NULL != r->str) {
+                ret += static_cast<size_t>(r->len) + 1;
+            }
+
+            ret += r->elements * sizeof(redisReply *);
+            for (size_t i = 0; i < r->elements; ++i) {
+                ret += get_reply_memory(r->element[i]);
+            }
+
+            return ret;
+        }
+
+        void near_cache::remove(entry_t *e) {
+            if (NULL == e->prev) {
+                lru_head = e->next;
+            } else {
+                e->prev->next = e->next;
+            }
+
+            if (NULL == e->next) {
+                lru_tail = e->prev;
+            } else {
+                e->next->prev = e->prev;
+            }
+
+            entries.erase(e->cmd);
+            HIREDIS_HAPP_MAP(std::string, std::vector<entry_t *>)::iterator it = keys.find(e->key);
+            if (keys.end() != it) {
+                std::vector<entry_t *> &key_entries = it->second;
+                for (size_t i = 0; i < key_entries.size(); ++i) {
+                    if (key_entries[i] == e) {
+                        key_entries[i] = key_entries.back();
+                        key_entries.pop_back();
+                        break;
+                    }
+                }
+
+                if (key_entries.empty()) {
+                    keys.erase(it);
+                }
+            }
+
+            memory -= e->memory;
+
+            // still used by callback
+            if (e->refs > 0) {
+                e->removed = true;
+                e->prev = NULL;
+                e->next = NULL;
+                return;
+            }
+
+            cmd_exec::free_reply(e->reply);
+            delete e;
+        }
+
+        void near_cache::evict() {
+            while (memory > max_memory && NULL != lru_tail) {
+                ++evictions;
+                remove(lru_tail);
+            }
+        }
+    }
+}
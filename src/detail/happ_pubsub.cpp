@@ -0,0 +1,137 @@
+#include <cstring>
+
+#include "detail/happ_pubsub.h"
+
+namespace hiredis {
+    namespace happ {
+        namespace detail {
+            static const char *pubsub_subscribe_cmds[] = {"SUBSCRIBE", "PSUBSCRIBE", "SSUBSCRIBE"};
+            static const char *pubsub_unsubscribe_cmds[] = {"UNSUBSCRIBE", "PUNSUBSCRIBE", "SUNSUBSCRIBE"};
+
+            static bool is_reply_str(const redisReply *r, const char *str, size_t len) {
+                return NULL != r && REDIS_REPLY_STRING == r->type && static_cast<size_t>(r->len) == len && 0 == memcmp(r->str, str, len);
+            }
+        }
+
+        pubsub::pubsub() : messages(0), dropped(0) {}
+
+        pubsub::subscription_t *pubsub::add(channel_type::type t, const std::string &name, message_fn_t fn) {
+            subscription_map_t::iterator it = subscriptions[t].find(name);
+            if (subscriptions[t].end() != it) {
+                it->second.fn = fn;
+                return &it->second;
+            }
+
+            subscription_t &ret = subscriptions[t][name];
+            ret.name = name;
+            ret.t = t;
+            ret.fn = fn;
+            return &ret;
+        }
+
+        pubsub::subscription_t *pubsub::find(channel_type::type t, const std::string &name) {
+            subscription_map_t::iterator it = subscriptions[t].find(name);
+            if (subscriptions[t].end() == it) {
+                return NULL;
+            }
+
+            return &it->second;
+        }
+
+        bool pubsub::remove(channel_type::type t, const std::string &name, std::string &node) {
+            subscription_map_t::iterator it = subscriptions[t].find(name);
+            if (subscriptions[t].end() == it) {
+                return false;
+            }
+
+            node.swap(it->second.node);
+            subscriptions[t].erase(it);
+            return true;
+        }
+
+        void pubsub::clear() {
+            for (int i = 0; i < channel_type::MAX; ++i) {
+                subscriptions[i].clear();
+            }
+        }
+
+        size_t pubsub::reset_node(const std::string &node) {
+            size_t ret = 0;
+            for (int i = 0; i < channel_type::MAX; ++i) {
+                for (subscription_map_t::iterator it = subscriptions[i].begin(); it != subscriptions[i].end(); ++it) {
+                    if (it->second.node == node) {
+                        it->second.node.clear();
+                        ++ret;
+                    }
+                }
+            }
+
+            return ret;
+        }
+
+        bool pubsub::dispatch(const redisReply *r) {
+            // message, channel, payload
+            // pmessage, pattern, channel, payload
+            // smessage, channel, payload
+            if (NULL == r || REDIS_REPLY_ARRAY != r->type || r->elements < 3) {
+                return false;
+            }
+
+            channel_type::type t;
+            const redisReply *name;
+            const redisReply *channel;
+            const redisReply *message;
+            if (detail::is_reply_str(r->element[0], "message", 7)) {
+                t = channel_type::CHANNEL;
+                name = channel = r->element[1];
+                message = r->element[2];
+            } else if (detail::is_reply_str(r->element[0], "smessage", 8)) {
+                t = channel_type::SHARD;
+                name = channel = r->element[1];
+                message = r->element[2];
+            } else if (r->elements >= 4 && detail::is_reply_str(r->element[0], "pmessage", 8)) {
+                t = channel_type::PATTERN;
+                name = r->element[1];
+                channel = r->element[2];
+                message = r->element[3];
+            } else {
+                return false;
+            }
+
+            if (NULL == name || NULL == name->str) {
+                return false;
+            }
+
+            ++messages;
+            subscription_map_t::iterator it = subscriptions[t].find(std::string(name->str, static_cast<size_t>(name->len)));
+            if (subscriptions[t].end() == it || !it->second.fn) {
+                ++dropped;
+                return true;
+            }
+
+            // copy it, callback may unsubscribe itself
+            message_fn_t fn = it->second.fn;
+            fn(channel, message);
+            return true;
+        }
+
+        bool pubsub::is_supported(channel_type::type t) {
+            if (t < channel_type::CHANNEL || t >= channel_type::MAX) {
+                return false;
+            }
+
+#if !defined(HIREDIS_HAPP_PUBSUB_SHARD)
+            // old hiredis does not put the context into subscribe mode by SSUBSCRIBE, and smessage would be taken as replies
+            if (channel_type::SHARD == t) {
+                return false;
+            }
+#endif
+
+            return true;
+        }
+
+        const char *pubsub::get_subscribe_cmd(channel_type::type t) { return detail::pubsub_subscribe_cmds[t]; }
+
+        const char *pubsub::get_unsubscribe_cmd(channel_type::type t) { return detail::pubsub_unsubscribe_cmds[t]; }
+    }
+}
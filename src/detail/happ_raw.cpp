@@ -20,6 +20,23 @@ namespace hiredis {
             static char NONE_MSG[] = "none";
         }
 
+        // cmds added by batch_exec and not finished yet
+        struct raw::batch_t {
+            cmd_t *cmd;     // the one passed to batch callback
+            size_t pending; // running cmds, and one more before all cmds are sent
+            int err;        // the first error code of cmds
+            bool flushed;
+            std::vector<batch_cmd_t> cmds;
+        };
+
+        // user callback of a cmd in batch
+        struct raw::batch_cmd_t {
+            batch_t *owner;
+            cmd_t *cmd;
+            cmd_t::callback_fn_t callback;
+            void *pri_data;
+        };
+
         raw::raw() {
             conf.log_fn_debug = conf.log_fn_info = NULL;
             conf.log_buffer = NULL;
@@ -28,6 +45,8 @@ namespace hiredis {
             conf.timer_interval_usec = HIREDIS_HAPP_TIMER_INTERVAL_USEC;
             conf.timer_timeout_sec = HIREDIS_HAPP_TIMER_TIMEOUT_SEC;
             conf.cmd_buffer_size = 0;
+            conf.cmd_timeout_sec = HIREDIS_HAPP_CMD_TIMEOUT_SEC;
+            conf.cmd_timeout_usec = HIREDIS_HAPP_CMD_TIMEOUT_USEC;
 
             memset(&callbacks, 0, sizeof(callbacks));
 
@@ -36,6 +55,13 @@ namespace hiredis {
 
             timer_actions.timer_conn.sequence = 0;
             timer_actions.timer_conn.timeout = 0;
+
+            tracking_client_id = 0;
+            resubscribe_status.pending = false;
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+            resubscribe_status.retry_sec = 0;
+            resubscribe_status.retry_usec = 0;
         }
 
         raw::~raw() {
@@ -73,6 +99,18 @@ namespace hiredis {
                 redisAsyncDisconnect(conn_->get_context());
             }
 
+            if (tracking_conn_ && NULL != tracking_conn_->get_context()) {
+                redisAsyncDisconnect(tracking_conn_->get_context());
+            }
+
+            if (subscriber_conn_ && NULL != subscriber_conn_->get_context()) {
+                redisAsyncDisconnect(subscriber_conn_->get_context());
+            }
+
+            if (redirected_conn_ && NULL != redirected_conn_->get_context()) {
+                redisAsyncDisconnect(redirected_conn_->get_context());
+            }
+
             // release timer pending list
             while (!timer_actions.timer_pending.empty()) {
                 cmd_t *cmd = timer_actions.timer_pending.front().cmd;
@@ -89,6 +127,17 @@ namespace hiredis {
             timer_actions.timer_conn.sequence = 0;
             timer_actions.timer_conn.timeout = 0;
 
+            // no invalidation messages any more
+            reply_cache.clear();
+
+            // all subscriptions are removed
+            subscriptions.clear();
+            resubscribe_status.pending = false;
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+            resubscribe_status.retry_sec = 0;
+            resubscribe_status.retry_usec = 0;
+
             // If in a callback, cmds in this connection will not finished, so it can not be freed.
             // In this case, it will call disconnect callback after callback is finished and then release the connection.
             // If not in a callback, this connection is already freed at the begining "redisAsyncDisconnect(conn_->get_context());"
@@ -153,6 +202,13 @@ namespace hiredis {
                 return NULL;
             }
 
+            // already finished by deadline
+            if (cmd->deadline_expired) {
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            add_cmd_deadline(cmd);
+
             // ttl pre judge
             if (0 == cmd->ttl) {
                 log_debug("cmd %p ttl expired", cmd);
@@ -161,6 +217,20 @@ namespace hiredis {
                 return NULL;
             }
 
+            // near cache, only the first sending
+            if (HIREDIS_HAPP_TTL == cmd->ttl && reply_cache.is_enabled()) {
+                near_cache::entry_t *cached = reply_cache.acquire(cmd);
+                if (NULL != cached) {
+                    log_debug("cmd %p hit near cache", cmd);
+                    call_cmd(cmd, error_code::REDIS_HAPP_OK, NULL, near_cache::get_reply(cached));
+                    reply_cache.release(cached);
+                    destroy_cmd(cmd);
+                    return NULL;
+                }
+
+                reply_cache.wrap(cmd);
+            }
+
             // move cmd into connection
             connection_t *conn_inst = get_connection();
             if (NULL == conn_inst) {
@@ -176,6 +246,11 @@ namespace hiredis {
                 return NULL;
             }
 
+            // tracking connection is lost, make a new one
+            if (reply_cache.is_enabled() && !reply_cache.is_tracked(conn_inst) && !tracking_conn_) {
+                make_tracking_connection();
+            }
+
             return exec(conn_inst, cmd);
         }
 
@@ -184,6 +259,13 @@ namespace hiredis {
                 return NULL;
             }
 
+            // already finished by deadline
+            if (cmd->deadline_expired) {
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            add_cmd_deadline(cmd);
+
             // ttl judge
             if (0 == cmd->ttl) {
                 log_debug("cmd %p at connection %s ttl expired", cmd, conf.init_connection.name.c_str());
@@ -192,6 +274,11 @@ namespace hiredis {
                 return NULL;
             }
 
+            // only the first sending adds to retry budget
+            if (HIREDIS_HAPP_TTL == cmd->ttl) {
+                retry_backoff.add_request(timer_actions.last_update_sec);
+            }
+
             // ttl
             --cmd->ttl;
 
@@ -225,17 +312,183 @@ namespace hiredis {
                 return NULL;
             }
 
+            ++stats.sent;
             log_debug("exec cmd %p, connection %s", cmd, conn->get_key().name.c_str());
             return cmd;
         }
 
+        raw::batch_t *raw::create_batch(cmd_t::callback_fn_t cbk, void *priv_data) {
+            cmd_t *cmd = create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
+            // only sub cmds are recorded in stats
+            cmd->stats = NULL;
+
+            batch_t *ret = new batch_t();
+            ret->cmd = cmd;
+            ret->pending = 0;
+            ret->err = error_code::REDIS_HAPP_OK;
+            ret->flushed = false;
+            return ret;
+        }
+
+        raw::cmd_t *raw::batch_exec(batch_t *b, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen) {
+            if (NULL == b || b->flushed) {
+                log_info("can not add cmd into a flushed batch");
+                return NULL;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_batch, NULL);
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            int len = cmd->vformat(argc, argv, argvlen);
+            if (len <= 0) {
+                log_info("format cmd with argc=%d failed", argc);
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                return NULL;
+            }
+
+            b->cmds.push_back(batch_cmd_t());
+            batch_cmd_t &bc = b->cmds.back();
+            bc.owner = b;
+            bc.cmd = cmd;
+            bc.callback = cbk;
+            bc.pri_data = priv_data;
+            return cmd;
+        }
+
+        raw::cmd_t *raw::batch_exec(batch_t *b, cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...) {
+            if (NULL == b || b->flushed) {
+                log_info("can not add cmd into a flushed batch");
+                return NULL;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_batch, NULL);
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            va_list ap;
+            va_start(ap, fmt);
+            int len = cmd->vformat(fmt, ap);
+            va_end(ap);
+            if (len <= 0) {
+                log_info("format cmd with format=%s failed", fmt);
+                cmd->callback = NULL;
+                destroy_cmd(cmd);
+                return NULL;
+            }
+
+            b->cmds.push_back(batch_cmd_t());
+            batch_cmd_t &bc = b->cmds.back();
+            bc.owner = b;
+            bc.cmd = cmd;
+            bc.callback = cbk;
+            bc.pri_data = priv_data;
+            return cmd;
+        }
+
+        size_t raw::flush_batch(batch_t *b) {
+            if (NULL == b || b->flushed) {
+                return 0;
+            }
+
+            // cmds can not be added any more, so the address of batch_cmd_t will not change
+            b->flushed = true;
+            b->pending = b->cmds.size() + 1;
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                b->cmds[i].cmd->pri_data = &b->cmds[i];
+            }
+            size_t ret = b->cmds.size();
+
+            // there is only one connection, cmds are appended into its output buffer in order
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                exec(b->cmds[i].cmd);
+            }
+
+            finish_batch(b);
+            return ret;
+        }
+
+        int raw::abort_batch(batch_t *b) {
+            if (NULL == b || b->flushed) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            b->flushed = true;
+            b->pending = b->cmds.size() + 1;
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                b->cmds[i].cmd->pri_data = &b->cmds[i];
+            }
+
+            for (size_t i = 0; i < b->cmds.size(); ++i) {
+                call_cmd(b->cmds[i].cmd, error_code::REDIS_HAPP_ABORT, NULL, NULL);
+                destroy_cmd(b->cmds[i].cmd);
+            }
+
+            b->err = error_code::REDIS_HAPP_ABORT;
+            finish_batch(b);
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        void raw::finish_batch(batch_t *b) {
+            if (NULL == b || 0 == b->pending) {
+                return;
+            }
+
+            if (--b->pending > 0) {
+                return;
+            }
+
+            call_cmd(b->cmd, b->err, NULL, NULL);
+            destroy_cmd(b->cmd);
+            delete b;
+        }
+
+        void raw::on_reply_batch(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            batch_cmd_t *bc = reinterpret_cast<batch_cmd_t *>(privdata);
+            batch_t *b = bc->owner;
+
+            if (error_code::REDIS_HAPP_OK != cmd->result() && error_code::REDIS_HAPP_OK == b->err) {
+                b->err = cmd->result();
+            }
+
+            // user callback and private data of this cmd
+            cmd->pri_data = bc->pri_data;
+            if (NULL != bc->callback) {
+                bc->callback(cmd, c, r, bc->pri_data);
+            }
+
+            cmd->holder.r->finish_batch(b);
+        }
+
         raw::cmd_t *raw::retry(cmd_t *cmd, connection_t *conn) {
             if (NULL == cmd) {
                 return NULL;
             }
 
             // First, retry immediately for several times.
-            if (false == is_timer_active() || cmd->ttl > HIREDIS_HAPP_TTL / 2) {
+            // If it's still failed, maybe it will take some more time to recover the connection,
+            // so wait for a while and retry again.
+            // And too many retries will make the recovering server even worse.
+            if (false == retry_backoff.retry(timer_actions.last_update_sec, HIREDIS_HAPP_TTL - cmd->ttl, &cmd->retry_delay)) {
+                log_info("cmd %p retry budget exhausted", cmd);
+                call_cmd(cmd, error_code::REDIS_HAPP_RETRY_BUDGET, NULL, NULL);
+                destroy_cmd(cmd);
+                return NULL;
+            }
+            ++stats.retries;
+
+            // retry can not be delayed without timer
+            if (!is_timer_active()) {
+                cmd->retry_delay = 0;
+            }
+
+            if (0 == cmd->retry_delay) {
                 if (NULL == conn) {
                     return exec(cmd);
                 } else {
@@ -243,9 +496,8 @@ namespace hiredis {
                 }
             }
 
-            // If it's still failed, maybe it will take some more time to recover the connection,
-            // so wait for a while and retry again.
-            add_timer_cmd(cmd);
+            log_debug("cmd %p will retry after %llu us", cmd, static_cast<unsigned long long>(cmd->retry_delay));
+            add_timer_cmd(cmd, static_cast<time_t>(cmd->retry_delay / 1000000), static_cast<time_t>(cmd->retry_delay % 1000000));
             return cmd;
         }
 
@@ -292,26 +544,17 @@ namespace hiredis {
             }
 
             // auth command
-            if (auth.auth_fn || !auth.password.empty()) {
-                // AUTH cmd
-                cmd_t *cmd = create_cmd(on_reply_auth, NULL);
-                if (NULL != cmd) {
-                    int len = 0;
-                    if (auth.auth_fn) {
-                        const std::string &passwd = auth.auth_fn(&ret, auth.password);
-                        len = cmd->format("AUTH %b", passwd.c_str(), passwd.size());
-                    } else if (!auth.password.empty()) {
-                        len = cmd->format("AUTH %b", auth.password.c_str(), auth.password.size());
-                    }
+            if (!send_auth(&ret)) {
+                return NULL;
+            }
 
-                    if (len <= 0) {
-                        log_info("format cmd AUTH failed");
-                        destroy_cmd(cmd);
-                        return NULL;
-                    }
+            if (reply_cache.is_enabled()) {
+                start_tracking();
+            }
 
-                    exec(&ret, cmd);
-                }
+            // EVALSHA will not get NOSCRIPT in this connection unless the script cache is flushed
+            for (script_registry::script_map_t::const_iterator iter = scripts.get_scripts().begin(); iter != scripts.get_scripts().end(); ++iter) {
+                send_script_load(&ret, iter->second);
             }
 
             // event callback
@@ -358,6 +601,7 @@ namespace hiredis {
             log_debug("release connection %s", conf.init_connection.name.c_str());
 
             // can not use conf.init_connection any more
+            reply_cache.set_tracked(conn_.get(), false);
             conn_.reset();
             timer_actions.timer_conn.sequence = 0;
             timer_actions.timer_conn.timeout = 0;
@@ -365,6 +609,66 @@ namespace hiredis {
             return true;
         }
 
+        int raw::redirect(const std::string &ip, uint16_t port) {
+            connection::key_t key;
+            connection::set_key(key, ip, port);
+            if (key.name == conf.init_connection.name) {
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            log_info("redirect from %s to %s", conf.init_connection.name.c_str(), key.name.c_str());
+
+            // tracking and subscriber connections will be made again to the new server
+            if (tracking_conn_) {
+                release_dedicated_connection(tracking_conn_.get(), true, error_code::REDIS_HAPP_CONNECTION);
+            }
+
+            if (subscriber_conn_) {
+                release_dedicated_connection(subscriber_conn_.get(), true, error_code::REDIS_HAPP_CONNECTION);
+            }
+
+            conf.init_connection = key;
+
+            if (!conn_) {
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            // the old one is still closing, just close this one as usual
+            redisAsyncContext *c = conn_->get_context();
+            if (redirected_conn_ || NULL == c) {
+                release_connection(true, error_code::REDIS_HAPP_CONNECTION);
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            reply_cache.set_tracked(conn_.get(), false);
+            ::hiredis::happ::unique_ptr<connection_t>::swap(redirected_conn_, conn_);
+            timer_actions.timer_conn.sequence = 0;
+            timer_actions.timer_conn.timeout = 0;
+
+            // If in a callback, the context can not be freed, so cmds in it will be finished by the old server
+            if (c->c.flags & REDIS_IN_CALLBACK) {
+                redisAsyncDisconnect(c);
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            // every cmd waiting for reply is called back with NULL, and on_reply_wrapper sends it to the new server
+            redisAsyncFree(c);
+
+            // disconnect callback is not called if it's not connected
+            if (redirected_conn_) {
+                release_dedicated_connection(redirected_conn_.get(), false, error_code::REDIS_HAPP_CONNECTION);
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        void raw::set_near_cache(size_t max_memory) {
+            reply_cache.set_max_memory(max_memory);
+            if (reply_cache.is_enabled() && conn_ && !reply_cache.is_tracked(conn_.get())) {
+                start_tracking();
+            }
+        }
+
         raw::onconnect_fn_t raw::set_on_connect(onconnect_fn_t cbk) {
             using std::swap;
             swap(cbk, callbacks.on_connect);
@@ -383,10 +687,22 @@ namespace hiredis {
             return cbk;
         }
 
-        void raw::set_cmd_buffer_size(size_t s) { conf.cmd_buffer_size = s; }
+        void raw::set_cmd_buffer_size(size_t s) {
+            conf.cmd_buffer_size = s;
+            cmd_cache.set_buffer_size(s);
+        }
 
         size_t raw::get_cmd_buffer_size() const { return conf.cmd_buffer_size; }
 
+        void raw::set_cmd_pool_watermark(size_t low, size_t high) { cmd_cache.set_watermark(low, high); }
+
+        void raw::reset_stats() {
+            stats.reset();
+            if (conn_) {
+                conn_->get_stats().reset();
+            }
+        }
+
         bool raw::is_timer_active() const {
             return (timer_actions.last_update_sec != 0 || timer_actions.last_update_usec != 0) && (conf.timer_interval_sec > 0 || conf.timer_interval_usec > 0);
         }
@@ -398,17 +714,38 @@ namespace hiredis {
 
         void raw::set_timeout(time_t sec) { conf.timer_timeout_sec = sec; }
 
-        void raw::add_timer_cmd(cmd_t *cmd) {
+        void raw::set_cmd_timeout(time_t sec, time_t usec) {
+            conf.cmd_timeout_sec = sec;
+            conf.cmd_timeout_usec = usec;
+        }
+
+        bool raw::set_cmd_deadline(cmd_t *cmd, time_t sec, time_t usec) {
+            return is_timer_active() && cmd_deadlines.set_timeout(cmd, timer_actions.last_update_sec, timer_actions.last_update_usec, sec, usec);
+        }
+
+        void raw::add_cmd_deadline(cmd_t *cmd) {
+            if (is_timer_active()) {
+                cmd_deadlines.add_timeout(cmd, timer_actions.last_update_sec, timer_actions.last_update_usec, conf.cmd_timeout_sec, conf.cmd_timeout_usec);
+            }
+        }
+
+        void raw::add_timer_cmd(cmd_t *cmd) { add_timer_cmd(cmd, conf.timer_interval_sec, conf.timer_interval_usec); }
+
+        void raw::add_timer_cmd(cmd_t *cmd, time_t sec, time_t usec) {
             if (NULL == cmd) {
                 return;
             }
 
             if (is_timer_active()) {
-                timer_actions.timer_pending.push_back(timer_t::delay_t());
-                timer_t::delay_t &d = timer_actions.timer_pending.back();
-                d.sec = timer_actions.last_update_sec + conf.timer_interval_sec;
-                d.usec = timer_actions.last_update_usec + conf.timer_interval_usec;
+                timer_t::delay_t d;
+                d.sec = timer_actions.last_update_sec + sec;
+                d.usec = timer_actions.last_update_usec + usec;
+                if (d.usec >= 1000000) {
+                    d.sec += d.usec / 1000000;
+                    d.usec %= 1000000;
+                }
                 d.cmd = cmd;
+                timer_actions.timer_pending.push(d);
             } else {
                 exec(cmd);
             }
@@ -420,8 +757,24 @@ namespace hiredis {
             timer_actions.last_update_sec = sec;
             timer_actions.last_update_usec = usec;
 
+            // release cached cmds not used recently
+            cmd_cache.trim(sec);
+
+            // cmds reach deadline, they will be destroyed when hiredis give them back
+            if (cmd_deadlines.size() > 0) {
+                std::vector<cmd_t *> expired_cmds;
+                cmd_deadlines.expire(sec, usec, expired_cmds);
+                for (size_t i = 0; i < expired_cmds.size(); ++i) {
+                    log_debug("cmd %p reach deadline", expired_cmds[i]);
+                    ++stats.timeouts;
+                    expired_cmds[i]->deadline_expired = true;
+                    call_cmd(expired_cmds[i], error_code::REDIS_HAPP_TIMEOUT, NULL, NULL);
+                    ++ret;
+                }
+            }
+
             while (!timer_actions.timer_pending.empty()) {
-                timer_t::delay_t &rd = timer_actions.timer_pending.front();
+                const timer_t::delay_t &rd = timer_actions.timer_pending.front();
                 if (rd.sec > sec || (rd.sec == sec && rd.usec > usec)) {
                     break;
                 }
@@ -441,6 +794,7 @@ namespace hiredis {
                 // sequence expired skip
                 if (conn_ && conn_->get_sequence() == timer_actions.timer_conn.sequence) {
                     assert(!(conn_->get_context()->c.flags & REDIS_IN_CALLBACK));
+                    ++stats.timeouts;
                     release_connection(true, error_code::REDIS_HAPP_TIMEOUT);
                 }
 
@@ -448,13 +802,22 @@ namespace hiredis {
                 timer_actions.timer_conn.sequence = 0;
             }
 
+            // subscriptions lost with the connection, stop after too many rounds without any reply
+            if (resubscribe_status.pending && resubscribe_status.times < HIREDIS_HAPP_RESUBSCRIBE_TIMES &&
+                (sec > resubscribe_status.retry_sec || (sec == resubscribe_status.retry_sec && usec >= resubscribe_status.retry_usec))) {
+                resubscribe();
+            }
+
             return ret;
         }
 
         raw::cmd_t *raw::create_cmd(cmd_t::callback_fn_t cbk, void *pridata) {
             holder_t h;
             h.r = this;
-            cmd_t *ret = cmd_t::create(h, cbk, pridata, conf.cmd_buffer_size);
+            cmd_t *ret = cmd_t::create(h, cbk, pridata, conf.cmd_buffer_size, &cmd_cache);
+            if (NULL != ret) {
+                ret->stats = &stats;
+            }
             return ret;
         }
 
@@ -493,11 +856,46 @@ namespace hiredis {
             }
         }
 
+        const std::string &raw::register_script(const std::string &body) {
+            // connections made later load it in make_connection, and the current one loads it when NOSCRIPT is replied
+            return scripts.add(body);
+        }
+
+        raw::cmd_t *raw::eval_script(const std::string &sha1, cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv,
+                                     const size_t *argvlen) {
+            cmd_t *cmd = create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            if (script_registry::format_eval(cmd, sha1, argc, argv, argvlen) <= 0) {
+                log_info("format cmd EVALSHA with argc=%d failed", argc);
+                destroy_cmd(cmd);
+                return NULL;
+            }
+
+            return exec(cmd);
+        }
+
         void raw::on_reply_wrapper(redisAsyncContext *c, void *r, void *privdata) {
             connection_t *conn = reinterpret_cast<connection_t *>(c->data);
             cmd_t *cmd = reinterpret_cast<cmd_t *>(privdata);
             raw *self = cmd->holder.r;
 
+            // callback is already called when reach deadline, just release it
+            if (cmd->deadline_expired) {
+                conn->call_reply(cmd, r);
+                return;
+            }
+
+            // server is switched, send it to the new one at once
+            if (NULL == r && conn == self->redirected_conn_.get()) {
+                self->log_debug("redis cmd %p redirect to %s", cmd, self->conf.init_connection.name.c_str());
+                conn->pop_reply(cmd);
+                self->exec(cmd);
+                return;
+            }
+
             // retry if disconnecting will lead to a infinite loop
             if (c->c.flags & REDIS_DISCONNECTING) {
                 self->log_debug("redis cmd %p reply when disconnecting context err %d,msg %s", cmd, c->err, NULL == c->errstr ? detail::NONE_MSG : c->errstr);
@@ -525,6 +923,16 @@ namespace hiredis {
 
             // error handler
             if (REDIS_REPLY_ERROR == reply->type) {
+                // script cache of server is flushed or it's a new master, load it and run again in the same connection
+                const std::string *body = self->scripts.reload(cmd, reply);
+                if (NULL != body) {
+                    self->log_debug("redis cmd %p %s, load script and retry", cmd, reply->str);
+                    conn->pop_reply(cmd);
+                    self->send_script_load(conn, *body);
+                    self->exec(conn, cmd);
+                    return;
+                }
+
                 self->log_debug("redis cmd %p reply error and abort, msg: %s", cmd, NULL == reply->str ? detail::NONE_MSG : reply->str);
                 // other errors will be passed to caller
                 conn->call_reply(cmd, r);
@@ -553,7 +961,11 @@ namespace hiredis {
             // failed, release resource
             if (REDIS_OK != status) {
                 self->log_debug("connect to %s failed, status: %d, msg: %s", conn->get_key().name.c_str(), status, c->errstr);
-                self->release_connection(false, status);
+                if (conn == self->conn_.get()) {
+                    self->release_connection(false, status);
+                } else {
+                    self->release_dedicated_connection(conn, false, status);
+                }
 
             } else {
                 conn->set_connected();
@@ -567,7 +979,11 @@ namespace hiredis {
             raw *self = conn->get_holder().r;
 
             // release rreource
-            self->release_connection(false, status);
+            if (conn == self->conn_.get()) {
+                self->release_connection(false, status);
+            } else {
+                self->release_dedicated_connection(conn, false, status);
+            }
         }
 
         void raw::on_reply_auth(cmd_exec *cmd, redisAsyncContext *rctx, void *r, void *privdata) {
@@ -602,6 +1018,416 @@ namespace hiredis {
             }
         }
 
+        bool raw::send_auth(connection_t *conn) {
+            if (!auth.auth_fn && auth.password.empty()) {
+                return true;
+            }
+
+            // AUTH cmd
+            cmd_t *cmd = create_cmd(on_reply_auth, NULL);
+            if (NULL != cmd) {
+                int len = 0;
+                if (auth.auth_fn) {
+                    const std::string &passwd = auth.auth_fn(conn, auth.password);
+                    len = cmd->format("AUTH %b", passwd.c_str(), passwd.size());
+                } else if (!auth.password.empty()) {
+                    len = cmd->format("AUTH %b", auth.password.c_str(), auth.password.size());
+                }
+
+                if (len <= 0) {
+                    log_info("format cmd AUTH failed");
+                    destroy_cmd(cmd);
+                    return false;
+                }
+
+                exec(conn, cmd);
+            }
+
+            return true;
+        }
+
+        void raw::send_script_load(connection_t *conn, const std::string &body) {
+            if (NULL == conn) {
+                return;
+            }
+
+            cmd_t *cmd = create_cmd(on_reply_script_load, NULL);
+            if (NULL == cmd) {
+                log_info("create cmd SCRIPT LOAD failed");
+                return;
+            }
+
+            if (script_registry::format_load(cmd, body) <= 0) {
+                log_info("format cmd SCRIPT LOAD failed");
+                destroy_cmd(cmd);
+                return;
+            }
+
+            exec(conn, cmd);
+        }
+
+        void raw::on_reply_script_load(cmd_exec *cmd, redisAsyncContext *, void *r, void *) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            raw *self = cmd->holder.r;
+
+            if (NULL == reply || REDIS_REPLY_ERROR == reply->type) {
+                self->log_info("SCRIPT LOAD failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+            }
+        }
+
+        raw::connection_t *raw::make_dedicated_connection(connection_ptr_t &holder) {
+            holder_t h;
+            redisAsyncContext *c = redisAsyncConnect(conf.init_connection.ip.c_str(), static_cast<int>(conf.init_connection.port));
+            if (NULL == c || c->err) {
+                log_info("redis connect to %s failed, msg: %s", conf.init_connection.name.c_str(), NULL == c ? detail::NONE_MSG : c->errstr);
+                return NULL;
+            }
+
+            h.r = this;
+            redisAsyncSetConnectCallback(c, on_dedicated_connected_wrapper);
+            redisAsyncSetDisconnectCallback(c, on_dedicated_disconnected_wrapper);
+            redisEnableKeepAlive(&c->c);
+
+            connection_ptr_t ret_ptr(new connection_t());
+            connection_t &ret = *ret_ptr;
+            ::hiredis::happ::unique_ptr<connection_t>::swap(holder, ret_ptr);
+            ret.init(h, conf.init_connection);
+            ret.set_connecting(c);
+
+            c->data = &ret;
+
+            if (!send_auth(&ret)) {
+                return NULL;
+            }
+
+            return &ret;
+        }
+
+        raw::connection_t *raw::make_tracking_connection() {
+            if (tracking_conn_) {
+                return NULL;
+            }
+
+            tracking_client_id = 0;
+            connection_t *conn = make_dedicated_connection(tracking_conn_);
+            if (NULL == conn) {
+                return NULL;
+            }
+            connection_t &ret = *conn;
+
+            // the other connection redirects invalidation messages to this one by its id
+            cmd_t *cmd = create_cmd(on_reply_tracking_id, NULL);
+            if (NULL != cmd) {
+                if (cmd->format("CLIENT ID") <= 0) {
+                    log_info("format cmd CLIENT ID failed");
+                    destroy_cmd(cmd);
+                } else {
+                    exec(&ret, cmd);
+                }
+            }
+
+            // subscribe message must use raw cmd, @see raw.h
+            if (REDIS_OK != ret.redis_raw_cmd(on_reply_invalidate, NULL, "SUBSCRIBE __redis__:invalidate")) {
+                log_info("subscribe invalidation messages from %s failed", conf.init_connection.name.c_str());
+            }
+
+            // event callback
+            if (callbacks.on_connect) {
+                callbacks.on_connect(this, &ret);
+            }
+
+            log_debug("redis make tracking connection to %s ", conf.init_connection.name.c_str());
+            return &ret;
+        }
+
+        void raw::start_tracking() {
+            if (!tracking_conn_) {
+                // the connection will be tracked after CLIENT ID replied
+                make_tracking_connection();
+                return;
+            }
+
+            if (tracking_client_id > 0 && conn_) {
+                send_tracking(conn_.get());
+            }
+        }
+
+        void raw::send_tracking(connection_t *conn) {
+            cmd_t *cmd = create_cmd(on_reply_tracking, reinterpret_cast<void *>(static_cast<intptr_t>(tracking_client_id)));
+            if (NULL == cmd) {
+                log_info("create cmd CLIENT TRACKING failed");
+                return;
+            }
+
+            if (cmd->format("CLIENT TRACKING on REDIRECT %lld", tracking_client_id) <= 0) {
+                log_info("format cmd CLIENT TRACKING failed");
+                destroy_cmd(cmd);
+                return;
+            }
+
+            exec(conn, cmd);
+        }
+
+        bool raw::release_dedicated_connection(connection_t *conn, bool close_fd, int status) {
+            bool is_tracking = NULL != conn && tracking_conn_.get() == conn;
+            bool is_subscriber = NULL != conn && subscriber_conn_.get() == conn;
+            bool is_redirected = NULL != conn && redirected_conn_.get() == conn;
+            if (!is_tracking && !is_subscriber && !is_redirected) {
+                return false;
+            }
+
+            connection_t::status::type from_status = conn->set_disconnected(close_fd);
+            switch (from_status) {
+            // recursion, exit
+            case connection_t::status::DISCONNECTED:
+                return true;
+
+            // connecting, call on_connected event
+            case connection_t::status::CONNECTING:
+                if (callbacks.on_connected) {
+                    callbacks.on_connected(this, conn, conn->get_context(), error_code::REDIS_HAPP_OK == status ? error_code::REDIS_HAPP_CONNECTION : status);
+                }
+                break;
+
+            // connecting, call on_disconnected event
+            case connection_t::status::CONNECTED:
+                if (callbacks.on_disconnected) {
+                    callbacks.on_disconnected(this, conn, conn->get_context(), status);
+                }
+                break;
+
+            default:
+                log_info("unknown connection status %d", static_cast<int>(from_status));
+                break;
+            }
+
+            log_debug("release %s connection %s", is_tracking ? "tracking" : (is_subscriber ? "subscriber" : "redirected"), conn->get_key().name.c_str());
+
+            if (is_redirected) {
+                redirected_conn_.reset();
+                return true;
+            }
+
+            if (is_subscriber) {
+                // subscribe again in proc
+                subscriber_conn_.reset();
+                if (subscriptions.reset_node(conf.init_connection.name) > 0) {
+                    resubscribe_status.pending = true;
+                }
+                return true;
+            }
+
+            // no invalidation messages any more
+            reply_cache.clear();
+            if (conn_) {
+                reply_cache.set_tracked(conn_.get(), false);
+            }
+
+            tracking_conn_.reset();
+            tracking_client_id = 0;
+            return true;
+        }
+
+        void raw::on_dedicated_connected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            raw *self = conn->get_holder().r;
+
+            // hiredis bug, sometimes 0 == status but c is already closed
+            if (REDIS_OK == status && hiredis::happ::connection::status::DISCONNECTED == conn->get_status()) {
+                status = REDIS_ERR_OTHER;
+            }
+
+            // event callback
+            if (self->callbacks.on_connected) {
+                self->callbacks.on_connected(self, conn, c, status);
+            }
+
+            // failed, release resource
+            if (REDIS_OK != status) {
+                self->log_debug("connect to %s failed, status: %d, msg: %s", conn->get_key().name.c_str(), status, c->errstr);
+                self->release_dedicated_connection(conn, false, status);
+            } else {
+                conn->set_connected();
+
+                self->log_debug("connect to %s success", conn->get_key().name.c_str());
+            }
+        }
+
+        void raw::on_dedicated_disconnected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            raw *self = conn->get_holder().r;
+
+            // release rreource
+            self->release_dedicated_connection(conn, false, status);
+        }
+
+        void raw::on_reply_tracking_id(cmd_exec *cmd, redisAsyncContext *c, void *r, void *) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            raw *self = cmd->holder.r;
+
+            if (NULL == reply || REDIS_REPLY_INTEGER != reply->type || NULL == c || c->data != self->tracking_conn_.get()) {
+                self->log_info("CLIENT ID failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+                return;
+            }
+
+            self->tracking_client_id = reply->integer;
+            if (self->conn_) {
+                self->send_tracking(self->conn_.get());
+            }
+        }
+
+        void raw::on_reply_tracking(cmd_exec *cmd, redisAsyncContext *c, void *r, void *privdata) {
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+            raw *self = cmd->holder.r;
+
+            if (NULL == reply || REDIS_REPLY_ERROR == reply->type || NULL == c || c->data != self->conn_.get()) {
+                self->log_info("CLIENT TRACKING failed. %s", (NULL != reply && NULL != reply->str) ? reply->str : detail::NONE_MSG);
+                return;
+            }
+
+            // the tracking connection may be lost and replaced
+            if (self->tracking_client_id != static_cast<long long>(reinterpret_cast<intptr_t>(privdata))) {
+                return;
+            }
+
+            self->reply_cache.set_tracked(self->conn_.get(), true);
+        }
+
+        void raw::on_reply_invalidate(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
+                return;
+            }
+
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            conn->get_holder().r->reply_cache.on_invalidate(reinterpret_cast<const redisReply *>(r));
+        }
+
+        int raw::subscribe(pubsub::channel_type::type t, const std::string &name, pubsub::message_fn_t fn) {
+            if (name.empty() || !fn || !pubsub::is_supported(t)) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            pubsub::subscription_t *sub = subscriptions.add(t, name, fn);
+            if (NULL == sub) {
+                return error_code::REDIS_HAPP_CREATE;
+            }
+
+            // already subscribed, only the callback is changed
+            if (!sub->node.empty()) {
+                return error_code::REDIS_HAPP_OK;
+            }
+
+            // subscriptions given up are sent again with this one
+            resubscribe_status.times = 0;
+            resubscribe_status.retry_delay = 0;
+
+            // connection not available now, try again in proc
+            if (!send_subscribe(*sub)) {
+                log_debug("subscribe %s later", name.c_str());
+                resubscribe_status.pending = true;
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int raw::unsubscribe(pubsub::channel_type::type t, const std::string &name) {
+            if (t < pubsub::channel_type::CHANNEL || t >= pubsub::channel_type::MAX) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            std::string node;
+            if (!subscriptions.remove(t, name, node)) {
+                return error_code::REDIS_HAPP_NOT_FOUND;
+            }
+
+            if (!node.empty() && subscriber_conn_) {
+                if (REDIS_OK != subscriber_conn_->redis_raw_cmd(on_reply_subscribe, NULL, "%s %b", pubsub::get_unsubscribe_cmd(t), name.c_str(), name.size())) {
+                    log_info("%s %s failed", pubsub::get_unsubscribe_cmd(t), name.c_str());
+                }
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        bool raw::send_subscribe(pubsub::subscription_t &sub) {
+            if (!subscriber_conn_) {
+                if (NULL == make_dedicated_connection(subscriber_conn_)) {
+                    return false;
+                }
+
+                // event callback
+                if (callbacks.on_connect) {
+                    callbacks.on_connect(this, subscriber_conn_.get());
+                }
+            }
+
+            // the connection may be released in callback
+            if (!subscriber_conn_) {
+                return false;
+            }
+
+            // subscribe message must use raw cmd, @see raw.h
+            if (REDIS_OK != subscriber_conn_->redis_raw_cmd(on_reply_subscribe, NULL, "%s %b", pubsub::get_subscribe_cmd(sub.t), sub.name.c_str(), sub.name.size())) {
+                log_info("%s %s failed", pubsub::get_subscribe_cmd(sub.t), sub.name.c_str());
+                return false;
+            }
+
+            sub.node = conf.init_connection.name;
+            return true;
+        }
+
+        void raw::resubscribe() {
+            resubscribe_status.pending = false;
+
+            for (int t = pubsub::channel_type::CHANNEL; t < pubsub::channel_type::MAX; ++t) {
+                pubsub::subscription_map_t &subs = subscriptions.get_subscriptions(static_cast<pubsub::channel_type::type>(t));
+                for (pubsub::subscription_map_t::iterator it = subs.begin(); it != subs.end(); ++it) {
+                    if (it->second.node.empty() && !send_subscribe(it->second)) {
+                        resubscribe_status.pending = true;
+                    }
+                }
+            }
+
+            // the connection made in this round may be lost later, the next round waits for backoff
+            ++resubscribe_status.times;
+            resubscribe_status.retry_delay = retry_backoff.next_delay(resubscribe_status.times, resubscribe_status.retry_delay);
+            resubscribe_status.retry_sec = timer_actions.last_update_sec + static_cast<time_t>(resubscribe_status.retry_delay / 1000000);
+            resubscribe_status.retry_usec = timer_actions.last_update_usec + static_cast<time_t>(resubscribe_status.retry_delay % 1000000);
+            if (resubscribe_status.retry_usec >= 1000000) {
+                resubscribe_status.retry_sec += resubscribe_status.retry_usec / 1000000;
+                resubscribe_status.retry_usec %= 1000000;
+            }
+
+            if (resubscribe_status.times >= HIREDIS_HAPP_RESUBSCRIBE_TIMES) {
+                log_info("resubscribe for %d times without any reply, wait for the next subscribe", static_cast<int>(resubscribe_status.times));
+            }
+        }
+
+        void raw::on_reply_subscribe(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
+                return;
+            }
+
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            raw *self = conn->get_holder().r;
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+
+            if (REDIS_REPLY_ERROR == reply->type) {
+                self->log_info("subscribe failed. %s", NULL == reply->str ? detail::NONE_MSG : reply->str);
+                return;
+            }
+
+            // the subscriber connection works again
+            if (!self->resubscribe_status.pending) {
+                self->resubscribe_status.times = 0;
+                self->resubscribe_status.retry_delay = 0;
+            }
+
+            self->subscriptions.dispatch(reply);
+        }
+
         void raw::log_debug(const char *fmt, ...) {
             if (NULL == conf.log_fn_debug || 0 == conf.log_max_size) {
                 return;
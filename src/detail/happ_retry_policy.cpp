@@ -0,0 +1,115 @@
+#include <ctime>
+
+#include "detail/happ_retry_policy.h"
+
+namespace hiredis {
+    namespace happ {
+        retry_policy::retry_policy() {
+            immediate_times = HIREDIS_HAPP_RETRY_IMMEDIATE_TIMES;
+            base_delay = HIREDIS_HAPP_RETRY_BACKOFF_BASE_USEC;
+            max_delay = HIREDIS_HAPP_RETRY_BACKOFF_MAX_USEC;
+
+            budget_percent = HIREDIS_HAPP_RETRY_BUDGET_PERCENT;
+            budget_min_per_sec = HIREDIS_HAPP_RETRY_BUDGET_MIN_PER_SEC;
+
+            window_sec = 0;
+            window_requests = 0;
+            window_retries = 0;
+            last_window_requests = 0;
+
+            // different seed in every process and every client, or they will still retry in lockstep
+            random_seed = static_cast<uint64_t>(time(NULL)) ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(this));
+            if (0 == random_seed) {
+                random_seed = 0x9E3779B97F4A7C15ULL;
+            }
+
+            retry_count = 0;
+            rejected_count = 0;
+        }
+
+        void retry_policy::set_immediate_times(size_t times) { immediate_times = times; }
+
+        void retry_policy::set_backoff(time_t base_sec, time_t base_usec, time_t max_sec, time_t max_usec) {
+            base_delay = static_cast<uint64_t>(base_sec) * 1000000 + static_cast<uint64_t>(base_usec);
+            max_delay = static_cast<uint64_t>(max_sec) * 1000000 + static_cast<uint64_t>(max_usec);
+            if (max_delay < base_delay) {
+                max_delay = base_delay;
+            }
+        }
+
+        void retry_policy::set_budget(uint32_t percent, uint32_t min_per_sec) {
+            budget_percent = percent;
+            budget_min_per_sec = min_per_sec;
+        }
+
+        void retry_policy::add_request(time_t sec) {
+            roll(sec);
+            ++window_requests;
+        }
+
+        bool retry_policy::acquire(time_t sec) {
+            if (0 == budget_percent) {
+                ++retry_count;
+                return true;
+            }
+
+            roll(sec);
+
+            size_t allowed = budget_min_per_sec + (window_requests + last_window_requests) * budget_percent / 100;
+            if (window_retries >= allowed) {
+                ++rejected_count;
+                return false;
+            }
+
+            ++window_retries;
+            ++retry_count;
+            return true;
+        }
+
+        uint64_t retry_policy::next_delay(size_t sent_times, uint64_t last_delay) {
+            if (sent_times <= immediate_times || 0 == max_delay) {
+                return 0;
+            }
+
+            // decorrelated jitter, the first delay is also spread from base to base * 3
+            uint64_t lower = base_delay;
+            uint64_t upper = (last_delay > base_delay ? last_delay : base_delay) * 3;
+            uint64_t ret = lower;
+            if (upper > lower) {
+                ret += random() % (upper - lower + 1);
+            }
+
+            return ret > max_delay ? max_delay : ret;
+        }
+
+        bool retry_policy::retry(time_t sec, size_t sent_times, uint64_t *delay) {
+            if (!acquire(sec)) {
+                return false;
+            }
+
+            if (NULL != delay) {
+                *delay = next_delay(sent_times, *delay);
+            }
+            return true;
+        }
+
+        uint64_t retry_policy::random() {
+            // xorshift64*
+            random_seed ^= random_seed >> 12;
+            random_seed ^= random_seed << 25;
+            random_seed ^= random_seed >> 27;
+            return random_seed * 2685821657736338717ULL;
+        }
+
+        void retry_policy::roll(time_t sec) {
+            if (sec == window_sec) {
+                return;
+            }
+
+            last_window_requests = (sec == window_sec + 1) ? window_requests : 0;
+            window_sec = sec;
+            window_requests = 0;
+            window_retries = 0;
+        }
+    }
+}
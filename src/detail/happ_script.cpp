@@ -0,0 +1,195 @@
+#include <cctype>
+#include <cstring>
+
+#include "detail/happ_cmd.h"
+#include "detail/happ_script.h"
+
+namespace hiredis {
+    namespace happ {
+        namespace detail {
+            static inline uint32_t sha1_rol(uint32_t v, int bits) { return (v << bits) | (v >> (32 - bits)); }
+
+            static void sha1_block(uint32_t state[5], const unsigned char *block) {
+                uint32_t w[80];
+                for (int i = 0; i < 16; ++i) {
+                    w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+                           (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+                }
+                for (int i = 16; i < 80; ++i) {
+                    w[i] = sha1_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+                }
+
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+                for (int i = 0; i < 80; ++i) {
+                    uint32_t f, k;
+                    if (i < 20) {
+                        f = (b & c) | (~b & d);
+                        k = 0x5A827999;
+                    } else if (i < 40) {
+                        f = b ^ c ^ d;
+                        k = 0x6ED9EBA1;
+                    } else if (i < 60) {
+                        f = (b & c) | (b & d) | (c & d);
+                        k = 0x8F1BBCDC;
+                    } else {
+                        f = b ^ c ^ d;
+                        k = 0xCA62C1D6;
+                    }
+
+                    uint32_t t = sha1_rol(a, 5) + f + e + k + w[i];
+                    e = d;
+                    d = c;
+                    c = sha1_rol(b, 30);
+                    b = a;
+                    a = t;
+                }
+
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+            }
+
+            static bool is_evalsha_cmd(const char *name, size_t len) {
+                return (7 == len && 0 == HIREDIS_HAPP_STRNCASE_CMP("EVALSHA", name, 7)) ||
+                       (10 == len && 0 == HIREDIS_HAPP_STRNCASE_CMP("EVALSHA_RO", name, 10));
+            }
+        }
+
+        script_registry::script_registry() : reloads(0) {}
+
+        const std::string &script_registry::add(const std::string &body) {
+            std::string sha1 = sha1_hex(body.c_str(), body.size());
+            script_map_t::iterator it = scripts.find(sha1);
+            if (scripts.end() == it) {
+                it = scripts.insert(script_map_t::value_type(sha1, body)).first;
+            }
+
+            return it->first;
+        }
+
+        const std::string *script_registry::find(const char *sha1, size_t len) const {
+            if (NULL == sha1 || 40 != len) {
+                return NULL;
+            }
+
+            // redis accepts SHA1 in upper case
+            std::string key(sha1, len);
+            for (size_t i = 0; i < key.size(); ++i) {
+                key[i] = static_cast<char>(tolower(static_cast<unsigned char>(key[i])));
+            }
+
+            script_map_t::const_iterator it = scripts.find(key);
+            if (scripts.end() == it) {
+                return NULL;
+            }
+
+            return &it->second;
+        }
+
+        const std::string *script_registry::find(cmd_exec *cmd) const {
+            if (NULL == cmd || scripts.empty()) {
+                return NULL;
+            }
+
+            const char *name = NULL;
+            size_t name_len = 0;
+            const char *next = cmd->pick_cmd(&name, &name_len);
+            if (NULL == name || !detail::is_evalsha_cmd(name, name_len)) {
+                return NULL;
+            }
+
+            const char *sha1 = NULL;
+            size_t sha1_len = 0;
+            cmd->pick_argument(next, &sha1, &sha1_len);
+            return find(sha1, sha1_len);
+        }
+
+        const std::string *script_registry::reload(cmd_exec *cmd, const redisReply *reply) {
+            if (NULL == reply || REDIS_REPLY_ERROR != reply->type || NULL == reply->str || 0 != HIREDIS_HAPP_STRNCASE_CMP("NOSCRIPT", reply->str, 8)) {
+                return NULL;
+            }
+
+            const std::string *ret = find(cmd);
+            if (NULL != ret) {
+                ++reloads;
+            }
+
+            return ret;
+        }
+
+        int script_registry::format_eval(cmd_exec *cmd, const std::string &sha1, int argc, const char **argv, const size_t *argvlen) {
+            if (NULL == cmd || argc < 0) {
+                return 0;
+            }
+
+            std::vector<const char *> eval_argv;
+            std::vector<size_t> eval_argvlen;
+            eval_argv.reserve(static_cast<size_t>(argc) + 2);
+            eval_argvlen.reserve(static_cast<size_t>(argc) + 2);
+            eval_argv.push_back("EVALSHA");
+            eval_argvlen.push_back(7);
+            eval_argv.push_back(sha1.c_str());
+            eval_argvlen.push_back(sha1.size());
+            for (int i = 0; i < argc; ++i) {
+                eval_argv.push_back(argv[i]);
+                eval_argvlen.push_back(argvlen[i]);
+            }
+
+            return cmd->vformat(static_cast<int>(eval_argv.size()), &eval_argv[0], &eval_argvlen[0]);
+        }
+
+        int script_registry::format_load(cmd_exec *cmd, const std::string &body) {
+            if (NULL == cmd) {
+                return 0;
+            }
+
+            return cmd->format("SCRIPT LOAD %b", body.c_str(), body.size());
+        }
+
+        bool script_registry::remove(const std::string &sha1) { return scripts.erase(sha1) > 0; }
+
+        void script_registry::clear() { scripts.clear(); }
+
+        std::string script_registry::sha1_hex(const char *data, size_t len) {
+            uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+            const unsigned char *in = reinterpret_cast<const unsigned char *>(data);
+
+            size_t left = len;
+            while (left >= 64) {
+                detail::sha1_block(state, in);
+                in += 64;
+                left -= 64;
+            }
+
+            // padding, 1 bit, zeros and bit length in big endian
+            unsigned char tail[128];
+            memset(tail, 0, sizeof(tail));
+            if (left > 0) {
+                memcpy(tail, in, left);
+            }
+            tail[left] = 0x80;
+            size_t tail_len = left < 56 ? 64 : 128;
+            uint64_t bits = static_cast<uint64_t>(len) * 8;
+            for (int i = 0; i < 8; ++i) {
+                tail[tail_len - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+            }
+
+            detail::sha1_block(state, tail);
+            if (128 == tail_len) {
+                detail::sha1_block(state, tail + 64);
+            }
+
+            static const char hex[] = "0123456789abcdef";
+            std::string ret;
+            ret.resize(40);
+            for (int i = 0; i < 20; ++i) {
+                unsigned char c = static_cast<unsigned char>(state[i / 4] >> ((3 - i % 4) * 8));
+                ret[i * 2] = hex[c >> 4];
+                ret[i * 2 + 1] = hex[c & 0x0F];
+            }
+            return ret;
+        }
+    }
+}
@@ -0,0 +1,427 @@
+#ifdef _MSC_VER
+#include <winsock2.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <assert.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include "detail/happ_sentinel.h"
+
+namespace hiredis {
+    namespace happ {
+        namespace detail {
+            static char SENTINEL_NONE_MSG[] = "none";
+        }
+
+        sentinel::sentinel() {
+            sentinel_index = 0;
+
+            timer_actions.last_update_sec = 0;
+            timer_actions.retry_interval_sec = HIREDIS_HAPP_SENTINEL_RETRY_INTERVAL_SEC;
+            timer_actions.next_connect_sec = 0;
+            timer_actions.connect_timeout = 0;
+
+            started = false;
+            reconnect_pending = false;
+            switch_count = 0;
+        }
+
+        sentinel::~sentinel() { reset(); }
+
+        int sentinel::init(const std::string &name) {
+            if (name.empty()) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            master_name = name;
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int sentinel::add_sentinel(const std::string &ip, uint16_t port) {
+            connection::key_t key;
+            connection::set_key(key, ip, port);
+
+            for (size_t i = 0; i < sentinels.size(); ++i) {
+                if (sentinels[i].name == key.name) {
+                    return error_code::REDIS_HAPP_OK;
+                }
+            }
+
+            sentinels.push_back(key);
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int sentinel::start() {
+            if (master_name.empty() || sentinels.empty()) {
+                return error_code::REDIS_HAPP_PARAM;
+            }
+
+            started = true;
+            if (!sentinel_conn) {
+                make_sentinel_connection();
+            }
+
+            return error_code::REDIS_HAPP_OK;
+        }
+
+        int sentinel::reset() {
+            started = false;
+            reconnect_pending = false;
+
+            release_sentinel_connection(true, error_code::REDIS_HAPP_CONNECTION);
+
+            // cmds must wait for SENTINEL get-master-addr-by-name after started again
+            master = connection::key_t();
+
+            // master is never known
+            while (!pending_cmds.empty()) {
+                cmd_t *cmd = pending_cmds.front();
+                pending_cmds.pop_front();
+
+                master_raw.call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, NULL, NULL);
+                master_raw.destroy_cmd(cmd);
+            }
+
+            timer_actions.last_update_sec = 0;
+            timer_actions.next_connect_sec = 0;
+            timer_actions.connect_timeout = 0;
+
+            return master_raw.reset();
+        }
+
+        sentinel::cmd_t *sentinel::exec(cmd_t::callback_fn_t cbk, void *priv_data, int argc, const char **argv, const size_t *argvlen) {
+            cmd_t *cmd = master_raw.create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            int len = cmd->vformat(argc, argv, argvlen);
+            if (len <= 0) {
+                master_raw.log_info("format cmd with argc=%d failed", argc);
+                master_raw.destroy_cmd(cmd);
+                return NULL;
+            }
+
+            return exec(cmd);
+        }
+
+        sentinel::cmd_t *sentinel::exec(cmd_t::callback_fn_t cbk, void *priv_data, const char *fmt, ...) {
+            cmd_t *cmd = master_raw.create_cmd(cbk, priv_data);
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            va_list ap;
+            va_start(ap, fmt);
+            int len = cmd->vformat(fmt, ap);
+            va_end(ap);
+            if (len <= 0) {
+                master_raw.log_info("format cmd with format=%s failed", fmt);
+                master_raw.destroy_cmd(cmd);
+                return NULL;
+            }
+
+            return exec(cmd);
+        }
+
+        sentinel::cmd_t *sentinel::exec(cmd_t *cmd) {
+            if (NULL == cmd) {
+                return NULL;
+            }
+
+            if (!master.name.empty()) {
+                return master_raw.exec(cmd);
+            }
+
+            // master will never be known
+            if (!started) {
+                master_raw.log_info("sentinel of %s not started", master_name.c_str());
+                master_raw.call_cmd(cmd, error_code::REDIS_HAPP_CONNECTION, NULL, NULL);
+                master_raw.destroy_cmd(cmd);
+                return NULL;
+            }
+
+            // send it when master is known, deadline works as usual
+            master_raw.add_cmd_deadline(cmd);
+            pending_cmds.push_back(cmd);
+            master_raw.log_debug("cmd %p wait for master %s", cmd, master_name.c_str());
+            return cmd;
+        }
+
+        const sentinel::connection_t *sentinel::get_sentinel_connection() const { return sentinel_conn.get(); }
+
+        sentinel::onswitch_fn_t sentinel::set_on_switch_master(onswitch_fn_t cbk) {
+            using std::swap;
+            swap(cbk, on_switch);
+            return cbk;
+        }
+
+        void sentinel::set_retry_interval(time_t sec) { timer_actions.retry_interval_sec = sec; }
+
+        int sentinel::proc(time_t sec, time_t usec) {
+            int ret = master_raw.proc(sec, usec);
+
+            timer_actions.last_update_sec = sec;
+
+            // cmds waiting for master are finished by master_raw when they reach deadline, just release them
+            if (ret > 0 && !pending_cmds.empty()) {
+                for (std::list<cmd_t *>::iterator it = pending_cmds.begin(); it != pending_cmds.end();) {
+                    if ((*it)->deadline_expired) {
+                        master_raw.destroy_cmd(*it);
+                        it = pending_cmds.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            // sentinel connection timeout
+            if (sentinel_conn && 0 != timer_actions.connect_timeout && sec >= timer_actions.connect_timeout) {
+                master_raw.log_info("sentinel %s timeout", sentinel_conn->get_key().name.c_str());
+                reconnect_pending = true;
+            }
+
+            // can not be released in its callback, so do it here
+            if (reconnect_pending) {
+                reconnect_pending = false;
+                if (sentinel_conn) {
+                    assert(NULL == sentinel_conn->get_context() || !(sentinel_conn->get_context()->c.flags & REDIS_IN_CALLBACK));
+                    release_sentinel_connection(true, error_code::REDIS_HAPP_CONNECTION);
+                }
+
+                // the next one may be available
+                timer_actions.next_connect_sec = 0;
+            }
+
+            if (started && !sentinel_conn && sec >= timer_actions.next_connect_sec) {
+                if (NULL != make_sentinel_connection()) {
+                    ++ret;
+                }
+            }
+
+            return ret;
+        }
+
+        void sentinel::set_log_writer(log_fn_t info_fn, log_fn_t debug_fn, size_t max_size) { master_raw.set_log_writer(info_fn, debug_fn, max_size); }
+
+        sentinel::connection_t *sentinel::make_sentinel_connection() {
+            holder_t h;
+            if (sentinel_conn || sentinels.empty()) {
+                return NULL;
+            }
+
+            // every sentinel is used by turns
+            const connection::key_t &key = sentinels[sentinel_index % sentinels.size()];
+            sentinel_index = (sentinel_index + 1) % sentinels.size();
+
+            redisAsyncContext *c = redisAsyncConnect(key.ip.c_str(), static_cast<int>(key.port));
+            if (NULL == c || c->err) {
+                master_raw.log_info("redis connect to sentinel %s failed, msg: %s", key.name.c_str(),
+                                    NULL == c ? detail::SENTINEL_NONE_MSG : c->errstr);
+                timer_actions.next_connect_sec = timer_actions.last_update_sec + timer_actions.retry_interval_sec;
+                return NULL;
+            }
+
+            h.s = this;
+            redisAsyncSetConnectCallback(c, on_connected_wrapper);
+            redisAsyncSetDisconnectCallback(c, on_disconnected_wrapper);
+            redisEnableKeepAlive(&c->c);
+            if (master_raw.conf.timer_timeout_sec > 0) {
+                struct timeval tv;
+                tv.tv_sec = master_raw.conf.timer_timeout_sec;
+                tv.tv_usec = 0;
+                redisSetTimeout(&c->c, tv);
+            }
+
+            connection_ptr_t ret_ptr(new connection_t());
+            connection_t &ret = *ret_ptr;
+            ::hiredis::happ::unique_ptr<connection_t>::swap(sentinel_conn, ret_ptr);
+            ret.init(h, key);
+            ret.set_connecting(c);
+
+            c->data = &ret;
+
+            // timeout until address of master is got
+            if (master_raw.conf.timer_timeout_sec > 0 && 0 != timer_actions.last_update_sec) {
+                timer_actions.connect_timeout = timer_actions.last_update_sec + master_raw.conf.timer_timeout_sec;
+            }
+
+            // subscribe message must use raw cmd, @see raw.h
+            // the address is replied before subscribe, so no switch will be missed
+            if (REDIS_OK != ret.redis_raw_cmd(on_reply_master_addr, NULL, "SENTINEL get-master-addr-by-name %b", master_name.c_str(), master_name.size()) ||
+                REDIS_OK != ret.redis_raw_cmd(on_reply_switch_master, NULL, "SUBSCRIBE +switch-master")) {
+                master_raw.log_info("send cmds to sentinel %s failed", key.name.c_str());
+                reconnect_pending = true;
+            }
+
+            master_raw.log_debug("redis make connection to sentinel %s ", key.name.c_str());
+            return &ret;
+        }
+
+        bool sentinel::release_sentinel_connection(bool close_fd, int status) {
+            if (!sentinel_conn) {
+                return false;
+            }
+
+            redisAsyncContext *c = sentinel_conn->get_context();
+            if (connection_t::status::DISCONNECTED == sentinel_conn->set_disconnected(false)) {
+                // recursion, exit
+                return true;
+            }
+
+            master_raw.log_debug("release connection to sentinel %s, status: %d", sentinel_conn->get_key().name.c_str(), status);
+
+            // connect to the next one later
+            timer_actions.next_connect_sec = timer_actions.last_update_sec + timer_actions.retry_interval_sec;
+            timer_actions.connect_timeout = 0;
+
+            // every callback is called with NULL reply, and disconnect callback is called before freed
+            if (close_fd && NULL != c) {
+                redisAsyncFree(c);
+            }
+
+            sentinel_conn.reset();
+            return true;
+        }
+
+        void sentinel::switch_master(const std::string &ip, uint16_t port) {
+            connection::key_t key;
+            connection::set_key(key, ip, port);
+
+            if (key.name != master.name) {
+                bool switched = !master.name.empty();
+                master_raw.log_info("master %s %s %s", master_name.c_str(), switched ? "switch to" : "is", key.name.c_str());
+
+                master = key;
+                if (switched) {
+                    ++switch_count;
+                }
+
+                // cmds waiting for reply of the old master are sent to the new one at once
+                master_raw.redirect(ip, port);
+
+                if (on_switch) {
+                    on_switch(this, master);
+                }
+            }
+
+            send_pending();
+        }
+
+        void sentinel::send_pending() {
+            if (pending_cmds.empty()) {
+                return;
+            }
+
+            std::list<cmd_t *> cmds;
+            cmds.swap(pending_cmds);
+            for (std::list<cmd_t *>::iterator it = cmds.begin(); it != cmds.end(); ++it) {
+                master_raw.exec(*it);
+            }
+        }
+
+        void sentinel::on_connected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            sentinel *self = conn->get_holder().s;
+
+            // hiredis bug, sometimes 0 == status but c is already closed
+            if (REDIS_OK == status && hiredis::happ::connection::status::DISCONNECTED == conn->get_status()) {
+                status = REDIS_ERR_OTHER;
+            }
+
+            // failed, release resource
+            if (REDIS_OK != status) {
+                self->master_raw.log_debug("connect to sentinel %s failed, status: %d, msg: %s", conn->get_key().name.c_str(), status, c->errstr);
+                self->release_sentinel_connection(false, status);
+            } else {
+                conn->set_connected();
+
+                self->master_raw.log_debug("connect to sentinel %s success", conn->get_key().name.c_str());
+            }
+        }
+
+        void sentinel::on_disconnected_wrapper(const struct redisAsyncContext *c, int status) {
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            sentinel *self = conn->get_holder().s;
+
+            // release rreource
+            if (conn == self->sentinel_conn.get()) {
+                self->release_sentinel_connection(false, status);
+            }
+        }
+
+        void sentinel::on_reply_master_addr(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
+                return;
+            }
+
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            sentinel *self = conn->get_holder().s;
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+
+            // nil if master is unknown to this sentinel
+            if (REDIS_REPLY_ARRAY != reply->type || 2 != reply->elements || REDIS_REPLY_STRING != reply->element[0]->type ||
+                REDIS_REPLY_STRING != reply->element[1]->type) {
+                self->master_raw.log_info("get address of master %s from sentinel %s failed. %s", self->master_name.c_str(), conn->get_key().name.c_str(),
+                                          (REDIS_REPLY_ERROR == reply->type && NULL != reply->str) ? reply->str : detail::SENTINEL_NONE_MSG);
+                self->reconnect_pending = true;
+                return;
+            }
+
+            long port = strtol(reply->element[1]->str, NULL, 10);
+            if (port <= 0 || port > 65535) {
+                self->master_raw.log_info("invalid port %s of master %s", reply->element[1]->str, self->master_name.c_str());
+                self->reconnect_pending = true;
+                return;
+            }
+
+            self->timer_actions.connect_timeout = 0;
+            self->switch_master(std::string(reply->element[0]->str, reply->element[0]->len), static_cast<uint16_t>(port));
+        }
+
+        void sentinel::on_reply_switch_master(redisAsyncContext *c, void *r, void *) {
+            // NULL when the connection is closed
+            if (NULL == r || NULL == c || NULL == c->data) {
+                return;
+            }
+
+            connection_t *conn = reinterpret_cast<connection_t *>(c->data);
+            sentinel *self = conn->get_holder().s;
+            redisReply *reply = reinterpret_cast<redisReply *>(r);
+
+            if (REDIS_REPLY_ERROR == reply->type) {
+                self->master_raw.log_info("subscribe +switch-master from sentinel %s failed. %s", conn->get_key().name.c_str(),
+                                          NULL == reply->str ? detail::SENTINEL_NONE_MSG : reply->str);
+                self->reconnect_pending = true;
+                return;
+            }
+
+            // message +switch-master "<master name> <old ip> <old port> <new ip> <new port>"
+            if (REDIS_REPLY_ARRAY != reply->type || 3 != reply->elements || REDIS_REPLY_STRING != reply->element[0]->type ||
+                REDIS_REPLY_STRING != reply->element[2]->type || 0 != HIREDIS_HAPP_STRCASE_CMP("message", reply->element[0]->str)) {
+                return;
+            }
+
+            std::istringstream ss(std::string(reply->element[2]->str, reply->element[2]->len));
+            std::string name, old_ip, new_ip;
+            int old_port = 0, new_port = 0;
+            ss >> name >> old_ip >> old_port >> new_ip >> new_port;
+            if (ss.fail() || name != self->master_name) {
+                return;
+            }
+
+            if (new_port <= 0 || new_port > 65535) {
+                self->master_raw.log_info("invalid port %d of master %s", new_port, self->master_name.c_str());
+                return;
+            }
+
+            self->switch_master(new_ip, static_cast<uint16_t>(new_port));
+        }
+    }
+}
@@ -0,0 +1,171 @@
+#include <cstring>
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#include <chrono>
+#elif defined(_MSC_VER)
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "detail/happ_stats.h"
+
+namespace hiredis {
+    namespace happ {
+        namespace detail {
+            static size_t highest_bit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+                return static_cast<size_t>(63 - __builtin_clzll(v));
+#else
+                size_t ret = 0;
+                while (v >>= 1) {
+                    ++ret;
+                }
+                return ret;
+#endif
+            }
+        }
+
+        latency_histogram::latency_histogram() { reset(); }
+
+        void latency_histogram::merge(const latency_histogram &other) {
+            if (0 == other.count) {
+                return;
+            }
+
+            for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+                buckets[i] += other.buckets[i];
+            }
+
+            if (0 == count || other.min_value < min_value) {
+                min_value = other.min_value;
+            }
+            if (other.max_value > max_value) {
+                max_value = other.max_value;
+            }
+            count += other.count;
+            sum += other.sum;
+        }
+
+        void latency_histogram::reset() {
+            memset(buckets, 0, sizeof(buckets));
+            count = 0;
+            sum = 0;
+            min_value = ~static_cast<uint64_t>(0);
+            max_value = 0;
+        }
+
+        uint64_t latency_histogram::get_percentile(double percentile) const {
+            if (0 == count) {
+                return 0;
+            }
+
+            if (percentile <= 0.0) {
+                return get_min();
+            }
+
+            uint64_t target = count;
+            if (percentile < 100.0) {
+                target = static_cast<uint64_t>(percentile * static_cast<double>(count) / 100.0 + 0.5);
+                if (0 == target) {
+                    target = 1;
+                }
+            }
+
+            uint64_t passed = 0;
+            for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+                passed += buckets[i];
+                if (passed >= target) {
+                    uint64_t ret = get_bucket_upper_bound(i);
+                    return ret > max_value ? max_value : ret;
+                }
+            }
+
+            return max_value;
+        }
+
+        size_t latency_histogram::get_bucket_index(uint64_t usec) {
+            if (usec < SUB_BUCKET_COUNT) {
+                return static_cast<size_t>(usec);
+            }
+
+            size_t high = detail::highest_bit(usec);
+            if (high >= MAX_VALUE_BITS) {
+                return BUCKET_COUNT - 1;
+            }
+
+            // the top SUB_BUCKET_BITS + 1 bits, with the highest bit removed
+            size_t sub = static_cast<size_t>(usec >> (high - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+            return (high - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub;
+        }
+
+        uint64_t latency_histogram::get_bucket_upper_bound(size_t index) {
+            if (index < SUB_BUCKET_COUNT) {
+                return static_cast<uint64_t>(index);
+            }
+
+            size_t high = index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1;
+            uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT + 1);
+            return (sub << (high - SUB_BUCKET_BITS)) - 1;
+        }
+
+        cmd_stats::cmd_stats() { reset(); }
+
+        void cmd_stats::reset() {
+            sent = 0;
+            replied = 0;
+            finished = 0;
+            moved = 0;
+            ask = 0;
+            retries = 0;
+            reloads = 0;
+            timeouts = 0;
+            hedges = 0;
+            hedge_wins = 0;
+            memset(errors, 0, sizeof(errors));
+            latency.reset();
+        }
+
+        void cmd_stats::merge(const cmd_stats &other) {
+            sent += other.sent;
+            replied += other.replied;
+            finished += other.finished;
+            moved += other.moved;
+            ask += other.ask;
+            retries += other.retries;
+            reloads += other.reloads;
+            timeouts += other.timeouts;
+            hedges += other.hedges;
+            hedge_wins += other.hedge_wins;
+            for (size_t i = 0; i < ERROR_TYPE_COUNT; ++i) {
+                errors[i] += other.errors[i];
+            }
+            latency.merge(other.latency);
+        }
+
+        size_t cmd_stats::get_error_index(int err) {
+            int ret = error_code::REDIS_HAPP_UNKNOWD - err + 1;
+            if (ret <= 0 || ret >= ERROR_TYPE_COUNT) {
+                return 0;
+            }
+
+            return static_cast<size_t>(ret);
+        }
+
+        uint64_t cmd_stats::now_usec() {
+#if defined(__cplusplus) && __cplusplus >= 201103L
+            return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#elif defined(_MSC_VER)
+            LARGE_INTEGER freq, counter;
+            QueryPerformanceFrequency(&freq);
+            QueryPerformanceCounter(&counter);
+            return static_cast<uint64_t>(counter.QuadPart / freq.QuadPart * 1000000 + counter.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000 + static_cast<uint64_t>(ts.tv_nsec) / 1000;
+#endif
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hiredis_happ.h"
+#include "frame/test_fake_reply.h"
+#include "frame/test_macros.h"
+
+#if defined(HIREDIS_HAPP_ATOMIC_STD)
+#include <thread>
+
+static void happ_cluster_group_update_slots(hiredis::happ::cluster *clu, test_fake_reply &slots) {
+    hiredis::happ::cmd_exec *cmd = clu->create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu->slot_reload.sequence));
+    clu->destroy_cmd(cmd);
+}
+
+static int happ_cluster_group_submit_count = 0;
+static size_t happ_cluster_group_submit_index = 0;
+static void happ_cluster_group_on_submit(hiredis::happ::cluster_group *, size_t index) {
+    ++happ_cluster_group_submit_count;
+    happ_cluster_group_submit_index = index;
+}
+
+static int happ_cluster_group_cmd_count = 0;
+static int happ_cluster_group_cmd_err = 0;
+static void happ_cluster_group_on_cmd(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *, void *privdata) {
+    CASE_EXPECT_EQ(&happ_cluster_group_cmd_count, privdata);
+    ++happ_cluster_group_cmd_count;
+    happ_cluster_group_cmd_err = cmd->result();
+}
+
+CASE_TEST(happ_cluster_group, slot_snapshot)
+{
+    hiredis::happ::cluster_group group;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, group.init(0, "127.0.0.1", 6370));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, group.init(2, "127.0.0.1", 6370));
+    CASE_EXPECT_EQ(2, group.size());
+    CASE_EXPECT_EQ(NULL, group.get_worker(2));
+    CASE_EXPECT_TRUE(!group.get_slot_snapshot());
+    group.set_on_submit(happ_cluster_group_on_submit);
+
+    hiredis::happ::cluster *w0 = group.get_worker(0);
+    hiredis::happ::cluster *w1 = group.get_worker(1);
+
+    // the first worker sends CLUSTER SLOTS and publishes them
+    group.start(0);
+    CASE_EXPECT_NE(NULL, w0->get_connection("127.0.0.1:6370"));
+    {
+        test_fake_reply slots(REDIS_REPLY_ARRAY);
+        slots.push_slots(0, 8191, 7000).push_slots(8192, 16383, 7001);
+        happ_cluster_group_update_slots(w0, slots);
+    }
+
+    hiredis::happ::cluster_group::slot_snapshot_ptr_t snapshot = group.get_slot_snapshot();
+    CASE_EXPECT_TRUE(!!snapshot);
+    if (snapshot) {
+        CASE_EXPECT_EQ(1, snapshot->version);
+        CASE_EXPECT_EQ(2, snapshot->nodes.size());
+    }
+
+    // the other one loads the snapshot without CLUSTER SLOTS
+    group.start(1);
+    CASE_EXPECT_EQ(NULL, w1->get_connection("127.0.0.1:6370"));
+    CASE_EXPECT_TRUE("127.0.0.1:7001" == w1->get_slot_master(16383)->name);
+
+    // cmds of one node are submitted to the same worker
+    CASE_EXPECT_EQ(0, group.pick_worker("bar", 3));
+    CASE_EXPECT_EQ(1, group.pick_worker("foo", 3));
+
+    happ_cluster_group_submit_count = 0;
+    happ_cluster_group_cmd_count = 0;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK,
+                   group.submit("foo", 3, happ_cluster_group_on_cmd, &happ_cluster_group_cmd_count, "GET %s", "foo"));
+    const char *argv[] = {"GET", "foo"};
+    size_t argvlen[] = {3, 3};
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK,
+                   group.submit("foo", 3, happ_cluster_group_on_cmd, &happ_cluster_group_cmd_count, 2, argv, argvlen));
+    CASE_EXPECT_EQ(1, happ_cluster_group_submit_count);
+    CASE_EXPECT_EQ(1, happ_cluster_group_submit_index);
+    CASE_EXPECT_EQ(2, group.get_queued_count(1));
+    CASE_EXPECT_EQ(0, group.get_queued_count(0));
+
+    CASE_EXPECT_EQ(0, group.dispatch(0));
+    CASE_EXPECT_EQ(2, group.dispatch(1));
+    CASE_EXPECT_EQ(0, group.get_queued_count(1));
+    CASE_EXPECT_EQ(1, happ_cluster_group_submit_count);
+
+    hiredis::happ::connection *conn = w1->get_connection("127.0.0.1:7001");
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL != conn) {
+        CASE_EXPECT_EQ(2, conn->get_pending_count());
+
+        test_fake_reply reply(REDIS_REPLY_NIL);
+        test_reply_first(conn, &reply.reply);
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_EQ(2, happ_cluster_group_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_group_cmd_err);
+
+    // slots reloaded by any worker are loaded by the others in dispatch
+    {
+        test_fake_reply slots(REDIS_REPLY_ARRAY);
+        slots.push_slots(0, 16383, 7001);
+        happ_cluster_group_update_slots(w1, slots);
+    }
+    snapshot = group.get_slot_snapshot();
+    CASE_EXPECT_TRUE(snapshot && 2 == snapshot->version);
+    CASE_EXPECT_TRUE("127.0.0.1:7000" == w0->get_slot_master(0)->name);
+    group.dispatch(0);
+    CASE_EXPECT_TRUE("127.0.0.1:7001" == w0->get_slot_master(0)->name);
+
+    // slots are spread to all workers if there are not enough nodes
+    CASE_EXPECT_EQ(static_cast<size_t>(hiredis::happ::cluster::get_slot_index("foo", 3)) % 2, group.pick_worker("foo", 3));
+
+    if (NULL != w0->get_connection("127.0.0.1:6370")) {
+        CASE_EXPECT_TRUE(w0->release_connection(w0->get_connection("127.0.0.1:6370"), true, 0));
+    }
+    if (NULL != conn) {
+        CASE_EXPECT_TRUE(w1->release_connection(conn, true, 0));
+    }
+    group.reset();
+    CASE_EXPECT_TRUE(!group.get_slot_snapshot());
+}
+
+static void happ_cluster_group_producer(hiredis::happ::cluster_group *group, int count) {
+    for (int i = 0; i < count; ++i) {
+        group->submit("foo", 3, happ_cluster_group_on_cmd, &happ_cluster_group_cmd_count, "INCR %s", "foo");
+    }
+}
+
+CASE_TEST(happ_cluster_group, mpsc)
+{
+    hiredis::happ::cluster_group group;
+    group.init(1, "127.0.0.1", 6370);
+    group.set_on_submit(happ_cluster_group_on_submit);
+
+    happ_cluster_group_submit_count = 0;
+    happ_cluster_group_cmd_count = 0;
+
+    const int producer_count = 4;
+    const int cmd_count = 2000;
+    std::vector<std::thread *> producers;
+    for (int i = 0; i < producer_count; ++i) {
+        producers.push_back(new std::thread(happ_cluster_group_producer, &group, cmd_count));
+    }
+
+    // cmds are dispatched while they are submitted
+    size_t dispatched = 0;
+    while (dispatched < static_cast<size_t>(producer_count * cmd_count)) {
+        dispatched += group.dispatch(0);
+    }
+
+    for (size_t i = 0; i < producers.size(); ++i) {
+        producers[i]->join();
+        delete producers[i];
+    }
+    CASE_EXPECT_EQ(0, group.dispatch(0));
+    CASE_EXPECT_EQ(0, group.get_queued_count(0));
+    CASE_EXPECT_GE(happ_cluster_group_submit_count, 1);
+
+    // all of them are waiting for slots
+    CASE_EXPECT_EQ(0, happ_cluster_group_cmd_count);
+
+    // cmds still in queue are finished by reset
+    happ_cluster_group_producer(&group, 1);
+    CASE_EXPECT_EQ(1, group.get_queued_count(0));
+    hiredis::happ::cluster *w0 = group.get_worker(0);
+    if (NULL != w0->get_connection("127.0.0.1:6370")) {
+        CASE_EXPECT_TRUE(w0->release_connection(w0->get_connection("127.0.0.1:6370"), true, 0));
+    }
+    group.reset();
+    CASE_EXPECT_EQ(producer_count * cmd_count + 1, happ_cluster_group_cmd_count);
+    CASE_EXPECT_EQ(0, group.get_queued_count(0));
+}
+
+#endif
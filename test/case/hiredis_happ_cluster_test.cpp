@@ -1,11 +1,15 @@
+#include <algorithm>
 #include <iostream>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
 #include <set>
+#include <string>
+#include <vector>
 #include <detail/happ_cmd.h>
 
 #include "hiredis_happ.h"
+#include "frame/test_fake_reply.h"
 #include "frame/test_macros.h"
 
 static int happ_cluster_f = 0;
@@ -66,4 +70,1562 @@ CASE_TEST(happ_cluster, connection_callback)
     clu.reset();
 }
 
-// 其他的需要真实的redis环境，没想好怎么测
\ No newline at end of file
+CASE_TEST(happ_cluster, slot_index)
+{
+    // values are the same as CLUSTER KEYSLOT
+    CASE_EXPECT_EQ(12182, hiredis::happ::cluster::get_slot_index("foo", 3));
+    CASE_EXPECT_EQ(5061, hiredis::happ::cluster::get_slot_index("bar", 3));
+    CASE_EXPECT_EQ(12739, hiredis::happ::cluster::get_slot_index("123456789", 9));
+    CASE_EXPECT_EQ(-1, hiredis::happ::cluster::get_slot_index("foo", 0));
+    CASE_EXPECT_EQ(-1, hiredis::happ::cluster::get_slot_index(NULL, 3));
+
+    // hash tags
+    int user_slot = hiredis::happ::cluster::get_slot_index("user1000", 8);
+    CASE_EXPECT_EQ(user_slot, hiredis::happ::cluster::get_slot_index("{user1000}.following", 20));
+    CASE_EXPECT_EQ(user_slot, hiredis::happ::cluster::get_slot_index("{user1000}.followers", 20));
+    CASE_EXPECT_EQ(user_slot, hiredis::happ::cluster::get_slot_index("prefix.{user1000}", 17));
+
+    // only the first { and the first } after it
+    CASE_EXPECT_EQ(hiredis::happ::cluster::get_slot_index("bar", 3), hiredis::happ::cluster::get_slot_index("foo{bar}{zap}", 13));
+    CASE_EXPECT_EQ(hiredis::happ::cluster::get_slot_index("{bar", 4), hiredis::happ::cluster::get_slot_index("foo{{bar}}zap", 13));
+
+    // empty or unclosed tags hash the whole key
+    CASE_EXPECT_NE(hiredis::happ::cluster::get_slot_index("bar", 3), hiredis::happ::cluster::get_slot_index("foo{}{bar}", 10));
+    CASE_EXPECT_NE(hiredis::happ::cluster::get_slot_index("bar", 3), hiredis::happ::cluster::get_slot_index("foo{bar", 7));
+    CASE_EXPECT_NE(hiredis::happ::cluster::get_slot_index("bar", 3), hiredis::happ::cluster::get_slot_index("foo}{bar", 8));
+
+    hiredis::happ::cluster clu;
+    CASE_EXPECT_EQ(NULL, clu.get_slot_by_key(NULL, 0));
+    CASE_EXPECT_EQ(clu.get_slot_by_key("bar", 3), clu.get_slot_by_key("{bar}.baz", 9));
+}
+
+CASE_TEST(happ_cluster, slot_nodes)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    CASE_EXPECT_EQ(static_cast<size_t>(HIREDIS_HAPP_SLOT_NUMBER * 2), sizeof(clu.slots));
+    CASE_EXPECT_EQ(NULL, clu.get_slot_node(0));
+    CASE_EXPECT_TRUE("127.0.0.1:6370" == clu.get_slot_master(0)->name);
+
+    test_fake_reply reply(REDIS_REPLY_ARRAY);
+    reply.push_slots(0, 100, 7000, 7003);
+    reply.push_slots(101, 5460, 7000, 7003);
+    reply.push_slots(5461, 10922, 7001, 0);
+    reply.push_slots(10923, 16383, 7002, 7005);
+    reply.push_slots(16383, 16384, 7002, 7005); // invalid range
+
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &reply.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    // ranges of the same master share one node
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.slot_nodes.size());
+    CASE_EXPECT_EQ(clu.get_slot_node(0), clu.get_slot_node(5460));
+    CASE_EXPECT_EQ(0, clu.get_slot_node(5460)->index);
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.get_slot_node(5460)->hosts.size());
+    CASE_EXPECT_TRUE("127.0.0.1:7000" == clu.get_slot_master(0)->name);
+    CASE_EXPECT_TRUE("127.0.0.1:7001" == clu.get_slot_master(5461)->name);
+    CASE_EXPECT_TRUE("127.0.0.1:7002" == clu.get_slot_master(16383)->name);
+    CASE_EXPECT_EQ(clu.get_slot_node(12182), clu.get_slot_by_key("foo", 3));
+
+    // the replica will be used after the master is removed
+    clu.remove_connection_key("127.0.0.1:7000");
+    CASE_EXPECT_TRUE("127.0.0.1:7003" == clu.get_slot_master(0)->name);
+    CASE_EXPECT_TRUE("127.0.0.1:7003" == clu.get_slot_master(5460)->name);
+
+    clu.reset();
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.slot_nodes.size());
+    CASE_EXPECT_EQ(NULL, clu.get_slot_node(0));
+}
+
+CASE_TEST(happ_cluster, reload_slots_later)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_slot_reload_interval(1, 0);
+    clu.proc(10, 0);
+
+    // first reload can be sent immediately
+    CASE_EXPECT_TRUE(clu.reload_slots_later());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+
+    // merged into the running one
+    CASE_EXPECT_FALSE(clu.reload_slots_later());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_avoided_count());
+
+    test_fake_reply reply(REDIS_REPLY_ARRAY);
+    reply.push_slots(0, 16383, 7000, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &reply.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::OK, clu.slot_flag);
+
+    // delayed until the interval passed
+    CASE_EXPECT_FALSE(clu.reload_slots_later());
+    CASE_EXPECT_FALSE(clu.reload_slots_later());
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.get_slot_reload_avoided_count());
+    CASE_EXPECT_TRUE(clu.slot_reload.delayed);
+
+    clu.proc(10, 500000);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::OK, clu.slot_flag);
+
+    clu.proc(11, 0);
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.get_slot_reload_avoided_count());
+    CASE_EXPECT_FALSE(clu.slot_reload.delayed);
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+
+    clu.reset();
+}
+
+CASE_TEST(happ_cluster, read_policy)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply reply(REDIS_REPLY_ARRAY);
+    reply.push_slots(0, 8191, 7000, 7003);
+    reply.push_slots(8192, 16383, 7001, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &reply.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    // master only
+    CASE_EXPECT_EQ(hiredis::happ::cluster::read_policy::MASTER_ONLY, clu.get_read_policy());
+    CASE_EXPECT_TRUE("127.0.0.1:7000" == clu.get_slot_reader(0)->name);
+
+    clu.set_read_policy(hiredis::happ::cluster::read_policy::PREFER_REPLICA);
+    CASE_EXPECT_TRUE("127.0.0.1:7003" == clu.get_slot_reader(0)->name);
+    // no replica
+    CASE_EXPECT_TRUE("127.0.0.1:7001" == clu.get_slot_reader(16383)->name);
+
+    clu.set_read_policy(hiredis::happ::cluster::read_policy::ROUND_ROBIN);
+    std::string first = clu.get_slot_reader(0)->name;
+    std::string second = clu.get_slot_reader(0)->name;
+    CASE_EXPECT_NE(first, second);
+    CASE_EXPECT_EQ(first, clu.get_slot_reader(0)->name);
+
+    // replica first if there is no pending cmd
+    clu.set_read_policy(hiredis::happ::cluster::read_policy::LEAST_PENDING);
+    CASE_EXPECT_TRUE("127.0.0.1:7003" == clu.get_slot_reader(0)->name);
+
+    clu.reset();
+}
+
+CASE_TEST(happ_cluster, connection_pool)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_connection_pool_size(2);
+    CASE_EXPECT_EQ(2, clu.get_connection_pool_size());
+    clu.set_connection_pool_busy_pending(2);
+    CASE_EXPECT_EQ(2, clu.get_connection_pool_busy_pending());
+
+    hiredis::happ::connection::key_t key;
+    hiredis::happ::connection::set_key(key, "127.0.0.1", 7000);
+
+    hiredis::happ::cluster::connection_t *conn1 = clu.get_or_make_connection(key);
+    CASE_EXPECT_NE(NULL, conn1);
+    // idle connection will be reused
+    CASE_EXPECT_EQ(conn1, clu.get_or_make_connection(key));
+
+    // not busy yet
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    cmd->format("GET %s", "foo");
+    clu.exec(conn1, cmd);
+    CASE_EXPECT_EQ(1, conn1->get_pending_count());
+    CASE_EXPECT_EQ(conn1, clu.get_or_make_connection(key));
+
+    // a new connection will be made when the old one is busy
+    cmd = clu.create_cmd(NULL, NULL);
+    cmd->format("GET %s", "bar");
+    clu.exec(conn1, cmd);
+    CASE_EXPECT_EQ(2, conn1->get_pending_count());
+
+    hiredis::happ::cluster::connection_t *conn2 = clu.get_or_make_connection(key);
+    CASE_EXPECT_NE(NULL, conn2);
+    CASE_EXPECT_NE(conn1, conn2);
+    CASE_EXPECT_NE(conn1->get_sequence(), conn2->get_sequence());
+
+    // pool is full
+    CASE_EXPECT_EQ(NULL, clu.make_connection(key));
+
+    // least pending
+    CASE_EXPECT_EQ(conn2, clu.get_connection(key.name));
+    CASE_EXPECT_EQ(conn2, clu.get_or_make_connection(key));
+
+    // round robin
+    clu.set_connection_pool_policy(hiredis::happ::cluster::pool_policy::ROUND_ROBIN);
+    hiredis::happ::cluster::connection_t *rr1 = clu.get_connection(key.name);
+    hiredis::happ::cluster::connection_t *rr2 = clu.get_connection(key.name);
+    CASE_EXPECT_NE(rr1, rr2);
+    CASE_EXPECT_EQ(rr1, clu.get_connection(key.name));
+
+    // release one connection, the other one is still available
+    CASE_EXPECT_TRUE(clu.release_connection(conn2, true, 0));
+    CASE_EXPECT_EQ(conn1, clu.get_connection(key.name));
+    CASE_EXPECT_EQ(conn1, clu.get_connection(key.name));
+
+    // release all connections of this node
+    CASE_EXPECT_TRUE(clu.release_connection(key, true, 0));
+    CASE_EXPECT_EQ(NULL, clu.get_connection(key.name));
+    CASE_EXPECT_FALSE(clu.release_connection(key, true, 0));
+
+    clu.reset();
+}
+
+static int happ_cluster_scatter_count = 0;
+static std::vector<std::string> happ_cluster_scatter_values;
+static long long happ_cluster_scatter_integer = 0;
+static void happ_cluster_on_scatter(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    ++happ_cluster_scatter_count;
+    CASE_EXPECT_EQ(&happ_cluster_scatter_count, privdata);
+    CASE_EXPECT_EQ(0, cmd->result());
+
+    redisReply *reply = reinterpret_cast<redisReply *>(r);
+    CASE_EXPECT_NE(NULL, reply);
+    if (NULL == reply) {
+        return;
+    }
+
+    happ_cluster_scatter_values.clear();
+    if (REDIS_REPLY_ARRAY == reply->type) {
+        for (size_t i = 0; i < reply->elements; ++i) {
+            if (REDIS_REPLY_NIL == reply->element[i]->type) {
+                happ_cluster_scatter_values.push_back("(nil)");
+            } else {
+                happ_cluster_scatter_values.push_back(std::string(reply->element[i]->str, reply->element[i]->len));
+            }
+        }
+    } else if (REDIS_REPLY_INTEGER == reply->type) {
+        happ_cluster_scatter_integer = reply->integer;
+    } else if (NULL != reply->str) {
+        happ_cluster_scatter_values.push_back(std::string(reply->str, reply->len));
+    }
+}
+
+CASE_TEST(happ_cluster, scatter)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 0);
+    slots.push_slots(8192, 16383, 7001, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    // foo and {foo}.bar are in slot 12182, bar is in slot 5061
+    const char *keys[] = {"foo", "bar", "{foo}.bar"};
+    size_t keys_len[] = {3, 3, 9};
+
+    happ_cluster_scatter_count = 0;
+    hiredis::happ::cmd_exec *scatter_cmd = NULL;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK,
+                   clu.mget(3, keys, keys_len, happ_cluster_on_scatter, &happ_cluster_scatter_count, &scatter_cmd));
+    CASE_EXPECT_NE(NULL, scatter_cmd);
+    hiredis::happ::connection *conn0 = clu.get_connection("127.0.0.1", 7000);
+    hiredis::happ::connection *conn1 = clu.get_connection("127.0.0.1", 7001);
+    CASE_EXPECT_NE(NULL, conn0);
+    CASE_EXPECT_NE(NULL, conn1);
+    if (NULL == conn0 || NULL == conn1) {
+        clu.reset();
+        return;
+    }
+
+    CASE_EXPECT_EQ(1, conn0->get_pending_count());
+    CASE_EXPECT_EQ(1, conn1->get_pending_count());
+
+    {
+        test_fake_reply reply(REDIS_REPLY_ARRAY);
+        reply.push_string("v_foo").push_string("v_foobar");
+        test_reply_first(conn1, &reply.reply);
+    }
+    CASE_EXPECT_EQ(0, happ_cluster_scatter_count);
+
+    {
+        test_fake_reply reply(REDIS_REPLY_ARRAY);
+        reply.push(new test_fake_reply(REDIS_REPLY_NIL));
+        test_reply_first(conn0, &reply.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_scatter_count);
+    CASE_EXPECT_EQ(3, happ_cluster_scatter_values.size());
+    if (3 == happ_cluster_scatter_values.size()) {
+        CASE_EXPECT_TRUE("v_foo" == happ_cluster_scatter_values[0]);
+        CASE_EXPECT_TRUE("(nil)" == happ_cluster_scatter_values[1]);
+        CASE_EXPECT_TRUE("v_foobar" == happ_cluster_scatter_values[2]);
+    }
+
+    // DEL
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.del(3, keys, keys_len, happ_cluster_on_scatter, &happ_cluster_scatter_count));
+    {
+        test_fake_reply reply(REDIS_REPLY_INTEGER);
+        reply.reply.integer = 2;
+        test_reply_first(conn1, &reply.reply);
+        reply.reply.integer = 1;
+        test_reply_first(conn0, &reply.reply);
+    }
+    CASE_EXPECT_EQ(2, happ_cluster_scatter_count);
+    CASE_EXPECT_EQ(3, happ_cluster_scatter_integer);
+
+    // MSET
+    const char *values[] = {"1", "2", "3"};
+    size_t values_len[] = {1, 1, 1};
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK,
+                   clu.mset(3, keys, keys_len, values, values_len, happ_cluster_on_scatter, &happ_cluster_scatter_count));
+    {
+        test_fake_reply reply(REDIS_REPLY_STATUS);
+        reply.str = "OK";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = 2;
+        test_reply_first(conn0, &reply.reply);
+        test_reply_first(conn1, &reply.reply);
+    }
+    CASE_EXPECT_EQ(3, happ_cluster_scatter_count);
+    CASE_EXPECT_EQ(1, happ_cluster_scatter_values.size());
+    if (1 == happ_cluster_scatter_values.size()) {
+        CASE_EXPECT_TRUE("OK" == happ_cluster_scatter_values[0]);
+    }
+
+    // out is reset if failed
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, clu.mget(0, keys, keys_len, happ_cluster_on_scatter, NULL, &scatter_cmd));
+    CASE_EXPECT_EQ(NULL, scatter_cmd);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, clu.mset(3, keys, keys_len, NULL, NULL, happ_cluster_on_scatter, NULL));
+    CASE_EXPECT_EQ(3, happ_cluster_scatter_count);
+
+    // connections are not connected, so they will not be released by reset
+    CASE_EXPECT_TRUE(clu.release_connection(conn0, true, 0));
+    CASE_EXPECT_TRUE(clu.release_connection(conn1, true, 0));
+    clu.reset();
+}
+
+static std::string happ_cluster_get_obuf(hiredis::happ::connection *conn) {
+    sds obuf = conn->get_context()->c.obuf;
+    return NULL == obuf ? std::string() : std::string(obuf, sdslen(obuf));
+}
+
+static int happ_cluster_batch_cmd_count = 0;
+static void happ_cluster_on_batch_cmd(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_cluster_batch_cmd_count, privdata);
+    CASE_EXPECT_EQ(privdata, cmd->private_data());
+    CASE_EXPECT_NE(NULL, r);
+    ++happ_cluster_batch_cmd_count;
+}
+
+static void happ_cluster_on_batch_cmd_abort(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_cluster_batch_cmd_count, privdata);
+    CASE_EXPECT_EQ(NULL, r);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_ABORT, cmd->result());
+    ++happ_cluster_batch_cmd_count;
+}
+
+static int happ_cluster_batch_count = 0;
+static int happ_cluster_batch_err = 0;
+static void happ_cluster_on_batch(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_cluster_batch_count, privdata);
+    CASE_EXPECT_EQ(NULL, r);
+    CASE_EXPECT_EQ(happ_cluster_batch_err, cmd->result());
+    // all cmds finished before batch callback
+    CASE_EXPECT_EQ(3, happ_cluster_batch_cmd_count);
+    ++happ_cluster_batch_count;
+}
+
+CASE_TEST(happ_cluster, batch)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 0);
+    slots.push_slots(8192, 16383, 7001, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    hiredis::happ::connection::key_t key0, key1;
+    hiredis::happ::connection::set_key(key0, "127.0.0.1", 7000);
+    hiredis::happ::connection::set_key(key1, "127.0.0.1", 7001);
+    hiredis::happ::connection *conn0 = clu.make_connection(key0);
+    hiredis::happ::connection *conn1 = clu.make_connection(key1);
+    CASE_EXPECT_NE(NULL, conn0);
+    CASE_EXPECT_NE(NULL, conn1);
+    if (NULL == conn0 || NULL == conn1) {
+        clu.reset();
+        return;
+    }
+
+    happ_cluster_batch_cmd_count = 0;
+    happ_cluster_batch_count = 0;
+    happ_cluster_batch_err = 0;
+    hiredis::happ::cluster::batch_t *batch = clu.create_batch(happ_cluster_on_batch, &happ_cluster_batch_count);
+    CASE_EXPECT_NE(NULL, batch);
+    CASE_EXPECT_NE(NULL, clu.batch_exec(batch, "foo", 3, happ_cluster_on_batch_cmd, &happ_cluster_batch_cmd_count, "SET %s %d", "foo", 1));
+    CASE_EXPECT_NE(NULL, clu.batch_exec(batch, "bar", 3, happ_cluster_on_batch_cmd, &happ_cluster_batch_cmd_count, "SET %s %d", "bar", 2));
+    CASE_EXPECT_NE(NULL, clu.batch_exec(batch, "{foo}.bar", 9, happ_cluster_on_batch_cmd, &happ_cluster_batch_cmd_count, "SET %s %d", "{foo}.bar", 3));
+
+    // nothing is sent before flush
+    CASE_EXPECT_EQ(0, conn0->get_pending_count());
+    CASE_EXPECT_EQ(0, conn1->get_pending_count());
+    CASE_EXPECT_EQ(3, clu.flush_batch(batch));
+    CASE_EXPECT_EQ(NULL, clu.batch_exec(batch, "foo", 3, happ_cluster_on_batch_cmd, NULL, "GET %s", "foo"));
+
+    CASE_EXPECT_EQ(1, conn0->get_pending_count());
+    CASE_EXPECT_EQ(2, conn1->get_pending_count());
+    // cmds to the same connection are together in output buffer
+    CASE_EXPECT_TRUE("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$1\r\n1\r\n*3\r\n$3\r\nSET\r\n$9\r\n{foo}.bar\r\n$1\r\n3\r\n" ==
+                     happ_cluster_get_obuf(conn1));
+
+    {
+        test_fake_reply reply(REDIS_REPLY_STATUS);
+        reply.str = "OK";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = 2;
+        test_reply_first(conn1, &reply.reply);
+        test_reply_first(conn0, &reply.reply);
+        CASE_EXPECT_EQ(0, happ_cluster_batch_count);
+        test_reply_first(conn1, &reply.reply);
+    }
+    CASE_EXPECT_EQ(3, happ_cluster_batch_cmd_count);
+    CASE_EXPECT_EQ(1, happ_cluster_batch_count);
+
+    // empty batch finishes at once
+    happ_cluster_batch_cmd_count = 3;
+    batch = clu.create_batch(happ_cluster_on_batch, &happ_cluster_batch_count);
+    CASE_EXPECT_EQ(0, clu.flush_batch(batch));
+    CASE_EXPECT_EQ(2, happ_cluster_batch_count);
+
+    // aborted batch sends nothing, and all callbacks are called
+    happ_cluster_batch_cmd_count = 0;
+    happ_cluster_batch_err = hiredis::happ::error_code::REDIS_HAPP_ABORT;
+    batch = clu.create_batch(happ_cluster_on_batch, &happ_cluster_batch_count);
+    for (int i = 0; i < 3; ++i) {
+        clu.batch_exec(batch, "bar", 3, happ_cluster_on_batch_cmd_abort, &happ_cluster_batch_cmd_count, "GET %s", "bar");
+    }
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.abort_batch(batch));
+    CASE_EXPECT_EQ(3, happ_cluster_batch_cmd_count);
+    CASE_EXPECT_EQ(3, happ_cluster_batch_count);
+    CASE_EXPECT_EQ(0, conn0->get_pending_count());
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, clu.abort_batch(NULL));
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn0, true, 0));
+    CASE_EXPECT_TRUE(clu.release_connection(conn1, true, 0));
+    clu.reset();
+}
+
+static int happ_cluster_transaction_count = 0;
+static int happ_cluster_transaction_err = 0;
+static size_t happ_cluster_transaction_elements = 0;
+static void happ_cluster_on_transaction(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    ++happ_cluster_transaction_count;
+    CASE_EXPECT_EQ(&happ_cluster_transaction_count, privdata);
+    happ_cluster_transaction_err = cmd->result();
+
+    redisReply *reply = reinterpret_cast<redisReply *>(r);
+    happ_cluster_transaction_elements = (NULL != reply && REDIS_REPLY_ARRAY == reply->type) ? reply->elements : 0;
+}
+
+static size_t happ_cluster_count_callbacks(hiredis::happ::connection *conn) {
+    size_t ret = 0;
+    for (redisCallback *cb = conn->get_context()->replies.head; NULL != cb; cb = cb->next) {
+        ++ret;
+    }
+    return ret;
+}
+
+CASE_TEST(happ_cluster, transaction)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 0);
+    slots.push_slots(8192, 16383, 7001, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    // {user1000} is in slot 3443, and it's moved to the other node later
+    hiredis::happ::connection::key_t key0, key1;
+    hiredis::happ::connection::set_key(key0, "127.0.0.1", 7000);
+    hiredis::happ::connection::set_key(key1, "127.0.0.1", 7001);
+    hiredis::happ::connection *conn0 = clu.make_connection(key0);
+    hiredis::happ::connection *conn1 = clu.make_connection(key1);
+    CASE_EXPECT_NE(NULL, conn0);
+    CASE_EXPECT_NE(NULL, conn1);
+    if (NULL == conn0 || NULL == conn1) {
+        clu.reset();
+        return;
+    }
+    int slot = hiredis::happ::cluster::get_slot_index("user1000", 8);
+    CASE_EXPECT_EQ(3443, slot);
+
+    happ_cluster_transaction_count = 0;
+    hiredis::happ::cluster::transaction_t *t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    CASE_EXPECT_NE(NULL, t);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.transaction_exec(t, "{user1000}.following", 20, "SET %s %d", "{user1000}.following", 1));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.transaction_exec(t, "{user1000}.followers", 20, "INCR %s", "{user1000}.followers"));
+
+    // MULTI, 2 cmds and EXEC in one write
+    CASE_EXPECT_NE(NULL, clu.flush_transaction(t));
+    CASE_EXPECT_EQ(1, conn0->get_pending_count());
+    CASE_EXPECT_EQ(4, happ_cluster_count_callbacks(conn0));
+    CASE_EXPECT_EQ(0, happ_cluster_count_callbacks(conn1));
+    std::string obuf = happ_cluster_get_obuf(conn0);
+    CASE_EXPECT_EQ(0, obuf.find("*1\r\n$5\r\nMULTI\r\n"));
+    CASE_EXPECT_EQ(obuf.size() - 14, obuf.rfind("*1\r\n$4\r\nEXEC\r\n"));
+
+    {
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.str = "OK";
+        ok.reply.str = &ok.str[0];
+        ok.reply.len = 2;
+        test_fake_reply queued(REDIS_REPLY_STATUS);
+        queued.str = "QUEUED";
+        queued.reply.str = &queued.str[0];
+        queued.reply.len = 6;
+        test_fake_reply results(REDIS_REPLY_ARRAY);
+        results.push_string("OK").push_integer(1);
+
+        test_reply_first(conn0, &ok.reply);
+        test_reply_first(conn0, &queued.reply);
+        test_reply_first(conn0, &queued.reply);
+        CASE_EXPECT_EQ(0, happ_cluster_transaction_count);
+        test_reply_first(conn0, &results.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_transaction_err);
+    CASE_EXPECT_EQ(2, happ_cluster_transaction_elements);
+
+    // after ASK, it's sent to the importing node with ASKING at once, and slots are not changed
+    t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    clu.transaction_exec(t, "{user1000}.following", 20, "SET %s %d", "{user1000}.following", 3);
+    CASE_EXPECT_NE(NULL, clu.flush_transaction(t));
+    {
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.str = "OK";
+        ok.reply.str = &ok.str[0];
+        ok.reply.len = 2;
+        test_fake_reply ask(REDIS_REPLY_ERROR);
+        ask.str = "ASK 3443 127.0.0.1:7002";
+        ask.reply.str = &ask.str[0];
+        ask.reply.len = static_cast<int>(ask.str.size());
+        test_fake_reply aborted(REDIS_REPLY_ERROR);
+        aborted.str = "EXECABORT Transaction discarded because of previous errors.";
+        aborted.reply.str = &aborted.str[0];
+        aborted.reply.len = static_cast<int>(aborted.str.size());
+
+        test_reply_first(conn0, &ok.reply);
+        test_reply_first(conn0, &ask.reply);
+        test_reply_first(conn0, &aborted.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(1, clu.get_stats().ask);
+    CASE_EXPECT_EQ(0, happ_cluster_count_callbacks(conn0));
+    CASE_EXPECT_TRUE(clu.get_slot_by_key("user1000", 8) != NULL && "127.0.0.1:7000" == clu.get_slot_by_key("user1000", 8)->hosts[0].name);
+
+    hiredis::happ::connection *conn2 = clu.get_connection("127.0.0.1:7002");
+    CASE_EXPECT_NE(NULL, conn2);
+    if (NULL != conn2) {
+        CASE_EXPECT_EQ(4, happ_cluster_count_callbacks(conn2));
+        CASE_EXPECT_EQ(0, happ_cluster_get_obuf(conn2).find("*1\r\n$6\r\nASKING\r\n*1\r\n$5\r\nMULTI\r\n"));
+
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.str = "OK";
+        ok.reply.str = &ok.str[0];
+        ok.reply.len = 2;
+        test_fake_reply results(REDIS_REPLY_ARRAY);
+        results.push_string("OK");
+
+        test_reply_first(conn2, &ok.reply);
+        test_reply_first(conn2, &ok.reply);
+        test_reply_first(conn2, &ok.reply);
+        test_reply_first(conn2, &results.reply);
+        CASE_EXPECT_TRUE(clu.release_connection(conn2, true, 0));
+    }
+    CASE_EXPECT_EQ(2, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_transaction_err);
+    CASE_EXPECT_EQ(1, happ_cluster_transaction_elements);
+
+    // the whole transaction is sent again after MOVED
+    t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    clu.transaction_exec(t, "{user1000}.following", 20, "SET %s %d", "{user1000}.following", 2);
+    clu.transaction_exec(t, "{user1000}.followers", 20, "INCR %s", "{user1000}.followers");
+    CASE_EXPECT_NE(NULL, clu.flush_transaction(t));
+    {
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.str = "OK";
+        ok.reply.str = &ok.str[0];
+        ok.reply.len = 2;
+        test_fake_reply moved(REDIS_REPLY_ERROR);
+        moved.str = "MOVED 3443 127.0.0.1:7001";
+        moved.reply.str = &moved.str[0];
+        moved.reply.len = static_cast<int>(moved.str.size());
+        test_fake_reply aborted(REDIS_REPLY_ERROR);
+        aborted.str = "EXECABORT Transaction discarded because of previous errors.";
+        aborted.reply.str = &aborted.str[0];
+        aborted.reply.len = static_cast<int>(aborted.str.size());
+
+        test_reply_first(conn0, &ok.reply);
+        test_reply_first(conn0, &moved.reply);
+        test_reply_first(conn0, &moved.reply);
+        test_reply_first(conn0, &aborted.reply);
+    }
+    CASE_EXPECT_EQ(2, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(2, clu.get_stats().moved);
+    CASE_EXPECT_TRUE(clu.get_slot_by_key("user1000", 8) != NULL && "127.0.0.1:7001" == clu.get_slot_by_key("user1000", 8)->hosts[0].name);
+    // CLUSTER SLOTS may be sent after it
+    CASE_EXPECT_TRUE(happ_cluster_count_callbacks(conn1) >= 4);
+    {
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.str = "OK";
+        ok.reply.str = &ok.str[0];
+        ok.reply.len = 2;
+        test_fake_reply results(REDIS_REPLY_ARRAY);
+        results.push_string("OK").push_integer(2);
+
+        test_reply_first(conn1, &ok.reply);
+        test_reply_first(conn1, &ok.reply);
+        test_reply_first(conn1, &ok.reply);
+        test_reply_first(conn1, &results.reply);
+    }
+    CASE_EXPECT_EQ(3, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_transaction_err);
+    CASE_EXPECT_EQ(2, happ_cluster_transaction_elements);
+
+    // keys in different slots
+    t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.transaction_exec(t, "foo", 3, "SET %s %d", "foo", 1));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_SLOT_UNAVAILABLE, clu.transaction_exec(t, "bar", 3, "SET %s %d", "bar", 1));
+    CASE_EXPECT_EQ(NULL, clu.flush_transaction(t));
+    CASE_EXPECT_EQ(4, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_SLOT_UNAVAILABLE, happ_cluster_transaction_err);
+
+    // empty transaction
+    t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(NULL, clu.flush_transaction(t));
+    CASE_EXPECT_EQ(5, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, happ_cluster_transaction_err);
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn0, true, 0));
+    CASE_EXPECT_TRUE(clu.release_connection(conn1, true, 0));
+    clu.reset();
+}
+
+CASE_TEST(happ_cluster, transaction_deadline)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 16383, 7000, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+    clu.set_cmd_timeout(1, 0);
+    clu.proc(100, 0);
+
+    hiredis::happ::connection::key_t key0;
+    hiredis::happ::connection::set_key(key0, "127.0.0.1", 7000);
+    hiredis::happ::connection *conn0 = clu.make_connection(key0);
+    CASE_EXPECT_NE(NULL, conn0);
+    if (NULL == conn0) {
+        clu.reset();
+        return;
+    }
+
+    happ_cluster_transaction_count = 0;
+    hiredis::happ::cluster::transaction_t *t = clu.create_transaction(happ_cluster_on_transaction, &happ_cluster_transaction_count);
+    clu.transaction_exec(t, "{user1000}.following", 20, "SET %s %d", "{user1000}.following", 1);
+    CASE_EXPECT_NE(NULL, clu.flush_transaction(t));
+    CASE_EXPECT_EQ(3, happ_cluster_count_callbacks(conn0));
+
+    // EXEC is finished by deadline, but MULTI and the queued cmd are still waiting for reply
+    clu.proc(101, 0);
+    CASE_EXPECT_EQ(1, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_TIMEOUT, happ_cluster_transaction_err);
+
+    // late MOVED still moves the slot, and the released transaction is not touched
+    {
+        test_fake_reply ok(REDIS_REPLY_STATUS);
+        ok.set_string("OK");
+        test_fake_reply moved(REDIS_REPLY_ERROR);
+        moved.set_string("MOVED 3443 127.0.0.1:7001");
+        test_fake_reply aborted(REDIS_REPLY_ERROR);
+        aborted.set_string("EXECABORT Transaction discarded because of previous errors.");
+
+        test_reply_first(conn0, &ok.reply);
+        test_reply_first(conn0, &moved.reply);
+        test_reply_first(conn0, &aborted.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_transaction_count);
+    CASE_EXPECT_EQ(0, happ_cluster_count_callbacks(conn0));
+    CASE_EXPECT_EQ(1, clu.get_stats().moved);
+    CASE_EXPECT_TRUE(clu.get_slot_by_key("user1000", 8) != NULL && "127.0.0.1:7001" == clu.get_slot_by_key("user1000", 8)->hosts[0].name);
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn0, true, 0));
+    clu.reset();
+}
+
+static int happ_cluster_deadline_count = 0;
+static void happ_cluster_on_deadline(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *) {
+    ++happ_cluster_deadline_count;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_TIMEOUT, cmd->result());
+    CASE_EXPECT_EQ(NULL, r);
+}
+
+CASE_TEST(happ_cluster, cmd_deadline)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_cmd_timeout(1, 0);
+    clu.proc(100, 0);
+
+    hiredis::happ::connection::key_t key;
+    hiredis::happ::connection::set_key(key, "127.0.0.1", 7000);
+    hiredis::happ::connection *conn = clu.make_connection(key);
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL == conn) {
+        return;
+    }
+
+    happ_cluster_deadline_count = 0;
+    hiredis::happ::cmd_exec *cmd1 = clu.create_cmd(happ_cluster_on_deadline, NULL);
+    cmd1->format("GET %s", "foo");
+    hiredis::happ::cmd_exec *cmd2 = clu.create_cmd(happ_cluster_on_deadline, NULL);
+    cmd2->format("GET %s", "bar");
+    CASE_EXPECT_EQ(cmd1, clu.exec(conn, cmd1));
+    CASE_EXPECT_EQ(cmd2, clu.exec(conn, cmd2));
+    CASE_EXPECT_TRUE(clu.set_cmd_deadline(cmd2, 0, 500000));
+    CASE_EXPECT_EQ(2, clu.cmd_deadlines.size());
+
+    clu.proc(100, 400000);
+    CASE_EXPECT_EQ(0, happ_cluster_deadline_count);
+    clu.proc(100, 500000);
+    CASE_EXPECT_EQ(1, happ_cluster_deadline_count);
+    clu.proc(101, 0);
+    CASE_EXPECT_EQ(2, happ_cluster_deadline_count);
+    CASE_EXPECT_EQ(0, clu.cmd_deadlines.size());
+    CASE_EXPECT_FALSE(clu.set_cmd_deadline(cmd1, 1, 0));
+
+    // late replies are dropped
+    CASE_EXPECT_EQ(2, conn->get_pending_count());
+    {
+        test_fake_reply reply(REDIS_REPLY_NIL);
+        test_reply_first(conn, &reply.reply);
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_EQ(2, happ_cluster_deadline_count);
+    CASE_EXPECT_EQ(0, conn->get_pending_count());
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn, true, 0));
+    clu.reset();
+}
+
+// 其他的需要真实的redis环境，没想好怎么测
+static int happ_cluster_retry_result = 0;
+static void happ_cluster_on_retry(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *, void *) {
+    happ_cluster_retry_result = cmd->result();
+}
+
+CASE_TEST(happ_cluster, retry_backoff)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.get_retry_policy().set_backoff(0, 100000, 2, 0);
+    clu.get_retry_policy().set_budget(50, 1);
+    clu.proc(100, 950000);
+
+    // sent twice and failed, so it should backoff
+    happ_cluster_retry_result = 0;
+    hiredis::happ::cmd_exec *cmd1 = clu.create_cmd(happ_cluster_on_retry, NULL);
+    cmd1->format("GET %s", "foo");
+    cmd1->ttl = HIREDIS_HAPP_TTL - 2;
+    CASE_EXPECT_EQ(cmd1, clu.retry(cmd1));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.timer_actions.timer_pending.size());
+    if (!clu.timer_actions.timer_pending.empty()) {
+        // 100ms to 300ms later, normalized into the next second
+        CASE_EXPECT_EQ(static_cast<time_t>(101), clu.timer_actions.timer_pending.front().sec);
+        CASE_EXPECT_GE(clu.timer_actions.timer_pending.front().usec, static_cast<time_t>(50000));
+        CASE_EXPECT_LE(clu.timer_actions.timer_pending.front().usec, static_cast<time_t>(250000));
+    }
+
+    // budget exhausted
+    hiredis::happ::cmd_exec *cmd2 = clu.create_cmd(happ_cluster_on_retry, NULL);
+    cmd2->format("GET %s", "bar");
+    cmd2->ttl = HIREDIS_HAPP_TTL - 2;
+    CASE_EXPECT_EQ(NULL, clu.retry(cmd2));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_RETRY_BUDGET, happ_cluster_retry_result);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_retry_policy().get_rejected_count());
+
+    clu.reset();
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_TIMEOUT, happ_cluster_retry_result);
+}
+
+static void happ_cluster_on_stats(hiredis::happ::cmd_exec *, struct redisAsyncContext *, void *, void *) {}
+
+CASE_TEST(happ_cluster, stats)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.proc(100, 0);
+
+    hiredis::happ::connection::key_t key;
+    hiredis::happ::connection::set_key(key, "127.0.0.1", 7000);
+    hiredis::happ::connection *conn = clu.make_connection(key);
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL == conn) {
+        return;
+    }
+
+    hiredis::happ::cmd_exec *cmd1 = clu.create_cmd(happ_cluster_on_stats, NULL);
+    cmd1->format("GET %s", "foo");
+    hiredis::happ::cmd_exec *cmd2 = clu.create_cmd(happ_cluster_on_stats, NULL);
+    cmd2->format("GET %s", "bar");
+    hiredis::happ::cmd_exec *cmd3 = clu.create_cmd(happ_cluster_on_stats, NULL);
+    cmd3->format("GET %s", "baz");
+    CASE_EXPECT_EQ(cmd1, clu.exec(conn, cmd1));
+    CASE_EXPECT_EQ(cmd2, clu.exec(conn, cmd2));
+    CASE_EXPECT_EQ(cmd3, clu.exec(conn, cmd3));
+    CASE_EXPECT_EQ(3, clu.get_stats().sent);
+    CASE_EXPECT_EQ(3, conn->get_stats().sent);
+
+    {
+        test_fake_reply reply(REDIS_REPLY_NIL);
+        test_reply_first(conn, &reply.reply);
+    }
+    {
+        test_fake_reply reply(REDIS_REPLY_ERROR);
+        reply.str = "ERR wrong type";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = static_cast<int>(reply.str.size());
+        test_reply_first(conn, &reply.reply);
+    }
+    {
+        test_fake_reply reply(REDIS_REPLY_ERROR);
+        reply.str = "MOVED 3999 127.0.0.1:7001";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = static_cast<int>(reply.str.size());
+        test_reply_first(conn, &reply.reply);
+    }
+
+    // snapshot
+    hiredis::happ::cmd_stats snapshot = clu.get_stats();
+    CASE_EXPECT_EQ(2, snapshot.finished);
+    CASE_EXPECT_EQ(1, snapshot.moved);
+    CASE_EXPECT_EQ(1, snapshot.get_error_count(hiredis::happ::error_code::REDIS_HAPP_HIREDIS));
+    CASE_EXPECT_EQ(2, snapshot.latency.get_count());
+
+    CASE_EXPECT_EQ(2, conn->get_stats().replied);
+    CASE_EXPECT_EQ(1, conn->get_stats().moved);
+    CASE_EXPECT_EQ(1, conn->get_stats().get_error_count(hiredis::happ::error_code::REDIS_HAPP_HIREDIS));
+    CASE_EXPECT_EQ(2, conn->get_stats().latency.get_count());
+
+    hiredis::happ::cmd_stats node;
+    CASE_EXPECT_TRUE(clu.get_node_stats(key.name, node));
+    CASE_EXPECT_EQ(3, node.sent);
+    CASE_EXPECT_FALSE(clu.get_node_stats("127.0.0.1:7002", node));
+
+    clu.reset_stats();
+    CASE_EXPECT_EQ(0, clu.get_stats().sent);
+    CASE_EXPECT_EQ(0, conn->get_stats().sent);
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn, true, 0));
+    clu.reset();
+}
+
+static int happ_cluster_slot_pending_count = 0;
+static void happ_cluster_on_slot_pending(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *, void *) {
+    ++happ_cluster_slot_pending_count;
+}
+
+CASE_TEST(happ_cluster, reload_slots_single_flight)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_slot_reload_interval(1, 0);
+    clu.get_retry_policy().set_backoff(0, 200000, 1, 0);
+    clu.proc(10, 0);
+
+    // cmds waiting for slots share one reload
+    happ_cluster_slot_pending_count = 0;
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_slot_pending, NULL, "GET %s", "foo"));
+    CASE_EXPECT_NE(NULL, clu.exec("bar", 3, happ_cluster_on_slot_pending, NULL, "GET %s", "bar"));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.slot_pending.size());
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+
+    // failed, and backoff
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, NULL, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::INVALID, clu.slot_flag);
+    CASE_EXPECT_TRUE(clu.slot_reload.delayed);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.slot_reload.failed_nodes.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.slot_reload.failed_nodes.count("127.0.0.1:6370"));
+
+    // next cmd does not send another reload immediately
+    CASE_EXPECT_NE(NULL, clu.exec("baz", 3, happ_cluster_on_slot_pending, NULL, "GET %s", "baz"));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+    clu.proc(10, 100000);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+
+    // the init node is the only one known, so it's used again
+    clu.proc(11, 0);
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+
+    test_fake_reply reply(REDIS_REPLY_ARRAY);
+    reply.push_slots(0, 8191, 7000, 7100).push_slots(8192, 16383, 7001, 0);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &reply.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::OK, clu.slot_flag);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.slot_pending.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.slot_reload.failed_count);
+    CASE_EXPECT_TRUE(clu.slot_reload.failed_nodes.empty());
+
+    // reloads are spread into nodes, except the failed ones
+    clu.slot_reload.failed_nodes.insert("127.0.0.1:7000");
+    std::set<std::string> picked;
+    for (int i = 0; i < 64; ++i) {
+        std::vector<const hiredis::happ::connection::key_t *> keys;
+        clu.get_slot_reload_nodes(keys, 1);
+        CASE_EXPECT_EQ(static_cast<size_t>(1), keys.size());
+        CASE_EXPECT_TRUE(keys[0]->name != "127.0.0.1:7000");
+        picked.insert(keys[0]->name);
+    }
+    CASE_EXPECT_GT(picked.size(), static_cast<size_t>(1));
+
+    clu.slot_reload.failed_nodes.insert("127.0.0.1:7100");
+    for (int i = 0; i < 16; ++i) {
+        std::vector<const hiredis::happ::connection::key_t *> keys;
+        clu.get_slot_reload_nodes(keys, 1);
+        CASE_EXPECT_TRUE(keys[0]->name != "127.0.0.1:7000" && keys[0]->name != "127.0.0.1:7100");
+    }
+
+    // all failed, any of them can be used again
+    clu.slot_reload.failed_nodes.insert("127.0.0.1:7001");
+    clu.slot_reload.failed_nodes.insert("127.0.0.1:6370");
+    {
+        std::vector<const hiredis::happ::connection::key_t *> keys;
+        clu.get_slot_reload_nodes(keys, 3);
+        CASE_EXPECT_EQ(static_cast<size_t>(3), keys.size());
+    }
+
+    clu.reset();
+}
+
+static int happ_cluster_ready_count = 0;
+static int happ_cluster_ready_status = 0;
+static void happ_cluster_on_ready(hiredis::happ::cluster *, int status) {
+    ++happ_cluster_ready_count;
+    happ_cluster_ready_status = status;
+}
+
+CASE_TEST(happ_cluster, warm_up)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_connection_pool_size(2);
+    clu.set_warm_up_policy(hiredis::happ::cluster::warm_up_policy::ALL);
+    clu.set_on_ready(happ_cluster_on_ready);
+    clu.proc(100, 0);
+
+    happ_cluster_ready_count = 0;
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 7100).push_slots(8192, 16383, 7001, 0);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+
+    // all masters and replicas are connected, with a full pool
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.connections.size());
+    std::vector<hiredis::happ::connection *> conns;
+    for (hiredis::happ::cluster::connection_map_t::iterator it = clu.connections.begin(); it != clu.connections.end(); ++it) {
+        CASE_EXPECT_EQ(static_cast<size_t>(2), it->second.conns.size());
+        for (size_t i = 0; i < it->second.conns.size(); ++i) {
+            conns.push_back(it->second.conns[i].get());
+        }
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(6), clu.warm_up_status.pending);
+
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_EQ(0, happ_cluster_ready_count);
+        CASE_EXPECT_EQ(1, conns[i]->get_pending_count());
+
+        test_fake_reply reply(REDIS_REPLY_STATUS);
+        reply.str = "PONG";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = static_cast<int>(reply.str.size());
+        test_reply_first(conns[i], &reply.reply);
+        conns[i]->set_connected();
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_ready_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_ready_status);
+
+    // reload again, only masters and all connections are ready
+    clu.set_warm_up_policy(hiredis::happ::cluster::warm_up_policy::MASTERS);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.connections.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.warm_up_status.pending);
+    CASE_EXPECT_EQ(2, happ_cluster_ready_count);
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_EQ(0, conns[i]->get_pending_count());
+    }
+
+    // only the lost one is made and waited
+    hiredis::happ::connection *lost = clu.connections["127.0.0.1:7000"].conns[0].get();
+    conns.erase(std::find(conns.begin(), conns.end(), lost));
+    CASE_EXPECT_TRUE(clu.release_connection(lost, true, 0));
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.connections["127.0.0.1:7000"].conns.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.warm_up_status.pending);
+    conns.push_back(clu.connections["127.0.0.1:7000"].conns[1].get());
+    CASE_EXPECT_EQ(1, conns.back()->get_pending_count());
+
+    // connections closed before replied are failures
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_TRUE(clu.release_connection(conns[i], true, 0));
+    }
+    CASE_EXPECT_EQ(3, happ_cluster_ready_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_CONNECTION, happ_cluster_ready_status);
+    clu.reset();
+}
+
+CASE_TEST(happ_cluster, reload_slots_seeds)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.add_seed("127.0.0.1", 6371));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.add_seed("127.0.0.1", 6371));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.add_seed("127.0.0.1", 6372));
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.get_seeds().size());
+    clu.set_slot_reload_fanout(2);
+    clu.proc(100, 0);
+
+    // no slot loaded, any seed can be used
+    const hiredis::happ::connection::key_t *seed = clu.get_slot_master(-1);
+    CASE_EXPECT_NE(NULL, seed);
+    CASE_EXPECT_TRUE(0 == seed->name.find("127.0.0.1:637"));
+
+    // queries are sent to different seeds
+    CASE_EXPECT_TRUE(clu.reload_slots());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_slot_reload_count());
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.connections.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.slot_reload.pending);
+
+    std::vector<hiredis::happ::connection *> conns;
+    for (hiredis::happ::cluster::connection_map_t::iterator it = clu.connections.begin(); it != clu.connections.end(); ++it) {
+        conns.push_back(it->second.conns[0].get());
+    }
+    if (conns.size() < 2) {
+        return;
+    }
+
+    // one failed, and wait for the other one
+    {
+        test_fake_reply reply(REDIS_REPLY_ERROR);
+        reply.str = "ERR This instance has cluster support disabled";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = static_cast<int>(reply.str.size());
+        test_reply_first(conns[0], &reply.reply);
+    }
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.slot_reload.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.slot_reload.failed_count);
+
+    {
+        test_fake_reply reply(REDIS_REPLY_ARRAY);
+        reply.push_slots(0, 16383, 7000, 0);
+        test_reply_first(conns[1], &reply.reply);
+    }
+    CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::OK, clu.slot_flag);
+    CASE_EXPECT_TRUE("127.0.0.1:7000" == clu.get_slot_master(0)->name);
+
+    // all queries failed
+    CASE_EXPECT_TRUE(clu.reload_slots());
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.slot_reload.pending);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        void *sequence = reinterpret_cast<void *>(clu.slot_reload.sequence);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, NULL, sequence);
+        CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::UPDATING, clu.slot_flag);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, NULL, sequence);
+        CASE_EXPECT_EQ(hiredis::happ::cluster::slot_status::INVALID, clu.slot_flag);
+        CASE_EXPECT_EQ(static_cast<size_t>(1), clu.slot_reload.failed_count);
+
+        // late replies of an old round are ignored
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, NULL, sequence);
+        CASE_EXPECT_EQ(static_cast<size_t>(1), clu.slot_reload.failed_count);
+        clu.destroy_cmd(cmd);
+    }
+
+    for (hiredis::happ::cluster::connection_map_t::iterator it = clu.connections.begin(); it != clu.connections.end();) {
+        hiredis::happ::connection *conn = (it++)->second.conns[0].get();
+        CASE_EXPECT_TRUE(clu.release_connection(conn, true, 0));
+    }
+    clu.reset();
+}
+
+static int happ_cluster_hedge_count = 0;
+static std::string happ_cluster_hedge_value;
+static void happ_cluster_on_hedge(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    ++happ_cluster_hedge_count;
+    CASE_EXPECT_EQ(&happ_cluster_hedge_count, privdata);
+    CASE_EXPECT_EQ(&happ_cluster_hedge_count, cmd->private_data());
+
+    redisReply *reply = reinterpret_cast<redisReply *>(r);
+    if (NULL != reply && REDIS_REPLY_STRING == reply->type) {
+        happ_cluster_hedge_value.assign(reply->str, static_cast<size_t>(reply->len));
+    }
+}
+
+static void happ_cluster_reply_string(hiredis::happ::connection *conn, const char *value) {
+    test_fake_reply reply(REDIS_REPLY_STRING);
+    reply.str = value;
+    reply.reply.str = &reply.str[0];
+    reply.reply.len = static_cast<int>(reply.str.size());
+    test_reply_first(conn, &reply.reply);
+}
+
+CASE_TEST(happ_cluster, hedge)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_read_policy(hiredis::happ::cluster::read_policy::PREFER_REPLICA);
+    clu.set_hedge_policy(99, 0, 100000);
+    clu.proc(100, 0);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 16383, 7000, 7100);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+
+    hiredis::happ::connection *master = clu.make_connection(*clu.get_slot_master(0));
+    hiredis::happ::connection *replica = clu.get_connection("127.0.0.1", 7100);
+    CASE_EXPECT_NE(NULL, master);
+    if (NULL == master) {
+        return;
+    }
+
+    // write cmds are not hedged
+    happ_cluster_hedge_count = 0;
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "SET %s %s", "foo", "bar"));
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.timer_actions.timer_hedges.size());
+
+    // READONLY and SET
+    happ_cluster_reply_string(master, "OK");
+    happ_cluster_reply_string(master, "OK");
+    CASE_EXPECT_EQ(1, happ_cluster_hedge_count);
+
+    // the hedged copy wins
+    hiredis::happ::cmd_exec *cmd = clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo");
+    CASE_EXPECT_NE(NULL, cmd);
+    replica = clu.get_connection("127.0.0.1", 7100);
+    CASE_EXPECT_NE(NULL, replica);
+    if (NULL == replica) {
+        return;
+    }
+    happ_cluster_reply_string(replica, "OK");
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.timer_actions.timer_hedges.size());
+    CASE_EXPECT_EQ(1, replica->get_pending_count());
+
+    clu.proc(100, 50000);
+    CASE_EXPECT_EQ(0, master->get_pending_count());
+    clu.proc(100, 100000);
+    CASE_EXPECT_EQ(1, master->get_pending_count());
+    CASE_EXPECT_EQ(1, clu.get_stats().hedges);
+
+    happ_cluster_reply_string(master, "from master");
+    CASE_EXPECT_EQ(2, happ_cluster_hedge_count);
+    CASE_EXPECT_TRUE("from master" == happ_cluster_hedge_value);
+    CASE_EXPECT_EQ(1, clu.get_stats().hedge_wins);
+
+    // the loser is dropped
+    happ_cluster_reply_string(replica, "from replica");
+    CASE_EXPECT_EQ(2, happ_cluster_hedge_count);
+    CASE_EXPECT_TRUE("from master" == happ_cluster_hedge_value);
+
+    // the original one wins
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    clu.proc(101, 0);
+    CASE_EXPECT_EQ(1, master->get_pending_count());
+    happ_cluster_reply_string(replica, "from replica");
+    CASE_EXPECT_EQ(3, happ_cluster_hedge_count);
+    CASE_EXPECT_TRUE("from replica" == happ_cluster_hedge_value);
+    happ_cluster_reply_string(master, "from master");
+    CASE_EXPECT_EQ(3, happ_cluster_hedge_count);
+    CASE_EXPECT_EQ(1, clu.get_stats().hedge_wins);
+
+    // replied before the delay, not hedged
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    happ_cluster_reply_string(replica, "from replica");
+    CASE_EXPECT_EQ(4, happ_cluster_hedge_count);
+    clu.proc(102, 0);
+    CASE_EXPECT_EQ(0, master->get_pending_count());
+    CASE_EXPECT_EQ(2, clu.get_stats().hedges);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.timer_actions.timer_hedges.size());
+
+    CASE_EXPECT_TRUE(clu.release_connection(master, true, 0));
+    CASE_EXPECT_TRUE(clu.release_connection(replica, true, 0));
+    clu.reset();
+}
+
+CASE_TEST(happ_cluster, near_cache)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.set_near_cache(1 << 20);
+    clu.proc(100, 0);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 16383, 7000, 0);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+
+    happ_cluster_hedge_count = 0;
+    happ_cluster_hedge_value.clear();
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.connections.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.tracking_conns.size());
+    if (clu.connections.empty() || clu.tracking_conns.empty()) {
+        return;
+    }
+
+    hiredis::happ::connection *conn = clu.connections.begin()->second.conns[0].get();
+    hiredis::happ::connection *tracking = clu.tracking_conns.begin()->second.conn.get();
+    CASE_EXPECT_EQ(1, tracking->get_pending_count());
+
+    // other connections are tracked after CLIENT ID replied
+    {
+        test_fake_reply reply(REDIS_REPLY_INTEGER);
+        reply.reply.integer = 42;
+        test_reply_first(tracking, &reply.reply);
+    }
+    CASE_EXPECT_EQ(2, conn->get_pending_count());
+
+    // sent before tracking, not cached
+    happ_cluster_reply_string(conn, "bar");
+    CASE_EXPECT_EQ(1, happ_cluster_hedge_count);
+    CASE_EXPECT_TRUE("bar" == happ_cluster_hedge_value);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.get_near_cache().size());
+
+    {
+        test_fake_reply reply(REDIS_REPLY_STATUS);
+        reply.str = "OK";
+        reply.reply.str = &reply.str[0];
+        reply.reply.len = static_cast<int>(reply.str.size());
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_TRUE(clu.get_near_cache().is_tracked(conn));
+
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    happ_cluster_reply_string(conn, "baz");
+    CASE_EXPECT_EQ(2, happ_cluster_hedge_count);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_near_cache().size());
+
+    // replied by cache
+    happ_cluster_hedge_value.clear();
+    CASE_EXPECT_EQ(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    CASE_EXPECT_EQ(3, happ_cluster_hedge_count);
+    CASE_EXPECT_TRUE("baz" == happ_cluster_hedge_value);
+    CASE_EXPECT_EQ(0, conn->get_pending_count());
+    CASE_EXPECT_EQ(1, clu.get_near_cache().get_hit_count());
+
+    // invalidated by message
+    {
+        test_fake_reply msg(REDIS_REPLY_ARRAY);
+        test_fake_reply *keys = new test_fake_reply(REDIS_REPLY_ARRAY);
+        msg.push_string("message").push_string("__redis__:invalidate").push(keys);
+        keys->push_string("foo");
+        hiredis::happ::cluster::on_reply_invalidate(tracking->get_context(), &msg.reply, NULL);
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.get_near_cache().size());
+
+    // all replies are dropped if the tracking connection is lost
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    happ_cluster_reply_string(conn, "baz");
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.get_near_cache().size());
+
+    CASE_EXPECT_TRUE(clu.release_connection(tracking, true, 0));
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.tracking_conns.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.get_near_cache().size());
+    CASE_EXPECT_FALSE(clu.get_near_cache().is_tracked(conn));
+
+    // and a new one is made
+    CASE_EXPECT_NE(NULL, clu.exec("foo", 3, happ_cluster_on_hedge, &happ_cluster_hedge_count, "GET %s", "foo"));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.tracking_conns.size());
+
+    CASE_EXPECT_TRUE(clu.release_connection(clu.tracking_conns.begin()->second.conn.get(), true, 0));
+    CASE_EXPECT_TRUE(clu.release_connection(conn, true, 0));
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.get_near_cache().get_tracked_count());
+    clu.reset();
+}
+
+static int happ_cluster_message_count = 0;
+static void happ_cluster_on_message(const redisReply *, const redisReply *) { ++happ_cluster_message_count; }
+
+CASE_TEST(happ_cluster, subscribe)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.proc(100, 0);
+
+    happ_cluster_message_count = 0;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, clu.subscribe(hiredis::happ::pubsub::channel_type::CHANNEL, "", happ_cluster_on_message));
+
+#if defined(HIREDIS_HAPP_PUBSUB_SHARD)
+    size_t shard_count = 1;
+
+    // shard channels wait for slots
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.subscribe(hiredis::happ::pubsub::channel_type::SHARD, "foo", happ_cluster_on_message));
+    CASE_EXPECT_TRUE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.subscriber_conns.size());
+#else
+    size_t shard_count = 0;
+
+    // hiredis does not know SSUBSCRIBE
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, clu.subscribe(hiredis::happ::pubsub::channel_type::SHARD, "foo", happ_cluster_on_message));
+#endif
+
+    // slot 12182 of foo is served by 7001
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 0).push_slots(8192, 16383, 7001, 0);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+    CASE_EXPECT_FALSE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(shard_count, clu.subscriber_conns.size());
+#if defined(HIREDIS_HAPP_PUBSUB_SHARD)
+    CASE_EXPECT_TRUE(clu.subscriber_conns.end() != clu.subscriber_conns.find("127.0.0.1:7001"));
+#endif
+
+    // channels and patterns share one node
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.subscribe(hiredis::happ::pubsub::channel_type::CHANNEL, "news", happ_cluster_on_message));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.subscribe(hiredis::happ::pubsub::channel_type::PATTERN, "news.*", happ_cluster_on_message));
+    CASE_EXPECT_FALSE(clu.subscribe_node.empty());
+    CASE_EXPECT_EQ(clu.subscribe_node, clu.subscriptions.find(hiredis::happ::pubsub::channel_type::PATTERN, "news.*")->node);
+    CASE_EXPECT_EQ(2 + shard_count, clu.get_pubsub().size());
+
+    // dispatch by channel
+    hiredis::happ::connection *conn = clu.subscriber_conns[clu.subscribe_node].get();
+    {
+        test_fake_reply msg(REDIS_REPLY_ARRAY);
+        msg.push_string("message").push_string("news").push_string("hello");
+        hiredis::happ::cluster::on_reply_subscribe(conn->get_context(), &msg.reply, NULL);
+
+        test_fake_reply other(REDIS_REPLY_ARRAY);
+        other.push_string("message").push_string("other").push_string("hello");
+        hiredis::happ::cluster::on_reply_subscribe(conn->get_context(), &other.reply, NULL);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_message_count);
+    CASE_EXPECT_EQ(1, clu.get_pubsub().get_dropped_count());
+
+    // subscribed again after the connection lost
+    std::vector<hiredis::happ::connection *> conns;
+    for (hiredis::happ::cluster::subscriber_map_t::iterator it = clu.subscriber_conns.begin(); it != clu.subscriber_conns.end(); ++it) {
+        conns.push_back(it->second.get());
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_TRUE(clu.release_connection(conns[i], true, 0));
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.subscriber_conns.size());
+    CASE_EXPECT_TRUE(clu.resubscribe_status.pending);
+    CASE_EXPECT_TRUE(clu.subscriptions.find(hiredis::happ::pubsub::channel_type::CHANNEL, "news")->node.empty());
+
+    clu.proc(101, 0);
+    CASE_EXPECT_FALSE(clu.resubscribe_status.pending);
+#if defined(HIREDIS_HAPP_PUBSUB_SHARD)
+    CASE_EXPECT_EQ("127.0.0.1:7001", clu.subscriptions.find(hiredis::happ::pubsub::channel_type::SHARD, "foo")->node);
+#endif
+    CASE_EXPECT_FALSE(clu.subscriptions.find(hiredis::happ::pubsub::channel_type::CHANNEL, "news")->node.empty());
+
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.unsubscribe(hiredis::happ::pubsub::channel_type::CHANNEL, "news"));
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_NOT_FOUND, clu.unsubscribe(hiredis::happ::pubsub::channel_type::CHANNEL, "news"));
+    CASE_EXPECT_EQ(1 + shard_count, clu.get_pubsub().size());
+
+    conns.clear();
+    for (hiredis::happ::cluster::subscriber_map_t::iterator it = clu.subscriber_conns.begin(); it != clu.subscriber_conns.end(); ++it) {
+        conns.push_back(it->second.get());
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_TRUE(clu.release_connection(conns[i], true, 0));
+    }
+    clu.reset();
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.get_pubsub().size());
+}
+
+static void happ_cluster_release_subscribers(hiredis::happ::cluster &clu) {
+    std::vector<hiredis::happ::connection *> conns;
+    for (hiredis::happ::cluster::subscriber_map_t::iterator it = clu.subscriber_conns.begin(); it != clu.subscriber_conns.end(); ++it) {
+        conns.push_back(it->second.get());
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        CASE_EXPECT_TRUE(clu.release_connection(conns[i], true, 0));
+    }
+}
+
+CASE_TEST(happ_cluster, resubscribe_backoff)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+    clu.proc(100, 0);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 8191, 7000, 0).push_slots(8192, 16383, 7001, 0);
+    {
+        hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+        hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+        clu.destroy_cmd(cmd);
+    }
+
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.subscribe(hiredis::happ::pubsub::channel_type::CHANNEL, "news", happ_cluster_on_message));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.subscriber_conns.size());
+
+    // the first round is sent at once
+    happ_cluster_release_subscribers(clu);
+    CASE_EXPECT_TRUE(clu.resubscribe_status.pending);
+    clu.proc(101, 0);
+    CASE_EXPECT_FALSE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.subscriber_conns.size());
+    CASE_EXPECT_EQ(static_cast<size_t>(1), clu.resubscribe_status.times);
+
+    // and the others wait for backoff
+    happ_cluster_release_subscribers(clu);
+    clu.proc(101, 0);
+    CASE_EXPECT_EQ(static_cast<size_t>(2), clu.resubscribe_status.times);
+    CASE_EXPECT_GE(clu.resubscribe_status.retry_delay, clu.get_retry_policy().get_backoff_base());
+
+    happ_cluster_release_subscribers(clu);
+    clu.proc(101, 0);
+    CASE_EXPECT_TRUE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.subscriber_conns.size());
+
+    clu.proc(102, 0);
+    CASE_EXPECT_FALSE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(3), clu.resubscribe_status.times);
+
+    // reset by a reply
+    {
+        test_fake_reply reply(REDIS_REPLY_ARRAY);
+        reply.push_string("subscribe").push_string("news").push_integer(1);
+        hiredis::happ::cluster::on_reply_subscribe(clu.subscriber_conns.begin()->second->get_context(), &reply.reply, NULL);
+    }
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.resubscribe_status.times);
+    CASE_EXPECT_EQ(0, clu.resubscribe_status.retry_delay);
+
+    // given up after too many rounds, until the next subscribe
+    clu.resubscribe_status.times = HIREDIS_HAPP_RESUBSCRIBE_TIMES;
+    happ_cluster_release_subscribers(clu);
+    clu.proc(200, 0);
+    CASE_EXPECT_TRUE(clu.resubscribe_status.pending);
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.subscriber_conns.size());
+
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, clu.subscribe(hiredis::happ::pubsub::channel_type::PATTERN, "news.*", happ_cluster_on_message));
+    CASE_EXPECT_EQ(static_cast<size_t>(0), clu.resubscribe_status.times);
+    clu.proc(200, 0);
+    CASE_EXPECT_FALSE(clu.resubscribe_status.pending);
+    CASE_EXPECT_FALSE(clu.subscriptions.find(hiredis::happ::pubsub::channel_type::CHANNEL, "news")->node.empty());
+
+    happ_cluster_release_subscribers(clu);
+    clu.reset();
+}
+
+static int happ_cluster_script_count = 0;
+static int happ_cluster_script_err = 0;
+static void happ_cluster_on_script(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *) {
+    ++happ_cluster_script_count;
+    happ_cluster_script_err = cmd->result();
+
+    redisReply *reply = reinterpret_cast<redisReply *>(r);
+    CASE_EXPECT_TRUE(NULL != reply && REDIS_REPLY_INTEGER == reply->type);
+}
+
+CASE_TEST(happ_cluster, script)
+{
+    hiredis::happ::cluster clu;
+    clu.init("127.0.0.1", 6370);
+
+    test_fake_reply slots(REDIS_REPLY_ARRAY);
+    slots.push_slots(0, 16383, 7000, 0);
+    hiredis::happ::cmd_exec *cmd = clu.create_cmd(NULL, NULL);
+    hiredis::happ::cluster::on_reply_update_slot(cmd, NULL, &slots.reply, reinterpret_cast<void *>(clu.slot_reload.sequence));
+    clu.destroy_cmd(cmd);
+
+    // scripts are loaded in new connections
+    std::string sha1 = clu.register_script("return redis.call('INCR', KEYS[1])");
+    CASE_EXPECT_EQ(1, clu.get_scripts().size());
+
+    hiredis::happ::connection::key_t key;
+    hiredis::happ::connection::set_key(key, "127.0.0.1", 7000);
+    hiredis::happ::connection *conn = clu.make_connection(key);
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL == conn) {
+        clu.reset();
+        return;
+    }
+    CASE_EXPECT_EQ(1, conn->get_pending_count());
+
+    happ_cluster_script_count = 0;
+    const char *argv[] = {"1", "foo"};
+    size_t argvlen[] = {1, 3};
+    CASE_EXPECT_NE(NULL, clu.eval_script("foo", 3, sha1, happ_cluster_on_script, NULL, 2, argv, argvlen));
+    CASE_EXPECT_EQ(2, conn->get_pending_count());
+
+    test_fake_reply loaded(REDIS_REPLY_STRING);
+    loaded.str = sha1;
+    loaded.reply.str = &loaded.str[0];
+    loaded.reply.len = static_cast<int>(loaded.str.size());
+    test_reply_first(conn, &loaded.reply);
+
+    // script cache is flushed, load it and run again in the same connection
+    {
+        test_fake_reply noscript(REDIS_REPLY_ERROR);
+        noscript.str = "NOSCRIPT No matching script. Please use EVAL.";
+        noscript.reply.str = &noscript.str[0];
+        noscript.reply.len = static_cast<int>(noscript.str.size());
+        test_reply_first(conn, &noscript.reply);
+    }
+    CASE_EXPECT_EQ(0, happ_cluster_script_count);
+    CASE_EXPECT_EQ(1, clu.get_scripts().get_reload_count());
+    CASE_EXPECT_EQ(2, conn->get_pending_count());
+
+    test_reply_first(conn, &loaded.reply);
+    {
+        test_fake_reply result(REDIS_REPLY_INTEGER);
+        result.reply.integer = 1;
+        test_reply_first(conn, &result.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_cluster_script_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_cluster_script_err);
+    CASE_EXPECT_EQ(0, conn->get_pending_count());
+
+    CASE_EXPECT_TRUE(clu.release_connection(conn, true, 0));
+    clu.reset();
+}
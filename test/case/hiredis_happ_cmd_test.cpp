@@ -61,3 +61,223 @@ CASE_TEST(happ_cmd, basic)
 
     hiredis::happ::cmd_exec::destroy(cmd);
 }
+
+CASE_TEST(happ_cmd, readonly)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+
+    CASE_EXPECT_TRUE(hiredis::happ::cmd_exec::is_readonly_cmd("GET", 3));
+    CASE_EXPECT_TRUE(hiredis::happ::cmd_exec::is_readonly_cmd("get", 3));
+    CASE_EXPECT_TRUE(hiredis::happ::cmd_exec::is_readonly_cmd("ZRevRangeByScore", 16));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_exec::is_readonly_cmd("GE", 2));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_exec::is_readonly_cmd("GETSET", 6));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_exec::is_readonly_cmd("SET", 3));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_exec::is_readonly_cmd("ZADD", 4));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_exec::is_readonly_cmd(NULL, 0));
+
+    hiredis::happ::cmd_exec* cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    cmd->format("HGET %s %s", "key", "field");
+    CASE_EXPECT_TRUE(cmd->is_readonly());
+
+    const char* argv[] = { "HSET", "key", "field", "value" };
+    cmd->vformat(4, argv, NULL);
+    CASE_EXPECT_FALSE(cmd->is_readonly());
+
+    hiredis::happ::cmd_exec::destroy(cmd);
+}
+
+CASE_TEST(happ_cmd, pool)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+
+    hiredis::happ::cmd_pool pool;
+    pool.set_buffer_size(sizeof(int));
+    pool.set_watermark(1, 2);
+
+    hiredis::happ::cmd_exec* cmds[3];
+    for (int i = 0; i < 3; ++i) {
+        cmds[i] = hiredis::happ::cmd_exec::create(h, NULL, NULL, sizeof(int), &pool);
+        CASE_EXPECT_NE(NULL, cmds[i]);
+        cmds[i]->format("GET %d", i);
+    }
+    CASE_EXPECT_EQ(0, pool.get_hit_count());
+    CASE_EXPECT_EQ(3, pool.get_miss_count());
+
+    // no more than high watermark
+    for (int i = 0; i < 3; ++i) {
+        hiredis::happ::cmd_exec::destroy(cmds[i]);
+    }
+    CASE_EXPECT_EQ(2, pool.get_cached_count());
+    CASE_EXPECT_EQ(2 * hiredis::happ::cmd_pool::get_block_size(sizeof(int)), pool.get_retained_bytes());
+
+    // reuse cached cmds, and the cmd must be clean
+    hiredis::happ::cmd_exec* cmd = hiredis::happ::cmd_exec::create(h, NULL, &pool, sizeof(int), &pool);
+    CASE_EXPECT_EQ(1, pool.get_hit_count());
+    CASE_EXPECT_EQ(1, pool.get_cached_count());
+    CASE_EXPECT_EQ(0, cmd->cmd.raw_len);
+    CASE_EXPECT_EQ(NULL, cmd->cmd.content.raw);
+    CASE_EXPECT_EQ(&pool, cmd->private_data());
+    CASE_EXPECT_EQ(-1, cmd->engine.slot);
+
+    // cmds with different buffer size are not cached
+    hiredis::happ::cmd_exec* big_cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 64, &pool);
+    CASE_EXPECT_EQ(4, pool.get_miss_count());
+    hiredis::happ::cmd_exec::destroy(big_cmd);
+    CASE_EXPECT_EQ(1, pool.get_cached_count());
+
+    hiredis::happ::cmd_exec::destroy(cmd);
+    CASE_EXPECT_EQ(2, pool.get_cached_count());
+
+    // the first trim only records the usage, the second one release cmds not used down to low watermark
+    CASE_EXPECT_EQ(0, pool.trim(1));
+    CASE_EXPECT_EQ(0, pool.trim(1));
+    CASE_EXPECT_EQ(1, pool.trim(2));
+    CASE_EXPECT_EQ(1, pool.get_cached_count());
+
+    // cached cmds are released when buffer size changed
+    pool.set_buffer_size(64);
+    CASE_EXPECT_EQ(0, pool.get_cached_count());
+    CASE_EXPECT_EQ(0, pool.get_retained_bytes());
+}
+
+CASE_TEST(happ_cmd, pool_format)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+
+    hiredis::happ::cmd_pool pool;
+    const char* argv[] = {"SET", "key", "a\r\nb"};
+    size_t argvlen[] = {3, 3, 4};
+
+    // the same as hiredis
+    sds expect = NULL;
+    int expect_len = redisFormatSdsCommandArgv(&expect, 3, argv, argvlen);
+
+    hiredis::happ::cmd_exec* cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0, &pool);
+    int len = cmd->vformat(3, argv, argvlen);
+    CASE_EXPECT_EQ(expect_len, len);
+    CASE_EXPECT_EQ(static_cast<size_t>(len), cmd->cmd.raw_len);
+    CASE_EXPECT_EQ(cmd->wire_buffer, cmd->cmd.content.raw);
+    CASE_EXPECT_EQ(0, memcmp(expect, cmd->cmd.content.raw, static_cast<size_t>(len)));
+
+    const char* cstr = NULL;
+    size_t clen = 0;
+    cmd->pick_cmd(&cstr, &clen);
+    CASE_EXPECT_EQ(3, clen);
+    CASE_EXPECT_EQ(0, strncmp("SET", cstr, 3));
+
+    // argvlen can be NULL
+    const char* argv2[] = {"GET", "key"};
+    const char* old_buffer = cmd->wire_buffer;
+    len = cmd->vformat(2, argv2, NULL);
+    CASE_EXPECT_EQ(22, len);
+    CASE_EXPECT_EQ(0, strcmp("*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n", cmd->cmd.content.raw));
+    CASE_EXPECT_EQ(old_buffer, cmd->wire_buffer);
+
+    // the formatting buffer is kept when cached and reused
+    hiredis::happ::cmd_exec::destroy(cmd);
+    CASE_EXPECT_EQ(hiredis::happ::cmd_pool::get_block_size(0) + 128, pool.get_retained_bytes());
+    cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0, &pool);
+    CASE_EXPECT_EQ(old_buffer, cmd->wire_buffer);
+    CASE_EXPECT_EQ(0, cmd->cmd.raw_len);
+    CASE_EXPECT_EQ(0, pool.get_retained_bytes());
+
+    // sds is copied
+    len = cmd->vformat(&expect);
+    CASE_EXPECT_EQ(expect_len, len);
+    CASE_EXPECT_EQ(cmd->wire_buffer, cmd->cmd.content.raw);
+
+    // printf-like format still use hiredis
+    len = cmd->format("GET %s", "key");
+    CASE_EXPECT_EQ(22, len);
+    CASE_EXPECT_NE(cmd->wire_buffer, cmd->cmd.content.raw);
+
+    hiredis::happ::cmd_exec::destroy(cmd);
+    redisFreeSdsCommand(expect);
+}
+
+CASE_TEST(happ_cmd, timer_wheel)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+
+    hiredis::happ::cmd_timer_wheel wheel;
+    std::vector<hiredis::happ::cmd_exec*> expired;
+    CASE_EXPECT_EQ(0, wheel.expire(100, 0, expired));
+
+    hiredis::happ::cmd_exec* cmds[4];
+    for (int i = 0; i < 4; ++i) {
+        cmds[i] = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    }
+
+    wheel.add(cmds[0], 100, 500000);
+    wheel.add(cmds[1], 101, 0);
+    // longer than a round
+    wheel.add(cmds[2], 100 + HIREDIS_HAPP_CMD_TIMER_SLOT_NUMBER * HIREDIS_HAPP_CMD_TIMER_TICK_MS / 1000 + 1, 500000);
+    wheel.add(cmds[3], 100, 600000);
+    CASE_EXPECT_EQ(4, wheel.size());
+
+    // O(1) cancel
+    CASE_EXPECT_TRUE(hiredis::happ::cmd_timer_wheel::remove(cmds[3]));
+    CASE_EXPECT_FALSE(hiredis::happ::cmd_timer_wheel::remove(cmds[3]));
+    CASE_EXPECT_EQ(3, wheel.size());
+
+    CASE_EXPECT_EQ(0, wheel.expire(100, 499000, expired));
+    CASE_EXPECT_EQ(1, wheel.expire(100, 500000, expired));
+    CASE_EXPECT_EQ(cmds[0], expired.back());
+    CASE_EXPECT_EQ(1, wheel.expire(101, 0, expired));
+    CASE_EXPECT_EQ(cmds[1], expired.back());
+
+    // in the same slot but not in this round
+    CASE_EXPECT_EQ(0, wheel.expire(100 + HIREDIS_HAPP_CMD_TIMER_SLOT_NUMBER * HIREDIS_HAPP_CMD_TIMER_TICK_MS / 1000, 500000, expired));
+    CASE_EXPECT_EQ(1, wheel.size());
+
+    // destroyed cmd is removed from wheel
+    hiredis::happ::cmd_exec::destroy(cmds[2]);
+    CASE_EXPECT_EQ(0, wheel.size());
+
+    hiredis::happ::cmd_exec::destroy(cmds[0]);
+    hiredis::happ::cmd_exec::destroy(cmds[1]);
+    hiredis::happ::cmd_exec::destroy(cmds[3]);
+}
+
+static void happ_cmd_on_timeout(hiredis::happ::cmd_exec*, struct redisAsyncContext*, void*, void*) {}
+
+CASE_TEST(happ_cmd, timer_wheel_timeout)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+
+    hiredis::happ::cmd_timer_wheel wheel;
+    std::vector<hiredis::happ::cmd_exec*> expired;
+    hiredis::happ::cmd_exec* cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+
+    // no callback, no deadline
+    CASE_EXPECT_FALSE(wheel.set_timeout(cmd, 100, 0, 1, 0));
+    cmd->callback = happ_cmd_on_timeout;
+
+    // 0 means no timeout
+    CASE_EXPECT_FALSE(wheel.add_timeout(cmd, 100, 0, 0, 0));
+    CASE_EXPECT_TRUE(wheel.add_timeout(cmd, 100, 800000, 0, 300000));
+    CASE_EXPECT_EQ(1, wheel.size());
+
+    // the first deadline is kept by add_timeout, and replaced by set_timeout
+    CASE_EXPECT_FALSE(wheel.add_timeout(cmd, 100, 900000, 1, 0));
+    CASE_EXPECT_EQ(0, wheel.expire(101, 0, expired));
+    CASE_EXPECT_EQ(1, wheel.expire(101, 100000, expired));
+    CASE_EXPECT_TRUE(wheel.set_timeout(cmd, 101, 100000, 1, 0));
+    CASE_EXPECT_EQ(0, wheel.expire(102, 0, expired));
+    CASE_EXPECT_EQ(1, wheel.expire(102, 100000, expired));
+    CASE_EXPECT_EQ(0, wheel.size());
+
+    // the first check is later than deadline
+    hiredis::happ::cmd_timer_wheel late_wheel;
+    CASE_EXPECT_TRUE(late_wheel.add_timeout(cmd, 100, 0, 1, 0));
+    CASE_EXPECT_EQ(1, late_wheel.expire(103, 0, expired));
+    CASE_EXPECT_EQ(cmd, expired.back());
+    CASE_EXPECT_EQ(0, late_wheel.size());
+
+    hiredis::happ::cmd_exec::destroy(cmd);
+}
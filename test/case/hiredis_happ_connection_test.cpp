@@ -84,3 +84,65 @@ CASE_TEST(happ_connection, basic)
 
     hiredis::happ::cmd_exec::destroy(cmd);
 }
+
+static int happ_connection_reply_timeout = 0;
+static void happ_connection_on_reply(hiredis::happ::cmd_exec* cmd, struct redisAsyncContext*, void*, void*) {
+    if (hiredis::happ::error_code::REDIS_HAPP_TIMEOUT == cmd->result()) {
+        ++happ_connection_reply_timeout;
+    }
+}
+
+CASE_TEST(happ_connection, reply_queue)
+{
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+    redisAsyncContext vir_context;
+    memset(&vir_context, 0, sizeof(vir_context));
+
+    hiredis::happ::connection conn;
+    hiredis::happ::connection other;
+    conn.init(h, "127.0.0.1", 1234);
+    conn.set_connecting(&vir_context);
+
+    hiredis::happ::cmd_exec* cmds[4];
+    for (int i = 0; i < 4; ++i) {
+        cmds[i] = hiredis::happ::cmd_exec::create(h, happ_connection_on_reply, NULL, 0);
+        conn.push_reply(cmds[i]);
+    }
+    CASE_EXPECT_EQ(4, conn.get_pending_count());
+
+    // not in this connection
+    hiredis::happ::cmd_exec* foreign = hiredis::happ::cmd_exec::create(h, happ_connection_on_reply, NULL, 0);
+    CASE_EXPECT_EQ(NULL, conn.pop_reply(foreign));
+    CASE_EXPECT_EQ(NULL, other.pop_reply(cmds[0]));
+    CASE_EXPECT_EQ(4, conn.get_pending_count());
+
+    // FIFO
+    CASE_EXPECT_EQ(cmds[0], conn.pop_reply(NULL));
+    CASE_EXPECT_EQ(NULL, cmds[0]->reply_owner);
+    CASE_EXPECT_EQ(NULL, conn.pop_reply(cmds[0]));
+
+    // cmds before the replied one are timeout
+    happ_connection_reply_timeout = 0;
+    CASE_EXPECT_EQ(cmds[2], conn.pop_reply(cmds[2]));
+    CASE_EXPECT_EQ(1, happ_connection_reply_timeout);
+    CASE_EXPECT_EQ(1, conn.get_pending_count());
+
+    // push after pop
+    conn.push_reply(cmds[0]);
+    CASE_EXPECT_EQ(cmds[3], conn.pop_reply(NULL));
+    CASE_EXPECT_EQ(cmds[0], conn.pop_reply(NULL));
+    CASE_EXPECT_EQ(NULL, conn.pop_reply(NULL));
+    CASE_EXPECT_EQ(0, conn.get_pending_count());
+
+    hiredis::happ::cmd_exec::destroy(cmds[0]);
+    hiredis::happ::cmd_exec::destroy(cmds[2]);
+    hiredis::happ::cmd_exec::destroy(cmds[3]);
+    hiredis::happ::cmd_exec::destroy(foreign);
+
+    // cmds left are released with connection
+    cmds[0] = hiredis::happ::cmd_exec::create(h, happ_connection_on_reply, NULL, 0);
+    conn.push_reply(cmds[0]);
+    conn.release(false);
+    CASE_EXPECT_EQ(0, conn.get_pending_count());
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "detail/crc16.h"
+#include "frame/test_macros.h"
+
+// the original byte-by-byte implementation, used to check the result and compare the performance
+static uint16_t happ_crc16_bytewise(const char *buf, size_t len) {
+    static uint16_t tab[256];
+    static bool inited = false;
+    if (!inited) {
+        for (int i = 0; i < 256; ++i) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+            tab[i] = crc;
+        }
+        inited = true;
+    }
+
+    uint16_t crc = 0;
+    for (size_t counter = 0; counter < len; counter++) {
+        crc = static_cast<uint16_t>((crc << 8) ^ tab[((crc >> 8) ^ *buf++) & 0x00FF]);
+    }
+    return crc;
+}
+
+CASE_TEST(happ_crc16, basic)
+{
+    CASE_EXPECT_EQ(0, crc16("", 0));
+    CASE_EXPECT_EQ(0x31C3, crc16("123456789", 9));
+
+    std::vector<char> data;
+    data.resize(1024 + 8);
+    unsigned int seed = 17;
+    for (size_t i = 0; i < data.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = static_cast<char>(seed >> 16);
+    }
+
+    // all the lengths and unaligned start positions
+    for (size_t off = 0; off < 8; ++off) {
+        for (size_t len = 0; len <= 1024; ++len) {
+            if (happ_crc16_bytewise(&data[off], len) != crc16(&data[off], len)) {
+                CASE_EXPECT_EQ(happ_crc16_bytewise(&data[off], len), crc16(&data[off], len));
+                return;
+            }
+        }
+    }
+}
+
+// opt-in, configure with -DENABLE_BENCHMARK_TEST=ON
+#if defined(HIREDIS_HAPP_TEST_BENCHMARK) && HIREDIS_HAPP_TEST_BENCHMARK
+// xor of crc16 of all the keys in benchmark
+#define HAPP_CRC16_BENCHMARK_SUM 0x613A
+
+static void happ_crc16_fill_benchmark_data(std::vector<char> &data) {
+    data.resize(256);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+}
+
+CASE_TEST(happ_crc16, benchmark)
+{
+    std::vector<char> data;
+    const size_t loop_times = 200000;
+
+    // the same keys for both, so the results must be the same
+    happ_crc16_fill_benchmark_data(data);
+    uint16_t bytewise_sum = 0;
+    clock_t begin = clock();
+    for (size_t i = 0; i < loop_times; ++i) {
+        data[i & 0xFF] = static_cast<char>(i);
+        bytewise_sum ^= happ_crc16_bytewise(&data[0], data.size());
+    }
+    clock_t bytewise_cost = clock() - begin;
+
+    happ_crc16_fill_benchmark_data(data);
+    uint16_t sliced_sum = 0;
+    begin = clock();
+    for (size_t i = 0; i < loop_times; ++i) {
+        data[i & 0xFF] = static_cast<char>(i);
+        sliced_sum ^= crc16(&data[0], data.size());
+    }
+    clock_t sliced_cost = clock() - begin;
+
+    std::cout << "crc16 of " << loop_times << " keys with " << data.size() << " bytes, byte-by-byte: "
+              << (static_cast<double>(bytewise_cost) * 1000 / CLOCKS_PER_SEC) << "ms, slicing-by-8: "
+              << (static_cast<double>(sliced_cost) * 1000 / CLOCKS_PER_SEC) << "ms" << std::endl;
+    CASE_EXPECT_EQ(bytewise_sum, sliced_sum);
+    CASE_EXPECT_EQ(HAPP_CRC16_BENCHMARK_SUM, sliced_sum);
+}
+#endif
@@ -0,0 +1,219 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hiredis_happ.h"
+#include "detail/happ_near_cache.h"
+#include "frame/test_macros.h"
+
+static int happ_near_cache_reply_count = 0;
+static void happ_near_cache_on_reply(hiredis::happ::cmd_exec* cmd, struct redisAsyncContext*, void* r, void* pridata) {
+    CASE_EXPECT_EQ(&happ_near_cache_reply_count, pridata);
+    CASE_EXPECT_EQ(cmd->pri_data, pridata);
+    CASE_EXPECT_NE(NULL, r);
+    ++happ_near_cache_reply_count;
+}
+
+static hiredis::happ::cmd_exec* happ_near_cache_create_cmd(const char* cmd, const char* key) {
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+    hiredis::happ::cmd_exec* ret = hiredis::happ::cmd_exec::create(h, happ_near_cache_on_reply, &happ_near_cache_reply_count, 0);
+    ret->format("%s %s", cmd, key);
+    return ret;
+}
+
+static void happ_near_cache_set_str(redisReply& r, const char* str) {
+    memset(&r, 0, sizeof(r));
+    r.type = REDIS_REPLY_STRING;
+    r.str = const_cast<char*>(str);
+    r.len = strlen(str);
+}
+
+CASE_TEST(happ_near_cache, basic)
+{
+    hiredis::happ::near_cache cache;
+    CASE_EXPECT_FALSE(cache.is_enabled());
+
+    redisReply val;
+    happ_near_cache_set_str(val, "world");
+    hiredis::happ::cmd_exec* cmd = happ_near_cache_create_cmd("GET", "hello");
+
+    // disabled
+    CASE_EXPECT_FALSE(cache.put(cmd, &val, cache.get_generation()));
+    CASE_EXPECT_FALSE(cache.wrap(cmd));
+    CASE_EXPECT_EQ(NULL, cache.acquire(cmd));
+
+    cache.set_max_memory(4096);
+    CASE_EXPECT_TRUE(cache.put(cmd, &val, cache.get_generation()));
+    CASE_EXPECT_EQ(1, cache.size());
+    CASE_EXPECT_GT(cache.get_memory(), 0);
+
+    hiredis::happ::near_cache::entry_t* e = cache.acquire(cmd);
+    CASE_EXPECT_NE(NULL, e);
+    CASE_EXPECT_EQ(1, cache.get_hit_count());
+    if (NULL != e) {
+        redisReply* r = hiredis::happ::near_cache::get_reply(e);
+        CASE_EXPECT_NE(&val, r);
+        CASE_EXPECT_EQ(std::string("world"), std::string(r->str, r->len));
+    }
+
+    // pinned entry is still valid after invalidated
+    CASE_EXPECT_EQ(1, cache.invalidate("hello", 5));
+    CASE_EXPECT_EQ(0, cache.size());
+    CASE_EXPECT_EQ(0, cache.get_memory());
+    if (NULL != e) {
+        redisReply* r = hiredis::happ::near_cache::get_reply(e);
+        CASE_EXPECT_EQ(std::string("world"), std::string(r->str, r->len));
+    }
+    cache.release(e);
+
+    CASE_EXPECT_EQ(NULL, cache.acquire(cmd));
+    CASE_EXPECT_EQ(1, cache.get_miss_count());
+    CASE_EXPECT_EQ(1, cache.get_invalidation_count());
+
+    // reply of stale generation
+    uint64_t gen = cache.get_generation();
+    cache.invalidate("other", 5);
+    CASE_EXPECT_FALSE(cache.put(cmd, &val, gen));
+
+    // error reply and not cacheable cmd
+    redisReply err;
+    happ_near_cache_set_str(err, "ERR");
+    err.type = REDIS_REPLY_ERROR;
+    CASE_EXPECT_FALSE(cache.put(cmd, &err, cache.get_generation()));
+
+    hiredis::happ::cmd_exec* set_cmd = happ_near_cache_create_cmd("INCR", "hello");
+    CASE_EXPECT_FALSE(cache.put(set_cmd, &val, cache.get_generation()));
+    CASE_EXPECT_FALSE(cache.wrap(set_cmd));
+    CASE_EXPECT_EQ(NULL, cache.acquire(set_cmd));
+    CASE_EXPECT_EQ(1, cache.get_miss_count());
+
+    hiredis::happ::cmd_exec::destroy(set_cmd);
+    hiredis::happ::cmd_exec::destroy(cmd);
+}
+
+CASE_TEST(happ_near_cache, lru)
+{
+    hiredis::happ::near_cache cache;
+    cache.set_max_memory(1 << 20);
+
+    redisReply val;
+    happ_near_cache_set_str(val, "value");
+
+    std::vector<hiredis::happ::cmd_exec*> cmds;
+    char key[32];
+    for (int i = 0; i < 8; ++i) {
+        sprintf(key, "key-%d", i);
+        cmds.push_back(happ_near_cache_create_cmd("GET", key));
+        CASE_EXPECT_TRUE(cache.put(cmds.back(), &val, cache.get_generation()));
+    }
+
+    size_t entry_memory = cache.get_memory() / 8;
+    CASE_EXPECT_EQ(entry_memory * 8, cache.get_memory());
+
+    // key-0 is used recently, so key-1 and key-2 are evicted
+    cache.release(cache.acquire(cmds[0]));
+    cache.set_max_memory(entry_memory * 6);
+    CASE_EXPECT_EQ(6, cache.size());
+    CASE_EXPECT_EQ(2, cache.get_eviction_count());
+    CASE_EXPECT_EQ(NULL, cache.acquire(cmds[1]));
+    CASE_EXPECT_EQ(NULL, cache.acquire(cmds[2]));
+
+    hiredis::happ::near_cache::entry_t* e = cache.acquire(cmds[0]);
+    CASE_EXPECT_NE(NULL, e);
+    cache.release(e);
+
+    cache.clear();
+    CASE_EXPECT_EQ(0, cache.size());
+    CASE_EXPECT_EQ(0, cache.get_memory());
+
+    for (size_t i = 0; i < cmds.size(); ++i) {
+        hiredis::happ::cmd_exec::destroy(cmds[i]);
+    }
+}
+
+CASE_TEST(happ_near_cache, wrap_and_invalidate)
+{
+    hiredis::happ::near_cache cache;
+    cache.set_max_memory(4096);
+
+    int conn_placeholder = 0;
+    const hiredis::happ::connection* conn = reinterpret_cast<const hiredis::happ::connection*>(&conn_placeholder);
+    redisAsyncContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.data = &conn_placeholder;
+
+    redisReply val;
+    happ_near_cache_set_str(val, "world");
+
+    // not tracked, reply is not cached
+    happ_near_cache_reply_count = 0;
+    hiredis::happ::cmd_exec* cmd = happ_near_cache_create_cmd("GET", "hello");
+    CASE_EXPECT_TRUE(cache.wrap(cmd));
+    CASE_EXPECT_EQ(hiredis::happ::near_cache::on_reply, cmd->callback);
+    cmd->call_reply(hiredis::happ::error_code::REDIS_HAPP_OK, &ctx, &val);
+    CASE_EXPECT_EQ(1, happ_near_cache_reply_count);
+    CASE_EXPECT_EQ(0, cache.size());
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    // tracked
+    cache.set_tracked(conn, true);
+    CASE_EXPECT_EQ(1, cache.get_tracked_count());
+    cmd = happ_near_cache_create_cmd("GET", "hello");
+    CASE_EXPECT_TRUE(cache.wrap(cmd));
+    cmd->call_reply(hiredis::happ::error_code::REDIS_HAPP_OK, &ctx, &val);
+    CASE_EXPECT_EQ(2, happ_near_cache_reply_count);
+    CASE_EXPECT_EQ(1, cache.size());
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    // key invalidated while in flight
+    cmd = happ_near_cache_create_cmd("STRLEN", "hello");
+    CASE_EXPECT_TRUE(cache.wrap(cmd));
+
+    redisReply msg_type, msg_channel, msg_keys, msg_key;
+    redisReply* msg_keys_arr[] = {&msg_key};
+    redisReply* msg_arr[] = {&msg_type, &msg_channel, &msg_keys};
+    happ_near_cache_set_str(msg_type, "message");
+    happ_near_cache_set_str(msg_channel, "__redis__:invalidate");
+    happ_near_cache_set_str(msg_key, "hello");
+    memset(&msg_keys, 0, sizeof(msg_keys));
+    msg_keys.type = REDIS_REPLY_ARRAY;
+    msg_keys.elements = 1;
+    msg_keys.element = msg_keys_arr;
+
+    redisReply msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = REDIS_REPLY_ARRAY;
+    msg.elements = 3;
+    msg.element = msg_arr;
+
+    CASE_EXPECT_TRUE(cache.on_invalidate(&msg));
+    CASE_EXPECT_EQ(0, cache.size());
+
+    cmd->call_reply(hiredis::happ::error_code::REDIS_HAPP_OK, &ctx, &val);
+    CASE_EXPECT_EQ(3, happ_near_cache_reply_count);
+    CASE_EXPECT_EQ(0, cache.size());
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    // nil means all keys are flushed
+    cmd = happ_near_cache_create_cmd("GET", "hello");
+    CASE_EXPECT_TRUE(cache.wrap(cmd));
+    cmd->call_reply(hiredis::happ::error_code::REDIS_HAPP_OK, &ctx, &val);
+    CASE_EXPECT_EQ(1, cache.size());
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    msg_keys.type = REDIS_REPLY_NIL;
+    msg_keys.elements = 0;
+    msg_keys.element = NULL;
+    CASE_EXPECT_TRUE(cache.on_invalidate(&msg));
+    CASE_EXPECT_EQ(0, cache.size());
+
+    // other messages
+    happ_near_cache_set_str(msg_type, "subscribe");
+    CASE_EXPECT_FALSE(cache.on_invalidate(&msg));
+
+    cache.set_tracked(conn, false);
+    CASE_EXPECT_EQ(0, cache.get_tracked_count());
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hiredis_happ.h"
+#include "detail/happ_pubsub.h"
+#include "frame/test_macros.h"
+
+static int happ_pubsub_message_count = 0;
+static std::string happ_pubsub_channel;
+static std::string happ_pubsub_message;
+static void happ_pubsub_on_message(const redisReply *channel, const redisReply *message) {
+    ++happ_pubsub_message_count;
+    happ_pubsub_channel.assign(channel->str, static_cast<size_t>(channel->len));
+    happ_pubsub_message.assign(message->str, static_cast<size_t>(message->len));
+}
+
+struct happ_pubsub_fake_message {
+    std::vector<redisReply> elements;
+    std::vector<redisReply *> element_ptrs;
+    redisReply reply;
+
+    happ_pubsub_fake_message(const char *t, const char *a, const char *b, const char *c = NULL) {
+        const char *strs[] = {t, a, b, c};
+        size_t count = NULL == c ? 3 : 4;
+        elements.resize(count);
+        element_ptrs.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            memset(&elements[i], 0, sizeof(redisReply));
+            elements[i].type = REDIS_REPLY_STRING;
+            elements[i].str = const_cast<char *>(strs[i]);
+            elements[i].len = strlen(strs[i]);
+            element_ptrs[i] = &elements[i];
+        }
+
+        memset(&reply, 0, sizeof(reply));
+        reply.type = REDIS_REPLY_ARRAY;
+        reply.elements = count;
+        reply.element = &element_ptrs[0];
+    }
+};
+
+CASE_TEST(happ_pubsub, dispatch)
+{
+    hiredis::happ::pubsub subs;
+    happ_pubsub_message_count = 0;
+
+    hiredis::happ::pubsub::subscription_t *sub = subs.add(hiredis::happ::pubsub::channel_type::CHANNEL, "news", happ_pubsub_on_message);
+    CASE_EXPECT_NE(NULL, sub);
+    CASE_EXPECT_TRUE(sub->node.empty());
+    subs.add(hiredis::happ::pubsub::channel_type::PATTERN, "news.*", happ_pubsub_on_message);
+    subs.add(hiredis::happ::pubsub::channel_type::SHARD, "{user}.1", happ_pubsub_on_message);
+    CASE_EXPECT_EQ(3, subs.size());
+
+    // replace the callback
+    CASE_EXPECT_EQ(sub, subs.add(hiredis::happ::pubsub::channel_type::CHANNEL, "news", happ_pubsub_on_message));
+    CASE_EXPECT_EQ(3, subs.size());
+
+    {
+        happ_pubsub_fake_message msg("message", "news", "hello");
+        CASE_EXPECT_TRUE(subs.dispatch(&msg.reply));
+        CASE_EXPECT_EQ(1, happ_pubsub_message_count);
+        CASE_EXPECT_EQ("news", happ_pubsub_channel);
+        CASE_EXPECT_EQ("hello", happ_pubsub_message);
+    }
+
+    {
+        happ_pubsub_fake_message msg("pmessage", "news.*", "news.sport", "goal");
+        CASE_EXPECT_TRUE(subs.dispatch(&msg.reply));
+        CASE_EXPECT_EQ(2, happ_pubsub_message_count);
+        CASE_EXPECT_EQ("news.sport", happ_pubsub_channel);
+        CASE_EXPECT_EQ("goal", happ_pubsub_message);
+    }
+
+    {
+        happ_pubsub_fake_message msg("smessage", "{user}.1", "login");
+        CASE_EXPECT_TRUE(subs.dispatch(&msg.reply));
+        CASE_EXPECT_EQ(3, happ_pubsub_message_count);
+        CASE_EXPECT_EQ("login", happ_pubsub_message);
+    }
+
+    // subscribe replies are not messages
+    {
+        happ_pubsub_fake_message msg("subscribe", "news", "1");
+        CASE_EXPECT_FALSE(subs.dispatch(&msg.reply));
+    }
+
+    // shard channel is not a normal channel
+    {
+        happ_pubsub_fake_message msg("message", "{user}.1", "login");
+        CASE_EXPECT_TRUE(subs.dispatch(&msg.reply));
+        CASE_EXPECT_EQ(3, happ_pubsub_message_count);
+        CASE_EXPECT_EQ(1, subs.get_dropped_count());
+    }
+
+    // messages after unsubscribed are dropped
+    std::string node;
+    CASE_EXPECT_TRUE(subs.remove(hiredis::happ::pubsub::channel_type::CHANNEL, "news", node));
+    CASE_EXPECT_FALSE(subs.remove(hiredis::happ::pubsub::channel_type::CHANNEL, "news", node));
+    {
+        happ_pubsub_fake_message msg("message", "news", "hello");
+        CASE_EXPECT_TRUE(subs.dispatch(&msg.reply));
+        CASE_EXPECT_EQ(3, happ_pubsub_message_count);
+        CASE_EXPECT_EQ(2, subs.get_dropped_count());
+        CASE_EXPECT_EQ(5, subs.get_message_count());
+    }
+
+    subs.clear();
+    CASE_EXPECT_EQ(0, subs.size());
+}
+
+CASE_TEST(happ_pubsub, reset_node)
+{
+    hiredis::happ::pubsub subs;
+    subs.add(hiredis::happ::pubsub::channel_type::CHANNEL, "a", happ_pubsub_on_message)->node = "127.0.0.1:7000";
+    subs.add(hiredis::happ::pubsub::channel_type::PATTERN, "b*", happ_pubsub_on_message)->node = "127.0.0.1:7000";
+    subs.add(hiredis::happ::pubsub::channel_type::SHARD, "c", happ_pubsub_on_message)->node = "127.0.0.1:7001";
+
+    CASE_EXPECT_EQ(2, subs.reset_node("127.0.0.1:7000"));
+    CASE_EXPECT_TRUE(subs.find(hiredis::happ::pubsub::channel_type::CHANNEL, "a")->node.empty());
+    CASE_EXPECT_TRUE(subs.find(hiredis::happ::pubsub::channel_type::PATTERN, "b*")->node.empty());
+    CASE_EXPECT_EQ("127.0.0.1:7001", subs.find(hiredis::happ::pubsub::channel_type::SHARD, "c")->node);
+    CASE_EXPECT_EQ(NULL, subs.find(hiredis::happ::pubsub::channel_type::SHARD, "a"));
+
+    std::string node;
+    CASE_EXPECT_TRUE(subs.remove(hiredis::happ::pubsub::channel_type::SHARD, "c", node));
+    CASE_EXPECT_EQ("127.0.0.1:7001", node);
+
+    CASE_EXPECT_EQ(std::string("SSUBSCRIBE"), hiredis::happ::pubsub::get_subscribe_cmd(hiredis::happ::pubsub::channel_type::SHARD));
+    CASE_EXPECT_EQ(std::string("PUNSUBSCRIBE"), hiredis::happ::pubsub::get_unsubscribe_cmd(hiredis::happ::pubsub::channel_type::PATTERN));
+
+    CASE_EXPECT_TRUE(hiredis::happ::pubsub::is_supported(hiredis::happ::pubsub::channel_type::CHANNEL));
+    CASE_EXPECT_FALSE(hiredis::happ::pubsub::is_supported(hiredis::happ::pubsub::channel_type::MAX));
+#if defined(HIREDIS_HAPP_PUBSUB_SHARD)
+    CASE_EXPECT_TRUE(hiredis::happ::pubsub::is_supported(hiredis::happ::pubsub::channel_type::SHARD));
+#else
+    CASE_EXPECT_FALSE(hiredis::happ::pubsub::is_supported(hiredis::happ::pubsub::channel_type::SHARD));
+#endif
+}
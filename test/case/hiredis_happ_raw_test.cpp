@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "hiredis_happ.h"
+#include "frame/test_fake_reply.h"
+#include "frame/test_macros.h"
+
+static int happ_raw_batch_cmd_count = 0;
+static void happ_raw_on_batch_cmd(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_raw_batch_cmd_count, privdata);
+    CASE_EXPECT_EQ(privdata, cmd->private_data());
+    CASE_EXPECT_NE(NULL, r);
+    ++happ_raw_batch_cmd_count;
+}
+
+static void happ_raw_on_batch_cmd_abort(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_raw_batch_cmd_count, privdata);
+    CASE_EXPECT_EQ(NULL, r);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_ABORT, cmd->result());
+    ++happ_raw_batch_cmd_count;
+}
+
+static int happ_raw_batch_count = 0;
+static int happ_raw_batch_err = 0;
+static void happ_raw_on_batch(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *privdata) {
+    CASE_EXPECT_EQ(&happ_raw_batch_count, privdata);
+    CASE_EXPECT_EQ(NULL, r);
+    CASE_EXPECT_EQ(happ_raw_batch_err, cmd->result());
+    // all cmds finished before batch callback
+    CASE_EXPECT_EQ(2, happ_raw_batch_cmd_count);
+    ++happ_raw_batch_count;
+}
+
+CASE_TEST(happ_raw, batch)
+{
+    hiredis::happ::raw r;
+    r.init("127.0.0.1", 6379);
+
+    hiredis::happ::connection *conn = r.make_connection();
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL == conn) {
+        r.reset();
+        return;
+    }
+
+    happ_raw_batch_cmd_count = 0;
+    happ_raw_batch_count = 0;
+    happ_raw_batch_err = 0;
+    hiredis::happ::raw::batch_t *batch = r.create_batch(happ_raw_on_batch, &happ_raw_batch_count);
+    CASE_EXPECT_NE(NULL, batch);
+    CASE_EXPECT_NE(NULL, r.batch_exec(batch, happ_raw_on_batch_cmd, &happ_raw_batch_cmd_count, "SET %s %d", "foo", 1));
+    CASE_EXPECT_NE(NULL, r.batch_exec(batch, happ_raw_on_batch_cmd, &happ_raw_batch_cmd_count, "SET %s %d", "bar", 2));
+
+    // nothing is sent before flush
+    CASE_EXPECT_EQ(0, conn->get_pending_count());
+    CASE_EXPECT_EQ(2, r.flush_batch(batch));
+    CASE_EXPECT_EQ(NULL, r.batch_exec(batch, happ_raw_on_batch_cmd, NULL, "GET %s", "foo"));
+    CASE_EXPECT_EQ(2, conn->get_pending_count());
+
+    // cmds are together in output buffer
+    sds obuf = conn->get_context()->c.obuf;
+    CASE_EXPECT_TRUE("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$1\r\n1\r\n*3\r\n$3\r\nSET\r\n$3\r\nbar\r\n$1\r\n2\r\n" ==
+                     (NULL == obuf ? std::string() : std::string(obuf, sdslen(obuf))));
+
+    {
+        test_fake_reply reply(REDIS_REPLY_STATUS);
+        reply.set_string("OK");
+        test_reply_first(conn, &reply.reply);
+        CASE_EXPECT_EQ(0, happ_raw_batch_count);
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_EQ(2, happ_raw_batch_cmd_count);
+    CASE_EXPECT_EQ(1, happ_raw_batch_count);
+
+    // empty batch finishes at once
+    batch = r.create_batch(happ_raw_on_batch, &happ_raw_batch_count);
+    CASE_EXPECT_EQ(0, r.flush_batch(batch));
+    CASE_EXPECT_EQ(2, happ_raw_batch_count);
+
+    // aborted batch sends nothing, and all callbacks are called
+    happ_raw_batch_cmd_count = 0;
+    happ_raw_batch_err = hiredis::happ::error_code::REDIS_HAPP_ABORT;
+    batch = r.create_batch(happ_raw_on_batch, &happ_raw_batch_count);
+    for (int i = 0; i < 2; ++i) {
+        r.batch_exec(batch, happ_raw_on_batch_cmd_abort, &happ_raw_batch_cmd_count, "GET %s", "bar");
+    }
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, r.abort_batch(batch));
+    CASE_EXPECT_EQ(2, happ_raw_batch_cmd_count);
+    CASE_EXPECT_EQ(3, happ_raw_batch_count);
+    CASE_EXPECT_EQ(0, conn->get_pending_count());
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, r.abort_batch(NULL));
+
+    // connection is not connected, so it will not be released by reset
+    CASE_EXPECT_TRUE(r.release_connection(true, 0));
+    r.reset();
+}
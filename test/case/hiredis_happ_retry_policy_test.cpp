@@ -0,0 +1,106 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "hiredis_happ.h"
+#include "frame/test_macros.h"
+
+CASE_TEST(happ_retry_policy, backoff)
+{
+    hiredis::happ::retry_policy policy;
+    policy.set_immediate_times(2);
+    policy.set_backoff(0, 10000, 1, 0);
+
+    // the first 2 retries are sent at once
+    CASE_EXPECT_EQ(0, policy.next_delay(1, 0));
+    CASE_EXPECT_EQ(0, policy.next_delay(2, 0));
+
+    // the first delay is also jittered from base
+    uint64_t delay = policy.next_delay(3, 0);
+    CASE_EXPECT_GE(delay, 10000);
+    CASE_EXPECT_LE(delay, 30000);
+
+    bool reach_max = false;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t next = policy.next_delay(4 + i, delay);
+        CASE_EXPECT_GE(next, 10000);
+        CASE_EXPECT_LE(next, 1000000);
+        CASE_EXPECT_LE(next, delay * 3);
+        if (1000000 == next) {
+            reach_max = true;
+        }
+        delay = next;
+    }
+    CASE_EXPECT_TRUE(reach_max);
+
+    // delays of different clients are spread
+    hiredis::happ::retry_policy other;
+    other.set_immediate_times(2);
+    other.set_backoff(0, 10000, 1, 0);
+    bool differs = false;
+    for (int i = 0; i < 16 && !differs; ++i) {
+        differs = policy.next_delay(3, 300000) != other.next_delay(3, 300000);
+    }
+    CASE_EXPECT_TRUE(differs);
+
+    // never longer than max, even if base is larger
+    policy.set_backoff(2, 0, 1, 0);
+    CASE_EXPECT_EQ(2000000, policy.get_backoff_max());
+    policy.max_delay = 1000000;
+    CASE_EXPECT_EQ(1000000, policy.next_delay(3, 0));
+
+    // no backoff
+    policy.set_backoff(0, 0, 0, 0);
+    CASE_EXPECT_EQ(0, policy.next_delay(10, 10000));
+}
+
+CASE_TEST(happ_retry_policy, budget)
+{
+    hiredis::happ::retry_policy policy;
+    policy.set_budget(10, 2);
+
+    // min retries per second
+    CASE_EXPECT_TRUE(policy.acquire(100));
+    CASE_EXPECT_TRUE(policy.acquire(100));
+    CASE_EXPECT_FALSE(policy.acquire(100));
+
+    // 10% of requests
+    for (int i = 0; i < 20; ++i) {
+        policy.add_request(100);
+    }
+    CASE_EXPECT_TRUE(policy.acquire(100));
+    CASE_EXPECT_TRUE(policy.acquire(100));
+    CASE_EXPECT_FALSE(policy.acquire(100));
+
+    // requests of last second are still counted
+    for (int i = 0; i < 4; ++i) {
+        CASE_EXPECT_TRUE(policy.acquire(101));
+    }
+    CASE_EXPECT_FALSE(policy.acquire(101));
+
+    // but not older ones
+    CASE_EXPECT_TRUE(policy.acquire(103));
+    CASE_EXPECT_TRUE(policy.acquire(103));
+    CASE_EXPECT_FALSE(policy.acquire(103));
+
+    CASE_EXPECT_EQ(10, policy.get_retry_count());
+    CASE_EXPECT_EQ(4, policy.get_rejected_count());
+
+    // delay is not changed if rejected
+    policy.set_immediate_times(1);
+    uint64_t delay = 0;
+    CASE_EXPECT_TRUE(policy.retry(104, 1, &delay));
+    CASE_EXPECT_EQ(0, delay);
+    CASE_EXPECT_TRUE(policy.retry(104, 2, &delay));
+    CASE_EXPECT_GE(delay, policy.get_backoff_base());
+    uint64_t last_delay = delay;
+    CASE_EXPECT_FALSE(policy.retry(104, 3, &delay));
+    CASE_EXPECT_EQ(last_delay, delay);
+
+    // disabled
+    policy.set_budget(0, 0);
+    for (int i = 0; i < 100; ++i) {
+        CASE_EXPECT_TRUE(policy.acquire(103));
+    }
+}
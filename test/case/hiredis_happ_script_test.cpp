@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "hiredis_happ.h"
+#include "frame/test_macros.h"
+
+CASE_TEST(happ_script, sha1)
+{
+    CASE_EXPECT_TRUE("da39a3ee5e6b4b0d3255bfef95601890afd80709" == hiredis::happ::script_registry::sha1_hex("", 0));
+    CASE_EXPECT_TRUE("a9993e364706816aba3e25717850c26c9cd0d89d" == hiredis::happ::script_registry::sha1_hex("abc", 3));
+
+    // padding needs one more block
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    CASE_EXPECT_TRUE("84983e441c3bd26ebaae4aa1f95129e5e54670f1" == hiredis::happ::script_registry::sha1_hex(two_blocks, strlen(two_blocks)));
+
+    // the same as SCRIPT LOAD of redis
+    CASE_EXPECT_TRUE("e0e1f9fabfc9d4800c877a703b823ac0578ff8db" == hiredis::happ::script_registry::sha1_hex("return 1", 8));
+}
+
+CASE_TEST(happ_script, registry)
+{
+    hiredis::happ::script_registry scripts;
+    CASE_EXPECT_TRUE(scripts.empty());
+
+    std::string sha1 = scripts.add("return 1");
+    CASE_EXPECT_TRUE("e0e1f9fabfc9d4800c877a703b823ac0578ff8db" == sha1);
+    scripts.add("return 1");
+    scripts.add("return redis.call('GET', KEYS[1])");
+    CASE_EXPECT_EQ(2, scripts.size());
+
+    CASE_EXPECT_NE(NULL, scripts.find(sha1));
+    CASE_EXPECT_NE(NULL, scripts.find("E0E1F9FABFC9D4800C877A703B823AC0578FF8DB"));
+    CASE_EXPECT_EQ(NULL, scripts.find("e0e1f9fa"));
+    if (NULL != scripts.find(sha1)) {
+        CASE_EXPECT_TRUE("return 1" == *scripts.find(sha1));
+    }
+
+    hiredis::happ::holder_t h;
+    h.clu = NULL;
+    hiredis::happ::cmd_exec *cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    cmd->format("EVALSHA %s 1 foo", sha1.c_str());
+    CASE_EXPECT_EQ(scripts.find(sha1), scripts.find(cmd));
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    cmd->format("GET %s", sha1.c_str());
+    CASE_EXPECT_EQ(NULL, scripts.find(cmd));
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    // EVALSHA and NOSCRIPT
+    const char *argv[] = {"1", "foo"};
+    size_t argvlen[] = {1, 3};
+    cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    CASE_EXPECT_GT(hiredis::happ::script_registry::format_eval(cmd, sha1, 2, argv, argvlen), 0);
+    CASE_EXPECT_EQ(scripts.find(sha1), scripts.find(cmd));
+
+    std::string msg = "NOSCRIPT No matching script. Please use EVAL.";
+    redisReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = REDIS_REPLY_ERROR;
+    reply.str = &msg[0];
+    reply.len = msg.size();
+    CASE_EXPECT_EQ(scripts.find(sha1), scripts.reload(cmd, &reply));
+    CASE_EXPECT_EQ(1, scripts.get_reload_count());
+
+    msg = "ERR wrong number of arguments";
+    reply.str = &msg[0];
+    reply.len = msg.size();
+    CASE_EXPECT_EQ(NULL, scripts.reload(cmd, &reply));
+    CASE_EXPECT_EQ(1, scripts.get_reload_count());
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    cmd = hiredis::happ::cmd_exec::create(h, NULL, NULL, 0);
+    CASE_EXPECT_GT(hiredis::happ::script_registry::format_load(cmd, "return 1"), 0);
+    size_t len = 0;
+    const char *content = cmd->get_content(&len);
+    CASE_EXPECT_TRUE(std::string("*3\r\n$6\r\nSCRIPT\r\n$4\r\nLOAD\r\n$8\r\nreturn 1\r\n") == std::string(content, len));
+    hiredis::happ::cmd_exec::destroy(cmd);
+
+    CASE_EXPECT_TRUE(scripts.remove(sha1));
+    CASE_EXPECT_FALSE(scripts.remove(sha1));
+    CASE_EXPECT_EQ(NULL, scripts.find(sha1));
+    scripts.clear();
+    CASE_EXPECT_TRUE(scripts.empty());
+}
@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hiredis_happ.h"
+#include "frame/test_fake_reply.h"
+#include "frame/test_macros.h"
+
+static void happ_sentinel_reply_master(hiredis::happ::sentinel &s, const char *ip, const char *port) {
+    test_fake_reply reply(REDIS_REPLY_ARRAY);
+    reply.push_string(ip).push_string(port);
+    test_reply_first(s.get_sentinel_connection(), &reply.reply);
+}
+
+static int happ_sentinel_cmd_count = 0;
+static int happ_sentinel_cmd_err = 0;
+static std::string happ_sentinel_cmd_value;
+static void happ_sentinel_on_cmd(hiredis::happ::cmd_exec *cmd, struct redisAsyncContext *, void *r, void *) {
+    ++happ_sentinel_cmd_count;
+    happ_sentinel_cmd_err = cmd->result();
+
+    redisReply *reply = reinterpret_cast<redisReply *>(r);
+    if (NULL != reply && REDIS_REPLY_STRING == reply->type) {
+        happ_sentinel_cmd_value.assign(reply->str, reply->len);
+    }
+}
+
+static int happ_sentinel_switch_count = 0;
+static std::string happ_sentinel_switch_master;
+static void happ_sentinel_on_switch(hiredis::happ::sentinel *, const hiredis::happ::connection::key_t &master) {
+    ++happ_sentinel_switch_count;
+    happ_sentinel_switch_master = master.name;
+}
+
+CASE_TEST(happ_sentinel, discover)
+{
+    hiredis::happ::sentinel s;
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_PARAM, s.start());
+
+    s.init("mymaster");
+    s.add_sentinel("127.0.0.1", 26379);
+    s.add_sentinel("127.0.0.1", 26379);
+    s.add_sentinel("127.0.0.1", 26380);
+    CASE_EXPECT_EQ(2, s.sentinels.size());
+    s.set_on_switch_master(happ_sentinel_on_switch);
+
+    happ_sentinel_cmd_count = 0;
+    happ_sentinel_switch_count = 0;
+    happ_sentinel_cmd_value.clear();
+
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, s.start());
+    CASE_EXPECT_NE(NULL, s.get_sentinel_connection());
+    CASE_EXPECT_TRUE("127.0.0.1:26379" == s.get_sentinel_connection()->get_key().name);
+
+    // master is not known, keep it
+    CASE_EXPECT_NE(NULL, s.exec(happ_sentinel_on_cmd, NULL, "GET foo"));
+    CASE_EXPECT_EQ(1, s.get_pending_count());
+    CASE_EXPECT_EQ(NULL, s.get_raw().get_connection());
+
+    happ_sentinel_reply_master(s, "127.0.0.1", "6380");
+    CASE_EXPECT_TRUE("127.0.0.1:6380" == s.get_master().name);
+    CASE_EXPECT_EQ(1, happ_sentinel_switch_count);
+    CASE_EXPECT_TRUE("127.0.0.1:6380" == happ_sentinel_switch_master);
+    CASE_EXPECT_EQ(0, s.get_switch_count());
+    CASE_EXPECT_EQ(0, s.get_pending_count());
+
+    hiredis::happ::connection *conn = s.get_raw().get_connection();
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL != conn) {
+        CASE_EXPECT_TRUE("127.0.0.1:6380" == conn->get_key().name);
+        CASE_EXPECT_EQ(1, conn->get_pending_count());
+
+        test_fake_reply reply(REDIS_REPLY_STRING);
+        reply.set_string("bar");
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_sentinel_cmd_err);
+    CASE_EXPECT_TRUE("bar" == happ_sentinel_cmd_value);
+
+    s.get_raw().release_connection(true, 0);
+    s.reset();
+}
+
+CASE_TEST(happ_sentinel, switch_master)
+{
+    hiredis::happ::sentinel s;
+    s.init("mymaster");
+    s.add_sentinel("127.0.0.1", 26379);
+    s.set_on_switch_master(happ_sentinel_on_switch);
+
+    happ_sentinel_cmd_count = 0;
+    happ_sentinel_switch_count = 0;
+    happ_sentinel_cmd_value.clear();
+
+    s.start();
+    happ_sentinel_reply_master(s, "127.0.0.1", "6380");
+    CASE_EXPECT_NE(NULL, s.exec(happ_sentinel_on_cmd, NULL, "GET foo"));
+
+    hiredis::happ::connection *old_conn = s.get_raw().get_connection();
+    CASE_EXPECT_NE(NULL, old_conn);
+    if (NULL != old_conn) {
+        CASE_EXPECT_EQ(1, old_conn->get_pending_count());
+    }
+
+    // switch of other masters
+    {
+        test_fake_reply msg(REDIS_REPLY_ARRAY);
+        msg.push_string("message").push_string("+switch-master").push_string("othermaster 127.0.0.1 6380 127.0.0.1 6381");
+        hiredis::happ::sentinel::on_reply_switch_master(s.get_sentinel_connection()->get_context(), &msg.reply, NULL);
+    }
+    CASE_EXPECT_TRUE("127.0.0.1:6380" == s.get_master().name);
+    CASE_EXPECT_EQ(old_conn, s.get_raw().get_connection());
+
+    // cmds waiting for reply of the old master are sent to the new one at once
+    {
+        test_fake_reply msg(REDIS_REPLY_ARRAY);
+        msg.push_string("message").push_string("+switch-master").push_string("mymaster 127.0.0.1 6380 127.0.0.1 6381");
+        hiredis::happ::sentinel::on_reply_switch_master(s.get_sentinel_connection()->get_context(), &msg.reply, NULL);
+    }
+    CASE_EXPECT_TRUE("127.0.0.1:6381" == s.get_master().name);
+    CASE_EXPECT_EQ(1, s.get_switch_count());
+    CASE_EXPECT_EQ(2, happ_sentinel_switch_count);
+    CASE_EXPECT_TRUE("127.0.0.1:6381" == happ_sentinel_switch_master);
+    CASE_EXPECT_EQ(0, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(NULL, s.get_raw().redirected_conn_.get());
+
+    hiredis::happ::connection *conn = s.get_raw().get_connection();
+    CASE_EXPECT_NE(NULL, conn);
+    if (NULL != conn) {
+        CASE_EXPECT_TRUE("127.0.0.1:6381" == conn->get_key().name);
+        CASE_EXPECT_EQ(1, conn->get_pending_count());
+
+        test_fake_reply reply(REDIS_REPLY_STRING);
+        reply.set_string("bar");
+        test_reply_first(conn, &reply.reply);
+    }
+    CASE_EXPECT_EQ(1, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_OK, happ_sentinel_cmd_err);
+    CASE_EXPECT_TRUE("bar" == happ_sentinel_cmd_value);
+
+    s.get_raw().release_connection(true, 0);
+    s.reset();
+}
+
+CASE_TEST(happ_sentinel, next_sentinel)
+{
+    hiredis::happ::sentinel s;
+    s.init("mymaster");
+    s.add_sentinel("127.0.0.1", 26379);
+    s.add_sentinel("127.0.0.1", 26380);
+
+    happ_sentinel_cmd_count = 0;
+    happ_sentinel_cmd_err = 0;
+
+    s.proc(1, 0);
+    s.start();
+    CASE_EXPECT_NE(NULL, s.exec(happ_sentinel_on_cmd, NULL, "GET foo"));
+
+    // master is unknown to this sentinel
+    {
+        test_fake_reply reply(REDIS_REPLY_NIL);
+        test_reply_first(s.get_sentinel_connection(), &reply.reply);
+    }
+    CASE_EXPECT_TRUE(s.reconnect_pending);
+    CASE_EXPECT_TRUE(s.get_master().name.empty());
+
+    s.proc(2, 0);
+    CASE_EXPECT_NE(NULL, s.get_sentinel_connection());
+    if (NULL != s.get_sentinel_connection()) {
+        CASE_EXPECT_TRUE("127.0.0.1:26380" == s.get_sentinel_connection()->get_key().name);
+    }
+    CASE_EXPECT_EQ(1, s.get_pending_count());
+    CASE_EXPECT_EQ(0, happ_sentinel_cmd_count);
+
+    // cmds waiting for master are finished
+    s.reset();
+    CASE_EXPECT_EQ(0, s.get_pending_count());
+    CASE_EXPECT_EQ(1, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_CONNECTION, happ_sentinel_cmd_err);
+}
+
+CASE_TEST(happ_sentinel, reset_master)
+{
+    hiredis::happ::sentinel s;
+    s.init("mymaster");
+    s.add_sentinel("127.0.0.1", 26379);
+
+    happ_sentinel_cmd_count = 0;
+    happ_sentinel_cmd_err = 0;
+
+    s.start();
+    happ_sentinel_reply_master(s, "127.0.0.1", "6380");
+    CASE_EXPECT_TRUE("127.0.0.1:6380" == s.get_master().name);
+
+    // master is got again after reset
+    s.reset();
+    CASE_EXPECT_TRUE(s.get_master().name.empty());
+    CASE_EXPECT_EQ(NULL, s.exec(happ_sentinel_on_cmd, NULL, "GET foo"));
+    CASE_EXPECT_EQ(1, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_CONNECTION, happ_sentinel_cmd_err);
+
+    s.proc(10, 0);
+    s.get_raw().set_cmd_timeout(1, 0);
+    s.start();
+    CASE_EXPECT_NE(NULL, s.exec(happ_sentinel_on_cmd, NULL, "GET foo"));
+    CASE_EXPECT_EQ(1, s.get_pending_count());
+    CASE_EXPECT_EQ(NULL, s.get_raw().get_connection());
+
+    // cmds waiting for master reach deadline are removed
+    s.proc(12, 0);
+    CASE_EXPECT_EQ(2, happ_sentinel_cmd_count);
+    CASE_EXPECT_EQ(hiredis::happ::error_code::REDIS_HAPP_TIMEOUT, happ_sentinel_cmd_err);
+    CASE_EXPECT_EQ(0, s.get_pending_count());
+
+    s.reset();
+    CASE_EXPECT_EQ(2, happ_sentinel_cmd_count);
+}
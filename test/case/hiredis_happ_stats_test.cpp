@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "hiredis_happ.h"
+#include "frame/test_macros.h"
+
+CASE_TEST(happ_stats, histogram_bucket)
+{
+    typedef hiredis::happ::latency_histogram histogram_t;
+
+    // every value is in the range of its bucket, and the error is less than 1/16
+    for (uint64_t v = 0; v < 100000; v = v * 2 + 1) {
+        for (uint64_t d = 0; d < 3; ++d) {
+            uint64_t value = v + d;
+            size_t index = histogram_t::get_bucket_index(value);
+            uint64_t upper = histogram_t::get_bucket_upper_bound(index);
+            uint64_t lower = 0 == index ? 0 : histogram_t::get_bucket_upper_bound(index - 1) + 1;
+            CASE_EXPECT_LE(lower, value);
+            CASE_EXPECT_GE(upper, value);
+            CASE_EXPECT_LE((upper - lower) * 16, value + 16);
+        }
+    }
+
+    // buckets are continuous
+    for (size_t i = 1; i < histogram_t::BUCKET_COUNT; ++i) {
+        uint64_t lower = histogram_t::get_bucket_upper_bound(i - 1) + 1;
+        CASE_EXPECT_EQ(i, histogram_t::get_bucket_index(lower));
+    }
+
+    // too large
+    CASE_EXPECT_EQ(static_cast<size_t>(histogram_t::BUCKET_COUNT - 1), histogram_t::get_bucket_index(~static_cast<uint64_t>(0)));
+}
+
+CASE_TEST(happ_stats, histogram_percentile)
+{
+    hiredis::happ::latency_histogram h;
+    CASE_EXPECT_EQ(0, h.get_percentile(50));
+
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        h.record(i * 100);
+    }
+
+    CASE_EXPECT_EQ(1000, h.get_count());
+    CASE_EXPECT_EQ(100, h.get_min());
+    CASE_EXPECT_EQ(100000, h.get_max());
+    CASE_EXPECT_EQ(50050, h.get_mean());
+    CASE_EXPECT_EQ(100000, h.get_percentile(100));
+
+    uint64_t p50 = h.get_percentile(50);
+    CASE_EXPECT_GE(p50, 50000);
+    CASE_EXPECT_LE(p50, 50000 + 50000 / 16);
+
+    uint64_t p99 = h.get_percentile(99);
+    CASE_EXPECT_GE(p99, 99000);
+    CASE_EXPECT_LE(p99, 100000);
+
+    hiredis::happ::latency_histogram other;
+    other.record(5);
+    other.record(200000);
+    h.merge(other);
+    CASE_EXPECT_EQ(1002, h.get_count());
+    CASE_EXPECT_EQ(5, h.get_min());
+    CASE_EXPECT_EQ(200000, h.get_max());
+
+    h.reset();
+    CASE_EXPECT_EQ(0, h.get_count());
+    CASE_EXPECT_EQ(0, h.get_min());
+}
+
+CASE_TEST(happ_stats, error_index)
+{
+    using hiredis::happ::cmd_stats;
+    using hiredis::happ::error_code;
+
+    CASE_EXPECT_EQ(static_cast<size_t>(0), cmd_stats::get_error_index(-1));
+    CASE_EXPECT_EQ(static_cast<size_t>(1), cmd_stats::get_error_index(error_code::REDIS_HAPP_UNKNOWD));
+    CASE_EXPECT_EQ(static_cast<size_t>(10), cmd_stats::get_error_index(error_code::REDIS_HAPP_RETRY_BUDGET));
+    CASE_EXPECT_EQ(static_cast<size_t>(cmd_stats::ERROR_TYPE_COUNT - 1), cmd_stats::get_error_index(error_code::REDIS_HAPP_ABORT));
+
+    cmd_stats s;
+    s.add_error(error_code::REDIS_HAPP_TTL);
+    s.add_error(error_code::REDIS_HAPP_TTL);
+    s.add_error(-1);
+    CASE_EXPECT_EQ(2, s.get_error_count(error_code::REDIS_HAPP_TTL));
+    CASE_EXPECT_EQ(1, s.get_error_count(-2));
+
+    uint64_t t1 = cmd_stats::now_usec();
+    uint64_t t2 = cmd_stats::now_usec();
+    CASE_EXPECT_LE(t1, t2);
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "hiredis_happ.h"
+#include "frame/test_macros.h"
+
+CASE_TEST(happ_timer_heap, out_of_order)
+{
+    typedef hiredis::happ::cluster::timer_t::delay_t delay_t;
+    hiredis::happ::timer_heap<delay_t> heap;
+
+    // deadlines are not added in time order, for example after timer interval is changed
+    const time_t secs[] = {5, 3, 5, 1, 4, 3, 2};
+    const time_t usecs[] = {0, 500000, 100, 999999, 0, 0, 0};
+    const size_t n = sizeof(secs) / sizeof(secs[0]);
+    for (size_t i = 0; i < n; ++i) {
+        delay_t d;
+        d.sec = secs[i];
+        d.usec = usecs[i];
+        d.cmd = NULL;
+        heap.push(d);
+    }
+    CASE_EXPECT_EQ(n, heap.size());
+
+    delay_t last = heap.front();
+    size_t popped = 0;
+    while (!heap.empty()) {
+        delay_t d = heap.front();
+        heap.pop_front();
+        CASE_EXPECT_FALSE(d < last);
+        last = d;
+        ++popped;
+    }
+    CASE_EXPECT_EQ(n, popped);
+    CASE_EXPECT_EQ(static_cast<time_t>(5), last.sec);
+    CASE_EXPECT_EQ(static_cast<time_t>(100), last.usec);
+}
+
+CASE_TEST(happ_timer_heap, no_allocation)
+{
+    typedef hiredis::happ::cluster::timer_t::conn_timetout_t conn_timeout_t;
+    hiredis::happ::timer_heap<conn_timeout_t> heap;
+
+    conn_timeout_t t;
+    t.sequence = 0;
+    for (int i = 0; i < 64; ++i) {
+        t.timeout = static_cast<time_t>((i * 37) % 64);
+        heap.push(t);
+    }
+    CASE_EXPECT_EQ(static_cast<time_t>(0), heap.front().timeout);
+
+    size_t cap = heap.capacity();
+    heap.clear();
+    CASE_EXPECT_TRUE(heap.empty());
+
+    // storage is kept after clear
+    for (int i = 64; i > 0; --i) {
+        t.timeout = static_cast<time_t>(i);
+        heap.push(t);
+        CASE_EXPECT_EQ(static_cast<time_t>(i), heap.front().timeout);
+    }
+    CASE_EXPECT_EQ(cap, heap.capacity());
+}
@@ -0,0 +1,101 @@
+/*
+ * test_fake_reply.h
+ *
+ *  replies of a stand-in redis server, used by tests without a real one
+ *
+ *  Released under the MIT license
+ */
+
+#ifndef TEST_FAKE_REPLY_H_
+#define TEST_FAKE_REPLY_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hiredis_happ.h"
+
+// a redisReply built by tests, children are owned and freed by it
+struct test_fake_reply {
+    redisReply reply;
+    std::vector<redisReply *> children;
+    std::vector<test_fake_reply *> owned_children;
+    std::string str;
+
+    test_fake_reply(int type) {
+        memset(&reply, 0, sizeof(reply));
+        reply.type = type;
+    }
+
+    ~test_fake_reply() {
+        for (size_t i = 0; i < owned_children.size(); ++i) {
+            delete owned_children[i];
+        }
+    }
+
+    test_fake_reply &set_string(const char *v) {
+        str = v;
+        reply.str = &str[0];
+        reply.len = static_cast<int>(str.size());
+        return *this;
+    }
+
+    test_fake_reply &push(test_fake_reply *child) {
+        owned_children.push_back(child);
+        children.push_back(&child->reply);
+        reply.element = &children[0];
+        reply.elements = children.size();
+        return *this;
+    }
+
+    test_fake_reply &push_integer(long long v) {
+        test_fake_reply *child = new test_fake_reply(REDIS_REPLY_INTEGER);
+        child->reply.integer = v;
+        return push(child);
+    }
+
+    test_fake_reply &push_string(const char *v) {
+        test_fake_reply *child = new test_fake_reply(REDIS_REPLY_STRING);
+        child->set_string(v);
+        return push(child);
+    }
+
+    // one range of CLUSTER SLOTS, all nodes are at 127.0.0.1
+    test_fake_reply &push_slots(long long si, long long ei, uint16_t master_port, uint16_t replica_port = 0) {
+        test_fake_reply *range = new test_fake_reply(REDIS_REPLY_ARRAY);
+        range->push_integer(si).push_integer(ei);
+
+        test_fake_reply *master = new test_fake_reply(REDIS_REPLY_ARRAY);
+        master->push_string("127.0.0.1").push_integer(master_port);
+        range->push(master);
+        if (0 != replica_port) {
+            test_fake_reply *replica = new test_fake_reply(REDIS_REPLY_ARRAY);
+            replica->push_string("127.0.0.1").push_integer(replica_port);
+            range->push(replica);
+        }
+
+        return push(range);
+    }
+};
+
+// reply the first pending cmd of a connection, just like hiredis does when the reply is received
+inline void test_reply_first(const hiredis::happ::connection *conn, redisReply *reply) {
+    redisAsyncContext *ac = conn->get_context();
+    redisCallback *cb = ac->replies.head;
+    if (NULL == cb) {
+        return;
+    }
+
+    ac->replies.head = cb->next;
+    if (NULL == ac->replies.head) {
+        ac->replies.tail = NULL;
+    }
+
+    if (NULL != cb->fn) {
+        cb->fn(ac, reply, cb->privdata);
+    }
+    free(cb);
+}
+
+#endif /* TEST_FAKE_REPLY_H_ */